@@ -32,10 +32,41 @@ typedef struct _Class Class;
  *   > gc 时输出 gc 相关信息
  * DUMP_AST_WHEN_COMPILE_PROG
  *   > ast_compile_program 解析源码为 ast 完成后是否转储 ast
+ * PROFILE_OPCODE_BIGRAM
+ *   > 统计 execute_instruction 中相邻执行的指令对，vm_free 时向 stderr 输出次数最多的指令对，用于挑选超级指令。
+ *     统计的是实际执行的指令流，已合并为超级指令的指令对计入超级指令
  * 
+ * - vm
+ * USE_COMPUTED_GOTO: execute_instruction 使用 computed goto 直接线程化分派，需要编译器支持 labels as values 扩展（GCC/Clang）。
+ * USE_SWITCH_DISPATCH: 强制使用 switch 分派，可移植的后备实现。未定义时若编译器支持则默认使用 USE_COMPUTED_GOTO。
+ * USE_NAN_BOXING: Value 使用 NaN-boxing 表示为 8 字节 u64（默认为 16 字节的 type + union 结构体），需要 64 位平台。
+ *   > 改变 SprApi 的 Value 布局，dylib 需使用相同配置重新构建。
+ * USE_STRING_INTERN: 所有字符串经由 vm->strings 驻留，内容相同的字符串为同一对象，字符串比较及 map 查找只需比较指针。
+ *   驻留表是弱引用，gc 标记结束后移除未被标记的字符串。原地构造的字符串须在构造完成后调用 objstring_intern。
+ * USE_TEMPLATE_JIT: 成为热点（见 HOT_CALL_THRESHOLD）的函数被逐指令翻译为 x86-64 机器码，之后在调用、返回及循环头处执行机器码；
+ *   方法调用只内联执行缓存命中的 primitive，其余调用及不支持的指令退回解释器。仅支持 x86-64 Linux。
+ *
+ * - gc
+ * USE_GENERATIONAL_GC: 分代回收。新对象分配在新生代，新生代回收只追踪新生代对象及记忆集，存活对象晋升到老年代；
+ *   老年代超过阈值或调用 VM.gc() 时进行完整回收。修改对象中的引用时需使用 gc.h 中的 GC_WRITE_BARRIER。
+ * USE_INCREMENTAL_GC: 增量标记。标记阶段被拆分为多步穿插在内存分配中，每步的工作量由 Configuration.gc_step_budget 限制；
+ *   标记期间依靠 GC_WRITE_BARRIER 维护三色不变式，灰色栈清空后一次性完成清除。不能与 USE_GENERATIONAL_GC 同时使用。
+ * USE_SLAB_ALLOCATOR: 不超过 256 字节的对象按 16 字节大小类从 slab 页中分配，回收时归还到对应大小类的空闲链表。
+ *   > 统计信息可通过 VM.slab_stats 获取。
+ * USE_MARK_BITMAP: slab 中的对象使用页首的标记位图代替对象头中的 is_dark，且不再链入 all_objs；
+ *   标记结束后 slab 页在之后的分配中惰性清除。fork 出的子进程 gc 时不会写入每个对象所在的内存页。
+ *   > 隐含 USE_SLAB_ALLOCATOR，不能与 USE_GENERATIONAL_GC、USE_INCREMENTAL_GC 同时使用。
+ * USE_PARALLEL_MARK: 完整回收的标记阶段由 Configuration.mark_threads 个线程并行完成，每个线程有私有和公开两个灰色栈，
+ *   空闲线程从其它线程的公开栈窃取对象，标记位以原子操作设置。堆小于 Configuration.parallel_mark_min_heap 时不并行。
+ *   > 需要 pthread。新生代回收与增量标记仍为单线程。
+ *   > 脚本可通过 VM.mark_threads、VM.parallel_mark_min_heap 调整，VM.parallel_mark_count 为并行标记的次数。
+ *
  * - compiler
  * USE_AST_COMPILER: 使用基于 ast 的编译器，可以享受更多语法糖和更好的编译器优化。
  * USE_ONE_PASS_COMPILER: 使用一遍解释器。解释器功能稳定，bug 很少，但是维护频率更低。
+ * USE_BYTECODE_CACHE: import 模块时把编译结果缓存到源文件旁的 .spc 文件中（foo.sp -> foo.spc），
+ *   之后的 import 在缓存比源文件新且源文件大小、mtime 与记录一致时直接加载缓存，跳过词法分析和编译。
+ *   > 指令集、缓存格式或核心模块变量变化时旧缓存自动失效；缓存写入失败时静默忽略。
  *
  * DEBUG_ASSERT_ON
  *   > 应常开启。决定 ASSERT 是否启用。
@@ -49,6 +80,14 @@ typedef struct _Class Class;
     #define USE_ONE_PASS_COMPILER
 #endif
 
+#if !defined(USE_SWITCH_DISPATCH) && !defined(USE_COMPUTED_GOTO) && defined(__GNUC__)
+    #define USE_COMPUTED_GOTO
+#endif
+
+#if defined(USE_MARK_BITMAP) && !defined(USE_SLAB_ALLOCATOR)
+    #define USE_SLAB_ALLOCATOR
+#endif
+
 #ifndef __STDBOOL_H
     #include <stdbool.h>
 #endif
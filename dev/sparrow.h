@@ -17,17 +17,102 @@ typedef enum {
     VT_OBJ,
 } ValueType;
 
-// sparrow 中的值
-typedef struct _Value {
-    ValueType type;
-    union {
-        u8 u8val;
-        u32 u32val;
-        i32 i32val;
-        double f64val;
-        ObjHeader* header;
-    };
-} Value;
+#ifdef USE_NAN_BOXING
+    // sparrow 中的值，NaN-boxing 表示，8 字节
+    // - f64：直接保存 double 的位模式
+    // - 对象：符号位 | QNAN | 48 位指针
+    // - 其余类型：QNAN | (ValueType << 32) | 32 位负载
+    typedef u64 Value;
+
+    #define SPR_SIGN_BIT    ((u64)0x8000000000000000)
+    #define SPR_QNAN        ((u64)0x7ffc000000000000)
+    #define SPR_TAG_SHIFT   32
+    #define SPR_TAG_MASK    ((u64)0xf << SPR_TAG_SHIFT)
+    #define SPR_TAGGED(vt, payload) ((Value)(SPR_QNAN | ((u64)(vt) << SPR_TAG_SHIFT) | (u32)(payload)))
+    #define SPR_IS_TAGGED(v, vt)    (((v) & (SPR_SIGN_BIT | SPR_QNAN | SPR_TAG_MASK)) == SPR_TAGGED(vt, 0))
+
+    #define VALUE_TYPE(v) \
+        (((v) & SPR_QNAN) != SPR_QNAN ? VT_F64 : ((v) & SPR_SIGN_BIT) ? VT_OBJ : (ValueType)(((v) & SPR_TAG_MASK) >> SPR_TAG_SHIFT))
+
+    #define VT_TO_VALUE(vt)         SPR_TAGGED(vt, 0)
+    #define I32_TO_VALUE(i)         SPR_TAGGED(VT_I32, (i32)(i))
+    #define U32_TO_VALUE(i)         SPR_TAGGED(VT_U32, (u32)(i))
+    #define U8_TO_VALUE(i)          SPR_TAGGED(VT_U8, (u8)(i))
+    #define F64_TO_VALUE(num)       (((union {f64 spr_f64; u64 spr_bits;}){.spr_f64 = (num)}).spr_bits)
+    #define OBJ_TO_VALUE(obj)       ((Value)(SPR_SIGN_BIT | SPR_QNAN | (u64)(uintptr_t)(obj)))
+
+    #define VALUE_TO_BOOL(v)        ((v) == VT_TO_VALUE(VT_TRUE))
+    #define VALUE_TO_I32(v)         ((i32)(u32)(v))
+    #define VALUE_TO_U32(v)         ((u32)(v))
+    #define VALUE_TO_U8(v)          ((u8)(v))
+    #define VALUE_TO_F64(v)         (((union {u64 spr_bits; f64 spr_f64;}){.spr_bits = (v)}).spr_f64)
+    #define VALUE_TO_OBJ(v)         ((ObjHeader*)(uintptr_t)((v) & ~(SPR_SIGN_BIT | SPR_QNAN)))
+
+    #define VALUE_IS_UNDEFINED(v)   ((v) == VT_TO_VALUE(VT_UNDEFINED))
+    #define VALUE_IS_FALSE(v)       ((v) == VT_TO_VALUE(VT_FALSE))
+    #define VALUE_IS_TRUE(v)        ((v) == VT_TO_VALUE(VT_TRUE))
+    #define VALUE_IS_NULL(v)        ((v) == VT_TO_VALUE(VT_NULL))
+    #define VALUE_IS_I32(v)         SPR_IS_TAGGED(v, VT_I32)
+    #define VALUE_IS_U32(v)         SPR_IS_TAGGED(v, VT_U32)
+    #define VALUE_IS_U8(v)          SPR_IS_TAGGED(v, VT_U8)
+    #define VALUE_IS_F64(v)         (((v) & SPR_QNAN) != SPR_QNAN)
+    #define VALUE_IS_OBJ(v)         (((v) & (SPR_SIGN_BIT | SPR_QNAN)) == (SPR_SIGN_BIT | SPR_QNAN))
+#else
+    // sparrow 中的值
+    typedef struct _Value {
+        ValueType type;
+        union {
+            u8 u8val;
+            u32 u32val;
+            i32 i32val;
+            double f64val;
+            ObjHeader* header;
+        };
+    } Value;
+
+    #define VALUE_TYPE(v)           ((v).type)
+
+    #define VT_TO_VALUE(vt)         ((Value){vt, {0}})
+    #define I32_TO_VALUE(i)         ((Value){.type = VT_I32, .i32val = (i)})
+    #define U32_TO_VALUE(i)         ((Value){.type = VT_U32, .u32val = (i)})
+    #define U8_TO_VALUE(i)          ((Value){.type = VT_U8,  .u8val = (i)})
+    #define F64_TO_VALUE(f)         ((Value){.type = VT_F64, .f64val = (f)})
+    #define OBJ_TO_VALUE(obj)       ((Value){.type = VT_OBJ, .header = (ObjHeader*)(obj)})
+
+    #define VALUE_TO_BOOL(v)        ((v).type == VT_TRUE ? true : false)
+    #define VALUE_TO_I32(v)         ((v).i32val)
+    #define VALUE_TO_U32(v)         ((v).u32val)
+    #define VALUE_TO_U8(v)          ((v).u8val)
+    #define VALUE_TO_F64(v)         ((v).f64val)
+    #define VALUE_TO_OBJ(v)         ((v).header)
+
+    #define VALUE_IS_UNDEFINED(v)   ((v).type == VT_UNDEFINED)
+    #define VALUE_IS_FALSE(v)       ((v).type == VT_FALSE)
+    #define VALUE_IS_TRUE(v)        ((v).type == VT_TRUE)
+    #define VALUE_IS_NULL(v)        ((v).type == VT_NULL)
+    #define VALUE_IS_I32(v)         ((v).type == VT_I32)
+    #define VALUE_IS_U32(v)         ((v).type == VT_U32)
+    #define VALUE_IS_U8(v)          ((v).type == VT_U8)
+    #define VALUE_IS_F64(v)         ((v).type == VT_F64)
+    #define VALUE_IS_OBJ(v)         ((v).type == VT_OBJ)
+#endif
+
+// 以下宏与 Value 的内存布局无关
+#define BOOL_TO_VALUE(b)        ((b) ? VT_TO_VALUE(VT_TRUE) : VT_TO_VALUE(VT_FALSE))
+#define VALUE_IS_BOOL(v)        (VALUE_IS_TRUE(v) || VALUE_IS_FALSE(v))
+#define VALUE_IS_NUM(v)         (VALUE_IS_I32(v) || VALUE_IS_F64(v) || VALUE_IS_U32(v))
+
+// SprApi 版本。Value 的内存布局属于 dylib ABI 的一部分，两种布局编译出的 dylib 不能混用。
+#define SPR_API_VERSION_STRUCT_VALUE    1
+#define SPR_API_VERSION_NAN_BOXING      2
+#ifdef USE_NAN_BOXING
+    #define SPR_API_VERSION SPR_API_VERSION_NAN_BOXING
+#else
+    #define SPR_API_VERSION SPR_API_VERSION_STRUCT_VALUE
+#endif
+
+// dylib 需在任一源文件中使用该宏导出构建时的 SprApi 版本，未导出时视为 SPR_API_VERSION_STRUCT_VALUE。
+#define SPR_DYLIB_EXPORT_API_VERSION() const u32 pub_spr_dylib_api_version = SPR_API_VERSION
 
 // native 函数的定义
 typedef bool (*Primitive)(VM* vm, Value* args);
@@ -9,19 +9,19 @@ static ObjString* CFile_FILE_classifier = NULL;
 
 static bool prim_CFile_stdin(VM* vm, Value* args) {
     ObjNativePointer* obj = api.create_native_pointer(api.vm, stdin, CFile_FILE_classifier, NULL);
-    args[0] = (Value) {.type = VT_OBJ, .header = (ObjHeader*)obj};
+    args[0] = OBJ_TO_VALUE((ObjHeader*)obj);
     return true;
 }
 
 static bool prim_CFile_stdout(VM* vm, Value* args) {
     ObjNativePointer* obj = api.create_native_pointer(api.vm, stdout, CFile_FILE_classifier, NULL);
-    args[0] = (Value) {.type = VT_OBJ, .header = (ObjHeader*)obj};
+    args[0] = OBJ_TO_VALUE((ObjHeader*)obj);
     return true;
 }
 
 static bool prim_CFile_stderr(VM* vm, Value* args) {
     ObjNativePointer* obj = api.create_native_pointer(api.vm, stderr, CFile_FILE_classifier, NULL);
-    args[0] = (Value) {.type = VT_OBJ, .header = (ObjHeader*)obj};
+    args[0] = OBJ_TO_VALUE((ObjHeader*)obj);
     return true;
 }
 
@@ -46,12 +46,12 @@ static bool prim_CFile_fopen(VM* vm, Value* args) {
     
     FILE* fp = fopen(path, mode);
     if (fp == NULL) {
-        args[0] = (Value) {.type = VT_NULL, .i32val = 0};
+        args[0] = VT_TO_VALUE(VT_NULL);
         return true;
     }
     
     ObjNativePointer* obj = api.create_native_pointer(api.vm, fp, CFile_FILE_classifier, CFile_FILE_destroy);
-    args[0] = (Value) {.type = VT_OBJ, .header = (ObjHeader*)obj};
+    args[0] = OBJ_TO_VALUE((ObjHeader*)obj);
     return true;
 }
 
@@ -61,50 +61,50 @@ static bool prim_CFile_fclose(VM* vm, Value* args) {
         return false;
     }
 
-    FILE* fp = api.unpack_native_pointer((ObjNativePointer*)args[1].header);
+    FILE* fp = api.unpack_native_pointer((ObjNativePointer*)VALUE_TO_OBJ(args[1]));
     if (fp == NULL) {
         return true;
     }
 
     fclose(fp);
 
-    api.set_native_pointer((ObjNativePointer*)args[1].header, NULL);
+    api.set_native_pointer((ObjNativePointer*)VALUE_TO_OBJ(args[1]), NULL);
 
     return true;
 }
 
 static bool prim_CFile_SEEK_SET(VM* vm, Value* args) {
-    args[0] = (Value) {.type = VT_I32, .i32val = SEEK_SET};
+    args[0] = I32_TO_VALUE(SEEK_SET);
     return true;
 }
 
 static bool prim_CFile_SEEK_CUR(VM* vm, Value* args) {
-    args[0] = (Value) {.type = VT_I32, .i32val = SEEK_CUR};
+    args[0] = I32_TO_VALUE(SEEK_CUR);
     return true;
 }
 
 static bool prim_CFile_SEEK_END(VM* vm, Value* args) {
-    args[0] = (Value) {.type = VT_I32, .i32val = SEEK_END};
+    args[0] = I32_TO_VALUE(SEEK_END);
     return true;
 }
 
 static bool prim_CFile_fseek(VM* vm, Value* args) {
-    if (api.validate_native_pointer(&api, args[1], CFile_FILE_classifier) != 0 || args[2].type != VT_I32 || args[3].type != VT_I32) {
+    if (api.validate_native_pointer(&api, args[1], CFile_FILE_classifier) != 0 || !VALUE_IS_I32(args[2]) || !VALUE_IS_I32(args[3])) {
         api.set_error(&api, "CFile.fseek(stream: NativePointer<FILE>, whence: i32, offset: i32) -> bool;\n");
         return false;
     }
-    FILE* stream = api.unpack_native_pointer((ObjNativePointer*)args[1].header);
-    int offset = args[3].i32val;
+    FILE* stream = api.unpack_native_pointer((ObjNativePointer*)VALUE_TO_OBJ(args[1]));
+    int offset = VALUE_TO_I32(args[3]);
 
-    if (args[2].i32val > 2 || args[2].i32val < 0) {
+    if (VALUE_TO_I32(args[2]) > 2 || VALUE_TO_I32(args[2]) < 0) {
         api.set_error(&api, "CFile.fseek: whence must between 0 and 2. please use CFile.SEEK_XXX.\n");
         return false;
     }
-    int whence = args[2].i32val;
+    int whence = VALUE_TO_I32(args[2]);
 
     int res = fseek(stream, offset, whence);
 
-    args[0] = (Value) {.type = (res == 0) ? VT_TRUE : VT_FALSE};
+    args[0] = BOOL_TO_VALUE(res == 0);
     return true;
 }
 
@@ -113,15 +113,15 @@ static bool prim_CFile_ftell(VM* vm, Value* args) {
         api.set_error(&api, "CFile.ftell(stream: NativePointer<FILE>) -> u32?;\n");
         return false;
     }
-    FILE* fp = api.unpack_native_pointer((ObjNativePointer*)args[1].header);
+    FILE* fp = api.unpack_native_pointer((ObjNativePointer*)VALUE_TO_OBJ(args[1]));
 
     long res = ftell(fp);
     if (res < 0) {
-        args[0] = (Value) {.type = VT_NULL};
+        args[0] = VT_TO_VALUE(VT_NULL);
         return true;
     }
 
-    args[0] = (Value) {.type = VT_U32, .u32val = res};
+    args[0] = U32_TO_VALUE(res);
     return true;
 }
 
@@ -130,27 +130,27 @@ static bool prim_CFile_rewind(VM* vm, Value* args) {
         api.set_error(&api, "CFile.rewind(stream: NativePointer<FILE>);\n");
         return false;
     }
-    FILE* fp = api.unpack_native_pointer((ObjNativePointer*)args[1].header);
+    FILE* fp = api.unpack_native_pointer((ObjNativePointer*)VALUE_TO_OBJ(args[1]));
 
     rewind(fp);
 
-    args[0] = (Value) {.type = VT_NULL};
+    args[0] = VT_TO_VALUE(VT_NULL);
     return true;
 }
 
 static bool prim_CFile_read_as_string(VM* vm, Value* args) {
-    if (api.validate_native_pointer(&api, args[1], CFile_FILE_classifier) != 0 || args[2].type != VT_U32) {
+    if (api.validate_native_pointer(&api, args[1], CFile_FILE_classifier) != 0 || !VALUE_IS_U32(args[2])) {
         api.set_error(&api, "CFile.read_as_string(stream: NativePointer<FILE>, u32: max_len) -> String?;\n");
         return false;
     }
 
-    u32 max_len = args[2].u32val;
+    u32 max_len = VALUE_TO_U32(args[2]);
     if (max_len == 0) {
-        args[0] = (Value) {.type = VT_NULL};
+        args[0] = VT_TO_VALUE(VT_NULL);
         return true;
     }
 
-    FILE* fp = api.unpack_native_pointer((ObjNativePointer*)args[1].header);
+    FILE* fp = api.unpack_native_pointer((ObjNativePointer*)VALUE_TO_OBJ(args[1]));
 
     char* buf = malloc(sizeof(char) * (max_len + 1));
     if (buf == NULL) {
@@ -161,7 +161,7 @@ static bool prim_CFile_read_as_string(VM* vm, Value* args) {
     int len = fread(buf, sizeof(char), max_len, fp);
     if (len == 0) {
         free(buf);
-        args[0] = (Value) {.type = VT_NULL};
+        args[0] = VT_TO_VALUE(VT_NULL);
         return true;
     }
 
@@ -171,23 +171,23 @@ static bool prim_CFile_read_as_string(VM* vm, Value* args) {
     
     free(buf);
 
-    args[0] = (Value) {.type = VT_OBJ, .header = (ObjHeader*)res};
+    args[0] = OBJ_TO_VALUE((ObjHeader*)res);
     return true;
 }
 
 static bool prim_CFile_read_as_bytes(VM* vm, Value* args) {
-    if (api.validate_native_pointer(&api, args[1], CFile_FILE_classifier) != 0 || args[2].type != VT_U32) {
+    if (api.validate_native_pointer(&api, args[1], CFile_FILE_classifier) != 0 || !VALUE_IS_U32(args[2])) {
         api.set_error(&api, "CFile.read_as_bytes(stream: NativePointer<FILE>, u32: max_len) -> List<u8>?;\n");
         return false;
     }
 
-    u32 max_len = args[2].u32val;
+    u32 max_len = VALUE_TO_U32(args[2]);
     if (max_len == 0) {
-        args[0] = (Value) {.type = VT_NULL};
+        args[0] = VT_TO_VALUE(VT_NULL);
         return true;
     }
 
-    FILE* fp = api.unpack_native_pointer((ObjNativePointer*)args[1].header);
+    FILE* fp = api.unpack_native_pointer((ObjNativePointer*)VALUE_TO_OBJ(args[1]));
 
     u8* buf = malloc(sizeof(u8) * max_len);
     if (buf == NULL) {
@@ -198,7 +198,7 @@ static bool prim_CFile_read_as_bytes(VM* vm, Value* args) {
     int len = fread(buf, sizeof(char), max_len, fp);
     if (len == 0) {
         free(buf);
-        args[0] = (Value) {.type = VT_NULL};
+        args[0] = VT_TO_VALUE(VT_NULL);
         return true;
     }
 
@@ -208,21 +208,23 @@ static bool prim_CFile_read_as_bytes(VM* vm, Value* args) {
     Value* elements = api.list_elements(res, &counts);
 
     for (int i = 0; i < counts; i++) {
-        elements[i] = (Value) {.type = VT_U8, .u8val = buf[i]};
+        elements[i] = U8_TO_VALUE(buf[i]);
     }
     
     free(buf);
 
-    args[0] = (Value) {.type = VT_OBJ, .header = (ObjHeader*)res};
+    args[0] = OBJ_TO_VALUE((ObjHeader*)res);
     return true;
 }
 
+SPR_DYLIB_EXPORT_API_VERSION();
+
 void pub_spr_dylib_init(SprApi api_in) {
     api = api_in;
 
     if (CFile_FILE_classifier == NULL) {
         CFile_FILE_classifier = api.create_string(api.vm, "CFILE_FILE*", 11);
-        api.push_keep_root(&api, (Value) {.type = VT_OBJ, .header = (ObjHeader*)CFile_FILE_classifier});
+        api.push_keep_root(&api, OBJ_TO_VALUE((ObjHeader*)CFile_FILE_classifier));
     }
 
     api.register_method(&api, "stdin", prim_CFile_stdin, true);
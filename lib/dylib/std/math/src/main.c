@@ -5,18 +5,18 @@
 static SprApi api;
 
 static bool value_to_f64(Value* val, f64* res, const char* msg) {
-    switch (val->type) {
+    switch (VALUE_TYPE(*val)) {
         case VT_F64:
-            *res = val->f64val;
+            *res = VALUE_TO_F64(*val);
             return true;
         case VT_U32:
-            *res = val->u32val;
+            *res = VALUE_TO_U32(*val);
             return true;
         case VT_I32:
-            *res = val->i32val;
+            *res = VALUE_TO_I32(*val);
             return true;
         case VT_U8:
-            *res = val->u8val;
+            *res = VALUE_TO_U8(*val);
             return true;
         default:
             api.set_error(&api, msg);
@@ -28,18 +28,18 @@ static bool value_to_f64(Value* val, f64* res, const char* msg) {
 // fn(f64) -> f64 的原生函数实现
 #define f64_Fn_f64(func) \
     static bool prim_Math_##func(VM* vm, Value* args) { \
-        switch (args[1].type) { \
+        switch (VALUE_TYPE(args[1])) { \
             case VT_I32: \
-                args[0] = (Value) {.type = VT_F64, .f64val = func((f64)args[1].i32val)}; \
+                args[0] = F64_TO_VALUE(func((f64)VALUE_TO_I32(args[1]))); \
                 return true; \
             case VT_U32: \
-                args[0] = (Value) {.type = VT_F64, .f64val = func((f64)args[1].u32val)}; \
+                args[0] = F64_TO_VALUE(func((f64)VALUE_TO_U32(args[1]))); \
                 return true; \
             case VT_U8: \
-                args[0] = (Value) {.type = VT_F64, .f64val = func((f64)args[1].u8val)}; \
+                args[0] = F64_TO_VALUE(func((f64)VALUE_TO_U8(args[1]))); \
                 return true; \
             case VT_F64: \
-                args[0] = (Value) {.type = VT_F64, .f64val = func(args[1].f64val)}; \
+                args[0] = F64_TO_VALUE(func(VALUE_TO_F64(args[1]))); \
                 return true; \
             default: \
                 api.set_error(&api, "Math." #func "(Number) -> f64;"); \
@@ -48,7 +48,7 @@ static bool value_to_f64(Value* val, f64* res, const char* msg) {
     }
 
 static bool prim_Math_pi(VM* vm, Value* args) {
-    args[0] = (Value) {.type = VT_F64, .f64val = 3.141592653589793};
+    args[0] = F64_TO_VALUE(3.141592653589793);
     return true;
 }
 
@@ -67,55 +67,55 @@ static bool prim_Math_atan2(VM* vm, Value* args) {
         return false;
     }
 
-    args[0] = (Value) {.type = VT_F64, .f64val = atan2(a, b)};
+    args[0] = F64_TO_VALUE(atan2(a, b));
     return true;
 }
 
 static bool prim_Math_xor(VM* vm, Value* args) {
-    if (args[1].type != VT_U32 || args[2].type != VT_U32) {
+    if (!VALUE_IS_U32(args[1]) || !VALUE_IS_U32(args[2])) {
         api.set_error(&api, "Math.xor(u32, u32) -> u32");
         return false;
     }
-    args[0] = (Value) {.type = VT_U32, .u32val = (args[1].u32val ^ args[2].u32val)};
+    args[0] = U32_TO_VALUE((VALUE_TO_U32(args[1]) ^ VALUE_TO_U32(args[2])));
     return true;
 }
 
 static bool prim_Math_is_nan(VM* vm, Value* args) {
-    switch (args[1].type) {
+    switch (VALUE_TYPE(args[1])) {
         case VT_F64:
-            args[0] = (Value) {.type = isnan(args[1].f64val) ? VT_TRUE : VT_FALSE};
+            args[0] = BOOL_TO_VALUE(isnan(VALUE_TO_F64(args[1])));
             return true;
         default:
-            args[0] = (Value) {.type = VT_FALSE};
+            args[0] = VT_TO_VALUE(VT_FALSE);
             return true;
     }
 }
 
 static bool prim_Math_is_inf(VM* vm, Value* args) {
-    switch (args[1].type) {
+    switch (VALUE_TYPE(args[1])) {
         case VT_F64:
-            args[0] = (Value) {.type = isinf(args[1].f64val) ? VT_TRUE : VT_FALSE};
+            args[0] = BOOL_TO_VALUE(isinf(VALUE_TO_F64(args[1])));
             return true;
         default:
-            args[0] = (Value) {.type = VT_FALSE};
+            args[0] = VT_TO_VALUE(VT_FALSE);
             return true;
     }
 }
 
 static bool prim_Math_abs(VM* vm, Value* args) {
-    switch (args[1].type) {
+    switch (VALUE_TYPE(args[1])) {
         case VT_U8:
         case VT_U32:
             args[0] = args[1];
             return true;
         case VT_I32: {
-            i32 val = args[0].i32val;
-            args[0] = (Value) {.type = VT_I32, .i32val = val < 0 ? -val : val};
+            i32 val = VALUE_TO_I32(args[0]);
+            args[0] = I32_TO_VALUE(val < 0 ? -val : val);
             return true;
         }
         case VT_F64: {
-            f64 val = args[0].f64val;
-            args[0] = (Value) {.type = VT_F64, .f64val = val < 0 ? -val : val};
+            f64 val = VALUE_TO_F64(args[0]);
+            args[0] = F64_TO_VALUE(val < 0 ? -val : val);
             return true;
         }
         default:
@@ -125,18 +125,18 @@ static bool prim_Math_abs(VM* vm, Value* args) {
 }
 
 static bool prim_Math_ceil(VM* vm, Value* args) {
-    switch (args[1].type) {
+    switch (VALUE_TYPE(args[1])) {
         case VT_U8:
-            args[0] = (Value) {.type = VT_F64, .f64val = args[1].u8val};
+            args[0] = F64_TO_VALUE(VALUE_TO_U8(args[1]));
             return true;
         case VT_U32:
-            args[0] = (Value) {.type = VT_F64, .f64val = args[1].u32val};
+            args[0] = F64_TO_VALUE(VALUE_TO_U32(args[1]));
             return true;
         case VT_I32:
-            args[0] = (Value) {.type = VT_F64, .f64val = args[1].i32val};
+            args[0] = F64_TO_VALUE(VALUE_TO_I32(args[1]));
             return true;
         case VT_F64:
-            args[0] = (Value) {.type = VT_F64, .f64val = ceil(args[0].f64val)};
+            args[0] = F64_TO_VALUE(ceil(VALUE_TO_F64(args[0])));
             return true;
         default:
             api.set_error(&api, "Math.ceil(Number) -> f64");
@@ -145,18 +145,18 @@ static bool prim_Math_ceil(VM* vm, Value* args) {
 }
 
 static bool prim_Math_floor(VM* vm, Value* args) {
-    switch (args[1].type) {
+    switch (VALUE_TYPE(args[1])) {
         case VT_U8:
-            args[0] = (Value) {.type = VT_F64, .f64val = args[1].u8val};
+            args[0] = F64_TO_VALUE(VALUE_TO_U8(args[1]));
             return true;
         case VT_U32:
-            args[0] = (Value) {.type = VT_F64, .f64val = args[1].u32val};
+            args[0] = F64_TO_VALUE(VALUE_TO_U32(args[1]));
             return true;
         case VT_I32:
-            args[0] = (Value) {.type = VT_F64, .f64val = args[1].i32val};
+            args[0] = F64_TO_VALUE(VALUE_TO_I32(args[1]));
             return true;
         case VT_F64:
-            args[0] = (Value) {.type = VT_F64, .f64val = floor(args[0].f64val)};
+            args[0] = F64_TO_VALUE(floor(VALUE_TO_F64(args[0])));
             return true;
         default:
             api.set_error(&api, "Math.floor(Number) -> f64");
@@ -165,15 +165,15 @@ static bool prim_Math_floor(VM* vm, Value* args) {
 }
 
 static bool prim_Math_fraction(VM* vm, Value* args) {
-    switch (args[1].type) {
+    switch (VALUE_TYPE(args[1])) {
         case VT_U8:
         case VT_U32:
         case VT_I32:
-            args[0] = (Value) {.type = VT_F64, .f64val = 0.0};
+            args[0] = F64_TO_VALUE(0.0);
             return true;
         case VT_F64: {
             double dummy;
-            args[0] = (Value) {.type = VT_F64, .f64val = modf(args[0].f64val, &dummy)};
+            args[0] = F64_TO_VALUE(modf(VALUE_TO_F64(args[0]), &dummy));
             return true;
         }
         default:
@@ -183,18 +183,18 @@ static bool prim_Math_fraction(VM* vm, Value* args) {
 }
 
 static bool prim_Math_truncate(VM* vm, Value* args) {
-    switch (args[1].type) {
+    switch (VALUE_TYPE(args[1])) {
         case VT_U8:
-            args[0] = (Value) {.type = VT_I32, .i32val = args[1].u8val};
+            args[0] = I32_TO_VALUE(VALUE_TO_U8(args[1]));
             return true;
         case VT_U32:
-            args[0] = (Value) {.type = VT_I32, .i32val = args[1].u32val};
+            args[0] = I32_TO_VALUE(VALUE_TO_U32(args[1]));
             return true;
         case VT_I32:
             args[0] = args[1];
             return true;
         case VT_F64:
-            args[0] = (Value) {.type = VT_I32, .i32val = trunc(args[1].f64val)};
+            args[0] = I32_TO_VALUE(trunc(VALUE_TO_F64(args[1])));
             return true;
         default:
             api.set_error(&api, "Math.truncate(Number) -> i32");
@@ -203,18 +203,18 @@ static bool prim_Math_truncate(VM* vm, Value* args) {
 }
 
 static bool prim_Math_i32(VM* vm, Value* args) {
-    switch (args[1].type) {
+    switch (VALUE_TYPE(args[1])) {
         case VT_U8:
-            args[0] = (Value) {.type = VT_I32, .i32val = args[1].u8val};
+            args[0] = I32_TO_VALUE(VALUE_TO_U8(args[1]));
             return true;
         case VT_U32:
-            args[0] = (Value) {.type = VT_I32, .i32val = args[1].u32val};
+            args[0] = I32_TO_VALUE(VALUE_TO_U32(args[1]));
             return true;
         case VT_I32:
             args[0] = args[1];
             return true;
         case VT_F64:
-            args[0] = (Value) {.type = VT_I32, .i32val = args[1].f64val};
+            args[0] = I32_TO_VALUE(VALUE_TO_F64(args[1]));
             return true;
         default:
             api.set_error(&api, "Math.i32(Number) -> i32");
@@ -223,18 +223,18 @@ static bool prim_Math_i32(VM* vm, Value* args) {
 }
 
 static bool prim_Math_u32(VM* vm, Value* args) {
-    switch (args[1].type) {
+    switch (VALUE_TYPE(args[1])) {
         case VT_U8:
-            args[0] = (Value) {.type = VT_U32, .u32val = args[1].u8val};
+            args[0] = U32_TO_VALUE(VALUE_TO_U8(args[1]));
             return true;
         case VT_U32:
             args[0] = args[1];
             return true;
         case VT_I32:
-            args[0] = (Value) {.type = VT_U32, .u32val = args[1].i32val};
+            args[0] = U32_TO_VALUE(VALUE_TO_I32(args[1]));
             return true;
         case VT_F64:
-            args[0] = (Value) {.type = VT_U32, .u32val = args[1].f64val};
+            args[0] = U32_TO_VALUE(VALUE_TO_F64(args[1]));
             return true;
         default:
             api.set_error(&api, "Math.u32(Number) -> u32");
@@ -243,15 +243,15 @@ static bool prim_Math_u32(VM* vm, Value* args) {
 }
 
 static bool prim_Math_f64(VM* vm, Value* args) {
-    switch (args[1].type) {
+    switch (VALUE_TYPE(args[1])) {
         case VT_U8:
-            args[0] = (Value) {.type = VT_F64, .f64val = args[1].u8val};
+            args[0] = F64_TO_VALUE(VALUE_TO_U8(args[1]));
             return true;
         case VT_U32:
-            args[0] = (Value) {.type = VT_F64, .f64val = args[1].u32val};
+            args[0] = F64_TO_VALUE(VALUE_TO_U32(args[1]));
             return true;
         case VT_I32:
-            args[0] = (Value) {.type = VT_F64, .f64val = args[1].i32val};
+            args[0] = F64_TO_VALUE(VALUE_TO_I32(args[1]));
             return true;
         case VT_F64:
             args[0] = args[1];
@@ -263,18 +263,18 @@ static bool prim_Math_f64(VM* vm, Value* args) {
 }
 
 static bool prim_Math_u8(VM* vm, Value* args) {
-    switch (args[1].type) {
+    switch (VALUE_TYPE(args[1])) {
         case VT_U8:
             args[0] = args[1];
             return true;
         case VT_U32:
-            args[0] = (Value) {.type = VT_U8, .u8val = args[1].u32val};
+            args[0] = U8_TO_VALUE(VALUE_TO_U32(args[1]));
             return true;
         case VT_I32:
-            args[0] = (Value) {.type = VT_U8, .u8val = args[1].i32val};
+            args[0] = U8_TO_VALUE(VALUE_TO_I32(args[1]));
             return true;
         case VT_F64:
-            args[0] = (Value) {.type = VT_U8, .u8val = args[1].f64val};
+            args[0] = U8_TO_VALUE(VALUE_TO_F64(args[1]));
             return true;
         default:
             api.set_error(&api, "Math.u8(Number) -> u8");
@@ -284,6 +284,8 @@ static bool prim_Math_u8(VM* vm, Value* args) {
 
 f64_Fn_f64(sqrt)
 
+SPR_DYLIB_EXPORT_API_VERSION();
+
 void pub_spr_dylib_init(SprApi api_in) {
     api = api_in;
     
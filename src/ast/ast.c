@@ -158,7 +158,7 @@ AST_Expr* string_interpolation(Parser* parser, bool can_assign) {
         struct AST_ArrayItem* item_str = malloc(sizeof(struct AST_ArrayItem));
         
         // 解析interpolation
-        if (((ObjString*)parser->pre_token.value.header)->val.len != 0) { // 当其为非空字符串时添加
+        if (((ObjString*)VALUE_TO_OBJ(parser->pre_token.value))->val.len != 0) { // 当其为非空字符串时添加
             item_str->item = literal(parser, false);
             item_str->next = NULL;
         } else {
@@ -184,7 +184,7 @@ AST_Expr* string_interpolation(Parser* parser, bool can_assign) {
     );
 
     // 结尾的TOKEN_STRING
-    if (((ObjString*)parser->pre_token.value.header)->val.len != 0) { // 当其为非空字符串时添加
+    if (((ObjString*)VALUE_TO_OBJ(parser->pre_token.value))->val.len != 0) { // 当其为非空字符串时添加
         struct AST_ArrayItem* item_str = malloc(sizeof(struct AST_ArrayItem));
         item_str->item = literal(parser, false);
         item_str->next = NULL;
@@ -246,6 +246,7 @@ AST_Expr* map_literal(Parser* parser, bool can_assign) {
 
     AST_MapLiteral* map = &res->expr.map_literal;
     map->entrys = NULL;
+    struct AST_MapEntry** tail = &map->entrys; // 按源码顺序链接，entry 依此顺序求值、插入
 
     do {
         if (PEEK_TOKEN(parser) == TOKEN_RC) {
@@ -253,8 +254,9 @@ AST_Expr* map_literal(Parser* parser, bool can_assign) {
         }
 
         struct AST_MapEntry* new = malloc(sizeof(struct AST_MapEntry));
-        new->next = map->entrys;
-        map->entrys = new;
+        new->next = NULL;
+        *tail = new;
+        tail = &new->next;
 
         new->key = compile_expr(parser, BP_UNARY);
         consume_cur_token(parser, TOKEN_COLON, "expect ':' after key.");
@@ -468,8 +470,8 @@ AST_Expr* infix_operator(Parser* parser, AST_Expr* l, bool can_assign) {
 
 // 类型注释
 static bool has_pending_gt = false; // 为了解决 '>>' 闭合 <> 的问题。
-static void type_annotation(Parser* parser) {
-    // 类型注释按规则解析后不保存任何信息，只做注释用
+static TypeHint type_annotation(Parser* parser) {
+    // 类型注释不做检查，只返回编译器可利用的 TypeHint：不带 <>、? 及 | 的 i32、f64
     // String | List<String> | Map<String, int> | List<Map<String, int>> | Tuple<int, int, int> | Fn<(T) -> K> | Fn<() -> None>?
     // 类型均以id起始，后可以接可嵌套的‘<>’，‘<>’中至少有一个id，id之间可以使用‘,’但不能以‘,’结尾。允许使用‘|’表示或关系
     // 所有类型后均可添加?表示可空类型
@@ -477,7 +479,24 @@ static void type_annotation(Parser* parser) {
 
     consume_cur_token(parser, TOKEN_ID, "typping must start by id.");
 
+    static const struct {
+        const char* name;
+        TypeHint hint;
+    } simple_types[] = {
+        {"i32", TYPE_HINT_I32},
+        {"f64", TYPE_HINT_F64},
+    };
+    TypeHint hint = TYPE_HINT_ANY;
+    for (u32 i = 0; i < sizeof(simple_types) / sizeof(simple_types[0]); i++) {
+        if (parser->pre_token.len == strlen(simple_types[i].name)
+            && memcmp(parser->pre_token.start, simple_types[i].name, parser->pre_token.len) == 0) {
+            hint = simple_types[i].hint;
+            break;
+        }
+    }
+
     if (match_token(parser, TOKEN_LT)) {
+        hint = TYPE_HINT_ANY;
         if (match_token(parser, TOKEN_LP)) {
             // callable标注
             // 参数列表解析
@@ -509,21 +528,30 @@ static void type_annotation(Parser* parser) {
         }
     }
 
-    match_token(parser, TOKEN_QUESTION);
+    if (match_token(parser, TOKEN_QUESTION)) {
+        hint = TYPE_HINT_ANY;
+    }
 
     if (match_token(parser, TOKEN_BIT_OR)) {
         type_annotation(parser);
+        hint = TYPE_HINT_ANY;
     }
+
+    return hint;
 }
-#define FUNCTION_RESULT_TYPPING_CHECK() \
+#define FUNCTION_RESULT_TYPPING_CHECK(hint) \
     if (match_token(parser, TOKEN_SUB)) { \
         consume_cur_token(parser, TOKEN_GT, "expect '->' for result typping."); \
-        type_annotation(parser); \
+        (hint) = type_annotation(parser); \
     }
-#define VAR_TYPPING_CHECK() \
+#define VAR_TYPPING_CHECK(hint) \
     if (match_token(parser, TOKEN_COLON)) { \
-        type_annotation(parser); \
+        (hint) = type_annotation(parser); \
     }
+// 函数、方法及闭包的类型注释默认为 TYPE_HINT_ANY
+#define INIT_TYPE_HINTS(owner) \
+    memset((owner)->arg_types, 0, sizeof((owner)->arg_types)); \
+    (owner)->result_type = TYPE_HINT_ANY;
 
 inline static void native_annotation(Parser* parser) {
     match_token(parser, TOKEN_STATIC);
@@ -562,13 +590,16 @@ inline static void native_annotation(Parser* parser) {
         consume_cur_token(parser, TOKEN_RP, "(native annotation): expect '= (id)'.");
     }
 
-    FUNCTION_RESULT_TYPPING_CHECK();
+    if (match_token(parser, TOKEN_SUB)) {
+        consume_cur_token(parser, TOKEN_GT, "expect '->' for result typping.");
+        type_annotation(parser);
+    }
 
     consume_cur_token(parser, TOKEN_SEMICOLON, "(native annotation): expect ';'.");
 }
 
 // 解析型参列表
-static void process_para_list(Parser* parser, u32* argc, ScriptID names[MAX_ARG_NUM]) {
+static void process_para_list(Parser* parser, u32* argc, ScriptID names[MAX_ARG_NUM], TypeHint types[MAX_ARG_NUM]) {
     u32 origin_argc = *argc;
 
     do {
@@ -579,7 +610,7 @@ static void process_para_list(Parser* parser, u32* argc, ScriptID names[MAX_ARG_
         consume_cur_token(parser, TOKEN_ID, "expect param name.");
         names[*argc - 1] = (ScriptID) {.start = parser->pre_token.start, .len = parser->pre_token.len};
 
-        VAR_TYPPING_CHECK();
+        VAR_TYPPING_CHECK(types[*argc - 1]);
     } while (match_token(parser, TOKEN_COMMA));
 }
 
@@ -594,20 +625,20 @@ void infix_method_signature(Parser* parser, struct _ClassMethod* method) {
     consume_cur_token(parser, TOKEN_LP, "expect '(' after infix operator.");
     
     consume_cur_token(parser, TOKEN_ID, "expect var name.");
-    VAR_TYPPING_CHECK();
-
     method->arg_names[0] = (ScriptID) {.start = parser->pre_token.start, .len = parser->pre_token.len};
 
+    VAR_TYPPING_CHECK(method->arg_types[0]);
+
     consume_cur_token(parser, TOKEN_RP, "expect ')' after var name.");
 
-    FUNCTION_RESULT_TYPPING_CHECK();
+    FUNCTION_RESULT_TYPPING_CHECK(method->result_type);
 }
 
 void unary_method_signature(Parser* parser, struct _ClassMethod* method) {
     method->type = AST_CLASS_GETTER;
     method->name = SCRIPT_ID_FROM_TOKEN(parser->pre_token);
     method->argc = 0;
-    FUNCTION_RESULT_TYPPING_CHECK();
+    FUNCTION_RESULT_TYPPING_CHECK(method->result_type);
 }
 
 void id_method_signature(Parser* parser, struct _ClassMethod* method) {
@@ -623,14 +654,14 @@ void id_method_signature(Parser* parser, struct _ClassMethod* method) {
             if (match_token(parser, TOKEN_RC)) {
                 COMPILE_ERROR(parser, "auto property constructor must not none.");
             }
-            process_para_list(parser, &method->argc, method->arg_names);
+            process_para_list(parser, &method->argc, method->arg_names, method->arg_types);
             consume_cur_token(parser, TOKEN_RC, "expect '}' in the end of auto property constructor.");
             auto_property_count = method->argc;
         }
 
         consume_cur_token(parser, TOKEN_LP, "constructor must be a method.");
         if (!match_token(parser, TOKEN_RP)) {
-            process_para_list(parser, &method->argc, method->arg_names);
+            process_para_list(parser, &method->argc, method->arg_names, method->arg_types);
             consume_cur_token(parser, TOKEN_RP, "expect ')' for parameter list");
         }
 
@@ -687,7 +718,7 @@ void id_method_signature(Parser* parser, struct _ClassMethod* method) {
         method->type = AST_CLASS_METHOD;
         method->argc = 0;
         if (!match_token(parser, TOKEN_RP)) {
-            process_para_list(parser, &method->argc, method->arg_names);
+            process_para_list(parser, &method->argc, method->arg_names, method->arg_types);
             consume_cur_token(parser, TOKEN_RP, "expect ')' for parameter list");
         }
     } else if (match_token(parser, TOKEN_ASSIGN)) {
@@ -697,12 +728,12 @@ void id_method_signature(Parser* parser, struct _ClassMethod* method) {
         
         consume_cur_token(parser, TOKEN_ID, "expect parameter name.");
         method->arg_names[0] = SCRIPT_ID_FROM_TOKEN(parser->pre_token);
-        VAR_TYPPING_CHECK();
+        VAR_TYPPING_CHECK(method->arg_types[0]);
 
         consume_cur_token(parser, TOKEN_RP, "expect ')' for parameter list");
     }
     
-    FUNCTION_RESULT_TYPPING_CHECK();
+    FUNCTION_RESULT_TYPPING_CHECK(method->result_type);
 }
 
 AST_Expr* subscript(Parser* parser, AST_Expr* l, bool can_assign) {
@@ -806,7 +837,7 @@ void subscript_method_signature(Parser* parser, struct _ClassMethod* method) {
     if (match_token(parser, TOKEN_RB)) {
         COMPILE_ERROR(parser, "subscript argc must > 0.");
     }
-    process_para_list(parser, &method->argc, method->arg_names);
+    process_para_list(parser, &method->argc, method->arg_names, method->arg_types);
     consume_cur_token(parser, TOKEN_RB, "expect ']' in the end of args list.");
 
     if (match_token(parser, TOKEN_ASSIGN)) {
@@ -815,13 +846,14 @@ void subscript_method_signature(Parser* parser, struct _ClassMethod* method) {
         consume_cur_token(parser, TOKEN_LP, "subscript-setter must have parameter list.");
         
         consume_cur_token(parser, TOKEN_ID, "expect parameter name.");
-        method->arg_names[method->argc++] = SCRIPT_ID_FROM_TOKEN(parser->pre_token);
-        VAR_TYPPING_CHECK();
+        method->arg_names[method->argc] = SCRIPT_ID_FROM_TOKEN(parser->pre_token);
+        VAR_TYPPING_CHECK(method->arg_types[method->argc]);
+        method->argc++;
 
         consume_cur_token(parser, TOKEN_RP, "subscript-setter only have 1 parameter, expect ')' in the end of parameter list.");
     }
 
-    FUNCTION_RESULT_TYPPING_CHECK();
+    FUNCTION_RESULT_TYPPING_CHECK(method->result_type);
 }
 
 void mix_method_signature(Parser* parser, struct _ClassMethod* method) {
@@ -833,14 +865,14 @@ void mix_method_signature(Parser* parser, struct _ClassMethod* method) {
         consume_cur_token(parser, TOKEN_LP, "expect '(' in the start of parameter list.");
         consume_cur_token(parser, TOKEN_ID, "expect parameter name.");
         method->arg_names[0] = SCRIPT_ID_FROM_TOKEN(parser->pre_token);
-        VAR_TYPPING_CHECK();
+        VAR_TYPPING_CHECK(method->arg_types[0]);
         consume_cur_token(parser, TOKEN_RP, "expect ')' in the end of parameter list.");
     } else {
         method->type = AST_CLASS_GETTER;
         method->argc = 0;
     }
 
-    FUNCTION_RESULT_TYPPING_CHECK();
+    FUNCTION_RESULT_TYPPING_CHECK(method->result_type);
 }
 
 AST_Expr* compile_expr(Parser* parser, BindPower rbp) {    
@@ -895,14 +927,15 @@ AST_Expr* closure_expr(Parser* parser, bool can_assign) {
     
     AST_ClosureExpr* closure = &res->expr.closure;
     closure->argc = 0;
+    INIT_TYPE_HINTS(closure);
 
     consume_cur_token(parser, TOKEN_LP, "closure must have parameter list (even it's empty).");
     if (!match_token(parser, TOKEN_RP)) {
-        process_para_list(parser, &closure->argc, closure->arg_names);
+        process_para_list(parser, &closure->argc, closure->arg_names, closure->arg_types);
         consume_cur_token(parser, TOKEN_RP, "expect ')' in the end of parameter list.");
     }
 
-    FUNCTION_RESULT_TYPPING_CHECK();
+    FUNCTION_RESULT_TYPPING_CHECK(closure->result_type);
 
     closure->body = malloc(sizeof(AST_Block));
     consume_cur_token(parser, TOKEN_LC, "expect '{' in the start of closure body.");
@@ -969,6 +1002,7 @@ void compile_for_stmt(Parser* parser, AST_Block* res) {
         stmt->type = AST_VAR_DEF_STMT;
         AST_VarDef* seq_def = &stmt->stmt.var_def;
         seq_def->name = for_seq;
+        seq_def->type = TYPE_HINT_ANY;
         seq_def->init_val = compile_expr(parser, BP_LOWEST);
         stmt;
     });
@@ -984,6 +1018,7 @@ void compile_for_stmt(Parser* parser, AST_Block* res) {
         stmt->type = AST_VAR_DEF_STMT;
         AST_VarDef* iter_def = &stmt->stmt.var_def;
         iter_def->name = for_iter;
+        iter_def->type = TYPE_HINT_ANY;
         iter_def->init_val = NULL;
         stmt;
     });
@@ -1045,6 +1080,7 @@ void compile_for_stmt(Parser* parser, AST_Block* res) {
             stmt->type = AST_VAR_DEF_STMT;
             AST_VarDef* loop_var_def = &stmt->stmt.var_def;
             loop_var_def->name = loop_var_name;
+            loop_var_def->type = TYPE_HINT_ANY;
             loop_var_def->init_val = ({
                 AST_Expr* iter_val_call = malloc(sizeof(AST_Expr));
                 iter_val_call->type = AST_CALL_METHOD_EXPR;
@@ -1244,15 +1280,16 @@ AST_FuncDef* compile_func_def(Parser* parser) {
     res->argc = 0;
     res->body = NULL;
     res->next = NULL;
+    INIT_TYPE_HINTS(res);
 
     // 型参解析
     consume_cur_token(parser, TOKEN_LP, "expect '(' after function name.");
     if (!match_token(parser, TOKEN_RP)) {
-        process_para_list(parser, &res->argc, res->arg_names);
+        process_para_list(parser, &res->argc, res->arg_names, res->arg_types);
         consume_cur_token(parser, TOKEN_RP, "expect ')' after parameter list.");
     }
 
-    FUNCTION_RESULT_TYPPING_CHECK();
+    FUNCTION_RESULT_TYPPING_CHECK(res->result_type);
 
     consume_cur_token(parser, TOKEN_LC, "expect '{' at the beginning of function body.");
 
@@ -1266,8 +1303,9 @@ void compile_var_def(Parser* parser, AST_VarDef* res) {
     Token* name_token = &parser->pre_token;
 
     res->name = (ScriptID) {.start = name_token->start, .len = name_token->len};
+    res->type = TYPE_HINT_ANY;
 
-    VAR_TYPPING_CHECK();
+    VAR_TYPPING_CHECK(res->type);
 
     // 初始化
     if (match_token(parser, TOKEN_ASSIGN)) {
@@ -1275,7 +1313,7 @@ void compile_var_def(Parser* parser, AST_VarDef* res) {
     } else {
         res->init_val = malloc(sizeof(AST_Expr));
         res->init_val->type = AST_LITERAL_EXPR;
-        res->init_val->expr.literal.type = VT_NULL;
+        res->init_val->expr.literal = VT_TO_VALUE(VT_NULL);
     }
 
     consume_cur_token(parser, TOKEN_SEMICOLON, "expect ';' in the end of variable definition.");
@@ -1322,8 +1360,9 @@ AST_ClassDef* compile_class_def(Parser* parser) {
             res->fields = field;
 
             field->name = (ScriptID) {.start = field_name->start, .len = field_name->len};
+            field->type = TYPE_HINT_ANY;
 
-            VAR_TYPPING_CHECK();
+            VAR_TYPPING_CHECK(field->type);
 
             if (is_static && match_token(parser, TOKEN_ASSIGN)) {
                 field->init_val = compile_expr(parser, BP_LOWEST);
@@ -1339,6 +1378,8 @@ AST_ClassDef* compile_class_def(Parser* parser) {
                 res->methods = getter_method;
                 
                 getter_method->is_static = is_static;
+                INIT_TYPE_HINTS(getter_method);
+                getter_method->result_type = field->type;
 
                 getter_method->type = AST_CLASS_GETTER;
                 getter_method->name = field->name;
@@ -1372,6 +1413,7 @@ AST_ClassDef* compile_class_def(Parser* parser) {
                 res->methods = setter_method;
                 
                 setter_method->is_static = is_static;
+                INIT_TYPE_HINTS(setter_method);
 
                 setter_method->type = AST_CLASS_SETTER;
                 setter_method->name = field->name;
@@ -1423,6 +1465,7 @@ AST_ClassDef* compile_class_def(Parser* parser) {
             method->is_static = is_static;
             method->type = AST_CLASS_METHOD;
             method->body = NULL;
+            INIT_TYPE_HINTS(method);
 
             AST_SymbolBindRule* sign_rule = &AST_Rules[parser->cur_token.type];
             if (sign_rule->method_sign == NULL) {
@@ -87,6 +87,8 @@ typedef struct {
 typedef struct {
     u32 argc;
     ScriptID arg_names[MAX_ARG_NUM];
+    TypeHint arg_types[MAX_ARG_NUM];
+    TypeHint result_type;
     AST_Block* body;
 } AST_ClosureExpr;
 
@@ -197,6 +199,7 @@ typedef struct {
 
 typedef struct _AST_VarDef {
     ScriptID name; // var name
+    TypeHint type; // 类型注释
     AST_Expr* init_val; // 初始化值，无则为null
 } AST_VarDef;
 
@@ -241,6 +244,8 @@ typedef struct _AST_FuncDef {
 
     u32 argc; // 参数个数
     ScriptID arg_names[MAX_ARG_NUM]; // 参数名
+    TypeHint arg_types[MAX_ARG_NUM]; // 参数的类型注释
+    TypeHint result_type; // 返回值的类型注释
 
     AST_Block* body; // 函数体
 
@@ -255,6 +260,7 @@ typedef struct _AST_ClassDef {
         bool is_static;
 
         ScriptID name;
+        TypeHint type;
         AST_Expr* init_val;
 
         struct _ClassFields* next;
@@ -276,6 +282,8 @@ typedef struct _AST_ClassDef {
 
         u32 argc;
         ScriptID arg_names[MAX_ARG_NUM];
+        TypeHint arg_types[MAX_ARG_NUM];
+        TypeHint result_type;
 
         AST_Block* body;
 
@@ -304,5 +312,8 @@ typedef struct {
 
 AST_Prog* compile_prog(Parser* parser);
 void destroy_ast_prog(VM* vm, AST_Prog* prog);
+void destroy_ast_expr(AST_Expr* expr);
+void destroy_ast_if_stmt(AST_IfStmt* if_stmt);
+void destroy_ast_block(AST_Block* block);
 
 #endif
\ No newline at end of file
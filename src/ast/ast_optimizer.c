@@ -0,0 +1,567 @@
+#include "ast_optimizer.h"
+#include "ast.h"
+#include "class.h"
+#include "common.h"
+#include "obj_string.h"
+#include "sparrow.h"
+#include "utils.h"
+#include "vm.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 只折叠两类运算，保证结果与运行时完全一致：
+// - 数字之间的运算：与 vm.c 中二元运算指令的快速路径相同，快速路径本就不查找方法，因此不受重载影响
+// - 字符串拼接及 bool、null、字符串间的相等比较：这些核心类的方法不能被脚本替换
+// 其余情况（含任何非字面量操作数）保持原样，运行时仍按方法调用分派，用户类重载的运算符照常生效。
+// 运行时会报错的运算（如整数除零）也不折叠，错误留到运行时抛出。
+
+static void optimize_expr(VM* vm, AST_Expr* expr);
+static void optimize_block(VM* vm, AST_Block* block);
+
+// 取出字面量节点的值，不是字面量时返回 false
+static bool literal_value(AST_Expr* expr, Value* val) {
+    switch (expr->type) {
+        case AST_LITERAL_TRUE:
+            *val = VT_TO_VALUE(VT_TRUE);
+            return true;
+        case AST_LITERAL_FALSE:
+            *val = VT_TO_VALUE(VT_FALSE);
+            return true;
+        case AST_LITERAL_NULL:
+            *val = VT_TO_VALUE(VT_NULL);
+            return true;
+        case AST_LITERAL_EXPR:
+            *val = expr->expr.literal;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// 字面量的真值：1 为真，0 为假（false 和 null），-1 表示不是字面量
+static int literal_truth(AST_Expr* expr) {
+    Value val;
+    if (!literal_value(expr, &val)) {
+        return -1;
+    }
+    return (VALUE_IS_FALSE(val) || VALUE_IS_NULL(val)) ? 0 : 1;
+}
+
+// 将 expr 改为值为 val 的字面量节点，原有的子节点须已释放
+static void set_literal(AST_Expr* expr, Value val) {
+    if (VALUE_IS_TRUE(val)) {
+        expr->type = AST_LITERAL_TRUE;
+    } else if (VALUE_IS_FALSE(val)) {
+        expr->type = AST_LITERAL_FALSE;
+    } else if (VALUE_IS_NULL(val)) {
+        expr->type = AST_LITERAL_NULL;
+    } else {
+        expr->type = AST_LITERAL_EXPR;
+        expr->expr.literal = val;
+    }
+}
+
+// 以 child 取代 expr，child 的节点本身被释放
+static void replace_with_child(AST_Expr* expr, AST_Expr* child) {
+    *expr = *child;
+    free(child);
+}
+
+static bool fold_string_add(VM* vm, ObjString* l, ObjString* r, Value* res) {
+    u32 len = l->val.len + r->val.len;
+    char* buf = malloc(len + 1);
+    if (buf == NULL) {
+        return false;
+    }
+    memcpy(buf, l->val.start, l->val.len);
+    memcpy(buf + l->val.len, r->val.start, r->val.len);
+
+    ObjString* str = objstring_new(vm, buf, len);
+    free(buf);
+
+    // 与词法分析得到的字符串字面量一样，由 ast_obj_root 持有直到 ast 销毁
+    push_tmp_root(vm, (ObjHeader*)str);
+    BufferAdd(Value, &vm->ast_obj_root, vm, OBJ_TO_VALUE(str));
+    pop_tmp_root(vm);
+
+    *res = OBJ_TO_VALUE(str);
+    return true;
+}
+
+#define BOTH_IS(type)       (VALUE_IS_##type(l) && VALUE_IS_##type(r))
+#define BOTH_IS_I32_OR_F64  ((VALUE_IS_I32(l) || VALUE_IS_F64(l)) && (VALUE_IS_I32(r) || VALUE_IS_F64(r)))
+#define AS_F64(v)           (VALUE_IS_F64(v) ? VALUE_TO_F64(v) : (f64)VALUE_TO_I32(v))
+// i32 溢出时按补码回绕，与虚拟机运行时的结果一致
+#define WRAP_I32(l, op, r)  ((i32)((u32)VALUE_TO_I32(l) op (u32)VALUE_TO_I32(r)))
+#define IS_OP(name)         (strcmp(op, name) == 0)
+
+// 计算 l op r，不能在编译期确定结果时返回 false
+static bool fold_infix(VM* vm, const char* op, Value l, Value r, Value* res) {
+    if (IS_OP("+") || IS_OP("-") || IS_OP("*")) {
+        char c = op[0];
+        if (BOTH_IS(I32)) {
+            *res = I32_TO_VALUE(c == '+' ? WRAP_I32(l, +, r) : c == '-' ? WRAP_I32(l, -, r) : WRAP_I32(l, *, r));
+            return true;
+        }
+        if (BOTH_IS(U32)) {
+            u32 a = VALUE_TO_U32(l), b = VALUE_TO_U32(r);
+            *res = U32_TO_VALUE(c == '+' ? a + b : c == '-' ? a - b : a * b);
+            return true;
+        }
+        if (BOTH_IS_I32_OR_F64) {
+            f64 a = AS_F64(l), b = AS_F64(r);
+            *res = F64_TO_VALUE(c == '+' ? a + b : c == '-' ? a - b : a * b);
+            return true;
+        }
+        if (c == '+' && VALUE_IS_STRING(l) && VALUE_IS_STRING(r)) {
+            return fold_string_add(vm, VALUE_TO_OBJSTR(l), VALUE_TO_OBJSTR(r), res);
+        }
+        return false;
+    }
+
+    if (IS_OP("/") || IS_OP("%")) {
+        bool is_div = op[0] == '/';
+        if (BOTH_IS(I32)) {
+            i32 a = VALUE_TO_I32(l), b = VALUE_TO_I32(r);
+            if (b == 0 || (a == INT32_MIN && b == -1)) {
+                return false;
+            }
+            *res = I32_TO_VALUE(is_div ? a / b : a % b);
+            return true;
+        }
+        if (BOTH_IS(U32)) {
+            u32 a = VALUE_TO_U32(l), b = VALUE_TO_U32(r);
+            if (b == 0) {
+                return false;
+            }
+            *res = U32_TO_VALUE(is_div ? a / b : a % b);
+            return true;
+        }
+        if (BOTH_IS_I32_OR_F64) {
+            f64 a = AS_F64(l), b = AS_F64(r);
+            *res = F64_TO_VALUE(is_div ? a / b : fmod(a, b));
+            return true;
+        }
+        return false;
+    }
+
+    if (IS_OP("<") || IS_OP("<=") || IS_OP(">") || IS_OP(">=") || IS_OP("==") || IS_OP("!=")) {
+        #define COMPARE(a, b) \
+            (IS_OP("<") ? (a) < (b) : IS_OP("<=") ? (a) <= (b) : IS_OP(">") ? (a) > (b) : \
+             IS_OP(">=") ? (a) >= (b) : IS_OP("==") ? (a) == (b) : (a) != (b))
+        if (BOTH_IS(I32)) {
+            *res = BOOL_TO_VALUE(COMPARE(VALUE_TO_I32(l), VALUE_TO_I32(r)));
+            return true;
+        }
+        if (BOTH_IS(U32)) {
+            *res = BOOL_TO_VALUE(COMPARE(VALUE_TO_U32(l), VALUE_TO_U32(r)));
+            return true;
+        }
+        if (BOTH_IS(U8)) {
+            *res = BOOL_TO_VALUE(COMPARE(VALUE_TO_U8(l), VALUE_TO_U8(r)));
+            return true;
+        }
+        if (BOTH_IS_I32_OR_F64) {
+            *res = BOOL_TO_VALUE(COMPARE(AS_F64(l), AS_F64(r)));
+            return true;
+        }
+        #undef COMPARE
+
+        // bool、null、String 均使用 Object 的 ==、!=
+        #define USE_OBJECT_EQ(v) (VALUE_IS_BOOL(v) || VALUE_IS_NULL(v) || VALUE_IS_STRING(v))
+        if ((IS_OP("==") || IS_OP("!=")) && USE_OBJECT_EQ(l) && USE_OBJECT_EQ(r)) {
+            bool eq = value_is_equal(l, r);
+            *res = BOOL_TO_VALUE(IS_OP("==") ? eq : !eq);
+            return true;
+        }
+        #undef USE_OBJECT_EQ
+        return false;
+    }
+
+    if (IS_OP("&") || IS_OP("|")) {
+        bool is_and = op[0] == '&';
+        if (BOTH_IS(I32)) {
+            *res = I32_TO_VALUE(is_and ? VALUE_TO_I32(l) & VALUE_TO_I32(r) : VALUE_TO_I32(l) | VALUE_TO_I32(r));
+            return true;
+        }
+        if (BOTH_IS(U32)) {
+            *res = U32_TO_VALUE(is_and ? VALUE_TO_U32(l) & VALUE_TO_U32(r) : VALUE_TO_U32(l) | VALUE_TO_U32(r));
+            return true;
+        }
+        return false;
+    }
+
+    if (IS_OP("^")) {
+        // i32 没有 ^ 运算符
+        if (BOTH_IS(U32)) {
+            *res = U32_TO_VALUE(VALUE_TO_U32(l) ^ VALUE_TO_U32(r));
+            return true;
+        }
+        return false;
+    }
+
+    if (IS_OP("<<") || IS_OP(">>")) {
+        // 移位数超出范围时结果依赖平台，留给运行时
+        bool is_left = op[0] == '<';
+        if (BOTH_IS(I32) && VALUE_TO_I32(r) >= 0 && VALUE_TO_I32(r) < 32) {
+            i32 a = VALUE_TO_I32(l), b = VALUE_TO_I32(r);
+            *res = I32_TO_VALUE(is_left ? (i32)((u32)a << b) : a >> b);
+            return true;
+        }
+        if (BOTH_IS(U32) && VALUE_TO_U32(r) < 32) {
+            u32 a = VALUE_TO_U32(l), b = VALUE_TO_U32(r);
+            *res = U32_TO_VALUE(is_left ? a << b : a >> b);
+            return true;
+        }
+        return false;
+    }
+
+    return false;
+}
+
+#undef IS_OP
+#undef WRAP_I32
+#undef AS_F64
+#undef BOTH_IS_I32_OR_F64
+#undef BOTH_IS
+
+// 计算 op val，不能在编译期确定结果时返回 false
+static bool fold_prefix(const char* op, Value val, Value* res) {
+    if (strcmp(op, "!") == 0) {
+        // bool 取反，null 为 true，其余对象使用 Object 的 !，结果为 false
+        *res = BOOL_TO_VALUE(VALUE_IS_FALSE(val) || VALUE_IS_NULL(val));
+        return true;
+    }
+
+    if (strcmp(op, "-") == 0) {
+        if (VALUE_IS_I32(val)) {
+            *res = I32_TO_VALUE((i32)(0u - (u32)VALUE_TO_I32(val)));
+            return true;
+        }
+        if (VALUE_IS_U32(val)) {
+            // 与 u32 的 - 一致，结果为 i32
+            *res = I32_TO_VALUE((i32)(0u - VALUE_TO_U32(val)));
+            return true;
+        }
+        if (VALUE_IS_F64(val)) {
+            *res = F64_TO_VALUE(-VALUE_TO_F64(val));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void optimize_args(VM* vm, u32 argc, AST_Expr* args[MAX_ARG_NUM]) {
+    for (u32 i = 0; i < argc; i++) {
+        optimize_expr(vm, args[i]);
+    }
+}
+
+static void optimize_expr(VM* vm, AST_Expr* expr) {
+    switch (expr->type) {
+        case AST_ARRAY_LITERAL: {
+            struct AST_ArrayItem* item = expr->expr.array_literal.head;
+            while (item != NULL) {
+                optimize_expr(vm, item->item);
+                item = item->next;
+            }
+            break;
+        }
+        case AST_MAP_LITERAL: {
+            struct AST_MapEntry* entry = expr->expr.map_literal.entrys;
+            while (entry != NULL) {
+                optimize_expr(vm, entry->key);
+                optimize_expr(vm, entry->val);
+                entry = entry->next;
+            }
+            break;
+        }
+
+        case AST_ASSIGN_EXPR:
+            if (expr->expr.assign.expr != NULL) {
+                optimize_expr(vm, expr->expr.assign.expr);
+            }
+            break;
+        case AST_ID_CALL_EXPR:
+            optimize_args(vm, expr->expr.id_call.argc, expr->expr.id_call.args);
+            break;
+
+        case AST_INFIX_EXPR: {
+            AST_InfixExpr* infix = &expr->expr.infix;
+            optimize_expr(vm, infix->l);
+            optimize_expr(vm, infix->r);
+
+            Value l, r, res;
+            if (literal_value(infix->l, &l) && literal_value(infix->r, &r) && fold_infix(vm, infix->op, l, r, &res)) {
+                destroy_ast_expr(infix->l);
+                destroy_ast_expr(infix->r);
+                set_literal(expr, res);
+            }
+            break;
+        }
+        case AST_PREFIX_EXPR: {
+            AST_PrefixExpr* prefix = &expr->expr.prefix;
+            optimize_expr(vm, prefix->expr);
+
+            Value val, res;
+            if (literal_value(prefix->expr, &val) && fold_prefix(prefix->op, val, &res)) {
+                destroy_ast_expr(prefix->expr);
+                set_literal(expr, res);
+            }
+            break;
+        }
+
+        case AST_LOGICAL_OR:
+        case AST_LOGICAL_AND: {
+            AST_LogicalCmpExpr* cmp = &expr->expr.logical_cmp;
+            optimize_expr(vm, cmp->l);
+            optimize_expr(vm, cmp->r);
+
+            int truth = literal_truth(cmp->l);
+            if (truth == -1) {
+                break;
+            }
+            // 左侧决定结果时表达式的值为左侧的值，否则为右侧的值
+            bool take_l = expr->type == AST_LOGICAL_OR ? truth == 1 : truth == 0;
+            AST_Expr* l = cmp->l;
+            AST_Expr* r = cmp->r;
+            if (take_l) {
+                destroy_ast_expr(r);
+                replace_with_child(expr, l);
+            } else {
+                destroy_ast_expr(l);
+                replace_with_child(expr, r);
+            }
+            break;
+        }
+
+        case AST_CALL_METHOD_EXPR:
+            optimize_expr(vm, expr->expr.call_method.obj);
+            optimize_args(vm, expr->expr.call_method.argc, expr->expr.call_method.args);
+            break;
+        case AST_GETTER_EXPR:
+            optimize_expr(vm, expr->expr.getter.obj);
+            break;
+        case AST_SETTER_EXPR:
+            optimize_expr(vm, expr->expr.setter.obj);
+            if (expr->expr.setter.val != NULL) {
+                optimize_expr(vm, expr->expr.setter.val);
+            }
+            break;
+        case AST_SUBSCRIPT_EXPR:
+        case AST_SUBSCRIPT_SETTER_EXPR:
+            optimize_expr(vm, expr->expr.subscript.obj);
+            optimize_args(vm, expr->expr.subscript.argc, expr->expr.subscript.args);
+            break;
+
+        case AST_SUPER_EXPR: {
+            AST_SuperCallExpr* super = &expr->expr.super_call;
+            switch (super->type) {
+                case SUPER_METHOD:
+                    optimize_args(vm, super->call_method.method.argc, super->call_method.method.args);
+                    break;
+                case SUPER_SUBSCRIPT:
+                case SUPER_SUBSCRIPT_SETTER:
+                    optimize_args(vm, super->call_method.subscript.argc, super->call_method.subscript.args);
+                    break;
+                case SUPER_SETTER:
+                    if (super->call_method.setter_value != NULL) {
+                        optimize_expr(vm, super->call_method.setter_value);
+                    }
+                    break;
+                case SUPER_GETTER:
+                    break;
+            }
+            break;
+        }
+
+        case AST_CONDITION_EXPR: {
+            AST_ConditionExpr* cond = &expr->expr.condition_expr;
+            optimize_expr(vm, cond->condition);
+            optimize_expr(vm, cond->true_val);
+            optimize_expr(vm, cond->false_val);
+
+            int truth = literal_truth(cond->condition);
+            if (truth == -1) {
+                break;
+            }
+            AST_Expr* taken = truth ? cond->true_val : cond->false_val;
+            destroy_ast_expr(cond->condition);
+            destroy_ast_expr(truth ? cond->false_val : cond->true_val);
+            replace_with_child(expr, taken);
+            break;
+        }
+
+        case AST_CLOSURE_EXPR:
+            optimize_block(vm, expr->expr.closure.body);
+            break;
+
+        case AST_LITERAL_TRUE:
+        case AST_LITERAL_FALSE:
+        case AST_LITERAL_NULL:
+        case AST_LITERAL_EXPR:
+        case AST_ID_EXPR:
+        case AST_SELF_EXPR:
+            // do noting
+            break;
+    }
+}
+
+static void optimize_stmt(VM* vm, AST_Stmt* stmt);
+
+// 返回只含 stmt 一条语句的 block
+static AST_Block* block_of_stmt(AST_Stmt* stmt) {
+    AST_Block* block = malloc(sizeof(AST_Block));
+    struct AST_BlockContext* context = malloc(sizeof(struct AST_BlockContext));
+    context->stmt = stmt;
+    context->next = NULL;
+    block->head = context;
+    block->tail = context;
+    return block;
+}
+
+// 化简 if 语句。条件为字面量时返回取代整条 if 语句的 block（可能为空），
+// 此时 if_stmt 中的内容已被释放或移入返回的 block；否则返回 NULL，if_stmt 仍是 if 语句。
+static AST_Block* optimize_if_stmt(VM* vm, AST_IfStmt* if_stmt) {
+    optimize_expr(vm, if_stmt->condition);
+    optimize_block(vm, if_stmt->then_block);
+
+    if (if_stmt->else_type == ELSE_IF) {
+        AST_IfStmt* else_if = if_stmt->else_branch.else_if;
+        AST_Block* block = optimize_if_stmt(vm, else_if);
+        if (block != NULL) {
+            free(else_if);
+            if_stmt->else_type = ELSE_BLOCK;
+            if_stmt->else_branch.block = block;
+        }
+    } else if (if_stmt->else_type == ELSE_BLOCK) {
+        optimize_block(vm, if_stmt->else_branch.block);
+    }
+
+    int truth = literal_truth(if_stmt->condition);
+    if (truth == -1) {
+        return NULL;
+    }
+    destroy_ast_expr(if_stmt->condition);
+
+    if (truth == 1) {
+        if (if_stmt->else_type == ELSE_BLOCK) {
+            destroy_ast_block(if_stmt->else_branch.block);
+        } else if (if_stmt->else_type == ELSE_IF) {
+            destroy_ast_if_stmt(if_stmt->else_branch.else_if);
+            free(if_stmt->else_branch.else_if);
+        }
+        return if_stmt->then_block;
+    }
+
+    destroy_ast_block(if_stmt->then_block);
+    switch (if_stmt->else_type) {
+        case ELSE_BLOCK:
+            return if_stmt->else_branch.block;
+        case ELSE_IF: {
+            // 条件不是字面量的 else-if 成为独立的 if 语句
+            AST_Stmt* stmt = malloc(sizeof(AST_Stmt));
+            stmt->type = AST_IF_STMT;
+            stmt->stmt.if_stmt = *if_stmt->else_branch.else_if;
+            free(if_stmt->else_branch.else_if);
+            return block_of_stmt(stmt);
+        }
+        case ELSE_NONE:
+        default: {
+            AST_Block* empty = malloc(sizeof(AST_Block));
+            empty->head = NULL;
+            empty->tail = NULL;
+            return empty;
+        }
+    }
+}
+
+static void optimize_stmt(VM* vm, AST_Stmt* stmt) {
+    switch (stmt->type) {
+        case AST_IF_STMT: {
+            AST_Block* block = optimize_if_stmt(vm, &stmt->stmt.if_stmt);
+            if (block != NULL) {
+                // 保留的分支仍作为 block 编译，其中的局部变量作用域不变
+                stmt->type = AST_BLOCK;
+                stmt->stmt.block = *block;
+                free(block);
+            }
+            break;
+        }
+        case AST_WHILE_STMT:
+            // 条件为 false 或 null 的循环由 generate_ast_while_stmt 整体跳过
+            optimize_expr(vm, stmt->stmt.while_stmt.condition);
+            optimize_block(vm, stmt->stmt.while_stmt.body);
+            break;
+        case AST_RETURN_STMT:
+            if (stmt->stmt.ret_stmt_res != NULL) {
+                optimize_expr(vm, stmt->stmt.ret_stmt_res);
+            }
+            break;
+        case AST_BLOCK:
+            optimize_block(vm, &stmt->stmt.block);
+            break;
+        case AST_EXPRESSION_STMT:
+            optimize_expr(vm, stmt->stmt.expr_stmt);
+            break;
+        case AST_VAR_DEF_STMT:
+            if (stmt->stmt.var_def.init_val != NULL) {
+                optimize_expr(vm, stmt->stmt.var_def.init_val);
+            }
+            break;
+        case AST_BREAK_STMT:
+        case AST_CONTINUE_STMT:
+            // do noting
+            break;
+    }
+}
+
+static void optimize_block(VM* vm, AST_Block* block) {
+    struct AST_BlockContext* context = block->head;
+    while (context != NULL) {
+        optimize_stmt(vm, context->stmt);
+        context = context->next;
+    }
+}
+
+static void optimize_class_def(VM* vm, AST_ClassDef* class_def) {
+    if (class_def->super != NULL) {
+        optimize_expr(vm, class_def->super);
+    }
+
+    struct _ClassFields* field = class_def->fields;
+    while (field != NULL) {
+        if (field->init_val != NULL) {
+            optimize_expr(vm, field->init_val);
+        }
+        field = field->next;
+    }
+
+    struct _ClassMethod* method = class_def->methods;
+    while (method != NULL) {
+        optimize_block(vm, method->body);
+        method = method->next;
+    }
+}
+
+void optimize_ast_prog(VM* vm, AST_Prog* prog) {
+    AST_FuncDef* func = prog->func_def_head;
+    while (func != NULL) {
+        optimize_block(vm, func->body);
+        func = func->next;
+    }
+
+    AST_ClassDef* class_def = prog->class_def_head;
+    while (class_def != NULL) {
+        optimize_class_def(vm, class_def);
+        class_def = class_def->next;
+    }
+
+    struct AST_ToplevelStmt* stmt = prog->toplevel_head;
+    while (stmt != NULL) {
+        optimize_stmt(vm, stmt->stmt);
+        stmt = stmt->next;
+    }
+}
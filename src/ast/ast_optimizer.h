@@ -0,0 +1,9 @@
+#ifndef __AST_OPTIMIZER_H__
+#define __AST_OPTIMIZER_H__
+
+#include "ast.h"
+
+// 生成字节码前对 ast 做常量折叠及死分支消除，原地修改 prog
+void optimize_ast_prog(VM* vm, AST_Prog* prog);
+
+#endif
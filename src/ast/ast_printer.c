@@ -9,18 +9,18 @@ void print_block_inline(FILE* file, AST_Block* block);
 void print_ast_block(FILE* file, AST_Block* block);
 
 void fprint_value(FILE* file, Value* val) {
-    switch (val->type) {
+    switch (VALUE_TYPE(*val)) {
         case VT_I32:
-            fprintf(file, "<i32 %d>", val->i32val);
+            fprintf(file, "<i32 %d>", VALUE_TO_I32(*val));
             break;
         case VT_U32:
-            fprintf(file, "<u32 %u>", val->u32val);
+            fprintf(file, "<u32 %u>", VALUE_TO_U32(*val));
             break;
         case VT_U8:
-            fprintf(file, "<u8 %u>", val->u8val);
+            fprintf(file, "<u8 %u>", VALUE_TO_U8(*val));
             break;
         case VT_F64:
-            fprintf(file, "<f64 %lf>", val->f64val);
+            fprintf(file, "<f64 %lf>", VALUE_TO_F64(*val));
             break;
         case VT_TRUE:
             fprintf(file, "<bool true>");
@@ -35,7 +35,7 @@ void fprint_value(FILE* file, Value* val) {
             fprintf(file, "<?undefined?>");
             break;
         case VT_OBJ: {
-            ObjHeader* obj = val->header;
+            ObjHeader* obj = VALUE_TO_OBJ(*val);
             switch (obj->type) {
                 case OT_STRING: {
                     fprintf(file, "<String '%s' at %p>", ((ObjString*)obj)->val.start, obj);
@@ -1,7 +1,11 @@
 #include "class.h"
 #include "common.h"
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "obj_string.h"
 #include "vm.h"
 #include "core.h"
@@ -15,12 +19,44 @@ static void run_file(const char* path) {
         root_dir = root;
     }
 
-    VM* vm = vm_new();
+    // SPR_CORE_SNAPSHOT 指定由 --dump-core-snapshot 生成的核心模块快照
+    const char* snapshot_path = getenv("SPR_CORE_SNAPSHOT");
+    void* snapshot = MAP_FAILED;
+    usize snapshot_size = 0;
+    if (snapshot_path != NULL) {
+        int fd = open(snapshot_path, O_RDONLY);
+        struct stat snapshot_stat;
+        if (fd != -1 && fstat(fd, &snapshot_stat) == 0 && snapshot_stat.st_size > 0) {
+            snapshot_size = snapshot_stat.st_size;
+            snapshot = mmap(NULL, snapshot_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    VM* vm = NULL;
+    if (snapshot == MAP_FAILED) {
+        if (snapshot_path != NULL) {
+            fprintf(stderr, "warning: could not open core snapshot '%s', compiling core module.\n", snapshot_path);
+        }
+        vm = vm_new();
+    } else {
+        bool loaded = false;
+        vm = vm_new_from_snapshot(snapshot, snapshot_size, &loaded);
+        // 快照过期或损坏时已退回到编译核心模块，提示重新生成
+        if (!loaded) {
+            fprintf(stderr, "warning: core snapshot '%s' is stale or corrupt, compiling core module.\n", snapshot_path);
+        }
+    }
     const char* src = read_file(path);
 
     execute_module(vm, OBJ_TO_VALUE(objstring_new(vm, path, strlen(path))), src);
 
     vm_free(vm);
+    if (snapshot != MAP_FAILED) {
+        munmap(snapshot, snapshot_size);
+    }
 }
 
 int main(int argc, char* argv[]) {
@@ -28,8 +64,17 @@ int main(int argc, char* argv[]) {
         case 2:
             run_file(argv[1]);
             break;
+        case 3:
+            if (strcmp(argv[1], "--dump-core-snapshot") == 0) {
+                if (!vm_dump_core_snapshot(argv[2])) {
+                    fprintf(stderr, "failed to write core snapshot '%s'.\n", argv[2]);
+                    return 1;
+                }
+                break;
+            }
+            // fallthrough
         default:
-            fprintf(stderr, "usage: %s <file-name>\n", argv[0]);
+            fprintf(stderr, "usage: %s <file-name>\n       %s --dump-core-snapshot <snapshot-path>\n", argv[0], argv[0]);
     }
     return 0;
 }
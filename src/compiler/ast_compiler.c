@@ -1,5 +1,6 @@
 #include "ast_compiler.h"
 #include "ast.h"
+#include "ast_optimizer.h"
 #include "class.h"
 #include "common.h"
 #include "compiler.h"
@@ -18,9 +19,10 @@
 static char* local_var_names[MAX_LOCAL_VAR_NUM] = {0};
 static u32 local_var_names_count = 0;
 
-static inline void generate_para_list(CompileUnitPubStruct* cu, u32 argc, ScriptID arg_names[MAX_FIELD_NUM]) {
+static inline void generate_para_list(CompileUnitPubStruct* cu, u32 argc, ScriptID arg_names[MAX_ARG_NUM], TypeHint arg_types[MAX_ARG_NUM]) {
     for (int i = 0; i < argc; i++) {
-        declare_variable(cu, arg_names[i].start, arg_names[i].len);
+        int index = declare_variable(cu, arg_names[i].start, arg_names[i].len);
+        cu->local_vars[index].type = arg_types[i];
     }
 }
 
@@ -28,12 +30,18 @@ void generate_ast_expr(CompileUnitPubStruct* cu, AST_Expr* expr);
 void generate_ast_block(CompileUnitPubStruct* cu, AST_Block* block);
 
 void generate_ast_array_literal(CompileUnitPubStruct* cu, AST_ArrayLiteral* arr) {
-    // 新建 List 对象
-    emit_load_module_var(cu, "List");
-    emit_call(cu, 0, "new()", 5);
-    
-    // 填入 item
+    // 前 UINT16_MAX 个 item 依次压栈，由 MAKE_LIST 一次创建 List
+    u32 count = 0;
     struct AST_ArrayItem* item = arr->head;
+    while (item != NULL && count < UINT16_MAX) {
+        generate_ast_expr(cu, item->item);
+        count++;
+        item = item->next;
+    }
+    write_opcode_short_operand(cu, OPCODE_MAKE_LIST, count);
+    cu->stack_slot_num -= count;
+
+    // 超出操作数范围的 item 逐个填入
     while (item != NULL) {
         generate_ast_expr(cu, item->item);
         emit_call(cu, 1, "core_append(_)", 14);
@@ -42,12 +50,19 @@ void generate_ast_array_literal(CompileUnitPubStruct* cu, AST_ArrayLiteral* arr)
 }
 
 void generate_ast_map_literal(CompileUnitPubStruct* cu, AST_MapLiteral* map) {
-    // 新建 Map 对象
-    emit_load_module_var(cu, "Map");
-    emit_call(cu, 0, "new()", 5);
-
-    // 填入 entres
+    // 前 UINT16_MAX 个 entry 的 key、value 依次压栈，由 MAKE_MAP 一次创建容量足够的 Map
+    u32 count = 0;
     struct AST_MapEntry* entry = map->entrys;
+    while (entry != NULL && count < UINT16_MAX) {
+        generate_ast_expr(cu, entry->key);
+        generate_ast_expr(cu, entry->val);
+        count++;
+        entry = entry->next;
+    }
+    write_opcode_short_operand(cu, OPCODE_MAKE_MAP, count);
+    cu->stack_slot_num -= count * 2;
+
+    // 超出操作数范围的 entry 逐个填入
     while (entry != NULL) {
         generate_ast_expr(cu, entry->key);
         generate_ast_expr(cu, entry->val);
@@ -307,6 +322,90 @@ void generate_ast_self_expr(CompileUnitPubStruct* cu) {
     emit_load_self(cu);
 }
 
+// 有专用指令的二元运算符，操作数为数字时由虚拟机直接计算
+static const struct {
+    const char* op;
+    OpCode opcode;
+} binary_operators[] = {
+    {"+", OPCODE_ADD},
+    {"-", OPCODE_SUB},
+    {"*", OPCODE_MUL},
+    {"/", OPCODE_DIV},
+    {"%", OPCODE_MOD},
+    {"<", OPCODE_LT},
+    {"<=", OPCODE_LE},
+    {">", OPCODE_GT},
+    {">=", OPCODE_GE},
+    {"==", OPCODE_EQ},
+    {"!=", OPCODE_NE},
+    {"&", OPCODE_BIT_AND},
+    {"|", OPCODE_BIT_OR},
+    {"^", OPCODE_BIT_XOR},
+    {"<<", OPCODE_BIT_SL},
+    {">>", OPCODE_BIT_SR},
+};
+
+// 两侧操作数类型已知时选择特化指令，不能特化时返回 OPCODE_END
+static OpCode specialized_operator(const char* op, TypeHint l, TypeHint r) {
+    if (l == TYPE_HINT_ANY || r == TYPE_HINT_ANY) {
+        return OPCODE_END;
+    }
+
+    if (l == TYPE_HINT_I32 && r == TYPE_HINT_I32) {
+        // i32 除法需处理除零，不做特化
+        if (strcmp(op, "+") == 0) return OPCODE_ADD_I32;
+        if (strcmp(op, "-") == 0) return OPCODE_SUB_I32;
+        if (strcmp(op, "*") == 0) return OPCODE_MUL_I32;
+        return OPCODE_END;
+    }
+
+    if (strcmp(op, "+") == 0) return OPCODE_ADD_F64;
+    if (strcmp(op, "-") == 0) return OPCODE_SUB_F64;
+    if (strcmp(op, "*") == 0) return OPCODE_MUL_F64;
+    if (strcmp(op, "/") == 0) return OPCODE_DIV_F64;
+    return OPCODE_END;
+}
+
+// 由字面量及带类型注释的局部变量推断表达式的类型，推断不出时为 TYPE_HINT_ANY
+static TypeHint expr_type(CompileUnitPubStruct* cu, AST_Expr* expr) {
+    switch (expr->type) {
+        case AST_LITERAL_EXPR:
+            if (VALUE_IS_I32(expr->expr.literal)) {
+                return TYPE_HINT_I32;
+            }
+            if (VALUE_IS_F64(expr->expr.literal)) {
+                return TYPE_HINT_F64;
+            }
+            return TYPE_HINT_ANY;
+
+        case AST_ID_EXPR: {
+            // upvalue 与模块变量可能在别处被修改，不做推断
+            int index = find_local(cu, expr->expr.id.start, expr->expr.id.len);
+            return index == -1 ? TYPE_HINT_ANY : cu->local_vars[index].type;
+        }
+
+        case AST_INFIX_EXPR: {
+            // 与特化指令的结果一致：i32 的 + - * 仍为 i32，有 f64 参与的 + - * / 为 f64
+            const char* op = expr->expr.infix.op;
+            TypeHint l = expr_type(cu, expr->expr.infix.l);
+            TypeHint r = expr_type(cu, expr->expr.infix.r);
+            switch (specialized_operator(op, l, r)) {
+                case OPCODE_ADD_I32:
+                case OPCODE_SUB_I32:
+                case OPCODE_MUL_I32:
+                    return TYPE_HINT_I32;
+                case OPCODE_END:
+                    return TYPE_HINT_ANY;
+                default:
+                    return TYPE_HINT_F64;
+            }
+        }
+
+        default:
+            return TYPE_HINT_ANY;
+    }
+}
+
 void generate_ast_infix_expr(CompileUnitPubStruct* cu, AST_InfixExpr* infix) {
     // 调用栈准备
     generate_ast_expr(cu, infix->l);
@@ -317,6 +416,20 @@ void generate_ast_infix_expr(CompileUnitPubStruct* cu, AST_InfixExpr* infix) {
         .len = strlen(infix->op),
         .argc = 1,
     };
+
+    OpCode specialized = specialized_operator(infix->op, expr_type(cu, infix->l), expr_type(cu, infix->r));
+    if (specialized != OPCODE_END) {
+        emit_binary_operator(cu, &sign, specialized);
+        return;
+    }
+
+    for (u32 i = 0; i < sizeof(binary_operators) / sizeof(binary_operators[0]); i++) {
+        if (strcmp(infix->op, binary_operators[i].op) == 0) {
+            emit_binary_operator(cu, &sign, binary_operators[i].opcode);
+            return;
+        }
+    }
+
     emit_call_by_signature(cu, &sign, OPCODE_CALL0);
 }
 
@@ -406,7 +519,7 @@ void generate_ast_closure_expr(CompileUnitPubStruct* cu, AST_ClosureExpr* closur
     compile_unit_pubstruct_init(cu->vm, cu->cur_module, &fncu, cu, false);
 
     fncu.fn->argc = closure->argc;
-    generate_para_list(&fncu, closure->argc, closure->arg_names);
+    generate_para_list(&fncu, closure->argc, closure->arg_names, closure->arg_types);
 
     generate_ast_block(&fncu, closure->body);
 
@@ -587,6 +700,9 @@ void generate_ast_var_def_stmt(CompileUnitPubStruct* cu, AST_VarDef* def) {
     }
     
     u32 index = declare_variable(cu, def->name.start, def->name.len);
+    if (cu->scope_depth != -1) {
+        cu->local_vars[index].type = def->type;
+    }
     define_variable(cu, index);
 }
 
@@ -670,7 +786,7 @@ void generate_ast_func_def(CompileUnitPubStruct* cu, AST_FuncDef* func) {
     CompileUnitPubStruct fncu;
     compile_unit_pubstruct_init(cu->vm, cu->cur_module, &fncu, cu, false);
 
-    generate_para_list(&fncu, func->argc, func->arg_names);
+    generate_para_list(&fncu, func->argc, func->arg_names, func->arg_types);
     fncu.fn->argc = func->argc;
 
     generate_ast_block(&fncu, func->body);
@@ -704,7 +820,7 @@ void generate_ast_class_def(CompileUnitPubStruct* cu, AST_ClassDef* class_def) {
         .name = class_def->name,
         .in_static = false,
     };
-    BufferInit(String, &clsbk.fields);
+    symbol_table_init(&clsbk.fields);
     BufferInit(Int, &clsbk.instant_methods);
     BufferInit(Int, &clsbk.static_methods);
     cu->enclosing_classbk = &clsbk;
@@ -787,7 +903,8 @@ void generate_ast_class_def(CompileUnitPubStruct* cu, AST_ClassDef* class_def) {
         compile_unit_pubstruct_init(cu->vm, cu->cur_module, &method_cu, cu, true);
 
         // 声明型参
-        generate_para_list(&method_cu, method->argc, method->arg_names);
+        generate_para_list(&method_cu, method->argc, method->arg_names, method->arg_types);
+        method_cu.fn->argc = method->argc;
 
         // 声明方法
         char sign_str[MAX_SIGN_LEN] = {0};
@@ -824,6 +941,7 @@ void generate_ast_class_def(CompileUnitPubStruct* cu, AST_ClassDef* class_def) {
 
 void ast_compile_program(CompileUnitPubStruct* cu, Parser* parser) {
     AST_Prog* prog = compile_prog(parser);
+    optimize_ast_prog(cu->vm, prog);
     
 #ifdef DUMP_AST_WHEN_COMPILE_PROG
     char buf[512] = {0};
@@ -0,0 +1,819 @@
+#include "bytecode_cache.h"
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "class.h"
+#include "compiler.h"
+#include "core.h"
+#include "gc.h"
+#include "obj_string.h"
+#include "opcode.h"
+#include "peephole.h"
+#include "vm.h"
+
+/**
+ * 缓存文件布局，多字节整数均为小端：
+ * [4b "SPC\0"] [u32 版本] [u32 指令集指纹] [u64 源文件大小] [u64 源文件 mtime 秒] [u32 纳秒]
+ *   > 核心模块快照没有源文件，记录 core_module_code 的长度和 hash，mtime 为 0
+ * [u32 继承的核心模块变量数] [u32 核心模块变量名指纹] [u32 校验和]
+ *   > 校验和为其后全部内容的 hash_string，不一致时整个缓存失效
+ * [u32 n] n 个模块变量名          : 编译成功后模块自身定义的变量，值均为 null
+ * [u32 n] n 个方法名              : 指令中的方法下标为此表的下标，加载时映射回 vm->all_method_names
+ * 顶层函数
+ *
+ * 函数: [u8 argc] [u32 upvalue_number] [u32 max_stack_slot_used] [u32 inline_cache_number]
+ *       [u32 n] n 个常量 [u32 n] n 字节指令 [u32 n] n 个行号
+ * 常量: [u8 tag] payload。tag 为 ValueType，字符串与函数分别为 CONST_STRING 和 CONST_FN，函数常量递归写入
+ * 字符串: [u32 len] len 字节
+ */
+
+#define CACHE_MAGIC "SPC"
+
+typedef enum {
+    CONST_STRING = VT_OBJ + 1,
+    CONST_FN,
+} ConstTag;
+
+// 指令集的任何变化都使旧缓存失效
+#define OPCODE_SLOTS(op, effect) #op ":" #effect ";"
+static const char opcode_signature[] =
+    #include "opcode.inc"
+;
+#undef OPCODE_SLOTS
+
+typedef struct {
+    u32* to_local; // 全局方法下标 -> 缓存中的下标，未使用的为 UINT32_MAX
+    u32* to_global; // 缓存中的下标 -> 全局方法下标
+    u32 count;
+} MethodRemap;
+
+// 源文件的标识，与缓存中记录的不一致时缓存失效
+typedef struct {
+    u64 size;
+    u64 mtime_sec;
+    u32 mtime_nsec;
+} SourceStamp;
+
+// 先写入内存，全部内容写完后才能计算校验和
+typedef struct {
+    u8* datas;
+    usize count;
+    usize capacity;
+    bool ok;
+} Writer;
+
+typedef struct {
+    const u8* cur;
+    const u8* end;
+    bool ok;
+} Reader;
+
+// 校验指令操作数的上限，均在读取整个文件之前确定
+typedef struct {
+    u32 method_num; // 缓存中的方法名数
+    u32 module_var_num; // 缓存加载成功后模块变量的总数
+} CacheBounds;
+
+char* bytecode_cache_path(const char* src_path) {
+    // foo.sp -> foo.spc，其它扩展名直接追加
+    usize len = strlen(src_path);
+    usize ext_len = strlen(SCRIPT_EXTENSION);
+    if (len >= ext_len && strcmp(src_path + len - ext_len, SCRIPT_EXTENSION) == 0) {
+        len -= ext_len;
+    }
+
+    usize cache_ext_len = strlen(BYTECODE_CACHE_EXTENSION);
+    char* path = malloc(len + cache_ext_len + 1);
+    if (path == NULL) {
+        MEM_ERROR("memory error when make bytecode cache path.");
+    }
+    memcpy(path, src_path, len);
+    memcpy(path + len, BYTECODE_CACHE_EXTENSION, cache_ext_len + 1);
+    return path;
+}
+
+static u32 hash_inherited_vars(ObjModule* module, u32 count) {
+    u32 hash = count;
+    for (u32 i = 0; i < count; i++) {
+        String name = module->module_var_name.datas[i];
+        hash = hash * 31 ^ hash_string(name.str, name.len);
+    }
+    return hash;
+}
+
+static SourceStamp file_stamp(struct stat* file_stat) {
+    return (SourceStamp){
+        .size = (u64)file_stat->st_size,
+        .mtime_sec = (u64)file_stat->st_mtim.tv_sec,
+        .mtime_nsec = (u32)file_stat->st_mtim.tv_nsec,
+    };
+}
+
+static SourceStamp code_stamp(const char* code) {
+    u32 len = strlen(code);
+    return (SourceStamp){
+        .size = len,
+        .mtime_sec = hash_string((char*)code, len),
+        .mtime_nsec = 0,
+    };
+}
+
+static bool has_method_operand(OpCode op) {
+    return (op >= OPCODE_CALL0 && op <= OPCODE_SUPER16)
+        || (op >= OPCODE_ADD && op <= OPCODE_BIT_SR)
+        || (op >= OPCODE_LT_JMP_IF_FALSE && op <= OPCODE_NE_JMP_IF_FALSE)
+        || (op >= OPCODE_ADD_I32 && op <= OPCODE_DIV_F64)
+        || (op >= OPCODE_LIST_SUBSCRIPT && op <= OPCODE_MAP_SUBSCRIPT)
+        || op == OPCODE_INSTANCE_METHOD || op == OPCODE_STATIC_METHOD;
+}
+
+static bool value_is_fn(Value val) {
+    return VALUE_IS_OBJ(val) && VALUE_TO_OBJ(val)->type == OT_FUNCTION;
+}
+
+// ========== 写入 ==========
+
+static void write_bytes(Writer* w, const void* data, usize len) {
+    if (!w->ok || len == 0) {
+        return;
+    }
+    if (w->count + len > w->capacity) {
+        usize capacity = w->capacity == 0 ? DEFAULT_BUFFER_SIZE : w->capacity;
+        while (capacity < w->count + len) {
+            capacity *= 2;
+        }
+        u8* datas = realloc(w->datas, capacity);
+        if (datas == NULL) {
+            w->ok = false;
+            return;
+        }
+        w->datas = datas;
+        w->capacity = capacity;
+    }
+    memcpy(w->datas + w->count, data, len);
+    w->count += len;
+}
+
+static void write_u8(Writer* w, u8 val) {
+    write_bytes(w, &val, 1);
+}
+
+static void write_u32(Writer* w, u32 val) {
+    u8 bytes[4] = {val, val >> 8, val >> 16, val >> 24};
+    write_bytes(w, bytes, 4);
+}
+
+static void write_u64(Writer* w, u64 val) {
+    write_u32(w, (u32)val);
+    write_u32(w, (u32)(val >> 32));
+}
+
+static void write_string(Writer* w, const char* str, u32 len) {
+    write_u32(w, len);
+    write_bytes(w, str, len);
+}
+
+static void collect_methods(MethodRemap* remap, ObjFn* fn) {
+    Byte* instr = fn->instr_stream.datas;
+    u32 ip = 0;
+    while (ip < fn->instr_stream.count) {
+        if (has_method_operand(instr[ip])) {
+            u32 index = (instr[ip + 1] << 8) | instr[ip + 2];
+            if (remap->to_local[index] == UINT32_MAX) {
+                remap->to_local[index] = remap->count;
+                remap->to_global[remap->count++] = index;
+            }
+        }
+        ip += 1 + get_byte_of_operands(instr, fn->constants.datas, ip);
+    }
+
+    for (u32 i = 0; i < fn->constants.count; i++) {
+        if (value_is_fn(fn->constants.datas[i])) {
+            collect_methods(remap, VALUE_TO_OBJFN(fn->constants.datas[i]));
+        }
+    }
+}
+
+static void write_fn(Writer* w, MethodRemap* remap, ObjFn* fn);
+
+static void write_constant(Writer* w, MethodRemap* remap, Value val) {
+    ValueType type = VALUE_TYPE(val);
+    switch (type) {
+        case VT_NULL:
+        case VT_FALSE:
+        case VT_TRUE:
+            write_u8(w, type);
+            break;
+        case VT_I32:
+            write_u8(w, type);
+            write_u32(w, (u32)VALUE_TO_I32(val));
+            break;
+        case VT_U32:
+            write_u8(w, type);
+            write_u32(w, VALUE_TO_U32(val));
+            break;
+        case VT_U8:
+            write_u8(w, type);
+            write_u8(w, VALUE_TO_U8(val));
+            break;
+        case VT_F64: {
+            f64 num = VALUE_TO_F64(val);
+            u64 bits;
+            memcpy(&bits, &num, sizeof(bits));
+            write_u8(w, type);
+            write_u64(w, bits);
+            break;
+        }
+        case VT_OBJ:
+            if (VALUE_IS_STRING(val)) {
+                ObjString* str = VALUE_TO_OBJSTR(val);
+                write_u8(w, CONST_STRING);
+                write_string(w, str->val.start, str->val.len);
+            } else if (value_is_fn(val)) {
+                write_u8(w, CONST_FN);
+                write_fn(w, remap, VALUE_TO_OBJFN(val));
+            } else {
+                w->ok = false; // 编译器不会产生其它类型的常量
+            }
+            break;
+        default:
+            w->ok = false;
+            break;
+    }
+}
+
+static void write_fn(Writer* w, MethodRemap* remap, ObjFn* fn) {
+    write_u8(w, fn->argc);
+    write_u32(w, fn->upvalue_number);
+    write_u32(w, fn->max_stack_slot_used);
+    write_u32(w, fn->inline_cache_number);
+
+    write_u32(w, fn->constants.count);
+    for (u32 i = 0; i < fn->constants.count && w->ok; i++) {
+        write_constant(w, remap, fn->constants.datas[i]);
+    }
+
+    // 方法下标改写为缓存中的下标后写入
+    u32 len = fn->instr_stream.count;
+    Byte* instr = malloc(len);
+    if (instr == NULL) {
+        w->ok = false;
+        return;
+    }
+    memcpy(instr, fn->instr_stream.datas, len);
+    u32 ip = 0;
+    while (ip < len) {
+        if (has_method_operand(instr[ip])) {
+            u32 local = remap->to_local[(instr[ip + 1] << 8) | instr[ip + 2]];
+            instr[ip + 1] = (local >> 8) & 0xFF;
+            instr[ip + 2] = local & 0xFF;
+        }
+        ip += 1 + get_byte_of_operands(fn->instr_stream.datas, fn->constants.datas, ip);
+    }
+    write_u32(w, len);
+    write_bytes(w, instr, len);
+    free(instr);
+
+#ifdef DEBUG
+    write_u32(w, fn->debug->line.count);
+    for (u32 i = 0; i < fn->debug->line.count; i++) {
+        write_u32(w, (u32)fn->debug->line.datas[i]);
+    }
+#else
+    write_u32(w, 0);
+#endif
+}
+
+static void write_header(Writer* w, ObjModule* module, u32 inherited_var_num, SourceStamp* stamp) {
+    write_bytes(w, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    write_u32(w, BYTECODE_CACHE_VERSION);
+    write_u32(w, hash_string((char*)opcode_signature, sizeof(opcode_signature) - 1));
+    write_u64(w, stamp->size);
+    write_u64(w, stamp->mtime_sec);
+    write_u32(w, stamp->mtime_nsec);
+    write_u32(w, inherited_var_num);
+    write_u32(w, hash_inherited_vars(module, inherited_var_num));
+}
+
+// 须在模块编译完成、执行之前调用，此时模块变量均未赋值，指令也未被运行时改写
+static bool write_cache(VM* vm, ObjModule* module, u32 inherited_var_num, ObjFn* fn, SourceStamp* stamp, FILE* file) {
+    u32 method_num = vm->all_method_names.count;
+    MethodRemap remap = {
+        .to_local = malloc(sizeof(u32) * (method_num + 1)),
+        .to_global = malloc(sizeof(u32) * (method_num + 1)),
+        .count = 0,
+    };
+    if (remap.to_local == NULL || remap.to_global == NULL) {
+        free(remap.to_local);
+        free(remap.to_global);
+        return false;
+    }
+    memset(remap.to_local, 0xFF, sizeof(u32) * method_num);
+    collect_methods(&remap, fn);
+
+    Writer w = {.datas = NULL, .count = 0, .capacity = 0, .ok = true};
+    write_header(&w, module, inherited_var_num, stamp);
+    usize checksum_pos = w.count;
+    write_u32(&w, 0); // 校验和，写完后回填
+
+    write_u32(&w, module->module_var_name.count - inherited_var_num);
+    for (u32 i = inherited_var_num; i < module->module_var_name.count; i++) {
+        String name = module->module_var_name.datas[i];
+        write_string(&w, name.str, name.len);
+    }
+
+    write_u32(&w, remap.count);
+    for (u32 i = 0; i < remap.count; i++) {
+        String name = vm->all_method_names.datas[remap.to_global[i]];
+        write_string(&w, name.str, name.len);
+    }
+
+    write_fn(&w, &remap, fn);
+
+    usize payload_size = w.count - checksum_pos - 4;
+    if (w.ok && payload_size <= UINT32_MAX) {
+        u32 checksum = hash_string((char*)w.datas + checksum_pos + 4, (u32)payload_size);
+        u8 bytes[4] = {checksum, checksum >> 8, checksum >> 16, checksum >> 24};
+        memcpy(w.datas + checksum_pos, bytes, 4);
+        w.ok = fwrite(w.datas, 1, w.count, file) == w.count;
+    } else {
+        w.ok = false;
+    }
+
+    free(w.datas);
+    free(remap.to_local);
+    free(remap.to_global);
+    return w.ok;
+}
+
+bool bytecode_cache_save(VM* vm, ObjModule* module, u32 inherited_var_num, ObjFn* fn, const char* src_path, const char* cache_path) {
+    struct stat src_stat;
+    if (stat(src_path, &src_stat) != 0) {
+        return false;
+    }
+    SourceStamp stamp = file_stamp(&src_stat);
+
+    // 先写入临时文件再改名，其它进程不会读到写了一半的缓存
+    usize tmp_path_len = strlen(cache_path) + 32;
+    char* tmp_path = malloc(tmp_path_len);
+    if (tmp_path == NULL) {
+        return false;
+    }
+    snprintf(tmp_path, tmp_path_len, "%s.%d.tmp", cache_path, (int)getpid());
+
+    FILE* file = fopen(tmp_path, "wb");
+    bool ok = file != NULL;
+    if (ok) {
+        ok = write_cache(vm, module, inherited_var_num, fn, &stamp, file);
+        ok &= fclose(file) == 0;
+        if (!ok || rename(tmp_path, cache_path) != 0) {
+            remove(tmp_path);
+            ok = false;
+        }
+    }
+
+    free(tmp_path);
+    return ok;
+}
+
+bool bytecode_cache_save_snapshot(VM* vm, ObjModule* module, u32 inherited_var_num, ObjFn* fn, const char* code, FILE* file) {
+    SourceStamp stamp = code_stamp(code);
+    return write_cache(vm, module, inherited_var_num, fn, &stamp, file);
+}
+
+// ========== 读取 ==========
+
+static const u8* read_bytes(Reader* r, usize len) {
+    if (!r->ok || (usize)(r->end - r->cur) < len) {
+        r->ok = false;
+        return NULL;
+    }
+    const u8* bytes = r->cur;
+    r->cur += len;
+    return bytes;
+}
+
+static u8 read_u8(Reader* r) {
+    const u8* bytes = read_bytes(r, 1);
+    return bytes == NULL ? 0 : bytes[0];
+}
+
+static u32 read_u32(Reader* r) {
+    const u8* b = read_bytes(r, 4);
+    return b == NULL ? 0 : (u32)b[0] | ((u32)b[1] << 8) | ((u32)b[2] << 16) | ((u32)b[3] << 24);
+}
+
+static u64 read_u64(Reader* r) {
+    u64 low = read_u32(r);
+    return low | ((u64)read_u32(r) << 32);
+}
+
+static const char* read_string(Reader* r, u32* len) {
+    *len = read_u32(r);
+    return (const char*)read_bytes(r, *len);
+}
+
+static bool read_header(Reader* r, ObjModule* module, SourceStamp* stamp) {
+    const u8* magic = read_bytes(r, sizeof(CACHE_MAGIC));
+    if (magic == NULL || memcmp(magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+        return false;
+    }
+
+    bool valid = read_u32(r) == BYTECODE_CACHE_VERSION;
+    valid &= read_u32(r) == hash_string((char*)opcode_signature, sizeof(opcode_signature) - 1);
+    valid &= read_u64(r) == stamp->size;
+    valid &= read_u64(r) == stamp->mtime_sec;
+    valid &= read_u32(r) == stamp->mtime_nsec;
+
+    // 核心模块变量的下标须与编译时一致
+    u32 inherited_var_num = read_u32(r);
+    valid &= inherited_var_num == module->module_var_name.count;
+    valid &= read_u32(r) == hash_inherited_vars(module, module->module_var_name.count);
+
+    u32 checksum = read_u32(r);
+    usize payload_size = r->end - r->cur;
+    if (!valid || !r->ok || payload_size > UINT32_MAX) {
+        return false;
+    }
+    return hash_string((char*)r->cur, (u32)payload_size) == checksum;
+}
+
+static inline u32 operand_short(Byte* instr, u32 pos) {
+    return (instr[pos] << 8) | instr[pos + 1];
+}
+
+// 超级指令执行时会一并读取后续指令的操作数，后续指令须与生成时相同
+static bool superinstruction_intact(Byte* instr, u32 len, OpCode op, u32 next) {
+    switch (op) {
+        case OPCODE_LOAD_LOCAL_VAR_LOAD_LOCAL_VAR:
+            return instr[next] == OPCODE_LOAD_LOCAL_VAR;
+        case OPCODE_LOAD_LOCAL_VAR_LOAD_CONSTANT:
+            return instr[next] == OPCODE_LOAD_CONSTANT;
+        case OPCODE_LOAD_LOCAL_VAR_LOAD_CONSTANT_CALL1:
+            return instr[next] == OPCODE_LOAD_CONSTANT && next + 3 < len && instr[next + 3] == OPCODE_CALL1;
+        case OPCODE_LOAD_SELF_FIELD_CALL0:
+            return instr[next] == OPCODE_CALL0;
+        case OPCODE_LT_JMP_IF_FALSE:
+        case OPCODE_LE_JMP_IF_FALSE:
+        case OPCODE_GT_JMP_IF_FALSE:
+        case OPCODE_GE_JMP_IF_FALSE:
+        case OPCODE_EQ_JMP_IF_FALSE:
+        case OPCODE_NE_JMP_IF_FALSE:
+            return instr[next] == OPCODE_JMP_IF_FALSE;
+        default:
+            return true;
+    }
+}
+
+// 校验指令流：每个操作数都须落在函数的常量表、局部变量、upvalue、模块变量和方法名表的范围内，
+// 跳转目标与栈深度由 peephole_verify_stack 沿控制流检查。initial_slots 为 0 时是顶层函数。
+// 此时方法下标仍是缓存中的下标，整个文件校验通过后才映射回 vm->all_method_names
+static bool validate_instr(ObjFn* fn, CacheBounds* bounds, u32 initial_slots) {
+    Byte* instr = fn->instr_stream.datas;
+    u32 len = fn->instr_stream.count;
+    u32 local_num = fn->argc + fn->max_stack_slot_used; // 栈帧中可用的槽数，含形参
+    u32 loop_num = 0;
+    u32 ip = 0;
+    OpCode last = OPCODE_END;
+
+    while (ip < len) {
+        OpCode op = instr[ip];
+        if (op > OPCODE_END) {
+            return false;
+        }
+        if (op == OPCODE_CREATE_CLOSURE) {
+            if (ip + 2 >= len) {
+                return false;
+            }
+            u32 fn_idx = operand_short(instr, ip + 1);
+            if (fn_idx >= fn->constants.count || !value_is_fn(fn->constants.datas[fn_idx])) {
+                return false;
+            }
+        }
+
+        u32 operand_len = get_byte_of_operands(instr, fn->constants.datas, ip);
+        if (ip + operand_len >= len) {
+            return false;
+        }
+
+        bool valid = true;
+        switch (op) {
+            case OPCODE_LOAD_CONSTANT: {
+                // 函数常量只由 CREATE_CLOSURE 使用
+                u32 index = operand_short(instr, ip + 1);
+                valid = index < fn->constants.count && !value_is_fn(fn->constants.datas[index]);
+                break;
+            }
+            case OPCODE_LOAD_LOCAL_VAR:
+            case OPCODE_STORE_LOCAL_VAR:
+            case OPCODE_STORE_LOCAL_VAR_POP:
+            case OPCODE_LOAD_LOCAL_VAR_LOAD_LOCAL_VAR:
+            case OPCODE_LOAD_LOCAL_VAR_LOAD_CONSTANT:
+            case OPCODE_LOAD_LOCAL_VAR_LOAD_CONSTANT_CALL1:
+                valid = instr[ip + 1] < local_num;
+                break;
+            case OPCODE_LOAD_UPVALUE:
+            case OPCODE_STORE_UPVALUE:
+                valid = instr[ip + 1] < fn->upvalue_number;
+                break;
+            case OPCODE_LOAD_MODULE_VAR:
+            case OPCODE_STORE_MODULE_VAR:
+            case OPCODE_STORE_MODULE_VAR_POP:
+                valid = operand_short(instr, ip + 1) < bounds->module_var_num;
+                break;
+            case OPCODE_LOAD_SELF_FIELD:
+            case OPCODE_STORE_SELF_FIELD:
+            case OPCODE_LOAD_FIELD:
+            case OPCODE_STORE_FIELD:
+            case OPCODE_LOAD_SELF_FIELD_CALL0:
+                // 字段数在绑定方法时才确定，这里只能检查上限
+                valid = instr[ip + 1] < MAX_FIELD_NUM;
+                break;
+            case OPCODE_CREATE_CLOSURE: {
+                // <[1b is_enclosing_local_var] [1b index]> 指向本函数的局部变量或 upvalue
+                ObjFn* closure_fn = VALUE_TO_OBJFN(fn->constants.datas[operand_short(instr, ip + 1)]);
+                for (u32 i = 0; i < closure_fn->upvalue_number && valid; i++) {
+                    u8 is_local = instr[ip + 3 + i * 2];
+                    u8 index = instr[ip + 4 + i * 2];
+                    valid = is_local <= 1 && index < (is_local ? local_num : fn->upvalue_number);
+                }
+                break;
+            }
+            case OPCODE_CONSTRUCT:
+                valid = initial_slots > 0; // 栈底须为 class，只出现在构造函数中
+                break;
+            case OPCODE_LOOP:
+                valid = ++loop_num <= UINT16_MAX + 1;
+                break;
+            default:
+                break;
+        }
+        valid = valid && superinstruction_intact(instr, len, op, ip + 1 + operand_len);
+
+        if (valid && has_method_operand(op)) {
+            valid = operand_short(instr, ip + 1) < bounds->method_num;
+
+            // CALLx、SUPERx 与快化指令的最后一个操作数为内联缓存下标
+            if (op <= OPCODE_SUPER16 || (op >= OPCODE_LIST_SUBSCRIPT && op <= OPCODE_MAP_SUBSCRIPT)) {
+                valid = valid && operand_short(instr, ip + operand_len - 1) < fn->inline_cache_number;
+            }
+            // SUPERx [2b method_index] [2b super_class_index]：基类的占位常量在绑定方法时回填
+            if (op >= OPCODE_SUPER0 && op <= OPCODE_SUPER16) {
+                u32 index = operand_short(instr, ip + 3);
+                valid = valid && index < fn->constants.count && VALUE_IS_NULL(fn->constants.datas[index]);
+            }
+        }
+        if (!valid) {
+            return false;
+        }
+
+        last = op;
+        ip += 1 + operand_len;
+    }
+
+    if (len == 0 || last != OPCODE_END) {
+        return false;
+    }
+
+    // 缓存中的深度须与沿控制流重新计算的一致，栈帧按它分配
+    u32 max_stack = 0;
+    return peephole_verify_stack(fn, initial_slots, &max_stack) && max_stack == fn->max_stack_slot_used;
+}
+
+// 把指令中的方法下标从缓存中的下标映射为 vm->all_method_names 的下标，函数常量递归处理
+static void remap_methods(ObjFn* fn, const u32* to_global) {
+    Byte* instr = fn->instr_stream.datas;
+    u32 ip = 0;
+    while (ip < fn->instr_stream.count) {
+        if (has_method_operand(instr[ip])) {
+            u32 global = to_global[operand_short(instr, ip + 1)];
+            instr[ip + 1] = (global >> 8) & 0xFF;
+            instr[ip + 2] = global & 0xFF;
+        }
+        ip += 1 + get_byte_of_operands(instr, fn->constants.datas, ip);
+    }
+
+    for (u32 i = 0; i < fn->constants.count; i++) {
+        if (value_is_fn(fn->constants.datas[i])) {
+            remap_methods(VALUE_TO_OBJFN(fn->constants.datas[i]), to_global);
+        }
+    }
+}
+
+static bool read_fn(VM* vm, Reader* r, CacheBounds* bounds, ObjFn* fn, u32 initial_slots);
+
+static bool read_constant(VM* vm, Reader* r, CacheBounds* bounds, ObjFn* fn) {
+    u8 tag = read_u8(r);
+    Value val;
+    switch (tag) {
+        case VT_NULL:
+        case VT_FALSE:
+        case VT_TRUE:
+            val = VT_TO_VALUE(tag);
+            break;
+        case VT_I32:
+            val = I32_TO_VALUE((i32)read_u32(r));
+            break;
+        case VT_U32:
+            val = U32_TO_VALUE(read_u32(r));
+            break;
+        case VT_U8:
+            val = U8_TO_VALUE(read_u8(r));
+            break;
+        case VT_F64: {
+            u64 bits = read_u64(r);
+            f64 num;
+            memcpy(&num, &bits, sizeof(num));
+            val = F64_TO_VALUE(num);
+            break;
+        }
+        case CONST_STRING: {
+            u32 len;
+            const char* str = read_string(r, &len);
+            if (str == NULL) {
+                return false;
+            }
+            val = OBJ_TO_VALUE(objstring_new(vm, str, len));
+            break;
+        }
+        case CONST_FN:
+            val = OBJ_TO_VALUE(objfn_new(vm, fn->module, 0));
+            break;
+        default:
+            return false;
+    }
+    if (!r->ok) {
+        return false;
+    }
+
+    if (VALUE_IS_OBJ(val)) {
+        push_tmp_root(vm, VALUE_TO_OBJ(val));
+    }
+    BufferAdd(Value, &fn->constants, vm, val);
+    GC_WRITE_BARRIER(vm, fn, val);
+    if (VALUE_IS_OBJ(val)) {
+        pop_tmp_root(vm);
+    }
+
+    // 先挂到外层函数的常量表上再填充，读取期间由外层函数保持可达
+    return tag == CONST_FN ? read_fn(vm, r, bounds, VALUE_TO_OBJFN(val), 1) : true;
+}
+
+// initial_slots 与编译时相同：顶层函数为 0，其它函数为 1
+static bool read_fn(VM* vm, Reader* r, CacheBounds* bounds, ObjFn* fn, u32 initial_slots) {
+    fn->argc = read_u8(r);
+    fn->upvalue_number = read_u32(r);
+    fn->max_stack_slot_used = read_u32(r);
+    u32 inline_cache_number = read_u32(r);
+    if (fn->argc > (initial_slots == 0 ? 0 : MAX_ARG_NUM) || fn->upvalue_number > MAX_UPVALUE_NUM
+        || inline_cache_number > UINT16_MAX + 1) {
+        return false;
+    }
+
+    u32 constant_num = read_u32(r);
+    if (!r->ok || constant_num > UINT16_MAX + 1) {
+        return false;
+    }
+    for (u32 i = 0; i < constant_num; i++) {
+        if (!read_constant(vm, r, bounds, fn)) {
+            return false;
+        }
+    }
+
+    u32 len = read_u32(r);
+    const u8* instr = read_bytes(r, len);
+    if (instr == NULL || len == 0) {
+        return false;
+    }
+    BufferFill(Byte, &fn->instr_stream, vm, 0, len);
+    memcpy(fn->instr_stream.datas, instr, len);
+
+    fn->inline_cache_number = inline_cache_number;
+    if (!validate_instr(fn, bounds, initial_slots)) {
+        return false;
+    }
+
+    u32 line_num = read_u32(r);
+    for (u32 i = 0; i < line_num && r->ok; i++) {
+        u32 line = read_u32(r);
+#ifdef DEBUG
+        BufferAdd(Int, &fn->debug->line, vm, (int)line);
+#else
+        (void)line;
+#endif
+    }
+    if (!r->ok) {
+        return false;
+    }
+
+    if (inline_cache_number > 0) {
+        InlineCache* caches = ALLOCATE_ARRAY(vm, InlineCache, inline_cache_number);
+        if (caches == NULL) {
+            MEM_ERROR("allocate inline caches failed.");
+        }
+        memset(caches, 0, sizeof(InlineCache) * inline_cache_number);
+        fn->inline_caches = caches;
+    }
+    alloc_loop_counters(vm, fn);
+    return true;
+}
+
+static ObjFn* read_cache(VM* vm, ObjModule* module, const u8* data, usize size, SourceStamp* stamp) {
+    Reader reader = {.cur = data, .end = data + size, .ok = true};
+    Reader* r = &reader;
+    if (!read_header(r, module, stamp)) {
+        return NULL;
+    }
+
+    // 模块变量在顶层函数读取成功后才定义，失败时模块仍可重新编译
+    u32 var_num = read_u32(r);
+    const u8* vars = r->cur;
+    for (u32 i = 0; i < var_num && r->ok; i++) {
+        u32 len;
+        read_string(r, &len);
+        if (len == 0 || len > MAX_ID_LEN) {
+            return NULL;
+        }
+    }
+
+    u32 method_num = read_u32(r);
+    if (!r->ok || method_num > UINT16_MAX + 1) {
+        return NULL;
+    }
+    Reader methods = *r;
+    for (u32 i = 0; i < method_num; i++) {
+        u32 len;
+        const char* name = read_string(r, &len);
+        if (name == NULL || len == 0 || len > MAX_SIGN_LEN) {
+            return NULL;
+        }
+    }
+
+    CacheBounds bounds = {
+        .method_num = method_num,
+        .module_var_num = module->module_var_name.count + var_num,
+    };
+    ObjFn* fn = objfn_new(vm, module, 0);
+    push_tmp_root(vm, (ObjHeader*)fn);
+    bool ok = read_fn(vm, r, &bounds, fn, 0) && r->cur == r->end;
+
+    // 整个文件校验通过后才加入方法名，失败的缓存不会在 vm->all_method_names 中留下符号
+    u32* to_global = ok ? malloc(sizeof(u32) * (method_num + 1)) : NULL;
+    ok = to_global != NULL;
+    for (u32 i = 0; i < method_num && ok; i++) {
+        u32 len;
+        const char* name = read_string(&methods, &len);
+        to_global[i] = ensure_symbol_exist(vm, &vm->all_method_names, name, len);
+        ok = to_global[i] <= UINT16_MAX;
+    }
+    if (ok) {
+        remap_methods(fn, to_global);
+    }
+    free(to_global);
+
+    for (u32 i = 0; i < var_num && ok; i++) {
+        u32 len = (u32)vars[0] | ((u32)vars[1] << 8) | ((u32)vars[2] << 16) | ((u32)vars[3] << 24);
+        const char* name = (const char*)vars + 4;
+        vars += 4 + len;
+        ok = define_module_var(vm, module, name, len, VT_TO_VALUE(VT_NULL)) != -1;
+    }
+
+    pop_tmp_root(vm);
+    return ok ? fn : NULL;
+}
+
+ObjFn* bytecode_cache_load(VM* vm, ObjModule* module, const char* src_path, const char* cache_path) {
+    struct stat src_stat, cache_stat;
+    if (stat(src_path, &src_stat) != 0 || stat(cache_path, &cache_stat) != 0) {
+        return NULL;
+    }
+
+    // 缓存须比源文件新
+    if (cache_stat.st_mtim.tv_sec < src_stat.st_mtim.tv_sec
+        || (cache_stat.st_mtim.tv_sec == src_stat.st_mtim.tv_sec && cache_stat.st_mtim.tv_nsec < src_stat.st_mtim.tv_nsec)) {
+        return NULL;
+    }
+
+    FILE* file = fopen(cache_path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    usize size = cache_stat.st_size;
+    u8* buf = malloc(size + 1);
+    if (buf == NULL || fread(buf, 1, size, file) != size) {
+        fclose(file);
+        free(buf);
+        return NULL;
+    }
+    fclose(file);
+
+    SourceStamp stamp = file_stamp(&src_stat);
+    ObjFn* fn = read_cache(vm, module, buf, size, &stamp);
+    free(buf);
+    return fn;
+}
+
+ObjFn* bytecode_cache_load_snapshot(VM* vm, ObjModule* module, const char* code, const void* snapshot, usize size) {
+    SourceStamp stamp = code_stamp(code);
+    return read_cache(vm, module, snapshot, size, &stamp);
+}
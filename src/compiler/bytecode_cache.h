@@ -0,0 +1,21 @@
+#ifndef __COMPILER_BYTECODE_CACHE_H__
+#define __COMPILER_BYTECODE_CACHE_H__
+
+#include "common.h"
+#include "meta_obj.h"
+#include "obj_fn.h"
+
+// 编译结果缓存文件的扩展名，写在源文件旁：foo.sp -> foo.spc
+#define BYTECODE_CACHE_EXTENSION ".spc"
+// 缓存格式变化时递增，旧缓存会被忽略并重新生成
+#define BYTECODE_CACHE_VERSION 2
+
+char* bytecode_cache_path(const char* src_path);
+ObjFn* bytecode_cache_load(VM* vm, ObjModule* module, const char* src_path, const char* cache_path);
+bool bytecode_cache_save(VM* vm, ObjModule* module, u32 inherited_var_num, ObjFn* fn, const char* src_path, const char* cache_path);
+
+// 快照与缓存文件格式相同，以源码字符串代替源文件校验，用于核心模块
+ObjFn* bytecode_cache_load_snapshot(VM* vm, ObjModule* module, const char* code, const void* snapshot, usize size);
+bool bytecode_cache_save_snapshot(VM* vm, ObjModule* module, u32 inherited_var_num, ObjFn* fn, const char* code, FILE* file);
+
+#endif
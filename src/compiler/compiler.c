@@ -3,7 +3,9 @@
 #include "vm.h"
 #include "class.h"
 #include "core.h"
+#include "gc.h"
 #include "parser.h"
+#include "peephole.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -46,9 +48,20 @@ inline void write_opcode_short_operand(CompileUnitPubStruct* cu, OpCode opcode,
     write_short_operand(cu, operand);
 }
 
+// 为调用点分配内联缓存索引，缓存本身在 end_compile_unit 中统一分配
+static void write_inline_cache_operand(CompileUnitPubStruct* cu) {
+    if (cu->fn->inline_cache_number > UINT16_MAX) {
+        COMPILE_ERROR(
+            cu->vm->cur_parser,
+            "the max number of call sites in one function is %d.", UINT16_MAX + 1
+        );
+    }
+    write_short_operand(cu, cu->fn->inline_cache_number++);
+}
+
 u32 add_constant(CompileUnitPubStruct* cu, Value constant) {
     if (VALUE_IS_OBJ(constant)) {
-        push_tmp_root(cu->vm, constant.header);
+        push_tmp_root(cu->vm, VALUE_TO_OBJ(constant));
     }
 
     // 避免重复常量重复入表
@@ -62,7 +75,13 @@ u32 add_constant(CompileUnitPubStruct* cu, Value constant) {
         }
     }
 
-    // 表中没有相同的常量，入表
+    // 表中没有相同的常量，入表。常量索引为2字节操作数
+    if (cu->fn->constants.count > UINT16_MAX) {
+        COMPILE_ERROR(
+            cu->vm->cur_parser,
+            "the max number of constants in one function is %d.", UINT16_MAX + 1
+        );
+    }
     BufferAdd(Value, &cu->fn->constants, cu->vm, constant);
 
     if (VALUE_IS_OBJ(constant)) {
@@ -208,6 +227,21 @@ void emit_call_by_signature(CompileUnitPubStruct* cu, Signature* sign, OpCode op
         // 为将来需要填入的基类占位
         write_short_operand(cu, add_constant(cu, VT_TO_VALUE(VT_NULL)));
     }
+
+    write_inline_cache_operand(cu);
+}
+
+// 二元运算指令 <BINARY_OPERATOR> [2b method_index]
+// 操作数为运算符方法的签名索引，供运行时操作数不是数字时回退为方法调用
+void emit_binary_operator(CompileUnitPubStruct* cu, Signature* sign, OpCode op) {
+    char sign_buffer[MAX_SIGN_LEN];
+    u32 len = sign2string(sign, sign_buffer);
+
+    int symbol_index = ensure_symbol_exist(
+        cu->vm, &cu->vm->all_method_names,
+        sign_buffer, len
+    );
+    write_opcode_short_operand(cu, op, symbol_index);
 }
 
 u32 add_local_var(CompileUnitPubStruct* cu, const char* name, u32 len) {
@@ -217,6 +251,7 @@ u32 add_local_var(CompileUnitPubStruct* cu, const char* name, u32 len) {
     var->len = len;
     var->scope_depth = cu->scope_depth;
     var->is_upvalue = false;
+    var->type = TYPE_HINT_ANY;
 
     return cu->local_vars_count++;
 }
@@ -280,6 +315,7 @@ void emit_call(CompileUnitPubStruct* cu, int argc, const char* name, u32 len) {
     );
 
     write_opcode_short_operand(cu, OPCODE_CALL0 + argc, symbol_index);
+    write_inline_cache_operand(cu);
 }
 
 u32 sign2string(Signature* sign, char* buf) {
@@ -382,7 +418,7 @@ int define_module_var(VM* vm, ObjModule* module, const char* name, u32 len, Valu
     }
 
     if (VALUE_IS_OBJ(val)) {
-        push_tmp_root(vm, val.header);
+        push_tmp_root(vm, VALUE_TO_OBJ(val));
     }
 
     int symbol_index = get_index_from_symbol_table(&module->module_var_name, name, len);
@@ -394,6 +430,7 @@ int define_module_var(VM* vm, ObjModule* module, const char* name, u32 len, Valu
     } else {
         symbol_index = -1;
     }
+    GC_WRITE_BARRIER(vm, module, val);
 
     if (VALUE_IS_OBJ(val)) {
         pop_tmp_root(vm);
@@ -404,6 +441,7 @@ int define_module_var(VM* vm, ObjModule* module, const char* name, u32 len, Valu
 
 void compile_unit_pubstruct_init(VM* vm, ObjModule* cur_module, CompileUnitPubStruct* cu, CompileUnitPubStruct* enclosing_unit, bool is_method) {
     cu->vm = vm;
+    cu->fn = NULL; // objfn_new 可能触发 gc，此前 cu 已可被 gc 访问
     vm->cur_cu = cu;
     cu->cur_module = cur_module;
     cu->enclosing_unit = enclosing_unit;
@@ -454,11 +492,60 @@ u32 get_byte_of_operands(Byte* instr_stream, Value* constants, int ip) {
         CASE(LOAD_FIELD):
         CASE(STORE_FIELD):
         CASE(LOAD_LOCAL_VAR):
+        CASE(LOAD_LOCAL_VAR_LOAD_LOCAL_VAR):
+        CASE(LOAD_LOCAL_VAR_LOAD_CONSTANT):
+        CASE(LOAD_LOCAL_VAR_LOAD_CONSTANT_CALL1):
+        CASE(LOAD_SELF_FIELD_CALL0):
         CASE(STORE_LOCAL_VAR):
         CASE(LOAD_UPVALUE):
         CASE(STORE_UPVALUE):
+        CASE(STORE_LOCAL_VAR_POP):
             return 1;
 
+        CASE(LOAD_CONSTANT):
+        CASE(LOAD_MODULE_VAR):
+        CASE(STORE_MODULE_VAR):
+        CASE(STORE_MODULE_VAR_POP):
+        CASE(LOOP):
+        CASE(JMP):
+        CASE(JMP_IF_FALSE):
+        CASE(AND):
+        CASE(OR):
+        CASE(INSTANCE_METHOD):
+        CASE(STATIC_METHOD):
+        CASE(ADD):
+        CASE(SUB):
+        CASE(MUL):
+        CASE(DIV):
+        CASE(MOD):
+        CASE(LT):
+        CASE(LE):
+        CASE(GT):
+        CASE(GE):
+        CASE(EQ):
+        CASE(NE):
+        CASE(BIT_AND):
+        CASE(BIT_OR):
+        CASE(BIT_XOR):
+        CASE(BIT_SL):
+        CASE(BIT_SR):
+        CASE(LT_JMP_IF_FALSE):
+        CASE(LE_JMP_IF_FALSE):
+        CASE(GT_JMP_IF_FALSE):
+        CASE(GE_JMP_IF_FALSE):
+        CASE(EQ_JMP_IF_FALSE):
+        CASE(NE_JMP_IF_FALSE):
+        CASE(ADD_I32):
+        CASE(SUB_I32):
+        CASE(MUL_I32):
+        CASE(ADD_F64):
+        CASE(SUB_F64):
+        CASE(MUL_F64):
+        CASE(DIV_F64):
+        CASE(MAKE_LIST):
+        CASE(MAKE_MAP):
+            return 2;
+
         CASE(CALL0):
         CASE(CALL1):
         CASE(CALL2):
@@ -476,17 +563,10 @@ u32 get_byte_of_operands(Byte* instr_stream, Value* constants, int ip) {
         CASE(CALL14):
         CASE(CALL15):
         CASE(CALL16):
-        CASE(LOAD_CONSTANT):
-        CASE(LOAD_MODULE_VAR):
-        CASE(STORE_MODULE_VAR):
-        CASE(LOOP):
-        CASE(JMP):
-        CASE(JMP_IF_FALSE):
-        CASE(AND):
-        CASE(OR):
-        CASE(INSTANCE_METHOD):
-        CASE(STATIC_METHOD):
-            return 2;
+        CASE(LIST_SUBSCRIPT):
+        CASE(LIST_LEN):
+        CASE(MAP_SUBSCRIPT):
+            return 4; // [2b method_index] [2b cache_index]
 
         CASE(SUPER0):
         CASE(SUPER1):
@@ -505,7 +585,7 @@ u32 get_byte_of_operands(Byte* instr_stream, Value* constants, int ip) {
         CASE(SUPER14):
         CASE(SUPER15):
         CASE(SUPER16):
-            return 4;
+            return 6; // [2b method_index] [2b super_class_index] [2b cache_index]
 
         CASE(CREATE_CLOSURE): {
             u32 fn_idx = (instr_stream[ip + 1] << 8) | instr_stream[ip + 2];
@@ -526,6 +606,7 @@ int ensure_symbol_exist(VM* vm, SymbolTable* table, const char* symbol, u32 len)
 
 int declare_module_var(VM* vm, ObjModule* module, const char* name, u32 len, Value val) {
     BufferAdd(Value, &module->module_var_value, vm, val);
+    GC_WRITE_BARRIER(vm, module, val);
     return add_symbol(vm, &module->module_var_name, name, len);
 }
 
@@ -544,8 +625,71 @@ ClassBookKeep* get_enclosing_classbk(CompileUnitPubStruct* cu) {
     return ncu == NULL ? NULL : ncu->enclosing_classbk;
 }
 
+// 为指令流中的每条 LOOP 分配回跳计数器，并建立由 LOOP 的位置到计数器的索引，使回跳时的查找为 O(1)。
+// 须在指令流确定后调用。调用方保证 fn 可达
+void alloc_loop_counters(VM* vm, ObjFn* fn) {
+    Byte* instr_stream = fn->instr_stream.datas;
+    u32 count = 0;
+    u32 last = 0;
+    for (u32 ip = 0; ip < fn->instr_stream.count; ip += 1 + get_byte_of_operands(instr_stream, fn->constants.datas, ip)) {
+        if (instr_stream[ip] == OPCODE_LOOP) {
+            count++;
+            last = ip;
+        }
+    }
+    if (count == 0) {
+        return;
+    }
+    if (count > UINT16_MAX + 1) {
+        RUNTIME_ERROR("too many loops in one function.");
+    }
+
+    LoopCounter* counters = ALLOCATE_ARRAY(vm, LoopCounter, count);
+    if (counters == NULL) {
+        MEM_ERROR("allocate loop counters failed.");
+    }
+    u32 index = 0;
+    for (u32 ip = 0; ip <= last; ip += 1 + get_byte_of_operands(instr_stream, fn->constants.datas, ip)) {
+        if (instr_stream[ip] == OPCODE_LOOP) {
+            counters[index++] = (LoopCounter) {.offset = ip, .count = 0};
+        }
+    }
+    fn->loop_counters = counters;
+    fn->loop_counter_number = count;
+
+    // 索引只覆盖到最后一条 LOOP，非 LOOP 位置的值不会被读取
+    u32 index_len = last + 1;
+    u16* index_of = ALLOCATE_ARRAY(vm, u16, index_len);
+    if (index_of == NULL) {
+        MEM_ERROR("allocate loop counter index failed.");
+    }
+    for (u32 i = 0; i < count; i++) {
+        index_of[counters[i].offset] = (u16)i;
+    }
+    fn->loop_counter_index = index_of;
+}
+
 ObjFn* end_compile_unit(CompileUnitPubStruct* cu) {
     write_opcode(cu, OPCODE_END);
+    // 模块编译单元没有占用栈槽的隐式局部变量
+    peephole_optimize(cu->fn, cu->enclosing_unit == NULL ? 0 : 1);
+
+    push_tmp_root(cu->vm, (ObjHeader*)cu->fn);
+    alloc_loop_counters(cu->vm, cu->fn);
+    pop_tmp_root(cu->vm);
+
+    if (cu->fn->inline_cache_number > 0) {
+        ObjFn* fn = cu->fn;
+        // 分配期间可能触发gc，此时 inline_caches 仍为 NULL
+        push_tmp_root(cu->vm, (ObjHeader*)fn);
+        InlineCache* caches = ALLOCATE_ARRAY(cu->vm, InlineCache, fn->inline_cache_number);
+        pop_tmp_root(cu->vm);
+        if (caches == NULL) {
+            MEM_ERROR("allocate inline caches failed.");
+        }
+        memset(caches, 0, sizeof(InlineCache) * fn->inline_cache_number);
+        fn->inline_caches = caches;
+    }
     
     if (cu->enclosing_unit != NULL) {
         // 把当前objfn添加到上层cu常量表中
@@ -562,6 +706,8 @@ ObjFn* end_compile_unit(CompileUnitPubStruct* cu) {
         }
     }
 
+    // cu 位于调用者的栈上，结束后不能再被 gc 访问。fn 已加入外层常量表，模块函数由调用者保护
+    cu->vm->cur_cu = cu->enclosing_unit;
     return cu->fn;
 }
 
@@ -706,11 +852,13 @@ void define_method(CompileUnitPubStruct* cu, Variable class, bool is_static, int
 void emit_create_instance(CompileUnitPubStruct* cu, Signature* sign, u32 constructor_index) {
     CompileUnitPubStruct method_cu;
     compile_unit_pubstruct_init(cu->vm, cu->cur_module, &method_cu, cu, true);
+    method_cu.fn->argc = sign->argc;
     
     // 1. push instance to stack[0]
     write_opcode(&method_cu, OPCODE_CONSTRUCT);
     // 2. call Class.new(...)
     write_opcode_short_operand(&method_cu, (OpCode)(OPCODE_CALL0 + sign->argc), constructor_index);
+    write_inline_cache_operand(&method_cu);
     // 3. return instance
     write_opcode(&method_cu, OPCODE_RETURN);
 
@@ -750,8 +898,11 @@ ObjFn* compile_module(VM* vm, ObjModule* module, const char* module_code, Compil
         }
     }
 
+    // 编译单元经由 cur_parser 被 gc 标记，须在恢复 cur_parser 前结束编译单元
+    ObjFn* fn = end_compile_unit(&module_cu);
+
     vm->cur_parser = vm->cur_parser->parent;
     vm->cur_cu = NULL;
 
-    return end_compile_unit(&module_cu);
+    return fn;
 }
@@ -19,11 +19,19 @@ typedef struct {
     u32 index;
 } Upvalue;
 
+// 类型注释中编译器可利用的部分，泛型、可空、联合类型及其它类型均为 TYPE_HINT_ANY
+typedef enum {
+    TYPE_HINT_ANY,
+    TYPE_HINT_I32,
+    TYPE_HINT_F64,
+} TypeHint;
+
 typedef struct {
     const char* name;
     u32 len;
     int scope_depth;
     bool is_upvalue;
+    TypeHint type; // 类型注释不做检查，只用于选择带类型守卫的特化指令
 } LocalVar;
 
 typedef enum {
@@ -92,6 +100,7 @@ typedef struct {
 } Variable;
 
 u32 get_byte_of_operands(Byte* instr_stream, Value* constants, int ip);
+void alloc_loop_counters(VM* vm, ObjFn* fn);
 int ensure_symbol_exist(VM* vm, SymbolTable* table, const char* symbol, u32 len);
 void compile_unit_pubstruct_init(VM* vm, ObjModule* cur_module, CompileUnitPubStruct* cu, CompileUnitPubStruct* enclosing_unit, bool is_method);
 
@@ -117,6 +126,7 @@ void emit_store_variable(CompileUnitPubStruct* cu, Variable var);
 void emit_load_self(CompileUnitPubStruct* cu);
 u32 sign2string(Signature* sign, char* buf);
 void emit_call_by_signature(CompileUnitPubStruct* cu, Signature* sign, OpCode op);
+void emit_binary_operator(CompileUnitPubStruct* cu, Signature* sign, OpCode op);
 void emit_call(CompileUnitPubStruct* cu, int argc, const char* name, u32 len);
 u32 add_local_var(CompileUnitPubStruct* cu, const char* name, u32 len);
 int declare_local_var(CompileUnitPubStruct* cu, const char* name, u32 len);
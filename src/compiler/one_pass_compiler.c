@@ -687,7 +687,7 @@ static void string_interpolation(CompileUnit* cu, bool can_assign) {
     emit_call(&cu->pub, 0, "new()", 5);
 
     do {
-        if (((ObjString*)cu->parser->pre_token.value.header)->val.len != 0) { // 当其为非空字符串时添加
+        if (((ObjString*)VALUE_TO_OBJ(cu->parser->pre_token.value))->val.len != 0) { // 当其为非空字符串时添加
             literal(cu, false); // 解析字符串
             // List.core_append(_: any) -> List 用于编译器内部构造列表。
             emit_call(&cu->pub, 1, "core_append(_)", 14);
@@ -703,7 +703,7 @@ static void string_interpolation(CompileUnit* cu, bool can_assign) {
     );
 
     // 结尾的TOKEN_STRING
-    if (((ObjString*)cu->parser->pre_token.value.header)->val.len != 0) { // 当其为非空字符串时添加
+    if (((ObjString*)VALUE_TO_OBJ(cu->parser->pre_token.value))->val.len != 0) { // 当其为非空字符串时添加
         literal(cu, false);
         emit_call(&cu->pub, 1, "core_append(_)", 14);
     }
@@ -1106,6 +1106,7 @@ static void compile_method(CompileUnit* cu, Variable class, bool is_static) {
     method_cu.parser = cu->parser;
 
     method_sign(&method_cu, &sign); // 解析函数签名
+    method_cu.pub.fn->argc = sign.argc;
     if (cls->in_static && sign.type == SIGN_CONSTRUCT) {
         COMPILE_ERROR(cu->parser, "constructor is not allowed to be static.");
     }
@@ -1219,7 +1220,7 @@ static void compile_class_definition(CompileUnit* cu) {
         .name = class_name,
         .in_static = false,
     };
-    BufferInit(String, &class_bk.fields);
+    symbol_table_init(&class_bk.fields);
     BufferInit(Int, &class_bk.instant_methods);
     BufferInit(Int, &class_bk.static_methods);
 
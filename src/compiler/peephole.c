@@ -0,0 +1,523 @@
+#include "peephole.h"
+#include "compiler.h"
+#include "opcode.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * 窥孔优化，由 end_compile_unit 对每个函数执行一次：
+ * 1. STORE_X n; POP; LOAD_X n => STORE_X n（X 为 LOCAL_VAR、UPVALUE、MODULE_VAR、SELF_FIELD）
+ * 2. STORE_LOCAL_VAR n; POP => STORE_LOCAL_VAR_POP n，STORE_MODULE_VAR n; POP => STORE_MODULE_VAR_POP n
+ * 3. 没有副作用的压栈指令紧跟 POP 时两条都删除
+ * 4. 跳转线程化：目标为 JMP 的前向跳转直接跳到最终目标，AND、OR 跳到同种指令时直接跳到其目标
+ *    （栈顶的值不变，该指令必然再次跳转）；目标为 LOOP 的 JMP 改为该 LOOP；目标为下一条指令的 JMP 删除
+ * 模式中除第一条外的指令都不能是跳转目标。最后按新位置重新编码跳转偏移，并沿控制流重新计算栈的最大深度。
+ */
+
+typedef struct {
+    u32 pos; // 在原指令流中的位置
+    u32 len; // 含操作码的字节数
+    OpCode op;
+    int target; // 跳转目标的指令下标，不是跳转指令时为 -1
+    u32 labels; // 以该指令为目标的跳转数
+    bool removed;
+} PeepInstr;
+
+typedef struct {
+    PeepInstr* instrs;
+    int count;
+    Byte* code; // 原指令流的副本
+} PeepFn;
+
+static inline bool is_forward_jump(OpCode op) {
+    return op == OPCODE_JMP || op == OPCODE_JMP_IF_FALSE || op == OPCODE_AND || op == OPCODE_OR;
+}
+
+static inline bool is_jump(OpCode op) {
+    return is_forward_jump(op) || op == OPCODE_LOOP;
+}
+
+static inline u32 read_short(Byte* code, u32 pos) {
+    return (code[pos] << 8) | code[pos + 1];
+}
+
+static int next_live(PeepFn* pf, int index) {
+    for (index++; index < pf->count; index++) {
+        if (!pf->instrs[index].removed) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+static void retarget(PeepFn* pf, PeepInstr* jump, int target) {
+    pf->instrs[jump->target].labels--;
+    pf->instrs[target].labels++;
+    jump->target = target;
+}
+
+// 删除指令，以其为目标的跳转改为跳到下一条指令。END 始终不会被删除，因此下一条指令总是存在
+static void remove_instr(PeepFn* pf, int index) {
+    PeepInstr* instr = &pf->instrs[index];
+    instr->removed = true;
+    if (is_jump(instr->op)) {
+        pf->instrs[instr->target].labels--;
+    }
+
+    if (instr->labels > 0) {
+        int next = next_live(pf, index);
+        for (int i = 0; i < pf->count; i++) {
+            if (!pf->instrs[i].removed && pf->instrs[i].target == index) {
+                retarget(pf, &pf->instrs[i], next);
+            }
+        }
+    }
+}
+
+// STORE_X 对应的 LOAD_X，不是可合并的存储指令时返回 -1
+static int load_of_store(OpCode op) {
+    switch (op) {
+        case OPCODE_STORE_LOCAL_VAR:    return OPCODE_LOAD_LOCAL_VAR;
+        case OPCODE_STORE_UPVALUE:      return OPCODE_LOAD_UPVALUE;
+        case OPCODE_STORE_MODULE_VAR:   return OPCODE_LOAD_MODULE_VAR;
+        case OPCODE_STORE_SELF_FIELD:   return OPCODE_LOAD_SELF_FIELD;
+        default:                        return -1;
+    }
+}
+
+static bool is_pure_push(OpCode op) {
+    switch (op) {
+        case OPCODE_PUSH_NULL:
+        case OPCODE_PUSH_TRUE:
+        case OPCODE_PUSH_FALSE:
+        case OPCODE_LOAD_CONSTANT:
+        case OPCODE_LOAD_LOCAL_VAR:
+        case OPCODE_LOAD_UPVALUE:
+        case OPCODE_LOAD_MODULE_VAR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool same_operands(PeepFn* pf, PeepInstr* a, PeepInstr* b) {
+    return a->len == b->len && memcmp(pf->code + a->pos + 1, pf->code + b->pos + 1, a->len - 1) == 0;
+}
+
+// 对第 index 条指令尝试各优化模式，有改动时返回 true
+static bool peephole_at(PeepFn* pf, int index) {
+    PeepInstr* instr = &pf->instrs[index];
+    int next = next_live(pf, index);
+    if (next == -1) {
+        return false;
+    }
+    PeepInstr* next_instr = &pf->instrs[next];
+
+    if (next_instr->op == OPCODE_POP && next_instr->labels == 0) {
+        int load_op = load_of_store(instr->op);
+        if (load_op != -1) {
+            int third = next_live(pf, next);
+            if (third != -1 && pf->instrs[third].labels == 0 && pf->instrs[third].op == (OpCode)load_op
+                && same_operands(pf, instr, &pf->instrs[third])) {
+                remove_instr(pf, next);
+                remove_instr(pf, third);
+                return true;
+            }
+        }
+
+        if (instr->op == OPCODE_STORE_LOCAL_VAR || instr->op == OPCODE_STORE_MODULE_VAR) {
+            instr->op = instr->op == OPCODE_STORE_LOCAL_VAR ? OPCODE_STORE_LOCAL_VAR_POP : OPCODE_STORE_MODULE_VAR_POP;
+            remove_instr(pf, next);
+            return true;
+        }
+
+        if (is_pure_push(instr->op)) {
+            remove_instr(pf, index);
+            remove_instr(pf, next);
+            return true;
+        }
+    }
+
+    if (!is_forward_jump(instr->op)) {
+        return false;
+    }
+
+    // 沿前向跳转链找到最终目标，链长不超过指令数
+    int target = instr->target;
+    for (int steps = 0; steps < pf->count; steps++) {
+        PeepInstr* t = &pf->instrs[target];
+        bool same_cond = (instr->op == OPCODE_AND || instr->op == OPCODE_OR) && t->op == instr->op;
+        if ((t->op == OPCODE_JMP || same_cond) && t->target > target) {
+            target = t->target;
+        } else {
+            break;
+        }
+    }
+    if (target != instr->target) {
+        retarget(pf, instr, target);
+        return true;
+    }
+
+    if (instr->op == OPCODE_JMP) {
+        PeepInstr* t = &pf->instrs[instr->target];
+        if (t->op == OPCODE_LOOP && t->target < index) {
+            instr->op = OPCODE_LOOP;
+            retarget(pf, instr, t->target);
+            return true;
+        }
+        if (instr->target == next) {
+            remove_instr(pf, index);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// 超级指令只替换第一条指令的操作码，后续指令保持原样，跳转到后续指令时照常执行，因此不受跳转目标的限制
+static void select_superinstructions(PeepFn* pf) {
+    int index = next_live(pf, -1);
+    while (index != -1) {
+        PeepInstr* instr = &pf->instrs[index];
+        int next = next_live(pf, index);
+        if (next == -1) {
+            break;
+        }
+        OpCode next_op = pf->instrs[next].op;
+        int third = next_live(pf, next);
+
+        OpCode fused = instr->op;
+        int covered = next; // 超级指令中最后一条被合并的指令
+        switch (instr->op) {
+            case OPCODE_LOAD_LOCAL_VAR:
+                if (next_op == OPCODE_LOAD_LOCAL_VAR) {
+                    fused = OPCODE_LOAD_LOCAL_VAR_LOAD_LOCAL_VAR;
+                } else if (next_op == OPCODE_LOAD_CONSTANT && third != -1 && pf->instrs[third].op == OPCODE_CALL1) {
+                    fused = OPCODE_LOAD_LOCAL_VAR_LOAD_CONSTANT_CALL1;
+                    covered = third;
+                } else if (next_op == OPCODE_LOAD_CONSTANT) {
+                    fused = OPCODE_LOAD_LOCAL_VAR_LOAD_CONSTANT;
+                }
+                break;
+            case OPCODE_LOAD_SELF_FIELD:
+                if (next_op == OPCODE_CALL0) {
+                    fused = OPCODE_LOAD_SELF_FIELD_CALL0;
+                }
+                break;
+            case OPCODE_LT:
+            case OPCODE_LE:
+            case OPCODE_GT:
+            case OPCODE_GE:
+            case OPCODE_EQ:
+            case OPCODE_NE:
+                if (next_op == OPCODE_JMP_IF_FALSE) {
+                    fused = OPCODE_LT_JMP_IF_FALSE + (instr->op - OPCODE_LT);
+                }
+                break;
+            default:
+                break;
+        }
+
+        if (fused != instr->op) {
+            instr->op = fused;
+            index = next_live(pf, covered);
+        } else {
+            index = next;
+        }
+    }
+}
+
+// 解码指令流并解析跳转目标，目标不是指令起始位置时返回 false
+static bool decode(PeepFn* pf, ObjFn* fn) {
+    u32 len = fn->instr_stream.count;
+    int* index_of_pos = malloc(sizeof(int) * len);
+    if (index_of_pos == NULL) {
+        return false;
+    }
+    for (u32 i = 0; i < len; i++) {
+        index_of_pos[i] = -1;
+    }
+
+    u32 ip = 0;
+    while (ip < len) {
+        PeepInstr* instr = &pf->instrs[pf->count];
+        instr->pos = ip;
+        instr->op = (OpCode)pf->code[ip];
+        instr->len = 1 + get_byte_of_operands(pf->code, fn->constants.datas, ip);
+        instr->target = -1;
+        instr->labels = 0;
+        instr->removed = false;
+        index_of_pos[ip] = pf->count++;
+        ip += instr->len;
+    }
+
+    bool ok = ip == len;
+    for (int i = 0; ok && i < pf->count; i++) {
+        PeepInstr* instr = &pf->instrs[i];
+        if (!is_jump(instr->op)) {
+            continue;
+        }
+        u32 offset = read_short(pf->code, instr->pos + 1);
+        i64 target_pos = instr->op == OPCODE_LOOP
+            ? (i64)instr->pos + 3 - offset
+            : (i64)instr->pos + 3 + offset;
+        if (target_pos < 0 || target_pos >= len || index_of_pos[target_pos] == -1) {
+            ok = false;
+            break;
+        }
+        instr->target = index_of_pos[target_pos];
+        pf->instrs[instr->target].labels++;
+    }
+
+    free(index_of_pos);
+    return ok;
+}
+
+// 按存活的指令重写指令流
+static void encode(PeepFn* pf, ObjFn* fn) {
+    u32* new_pos = malloc(sizeof(u32) * pf->count);
+    if (new_pos == NULL) {
+        return;
+    }
+
+    // 被删除的指令的新位置为其后第一条存活指令的位置
+    u32 pos = 0;
+    for (int i = 0; i < pf->count; i++) {
+        new_pos[i] = pos;
+        if (!pf->instrs[i].removed) {
+            pos += pf->instrs[i].len;
+        }
+    }
+
+    Byte* datas = fn->instr_stream.datas;
+    for (int i = 0; i < pf->count; i++) {
+        PeepInstr* instr = &pf->instrs[i];
+        if (instr->removed) {
+            continue;
+        }
+
+        datas[new_pos[i]] = instr->op;
+        if (is_jump(instr->op)) {
+            u32 offset = instr->op == OPCODE_LOOP
+                ? new_pos[i] + 3 - new_pos[instr->target]
+                : new_pos[instr->target] - new_pos[i] - 3;
+            datas[new_pos[i] + 1] = (offset >> 8) & 0xFF;
+            datas[new_pos[i] + 2] = offset & 0xFF;
+        } else {
+            memcpy(datas + new_pos[i] + 1, pf->code + instr->pos + 1, instr->len - 1);
+        }
+
+#ifdef DEBUG
+        // 行号与指令字节一一对应，新位置不大于原位置，可原地前移
+        if (fn->debug->line.count == fn->instr_stream.count) {
+            memmove(fn->debug->line.datas + new_pos[i], fn->debug->line.datas + instr->pos, sizeof(fn->debug->line.datas[0]) * instr->len);
+        }
+#endif
+    }
+
+#ifdef DEBUG
+    if (fn->debug->line.count == fn->instr_stream.count) {
+        fn->debug->line.count = pos;
+    }
+#endif
+    fn->instr_stream.count = pos;
+    free(new_pos);
+}
+
+static int stack_effect(PeepFn* pf, PeepInstr* instr) {
+    switch (instr->op) {
+        case OPCODE_MAKE_LIST:
+            return 1 - (int)read_short(pf->code, instr->pos + 1);
+        case OPCODE_MAKE_MAP:
+            return 1 - 2 * (int)read_short(pf->code, instr->pos + 1);
+        default:
+            return opcode_slots_used[instr->op];
+    }
+}
+
+// 指令执行时读取的栈顶值的个数
+static int stack_inputs(PeepFn* pf, PeepInstr* instr) {
+    OpCode op = instr->op;
+    if (op >= OPCODE_CALL0 && op <= OPCODE_CALL16) {
+        return op - OPCODE_CALL0 + 1;
+    }
+    if (op >= OPCODE_SUPER0 && op <= OPCODE_SUPER16) {
+        return op - OPCODE_SUPER0 + 1;
+    }
+    if ((op >= OPCODE_ADD && op <= OPCODE_BIT_SR) || (op >= OPCODE_LT_JMP_IF_FALSE && op <= OPCODE_DIV_F64)) {
+        return 2;
+    }
+    switch (op) {
+        case OPCODE_STORE_LOCAL_VAR:
+        case OPCODE_STORE_LOCAL_VAR_POP:
+        case OPCODE_STORE_UPVALUE:
+        case OPCODE_STORE_MODULE_VAR:
+        case OPCODE_STORE_MODULE_VAR_POP:
+        case OPCODE_STORE_SELF_FIELD:
+        case OPCODE_LOAD_FIELD:
+        case OPCODE_POP:
+        case OPCODE_JMP_IF_FALSE:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_CLOSE_UPVALUE:
+        case OPCODE_RETURN:
+        case OPCODE_LIST_LEN:
+            return 1;
+        case OPCODE_STORE_FIELD:
+        case OPCODE_CREATE_CLASS:
+        case OPCODE_INSTANCE_METHOD:
+        case OPCODE_STATIC_METHOD:
+        case OPCODE_LIST_SUBSCRIPT:
+        case OPCODE_MAP_SUBSCRIPT:
+            return 2;
+        case OPCODE_MAKE_LIST:
+            return (int)read_short(pf->code, instr->pos + 1);
+        case OPCODE_MAKE_MAP:
+            return 2 * (int)read_short(pf->code, instr->pos + 1);
+        default:
+            return 0;
+    }
+}
+
+// 沿控制流计算栈的最大深度，计数方式与编译期相同：形参不计入，因此深度可以为负（如构造函数的 CONSTRUCT; CALLx）。
+// 同一条指令经不同路径到达时深度不一致，或某条指令读取的栈顶值低于 min_depth 时返回 false
+static bool compute_max_stack(PeepFn* pf, u32 initial_slots, int min_depth, u32* max_out) {
+    int* depth = malloc(sizeof(int) * pf->count);
+    int* worklist = malloc(sizeof(int) * pf->count);
+    if (depth == NULL || worklist == NULL) {
+        free(depth);
+        free(worklist);
+        return false;
+    }
+    for (int i = 0; i < pf->count; i++) {
+        depth[i] = INT_MIN; // 尚未到达
+    }
+
+    int top = 0;
+    int first = next_live(pf, -1);
+    depth[first] = initial_slots;
+    worklist[top++] = first;
+    int max = initial_slots;
+    bool ok = true;
+
+    while (ok && top > 0) {
+        int index = worklist[--top];
+        PeepInstr* instr = &pf->instrs[index];
+        int before = depth[index];
+        int after = before + stack_effect(pf, instr);
+        max = after > max ? after : max;
+        if (before - stack_inputs(pf, instr) < min_depth) {
+            ok = false;
+            break;
+        }
+
+        int succ[2];
+        int succ_depth[2];
+        int succ_num = 0;
+        switch (instr->op) {
+            case OPCODE_RETURN:
+            case OPCODE_END:
+                break;
+            case OPCODE_JMP:
+            case OPCODE_LOOP:
+                succ[succ_num] = instr->target;
+                succ_depth[succ_num++] = before;
+                break;
+            case OPCODE_AND:
+            case OPCODE_OR:
+                // 跳转时第一个条件留在栈顶，否则弹出后计算第二个条件
+                succ[succ_num] = instr->target;
+                succ_depth[succ_num++] = before;
+                succ[succ_num] = next_live(pf, index);
+                succ_depth[succ_num++] = after;
+                break;
+            case OPCODE_JMP_IF_FALSE:
+                succ[succ_num] = instr->target;
+                succ_depth[succ_num++] = after;
+                succ[succ_num] = next_live(pf, index);
+                succ_depth[succ_num++] = after;
+                break;
+            default:
+                succ[succ_num] = next_live(pf, index);
+                succ_depth[succ_num++] = after;
+                break;
+        }
+
+        for (int i = 0; i < succ_num; i++) {
+            if (succ[i] == -1) {
+                ok = false;
+            } else if (depth[succ[i]] == INT_MIN) {
+                depth[succ[i]] = succ_depth[i];
+                worklist[top++] = succ[i];
+            } else if (depth[succ[i]] != succ_depth[i]) {
+                ok = false;
+            }
+        }
+    }
+
+    free(depth);
+    free(worklist);
+    *max_out = (u32)max;
+    return ok;
+}
+
+void peephole_optimize(ObjFn* fn, u32 initial_slots) {
+    u32 len = fn->instr_stream.count;
+    if (len == 0) {
+        return;
+    }
+
+    PeepFn pf = {
+        .instrs = malloc(sizeof(PeepInstr) * len),
+        .count = 0,
+        .code = malloc(len),
+    };
+    if (pf.instrs == NULL || pf.code == NULL) {
+        goto end;
+    }
+    memcpy(pf.code, fn->instr_stream.datas, len);
+
+    if (!decode(&pf, fn) || pf.instrs[pf.count - 1].op != OPCODE_END) {
+        goto end;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < pf.count; i++) {
+            if (!pf.instrs[i].removed && peephole_at(&pf, i)) {
+                changed = true;
+            }
+        }
+    }
+
+    select_superinstructions(&pf);
+    encode(&pf, fn);
+
+    // 以上变换不会增加任何位置的栈深度，分析失败时保留编译期的计数仍是安全的
+    u32 max_stack = 0;
+    if (compute_max_stack(&pf, initial_slots, -(int)fn->argc, &max_stack)) {
+        fn->max_stack_slot_used = max_stack;
+    }
+
+end:
+    free(pf.instrs);
+    free(pf.code);
+}
+
+bool peephole_verify_stack(ObjFn* fn, u32 initial_slots, u32* max_out) {
+    u32 len = fn->instr_stream.count;
+    PeepFn pf = {
+        .instrs = malloc(sizeof(PeepInstr) * len),
+        .count = 0,
+        .code = fn->instr_stream.datas, // 只读，无需复制
+    };
+    if (pf.instrs == NULL) {
+        return false;
+    }
+
+    bool ok = len > 0 && decode(&pf, fn) && compute_max_stack(&pf, initial_slots, -(int)fn->argc, max_out);
+    free(pf.instrs);
+    return ok;
+}
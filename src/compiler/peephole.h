@@ -0,0 +1,15 @@
+#ifndef __COMPILER_PEEPHOLE_H__
+#define __COMPILER_PEEPHOLE_H__
+
+#include "common.h"
+#include "obj_fn.h"
+
+// 对编译完成（已写入 END）的函数指令流做窥孔优化并重新计算 max_stack_slot_used。
+// initial_slots 为编译单元开始时的栈槽数，与 compile_unit_pubstruct_init 中的计数方式一致
+void peephole_optimize(ObjFn* fn, u32 initial_slots);
+
+// 校验指令流的控制流并重新计算栈的最大深度，用于加载字节码缓存，指令长度须已校验过。
+// 跳转目标不是指令起始位置、同一条指令经不同路径到达时深度不一致或会读到形参以下的栈槽时返回 false
+bool peephole_verify_stack(ObjFn* fn, u32 initial_slots, u32* max_out);
+
+#endif
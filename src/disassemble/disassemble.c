@@ -13,19 +13,23 @@ static const char* op_name_map[] = {
 };
 #undef OPCODE_SLOTS
 
+const char* opcode_name(OpCode op) {
+    return op_name_map[op];
+}
+
 void print_value(Value* val) {
-    switch (val->type) {
+    switch (VALUE_TYPE(*val)) {
         case VT_I32:
-            printf("<i32 %d>", val->i32val);
+            printf("<i32 %d>", VALUE_TO_I32(*val));
             break;
         case VT_U32:
-            printf("<u32 %u>", val->u32val);
+            printf("<u32 %u>", VALUE_TO_U32(*val));
             break;
         case VT_U8:
-            printf("<u8 %u>", val->u8val);
+            printf("<u8 %u>", VALUE_TO_U8(*val));
             break;
         case VT_F64:
-            printf("<f64 %lf>", val->f64val);
+            printf("<f64 %lf>", VALUE_TO_F64(*val));
             break;
         case VT_TRUE:
             printf("<bool true>");
@@ -40,7 +44,7 @@ void print_value(Value* val) {
             printf("<?undefined?>");
             break;
         case VT_OBJ: {
-            ObjHeader* obj = val->header;
+            ObjHeader* obj = VALUE_TO_OBJ(*val);
             switch (obj->type) {
                 case OT_STRING: {
                     printf("<String '%s' at %p>", ((ObjString*)obj)->val.start, obj);
@@ -112,14 +116,26 @@ void dis_asm(VM* vm, ObjModule* module, ObjFn* chunk) {
         OpCode op = chunk->instr_stream.datas[ip++];
         const char* name = op_name_map[op];
         int operand_byte = get_byte_of_operands(chunk->instr_stream.datas, chunk->constants.datas, ip - 1);
-        printf("%5d %-25s", (ip - 1), name);
-
-        if (operand_byte == 4 && op != OPCODE_CREATE_CLOSURE) {
-            // SUPERX [2b] [2b]
-            ip += 4;
-            int operand1 = (u16)(chunk->instr_stream.datas[ip - 4] << 8) | chunk->instr_stream.datas[ip - 3];
-            int operand2 = (u16)(chunk->instr_stream.datas[ip - 2] << 8) | chunk->instr_stream.datas[ip - 1];
-            printf("%-10d %-10d", operand1, operand2);
+        printf("%5d %-36s", (ip - 1), name);
+
+        if ((OPCODE_CALL0 <= op && op <= OPCODE_CALL16) || (OPCODE_SUPER0 <= op && op <= OPCODE_SUPER16)
+            || (OPCODE_LIST_SUBSCRIPT <= op && op <= OPCODE_MAP_SUBSCRIPT)) {
+            // CALLX 及快化指令 [2b method_index] [2b cache_index]
+            // SUPERX [2b method_index] [2b super_class_index] [2b cache_index]
+            ip += operand_byte;
+            int method_index = (u16)(chunk->instr_stream.datas[ip - operand_byte] << 8) | chunk->instr_stream.datas[ip - operand_byte + 1];
+            int cache_index = (u16)(chunk->instr_stream.datas[ip - 2] << 8) | chunk->instr_stream.datas[ip - 1];
+            printf("%-10d ", method_index);
+            if (operand_byte == 6) {
+                int super_index = (u16)(chunk->instr_stream.datas[ip - 4] << 8) | chunk->instr_stream.datas[ip - 3];
+                printf("%-10d ", super_index);
+            }
+            printf("%s", vm->all_method_names.datas[method_index].str);
+
+            if (chunk->inline_caches != NULL) {
+                InlineCache* cache = &chunk->inline_caches[cache_index];
+                printf(" (ic#%d hits: %u, misses: %u)", cache_index, cache->hits, cache->misses);
+            }
         } else if (op == OPCODE_CREATE_CLOSURE) {
             // CREATE_CLOSURE [2b closure_constant_index] <[1b bool_is_local_var] [1b index_for_value] for each upvalue>
             ip += 2;
@@ -142,9 +158,11 @@ void dis_asm(VM* vm, ObjModule* module, ObjFn* chunk) {
 
             if (op == OPCODE_LOAD_CONSTANT) {
                 print_value(&chunk->constants.datas[operand]);
-            } else if (op == OPCODE_LOAD_MODULE_VAR || op == OPCODE_STORE_MODULE_VAR) {
+            } else if (op == OPCODE_LOAD_MODULE_VAR || op == OPCODE_STORE_MODULE_VAR || op == OPCODE_STORE_MODULE_VAR_POP) {
                 printf("%s", module->module_var_name.datas[operand].str);
-            } else if ((OPCODE_CALL0 <= op && op <= OPCODE_CALL16) || (op == OPCODE_STATIC_METHOD || op == OPCODE_INSTANCE_METHOD)) {
+            } else if ((OPCODE_ADD <= op && op <= OPCODE_BIT_SR) || (OPCODE_LT_JMP_IF_FALSE <= op && op <= OPCODE_NE_JMP_IF_FALSE)
+                || (OPCODE_ADD_I32 <= op && op <= OPCODE_DIV_F64)
+                || (op == OPCODE_STATIC_METHOD || op == OPCODE_INSTANCE_METHOD)) {
                 printf("%s", vm->all_method_names.datas[operand].str);
             } else if (op == OPCODE_LOOP) {
                 printf("-> %-5d", ip - operand);
@@ -160,3 +178,43 @@ void dis_asm(VM* vm, ObjModule* module, ObjFn* chunk) {
         }
     }
 }
+
+#ifdef PROFILE_OPCODE_BIGRAM
+void dump_opcode_bigrams(VM* vm, u32 top_n) {
+    u64 total = 0;
+    for (u32 i = 0; i < OPCODE_NUM; i++) {
+        for (u32 j = 0; j < OPCODE_NUM; j++) {
+            total += vm->opcode_bigrams[i][j];
+        }
+    }
+    if (total == 0) {
+        return;
+    }
+
+    // 每轮选出剩余计数最大的指令对，top_n 很小，无需排序
+    bool printed[OPCODE_NUM][OPCODE_NUM] = {0};
+    fprintf(stderr, "====== opcode bigrams (total %lu) ======\n", (unsigned long)total);
+    for (u32 n = 0; n < top_n; n++) {
+        u32 first = 0, second = 0;
+        u64 max = 0;
+        for (u32 i = 0; i < OPCODE_NUM; i++) {
+            for (u32 j = 0; j < OPCODE_NUM; j++) {
+                if (!printed[i][j] && vm->opcode_bigrams[i][j] > max) {
+                    max = vm->opcode_bigrams[i][j];
+                    first = i;
+                    second = j;
+                }
+            }
+        }
+        if (max == 0) {
+            break;
+        }
+
+        printed[first][second] = true;
+        fprintf(
+            stderr, "%5.2f%% %12lu  %s -> %s\n",
+            max * 100.0 / total, (unsigned long)max, op_name_map[first], op_name_map[second]
+        );
+    }
+}
+#endif
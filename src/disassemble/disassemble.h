@@ -2,8 +2,15 @@
 #define __DIS_ASM_DISASSEMBLE_H__
 
 #include "obj_fn.h"
+#include "opcode.h"
 
 void dis_asm(VM* vm, ObjModule* module, ObjFn* chunk);
 void print_value(Value* val);
+const char* opcode_name(OpCode op);
+
+#ifdef PROFILE_OPCODE_BIGRAM
+// 向 stderr 输出执行次数最多的 top_n 个指令对
+void dump_opcode_bigrams(VM* vm, u32 top_n);
+#endif
 
 #endif
\ No newline at end of file
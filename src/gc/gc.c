@@ -3,6 +3,7 @@
 #include "common.h"
 #include "compiler.h"
 #include "header_obj.h"
+#include "jit.h"
 #include "meta_obj.h"
 #include "obj_fn.h"
 #include "obj_list.h"
@@ -16,30 +17,105 @@
 #include <stdlib.h>
 
 #ifdef OUTPUT_GC_INFO
+    #include <inttypes.h>
     #include <time.h>
     #include "disassemble.h"
 #endif
 
+#ifdef USE_PARALLEL_MARK
+    #include <pthread.h>
+    #include <sched.h>
+    #include <string.h>
+
+    #define MARK_SHARE_THRESHOLD 64 // 私有灰色栈超过该长度且公开栈为空时，分出一半供其它线程窃取
+
+    typedef struct markPool MarkPool;
+
+    // 并行标记时每个线程的上下文
+    typedef struct {
+        VM* vm;
+        MarkPool* pool;
+        Gray local; // 私有灰色栈，只有所属线程访问
+        Gray shared; // 公开的灰色栈，其它线程可从中窃取
+        pthread_mutex_t lock; // 保护 shared
+        u64 live_bytes; // 本线程标记的存活对象字节数
+    } MarkWorker;
+
+    struct markPool {
+        MarkWorker* workers;
+        u32 worker_num;
+        u32 idle_num; // 找不到工作的线程数，原子访问
+    };
+
+    static __thread MarkWorker* cur_worker = NULL;
+
+    // black_xxx 累计存活对象大小的位置，并行标记时各线程分别计数
+    #define LIVE_BYTES(vm) (*(cur_worker != NULL ? &cur_worker->live_bytes : &(vm)->allocated_bytes))
+#else
+    #define LIVE_BYTES(vm) ((vm)->allocated_bytes)
+#endif
+
+inline static void gray_push(Gray* grays, ObjHeader* obj) {
+    if (grays->count >= grays->capacity) {
+        grays->capacity = grays->count * 2;
+        grays->gray_objs = (ObjHeader**)(realloc(grays->gray_objs, grays->capacity * sizeof(ObjHeader*)));
+    }
+
+    grays->gray_objs[grays->count++] = obj;
+}
+
+// 标记对象，返回其此前是否已被标记
+inline static bool mark_obj(ObjHeader* obj) {
+#ifdef USE_MARK_BITMAP
+    // slab 中的对象使用所在页的标记位图，标记时不写对象头
+    if (obj->slab_class != SLAB_NO_CLASS) {
+        return slab_test_and_mark(obj);
+    }
+#endif
+#ifdef USE_PARALLEL_MARK
+    if (__atomic_load_n(&obj->is_dark, __ATOMIC_RELAXED)) {
+        return true;
+    }
+    return __atomic_exchange_n(&obj->is_dark, true, __ATOMIC_RELAXED);
+#else
+    if (obj->is_dark) {
+        return true;
+    }
+    obj->is_dark = true;
+    return false;
+#endif
+}
+
 void gray_obj(VM* vm, ObjHeader* obj) {
-    if (obj == NULL || obj->is_dark) {
+    if (obj == NULL) {
         return;
     }
 
-    obj->is_dark = true;
+#ifdef USE_GENERATIONAL_GC
+    // 新生代回收只追踪新生代对象，老年代对象视为存活，其对新生代的引用由记忆集提供
+    if (vm->in_minor_gc && obj->is_old) {
+        return;
+    }
+#endif
 
-    if (vm->grays.count >= vm->grays.capacity) {
-        vm->grays.capacity = vm->grays.count * 2;
-        vm->grays.gray_objs = (ObjHeader**)(realloc(vm->grays.gray_objs, vm->grays.capacity * sizeof(ObjHeader*)));
+    if (mark_obj(obj)) {
+        return;
     }
 
-    vm->grays.gray_objs[vm->grays.count++] = obj;
+#ifdef USE_PARALLEL_MARK
+    if (cur_worker != NULL) {
+        gray_push(&cur_worker->local, obj);
+        return;
+    }
+#endif
+    gray_push(&vm->grays, obj);
 }
 
 void gray_value(VM* vm, Value val) {
     if (!VALUE_IS_OBJ(val)) {
         return;
     }
-    gray_obj(vm, val.header);
+    gray_obj(vm, VALUE_TO_OBJ(val));
 }
 
 inline static void gray_buffer(VM* vm, BufferType(Value)* buffer) {
@@ -51,14 +127,14 @@ inline static void gray_buffer(VM* vm, BufferType(Value)* buffer) {
 static void black_class(VM* vm, Class* class) {
     gray_obj(vm, (ObjHeader*)class->header.class);
     gray_obj(vm, (ObjHeader*)class->super_class);
-    for (int i = 0; i < class->methods.count; i++) {
-        if (class->methods.datas[i].type == MT_SCRIPT) {
-            gray_obj(vm, (ObjHeader*)class->methods.datas[i].obj);
+    for (u32 i = 0; i < class->method_capacity; i++) {
+        if (class->method_keys[i] != 0 && class->method_slots[i].type == MT_SCRIPT) {
+            gray_obj(vm, (ObjHeader*)class->method_slots[i].obj);
         }
     }
     gray_obj(vm, (ObjHeader*)class->name);
-    vm->allocated_bytes += sizeof(Class);
-    vm->allocated_bytes += sizeof(Method) * class->methods.capacity;
+    LIVE_BYTES(vm) += sizeof(Class);
+    LIVE_BYTES(vm) += METHOD_TABLE_BYTES(class->method_capacity);
 }
 
 static void black_closure(VM* vm, ObjClosure* closure) {
@@ -66,8 +142,8 @@ static void black_closure(VM* vm, ObjClosure* closure) {
     for (int i = 0; i < closure->fn->upvalue_number; i++) {
         gray_obj(vm, (ObjHeader*)closure->upvalue[i]);
     }
-    vm->allocated_bytes += sizeof(ObjClosure);
-    vm->allocated_bytes += sizeof(ObjUpvalue) * closure->fn->upvalue_number;
+    LIVE_BYTES(vm) += sizeof(ObjClosure);
+    LIVE_BYTES(vm) += sizeof(ObjUpvalue) * closure->fn->upvalue_number;
 }
 
 static void black_thread(VM* vm, ObjThread* thread) {
@@ -89,18 +165,23 @@ static void black_thread(VM* vm, ObjThread* thread) {
     gray_obj(vm, (ObjHeader*)thread->caller);
     gray_value(vm, thread->error_obj);
 
-    vm->allocated_bytes += sizeof(ObjThread);
-    vm->allocated_bytes += sizeof(Value) * thread->stack_capacity;
-    vm->allocated_bytes += sizeof(Frame) * thread->frame_capacity;
+    LIVE_BYTES(vm) += sizeof(ObjThread);
+    LIVE_BYTES(vm) += sizeof(Value) * thread->stack_capacity;
+    LIVE_BYTES(vm) += sizeof(Frame) * thread->frame_capacity;
 }
 
 static void black_fn(VM* vm, ObjFn* fn) {
     gray_buffer(vm, &fn->constants);
-    vm->allocated_bytes += sizeof(ObjFn);
-    vm->allocated_bytes += sizeof(u8) * fn->instr_stream.capacity;
-    vm->allocated_bytes += sizeof(Value) * fn->constants.capacity;
+    LIVE_BYTES(vm) += sizeof(ObjFn);
+    LIVE_BYTES(vm) += sizeof(u8) * fn->instr_stream.capacity;
+    LIVE_BYTES(vm) += sizeof(Value) * fn->constants.capacity;
+    LIVE_BYTES(vm) += sizeof(InlineCache) * fn->inline_cache_number;
+    LIVE_BYTES(vm) += sizeof(LoopCounter) * fn->loop_counter_number;
+    if (fn->loop_counter_number > 0) {
+        LIVE_BYTES(vm) += sizeof(u16) * (fn->loop_counters[fn->loop_counter_number - 1].offset + 1);
+    }
 #if DEBUG
-    vm->allocated_bytes += sizeof(Int) * fn->instr_stream.capacity;
+    LIVE_BYTES(vm) += sizeof(Int) * fn->instr_stream.capacity;
 #endif
 }
 
@@ -109,41 +190,42 @@ static void black_instance(VM* vm, ObjInstance* instance) {
     for (int i = 0; i < instance->header.class->field_number; i++) {
         gray_value(vm, instance->fields[i]);
     }
-    vm->allocated_bytes += sizeof(ObjInstance);
-    vm->allocated_bytes += sizeof(Value) * instance->header.class->field_number;
+    LIVE_BYTES(vm) += sizeof(ObjInstance);
+    LIVE_BYTES(vm) += sizeof(Value) * instance->header.class->field_number;
 }
 
 static void black_list(VM* vm, ObjList* list) {
     gray_buffer(vm, &list->elements);
-    vm->allocated_bytes += sizeof(ObjList);
-    vm->allocated_bytes += sizeof(Value) * list->elements.capacity;
+    LIVE_BYTES(vm) += sizeof(ObjList);
+    LIVE_BYTES(vm) += sizeof(Value) * list->elements.capacity;
 }
 
 static void black_map(VM* vm, ObjMap* map) {
-    for (int i = 0; i < map->capacity; i++) {
-        if (VALUE_IS_UNDEFINED(map->entries[i].key)) {
+    for (u32 i = 0; i < map->entry_count; i++) {
+        if (!MAP_ENTRY_IS_VALID(&map->entries[i])) {
             continue;
         }
 
         gray_value(vm, map->entries[i].key);
         gray_value(vm, map->entries[i].val);
     }
-    vm->allocated_bytes += sizeof(ObjMap);
-    vm->allocated_bytes += sizeof(Entry) * map->capacity;
+    LIVE_BYTES(vm) += sizeof(ObjMap);
+    LIVE_BYTES(vm) += (sizeof(u8) + sizeof(u32)) * map->capacity + sizeof(Entry) * MAP_MAX_LOAD(map->capacity);
 }
 
 static void black_range(VM* vm) {
-    vm->allocated_bytes += sizeof(ObjRange);
+    LIVE_BYTES(vm) += sizeof(ObjRange);
 }
 
 static void black_string(VM* vm, ObjString* string) {
-    vm->allocated_bytes += sizeof(ObjString);
-    vm->allocated_bytes += sizeof(char) * (string->val.len + 1);
+    LIVE_BYTES(vm) += sizeof(ObjString);
+    LIVE_BYTES(vm) += sizeof(char) * (string->val.len + 1);
 }
 
 static void black_upvalue(VM* vm, ObjUpvalue* upvalue) {
-    gray_value(vm, upvalue->closed_upvalue);
-    vm->allocated_bytes += sizeof(ObjUpvalue);
+    // 关闭后 local_var_ptr 指向 closed_upvalue；开放时指向所在线程的栈
+    gray_value(vm, *upvalue->local_var_ptr);
+    LIVE_BYTES(vm) += sizeof(ObjUpvalue);
 }
 
 inline static void black_module(VM* vm, ObjModule* module) {
@@ -153,9 +235,10 @@ inline static void black_module(VM* vm, ObjModule* module) {
 
     gray_obj(vm, (ObjHeader*)module->name);
 
-    vm->allocated_bytes += sizeof(ObjModule);
-    vm->allocated_bytes += sizeof(String) * module->module_var_name.capacity;
-    vm->allocated_bytes += sizeof(Value) * module->module_var_value.capacity;
+    LIVE_BYTES(vm) += sizeof(ObjModule);
+    LIVE_BYTES(vm) += sizeof(String) * module->module_var_name.capacity;
+    LIVE_BYTES(vm) += sizeof(SymbolSlot) * module->module_var_name.slot_capacity;
+    LIVE_BYTES(vm) += sizeof(Value) * module->module_var_value.capacity;
 }
 
 inline static void black_native_pointer(VM* vm, ObjNativePointer* np) {
@@ -164,8 +247,8 @@ inline static void black_native_pointer(VM* vm, ObjNativePointer* np) {
 
 static void black_obj(VM* vm, ObjHeader* obj) {
 #if OUTPUT_GC_INFO
-    printf("~ mark [%u] ", vm->allocated_bytes);
-    u32 _before = vm->allocated_bytes;
+    printf("~ mark [%" PRIu64 "] ", vm->allocated_bytes);
+    u64 _before = vm->allocated_bytes;
     print_value(&OBJ_TO_VALUE(obj));
 #endif
     switch (obj->type) {
@@ -210,27 +293,191 @@ static void black_obj(VM* vm, ObjHeader* obj) {
     }
 
 #ifdef OUTPUT_GC_INFO
-    printf(" [%u, %ld]\n", vm->allocated_bytes, (long)vm->allocated_bytes - (long)_before);
+    printf(" [%" PRIu64 ", %" PRId64 "]\n", vm->allocated_bytes, (i64)vm->allocated_bytes - (i64)_before);
 #endif
 }
 
 static void black_obj_in_gray(VM* vm) {
     while (vm->grays.count > 0) {
         ObjHeader* header = vm->grays.gray_objs[--vm->grays.count];
+    #ifdef USE_GENERATIONAL_GC
+        // 记忆集中的老年代对象已计入 old_bytes
+        if (vm->in_minor_gc && header->is_old) {
+            u64 before = vm->allocated_bytes;
+            black_obj(vm, header);
+            vm->allocated_bytes = before;
+            continue;
+        }
+    #endif
         black_obj(vm, header);
     }
 }
 
+#ifdef USE_PARALLEL_MARK
+inline static void gray_init(Gray* grays) {
+    grays->capacity = 32;
+    grays->count = 0;
+    grays->gray_objs = (ObjHeader**)(malloc(grays->capacity * sizeof(ObjHeader*)));
+}
+
+// 私有栈较长而公开栈已被取空时，将私有栈底部（较早置灰）的一半移入公开栈
+static void mark_worker_share(MarkWorker* worker) {
+    if (worker->local.count < MARK_SHARE_THRESHOLD || __atomic_load_n(&worker->shared.count, __ATOMIC_ACQUIRE) > 0) {
+        return;
+    }
+
+    u32 half = worker->local.count / 2;
+    pthread_mutex_lock(&worker->lock);
+    Gray* shared = &worker->shared;
+    if (shared->count + half > shared->capacity) {
+        shared->capacity = (shared->count + half) * 2;
+        shared->gray_objs = (ObjHeader**)(realloc(shared->gray_objs, shared->capacity * sizeof(ObjHeader*)));
+    }
+    memcpy(shared->gray_objs + shared->count, worker->local.gray_objs, half * sizeof(ObjHeader*));
+    // 其它线程会不加锁地读取 count 判断是否有可窃取的对象
+    __atomic_store_n(&shared->count, shared->count + half, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&worker->lock);
+
+    worker->local.count -= half;
+    memmove(worker->local.gray_objs, worker->local.gray_objs + half, worker->local.count * sizeof(ObjHeader*));
+}
+
+// 从 victim 的公开栈中取走一半放入 worker 的私有栈，返回是否取到
+static bool mark_worker_steal_from(MarkWorker* worker, MarkWorker* victim) {
+    if (__atomic_load_n(&victim->shared.count, __ATOMIC_ACQUIRE) == 0) {
+        return false;
+    }
+
+    pthread_mutex_lock(&victim->lock);
+    u32 count = victim->shared.count;
+    u32 take = (count + 1) / 2;
+    for (u32 i = 0; i < take; i++) {
+        gray_push(&worker->local, victim->shared.gray_objs[count - 1 - i]);
+    }
+    __atomic_store_n(&victim->shared.count, count - take, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&victim->lock);
+
+    return take > 0;
+}
+
+// 取下一个待标记的对象：依次尝试私有栈、自身公开栈、其它线程的公开栈
+static ObjHeader* mark_worker_next(MarkWorker* worker) {
+    if (worker->local.count > 0) {
+        return worker->local.gray_objs[--worker->local.count];
+    }
+
+    MarkPool* pool = worker->pool;
+    u32 self = worker - pool->workers;
+    for (u32 i = 0; i < pool->worker_num; i++) {
+        if (mark_worker_steal_from(worker, &pool->workers[(self + i) % pool->worker_num])) {
+            return worker->local.gray_objs[--worker->local.count];
+        }
+    }
+    return NULL;
+}
+
+// 没有可做的工作时等待：任一公开栈出现对象则返回 true 继续窃取；所有线程都空闲时标记结束，返回 false
+static bool mark_worker_wait(MarkWorker* worker) {
+    MarkPool* pool = worker->pool;
+    __atomic_add_fetch(&pool->idle_num, 1, __ATOMIC_SEQ_CST);
+    while (true) {
+        for (u32 i = 0; i < pool->worker_num; i++) {
+            if (__atomic_load_n(&pool->workers[i].shared.count, __ATOMIC_ACQUIRE) > 0) {
+                __atomic_sub_fetch(&pool->idle_num, 1, __ATOMIC_SEQ_CST);
+                return true;
+            }
+        }
+        if (__atomic_load_n(&pool->idle_num, __ATOMIC_SEQ_CST) == pool->worker_num) {
+            return false;
+        }
+        sched_yield();
+    }
+}
+
+static void* mark_worker_run(void* arg) {
+    MarkWorker* worker = (MarkWorker*)arg;
+    cur_worker = worker;
+
+    while (true) {
+        ObjHeader* obj = mark_worker_next(worker);
+        if (obj == NULL) {
+            if (mark_worker_wait(worker)) {
+                continue;
+            }
+            break;
+        }
+        black_obj(worker->vm, obj);
+        mark_worker_share(worker);
+    }
+
+    cur_worker = NULL;
+    return NULL;
+}
+
+// 以 worker_num 个线程（含当前线程）并行清空灰色栈
+static void parallel_black_obj_in_gray(VM* vm, u32 worker_num) {
+    MarkPool pool = {
+        .workers = (MarkWorker*)malloc(sizeof(MarkWorker) * worker_num),
+        .worker_num = worker_num,
+        .idle_num = 0,
+    };
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * worker_num);
+    bool* started = (bool*)malloc(sizeof(bool) * worker_num);
+
+    for (u32 i = 0; i < worker_num; i++) {
+        MarkWorker* worker = &pool.workers[i];
+        worker->vm = vm;
+        worker->pool = &pool;
+        worker->live_bytes = 0;
+        gray_init(&worker->local);
+        gray_init(&worker->shared);
+        pthread_mutex_init(&worker->lock, NULL);
+    }
+
+    // 已置灰的根平均分配到各线程的公开栈
+    for (u32 i = 0; i < vm->grays.count; i++) {
+        gray_push(&pool.workers[i % worker_num].shared, vm->grays.gray_objs[i]);
+    }
+    vm->grays.count = 0;
+
+    for (u32 i = 1; i < worker_num; i++) {
+        started[i] = pthread_create(&threads[i], NULL, mark_worker_run, &pool.workers[i]) == 0;
+        if (!started[i]) {
+            // 创建失败的线程视为一直空闲，其公开栈中的对象由其它线程窃取
+            __atomic_add_fetch(&pool.idle_num, 1, __ATOMIC_SEQ_CST);
+        }
+    }
+    mark_worker_run(&pool.workers[0]);
+
+    for (u32 i = 0; i < worker_num; i++) {
+        MarkWorker* worker = &pool.workers[i];
+        if (i > 0 && started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+        vm->allocated_bytes += worker->live_bytes;
+        free(worker->local.gray_objs);
+        free(worker->shared.gray_objs);
+        pthread_mutex_destroy(&worker->lock);
+    }
+
+    free(started);
+    free(threads);
+    free(pool.workers);
+}
+#endif
+
 void free_obj(VM* vm, ObjHeader* header) {
 #ifdef OUTPUT_GC_INFO
-    u32 _before = vm->allocated_bytes;
-    printf("# free [%u] ", _before);
+    u64 _before = vm->allocated_bytes;
+    printf("# free [%" PRIu64 "] ", _before);
     print_value(&OBJ_TO_VALUE(header));
 #endif
 
     switch (header->type) {
         case OT_CLASS: {
-            gc_BufferClear(Method, &((Class*)header)->methods, vm);
+            if (((Class*)header)->method_keys != NULL) {
+                mem_manager(vm, ((Class*)header)->method_keys, METHOD_TABLE_BYTES(((Class*)header)->method_capacity), 0);
+            }
             break;
         }
         case OT_THREAD: {
@@ -243,6 +490,12 @@ void free_obj(VM* vm, ObjHeader* header) {
             ObjFn* fn = (ObjFn*)header;
             gc_BufferClear(Value, &fn->constants, vm);
             gc_BufferClear(Byte, &fn->instr_stream, vm);
+            DEALLOCATE(vm, fn->inline_caches);
+            DEALLOCATE(vm, fn->loop_counters);
+            DEALLOCATE(vm, fn->loop_counter_index);
+        #ifdef USE_TEMPLATE_JIT
+            jit_free(fn);
+        #endif
         #ifdef DEBUG
             gc_BufferClear(Int, &fn->debug->line);
             DEALLOCATE(vm, fn->debug->fn_name);
@@ -255,11 +508,11 @@ void free_obj(VM* vm, ObjHeader* header) {
             break;
         }
         case OT_MAP: {
-            DEALLOCATE(vm, ((ObjMap*)header)->entries);
+            DEALLOCATE(vm, ((ObjMap*)header)->ctrls); // indices、entries 与控制字节在同一块内存中
             break;
         }
         case OT_MODULE:{
-            gc_BufferClear(String, &((ObjModule*)header)->module_var_name, vm);
+            gc_symbol_table_clear(vm, &((ObjModule*)header)->module_var_name);
             gc_BufferClear(Value, &((ObjModule*)header)->module_var_value, vm);
             break;
         }
@@ -282,32 +535,112 @@ void free_obj(VM* vm, ObjHeader* header) {
             UNREACHABLE();
     }
 
-    DEALLOCATE(vm, header);
+    obj_deallocate(vm, header);
 
 #ifdef OUTPUT_GC_INFO
-    printf(" [%u, %ld]\n", vm->allocated_bytes, (long)vm->allocated_bytes - (long)_before);
+    printf(" [%" PRIu64 ", %" PRId64 "]\n", vm->allocated_bytes, (i64)vm->allocated_bytes - (i64)_before);
 #endif
 }
 
+#ifdef USE_MARK_BITMAP
+// 回收页中已分配但未被标记的对象，并清空标记位图
+static void sweep_slab_page(VM* vm, SlabPage* page) {
+    for (u32 w = 0; w < SLAB_BITMAP_WORDS; w++) {
+        u64 dead = page->live_bits[w] & ~page->mark_bits[w];
+        page->mark_bits[w] = 0;
+        while (dead != 0) {
+            u32 bit = __builtin_ctzll(dead);
+            dead &= dead - 1;
+            free_obj(vm, (ObjHeader*)slab_slot(page, w * 64 + bit));
+        }
+    }
+    page->need_sweep = false;
+}
+
+// 惰性清除：依次清除该大小类中待清除的页，直到空闲链表中有可用的槽
+void gc_lazy_sweep(VM* vm, u8 size_class) {
+    SlabAllocator* slab = &vm->slab;
+    while (slab->free_list[size_class] == NULL && slab->sweep_cursor[size_class] != NULL) {
+        SlabPage* page = slab->sweep_cursor[size_class];
+        slab->sweep_cursor[size_class] = page->next;
+        sweep_slab_page(vm, page);
+    }
+}
+
+// 完成上一轮剩余的清除，标记位图清空后才能开始新一轮标记
+static void finish_lazy_sweep(VM* vm) {
+    SlabAllocator* slab = &vm->slab;
+    for (int i = 0; i < SLAB_CLASS_NUM; i++) {
+        while (slab->sweep_cursor[i] != NULL) {
+            SlabPage* page = slab->sweep_cursor[i];
+            slab->sweep_cursor[i] = page->next;
+            sweep_slab_page(vm, page);
+        }
+    }
+}
+#endif
+
 void gray_compile_unit(VM* vm, CompileUnitPubStruct* cu) {
     //向上遍历父编译器外层链 使其fn可到达
     //编译结束后,vm->curParser会在endCompileUnit中置为NULL,
     //本函数是在编译过程中调用的,即vm->curParser肯定不为NULL,
     ASSERT(vm->cur_parser != NULL, "only called while compiling!");
     do {
-        gray_obj(vm, (ObjHeader*)cu->fn);
+        // 编译单元在 objfn_new 分配 fn 之前已经发布
+        if (cu->fn != NULL) {
+            gray_obj(vm, (ObjHeader*)cu->fn);
+        }
         cu = cu->enclosing_unit;
     } while (cu != NULL);
 }
 
-void start_gc(VM* vm) {
-#ifdef OUTPUT_GC_INFO
-    double start_time = (double)clock();
-    u32 before = vm->allocated_bytes;
-    printf("-- gc before: %d vm: %p --\n", before, vm);
+// 由存活对象大小计算下一次回收的阈值。设置了软上限时阈值不超过软上限，
+// 但存活对象已接近软上限时至少留出 1/8 的增长空间，避免连续回收
+static u64 next_gc_threshold(VM* vm, u64 live_bytes) {
+    u64 threshold = live_bytes * vm->config.heap_growth_factor;
+    if (threshold < vm->config.min_heap_size) {
+        threshold = vm->config.min_heap_size;
+    }
+
+    u64 soft = vm->config.soft_heap_size;
+    if (soft != 0 && threshold > soft) {
+        u64 least = live_bytes + live_bytes / 8;
+        threshold = soft > least ? soft : least;
+    }
+    return threshold;
+}
+
+// 驻留表与 vm->hot_fns 不作为根，标记结束后、清除前移除其中将被回收的对象
+static bool obj_is_marked(ObjHeader* obj) {
+#ifdef USE_MARK_BITMAP
+    if (obj->slab_class != SLAB_NO_CLASS) {
+        return slab_is_marked(obj);
+    }
 #endif
+    return obj->is_dark;
+}
 
-    vm->allocated_bytes = 0;
+#ifdef USE_GENERATIONAL_GC
+static bool obj_survives_minor_gc(ObjHeader* obj) {
+    return obj->is_old || obj->is_dark;
+}
+#endif
+
+// 删除 vm->hot_fns 中将被回收的闭包。函数仍存活时清除其热点标记，由之后执行的闭包重新记录
+static void prune_hot_fns(VM* vm, bool (*is_alive)(ObjHeader*)) {
+    u32 kept = 0;
+    for (u32 i = 0; i < vm->hot_fns.count; i++) {
+        ObjClosure* closure = VALUE_TO_OBJCLOSURE(vm->hot_fns.datas[i]);
+        if (is_alive((ObjHeader*)closure)) {
+            vm->hot_fns.datas[kept++] = vm->hot_fns.datas[i];
+        } else if (is_alive((ObjHeader*)closure->fn)) {
+            closure->fn->is_hot = false;
+        }
+    }
+    vm->hot_fns.count = kept;
+}
+
+static void gray_roots(VM* vm) {
     gray_obj(vm, (ObjHeader*)vm->all_module);
 
     for (int i = 0; i < vm->tmp_roots_num; i++) {
@@ -327,8 +660,172 @@ void start_gc(VM* vm) {
 
     gray_buffer(vm, &vm->allways_keep_roots);
     gray_buffer(vm, &vm->ast_obj_root);
+}
+
+#if defined(USE_GENERATIONAL_GC) || defined(USE_INCREMENTAL_GC)
+void gc_remember(VM* vm, ObjHeader* obj) {
+    if (obj->is_remembered) {
+        return;
+    }
+    obj->is_remembered = true;
+    gray_push(&vm->remembered_set, obj);
+}
+
+// 运行中的线程、临时根和正在编译的函数会在没有写屏障的情况下被修改，
+// 分代模式下每次回收前后、增量模式下每步标记时都将其加入记忆集
+static void remember_unbarriered_roots(VM* vm) {
+    for (u32 i = 0; i < vm->tmp_roots_num; i++) {
+        GC_REMEMBER(vm, vm->tmp_roots[i]);
+    }
+
+    GC_REMEMBER(vm, vm->cur_thread);
+
+    for (CompileUnitPubStruct* cu = vm->cur_cu; cu != NULL; cu = cu->enclosing_unit) {
+        if (cu->fn != NULL) {
+            GC_REMEMBER(vm, cu->fn);
+        }
+    }
+}
+
+static void clear_remembered_set(VM* vm) {
+    for (u32 i = 0; i < vm->remembered_set.count; i++) {
+        vm->remembered_set.gray_objs[i]->is_remembered = false;
+    }
+    vm->remembered_set.count = 0;
+}
+#endif
+
+#ifdef USE_GENERATIONAL_GC
+// 新生代回收：只追踪新生代，存活的新生代对象全部晋升到老年代
+static void start_minor_gc(VM* vm) {
+#ifdef OUTPUT_GC_INFO
+    double start_time = (double)clock();
+    u64 before = vm->allocated_bytes;
+    printf("-- minor gc before: %" PRIu64 " vm: %p --\n", before, vm);
+#endif
+
+    vm->in_minor_gc = true;
+    vm->allocated_bytes = 0;
+
+    remember_unbarriered_roots(vm);
+    gray_roots(vm);
+
+    // 记忆集中的老年代对象作为根，其引用的新生代对象由此可达
+    for (u32 i = 0; i < vm->remembered_set.count; i++) {
+        ObjHeader* obj = vm->remembered_set.gray_objs[i];
+        obj->is_dark = true;
+        gray_push(&vm->grays, obj);
+    }
 
     black_obj_in_gray(vm);
+#ifdef USE_STRING_INTERN
+    string_table_remove_unmarked(&vm->strings, obj_survives_minor_gc);
+#endif
+    prune_hot_fns(vm, obj_survives_minor_gc);
+
+    u64 promoted_bytes = vm->allocated_bytes;
+
+    ObjHeader* obj = vm->all_objs;
+    while (obj != NULL) {
+        ObjHeader* next = obj->next;
+        if (!obj->is_dark) {
+            free_obj(vm, obj);
+        } else {
+            obj->is_dark = false;
+            obj->is_old = true;
+            obj->next = vm->old_objs;
+            vm->old_objs = obj;
+        }
+        obj = next;
+    }
+    vm->all_objs = NULL;
+
+    for (u32 i = 0; i < vm->remembered_set.count; i++) {
+        vm->remembered_set.gray_objs[i]->is_dark = false;
+    }
+    clear_remembered_set(vm);
+    remember_unbarriered_roots(vm);
+
+    vm->method_cache_epoch++; // 被回收的class地址可能被复用，内联缓存失效
+    vm->in_minor_gc = false;
+    vm->old_bytes += promoted_bytes;
+    vm->allocated_bytes = vm->old_bytes;
+    vm->config.next_gc = vm->allocated_bytes + vm->config.nursery_size;
+
+#ifdef OUTPUT_GC_INFO
+    double elapsed = (double)clock() - start_time;
+    printf(
+        ">> minor gc after: %" PRIu64 ", promoted: %" PRIu64 ", next_gc: %" PRIu64 ", take %.3fms.\n",
+        vm->allocated_bytes, promoted_bytes, vm->config.next_gc, elapsed
+    );
+#endif
+}
+#endif
+
+#ifdef USE_INCREMENTAL_GC
+// 开始一轮增量标记：将根置灰，此后的标记工作分摊到之后的内存分配中
+static void incremental_begin(VM* vm) {
+#ifdef OUTPUT_GC_INFO
+    printf("-- incremental gc begin: %" PRIu64 " vm: %p --\n", vm->allocated_bytes, vm);
+#endif
+
+    vm->gc_marking = true;
+    vm->marked_bytes = 0;
+    vm->cycle_start_bytes = vm->allocated_bytes;
+
+    remember_unbarriered_roots(vm);
+    gray_roots(vm);
+}
+
+// 标记一步：最多处理 budget 字节的存活对象，返回灰色栈是否已清空
+static bool incremental_mark_step(VM* vm, u64 budget) {
+    remember_unbarriered_roots(vm);
+
+    // black_xxx 将存活对象的大小累加到 allocated_bytes，标记期间暂借其统计 marked_bytes
+    u64 allocated = vm->allocated_bytes;
+    u64 start = vm->marked_bytes;
+    vm->allocated_bytes = vm->marked_bytes;
+    while (vm->grays.count > 0 && vm->allocated_bytes - start < budget) {
+        black_obj(vm, vm->grays.gray_objs[--vm->grays.count]);
+    }
+    vm->marked_bytes = vm->allocated_bytes;
+    vm->allocated_bytes = allocated;
+
+    return vm->grays.count == 0;
+}
+
+// 结束本轮标记：重新扫描根及标记期间无写屏障修改过的对象，然后清除未标记的对象
+static void incremental_finish(VM* vm) {
+#ifdef OUTPUT_GC_INFO
+    double start_time = (double)clock();
+    u64 before = vm->allocated_bytes;
+#endif
+
+    remember_unbarriered_roots(vm);
+
+    u64 allocated = vm->allocated_bytes;
+    vm->allocated_bytes = vm->marked_bytes;
+
+    gray_roots(vm);
+    for (u32 i = 0; i < vm->remembered_set.count; i++) {
+        ObjHeader* obj = vm->remembered_set.gray_objs[i];
+        if (!obj->is_dark) {
+            continue; // 尚未被标记的对象若可达会经由根被扫描
+        }
+        u64 counted = vm->allocated_bytes; // 已计入 marked_bytes，仅重新扫描其引用
+        black_obj(vm, obj);
+        vm->allocated_bytes = counted;
+    }
+    black_obj_in_gray(vm);
+#ifdef USE_STRING_INTERN
+    string_table_remove_unmarked(&vm->strings, obj_is_marked);
+#endif
+    prune_hot_fns(vm, obj_is_marked);
+
+    vm->marked_bytes = vm->allocated_bytes;
+    vm->allocated_bytes = allocated;
+    clear_remembered_set(vm);
+    vm->gc_marking = false;
 
     ObjHeader** obj = &vm->all_objs;
     while (*obj != NULL) {
@@ -341,17 +838,153 @@ void start_gc(VM* vm) {
             obj = &(*obj)->next;
         }
     }
+    vm->method_cache_epoch++; // 被回收的class地址可能被复用，内联缓存失效
 
-    vm->config.next_gc = vm->allocated_bytes * vm->config.heap_growth_factor;
-    if (vm->config.next_gc < vm->config.min_heap_size) {
-        vm->config.next_gc = vm->config.min_heap_size;
+    // 标记期间新分配的对象未经扫描，全部视为存活
+    vm->allocated_bytes = vm->marked_bytes;
+    if (allocated > vm->cycle_start_bytes) {
+        vm->allocated_bytes += allocated - vm->cycle_start_bytes;
     }
 
+    vm->config.next_gc = next_gc_threshold(vm, vm->allocated_bytes);
+
+#ifdef OUTPUT_GC_INFO
+    double elapsed = (double)clock() - start_time;
+    printf(
+        ">> incremental gc finish: %" PRIu64 ", collected: %" PRId64 ", next_gc: %" PRIu64 ", take %.3fms.\n",
+        vm->allocated_bytes, (i64)before - (i64)vm->allocated_bytes, vm->config.next_gc, elapsed
+    );
+#endif
+}
+#endif
+
+// 由内存分配触发的回收。分代模式下老年代未超过阈值时只进行新生代回收；
+// 增量模式下每次只推进一步标记，灰色栈清空后完成本轮回收
+void start_gc(VM* vm) {
+#ifdef USE_GENERATIONAL_GC
+    if (vm->old_bytes < vm->config.next_full_gc) {
+        start_minor_gc(vm);
+        return;
+    }
+#endif
+
+#ifdef USE_INCREMENTAL_GC
+    if (!vm->gc_marking) {
+        incremental_begin(vm);
+    }
+
+    if (incremental_mark_step(vm, vm->config.gc_step_budget)) {
+        incremental_finish(vm);
+    } else {
+        vm->config.next_gc = vm->allocated_bytes + vm->config.gc_step_interval;
+    }
+    return;
+#endif
+
+    start_full_gc(vm);
+}
+
+// 完整的标记-清除回收
+void start_full_gc(VM* vm) {
+#ifdef USE_INCREMENTAL_GC
+    // 不限制工作量，一次完成当前（或新开始的）一轮标记
+    if (!vm->gc_marking) {
+        incremental_begin(vm);
+    }
+    incremental_mark_step(vm, UINT64_MAX);
+    incremental_finish(vm);
+    return;
+#endif
+
+#ifdef OUTPUT_GC_INFO
+    double start_time = (double)clock();
+    u64 before = vm->allocated_bytes;
+    printf("-- gc before: %" PRIu64 " vm: %p --\n", before, vm);
+#endif
+
+#ifdef USE_MARK_BITMAP
+    finish_lazy_sweep(vm);
+#endif
+
+#ifdef USE_PARALLEL_MARK
+    bool parallel = vm->config.mark_threads > 1 && vm->allocated_bytes >= vm->config.parallel_mark_min_heap;
+#endif
+
+    vm->allocated_bytes = 0;
+    gray_roots(vm);
+#ifdef USE_PARALLEL_MARK
+    if (parallel) {
+        parallel_black_obj_in_gray(vm, vm->config.mark_threads);
+        vm->parallel_mark_count++;
+    } else {
+        black_obj_in_gray(vm);
+    }
+#else
+    black_obj_in_gray(vm);
+#endif
+
+#ifdef USE_STRING_INTERN
+    string_table_remove_unmarked(&vm->strings, obj_is_marked);
+#endif
+    prune_hot_fns(vm, obj_is_marked);
+
+#ifdef USE_GENERATIONAL_GC
+    // 存活对象将全部归入老年代，记忆集随之失效；须在清除前清空，其中可能有待回收的对象
+    clear_remembered_set(vm);
+#endif
+
+    ObjHeader** obj = &vm->all_objs;
+    while (*obj != NULL) {
+        if (!(*obj)->is_dark) {
+            ObjHeader* unreached = *obj;
+            *obj = unreached->next;
+            free_obj(vm, unreached);
+        } else {
+            (*obj)->is_dark = false;
+        #ifdef USE_GENERATIONAL_GC
+            (*obj)->is_old = true;
+        #endif
+            obj = &(*obj)->next;
+        }
+    }
+
+    vm->method_cache_epoch++; // 被回收的class地址可能被复用，内联缓存失效
+
+#ifdef USE_MARK_BITMAP
+    // all_objs 中只有不由 slab 分配的大对象，slab 中的对象留待之后的分配中惰性清除
+    slab_begin_sweep(&vm->slab);
+#endif
+
+#ifdef USE_GENERATIONAL_GC
+    // 将老年代链表接在新生代之后继续清除
+    *obj = vm->old_objs;
+    while (*obj != NULL) {
+        if (!(*obj)->is_dark) {
+            ObjHeader* unreached = *obj;
+            *obj = unreached->next;
+            free_obj(vm, unreached);
+        } else {
+            (*obj)->is_dark = false;
+            obj = &(*obj)->next;
+        }
+    }
+    vm->old_objs = vm->all_objs;
+    vm->all_objs = NULL;
+
+    remember_unbarriered_roots(vm);
+
+    vm->old_bytes = vm->allocated_bytes;
+    vm->config.next_full_gc = next_gc_threshold(vm, vm->allocated_bytes);
+    vm->config.next_gc = vm->allocated_bytes + vm->config.nursery_size;
+#else
+    vm->config.next_gc = next_gc_threshold(vm, vm->allocated_bytes);
+#endif
+
 #ifdef OUTPUT_GC_INFO
     double elapsed = (double)clock() - start_time;
     printf(
-        ">> gc after: %u, collected: %ld, next_gc: %u, take %.3fms.\n",
-        vm->allocated_bytes, (long)before - (long)vm->allocated_bytes, vm->config.next_gc, elapsed
+        ">> gc after: %" PRIu64 ", collected: %" PRId64 ", next_gc: %" PRIu64 ", take %.3fms.\n",
+        vm->allocated_bytes, (i64)before - (i64)vm->allocated_bytes, vm->config.next_gc, elapsed
     );
 #endif
 }
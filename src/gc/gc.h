@@ -4,6 +4,57 @@
 #include "vm.h"
 
 void start_gc(VM* vm);
+void start_full_gc(VM* vm);
 void free_obj(VM* vm, ObjHeader* header);
 
-#endif
\ No newline at end of file
+#ifdef USE_MARK_BITMAP
+    void gc_lazy_sweep(VM* vm, u8 size_class);
+#endif
+
+#ifdef USE_GENERATIONAL_GC
+    void gc_remember(VM* vm, ObjHeader* obj);
+
+    // 写屏障：老年代对象 holder 中写入了新生代对象时，将 holder 加入记忆集
+    #define GC_WRITE_BARRIER(vm, holder, val) \
+        do {\
+            Value _barrier_val = (val);\
+            if (((ObjHeader*)(holder))->is_old && VALUE_IS_OBJ(_barrier_val) && !VALUE_TO_OBJ(_barrier_val)->is_old) {\
+                gc_remember(vm, (ObjHeader*)(holder));\
+            }\
+        } while (0)
+
+    // holder 的内容将在无写屏障的情况下被修改（如线程栈），直接将其加入记忆集
+    #define GC_REMEMBER(vm, holder) \
+        do {\
+            ObjHeader* _barrier_holder = (ObjHeader*)(holder);\
+            if (_barrier_holder != NULL && _barrier_holder->is_old) {\
+                gc_remember(vm, _barrier_holder);\
+            }\
+        } while (0)
+#elif defined(USE_INCREMENTAL_GC)
+    void gray_obj(VM* vm, ObjHeader* obj);
+    void gc_remember(VM* vm, ObjHeader* obj);
+
+    // 写屏障（插入屏障）：标记期间向已标记的 holder 写入对象时，将该对象置灰，避免其在本轮被回收
+    #define GC_WRITE_BARRIER(vm, holder, val) \
+        do {\
+            Value _barrier_val = (val);\
+            if ((vm)->gc_marking && ((ObjHeader*)(holder))->is_dark && VALUE_IS_OBJ(_barrier_val)) {\
+                gray_obj(vm, VALUE_TO_OBJ(_barrier_val));\
+            }\
+        } while (0)
+
+    // holder 的内容将在无写屏障的情况下被修改（如线程栈），标记结束前重新扫描
+    #define GC_REMEMBER(vm, holder) \
+        do {\
+            ObjHeader* _barrier_holder = (ObjHeader*)(holder);\
+            if ((vm)->gc_marking && _barrier_holder != NULL) {\
+                gc_remember(vm, _barrier_holder);\
+            }\
+        } while (0)
+#else
+    #define GC_WRITE_BARRIER(vm, holder, val)   ((void)0)
+    #define GC_REMEMBER(vm, holder)             ((void)0)
+#endif
+
+#endif
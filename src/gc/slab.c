@@ -0,0 +1,121 @@
+#include "slab.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+void slab_init(SlabAllocator* slab) {
+    memset(slab, 0, sizeof(SlabAllocator));
+}
+
+void slab_destroy(SlabAllocator* slab) {
+    for (int i = 0; i < SLAB_CLASS_NUM; i++) {
+        SlabPage* page = slab->pages[i];
+        while (page != NULL) {
+            SlabPage* next = page->next;
+            free(page);
+            page = next;
+        }
+    }
+    slab_init(slab);
+}
+
+// 为大小类申请新页，页首保存元信息，其余空间按对象大小切分
+static void slab_new_page(SlabAllocator* slab, u8 size_class) {
+    SlabPage* page = (SlabPage*)aligned_alloc(SLAB_PAGE_SIZE, SLAB_PAGE_SIZE);
+    if (page == NULL) {
+        MEM_ERROR("allocate slab page failed!");
+    }
+
+    page->slot_size = (size_class + 1) * SLAB_GRANULARITY;
+    page->slot_count = (SLAB_PAGE_SIZE - SLAB_PAGE_HEADER_SIZE) / page->slot_size;
+#ifdef USE_MARK_BITMAP
+    page->need_sweep = false;
+    memset(page->live_bits, 0, sizeof(page->live_bits));
+    memset(page->mark_bits, 0, sizeof(page->mark_bits));
+#endif
+
+    page->next = slab->pages[size_class];
+    slab->pages[size_class] = page;
+
+    slab->bump[size_class] = (char*)page + SLAB_PAGE_HEADER_SIZE;
+    slab->bump_end[size_class] = slab->bump[size_class] + page->slot_count * page->slot_size;
+
+    slab->stats.page_count++;
+    slab->stats.page_bytes += SLAB_PAGE_SIZE;
+}
+
+void* slab_alloc(SlabAllocator* slab, u8 size_class) {
+    ASSERT(size_class < SLAB_CLASS_NUM, "invalid slab size class.");
+
+    slab->stats.alloc_count++;
+    slab->stats.live_count[size_class]++;
+
+    void* ptr = slab->free_list[size_class];
+    if (ptr != NULL) {
+        slab->free_list[size_class] = ((SlabFreeNode*)ptr)->next;
+        slab->stats.reuse_count++;
+    } else {
+        u32 size = (size_class + 1) * SLAB_GRANULARITY;
+        if (slab->bump[size_class] == NULL || slab->bump[size_class] + size > slab->bump_end[size_class]) {
+            slab_new_page(slab, size_class);
+        }
+
+        ptr = slab->bump[size_class];
+        slab->bump[size_class] += size;
+    }
+
+#ifdef USE_MARK_BITMAP
+    SlabPage* page = slab_page_of(ptr);
+    u32 index = slab_slot_index(page, ptr);
+    page->live_bits[index / 64] |= (u64)1 << (index % 64);
+    if (page->need_sweep) {
+        // 所在页尚未清除，新对象须视为已标记，否则会被随后的清除回收
+        page->mark_bits[index / 64] |= (u64)1 << (index % 64);
+    }
+#endif
+
+    return ptr;
+}
+
+void slab_free(SlabAllocator* slab, void* ptr, u8 size_class) {
+    ASSERT(size_class < SLAB_CLASS_NUM, "invalid slab size class.");
+
+#ifdef USE_MARK_BITMAP
+    SlabPage* page = slab_page_of(ptr);
+    u32 index = slab_slot_index(page, ptr);
+    page->live_bits[index / 64] &= ~((u64)1 << (index % 64));
+#endif
+
+    SlabFreeNode* node = (SlabFreeNode*)ptr;
+    node->next = slab->free_list[size_class];
+    slab->free_list[size_class] = node;
+
+    slab->stats.free_count++;
+    slab->stats.live_count[size_class]--;
+}
+
+#ifdef USE_MARK_BITMAP
+void slab_begin_sweep(SlabAllocator* slab) {
+    for (int i = 0; i < SLAB_CLASS_NUM; i++) {
+        for (SlabPage* page = slab->pages[i]; page != NULL; page = page->next) {
+            page->need_sweep = true;
+        }
+        slab->sweep_cursor[i] = slab->pages[i];
+    }
+}
+
+void slab_for_each_live(SlabAllocator* slab, void (*visit)(void* obj, void* arg), void* arg) {
+    for (int i = 0; i < SLAB_CLASS_NUM; i++) {
+        for (SlabPage* page = slab->pages[i]; page != NULL; page = page->next) {
+            for (u32 w = 0; w < SLAB_BITMAP_WORDS; w++) {
+                u64 live = page->live_bits[w]; // visit 可能释放对象，先取出该字
+                while (live != 0) {
+                    u32 bit = __builtin_ctzll(live);
+                    live &= live - 1;
+                    visit(slab_slot(page, w * 64 + bit), arg);
+                }
+            }
+        }
+    }
+}
+#endif
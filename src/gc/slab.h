@@ -0,0 +1,109 @@
+#ifndef __GC_SLAB_H__
+#define __GC_SLAB_H__
+
+#include "common.h"
+
+// 按 16 字节划分大小类，不超过 SLAB_MAX_SIZE 的对象由 slab 分配
+#define SLAB_GRANULARITY    16
+#define SLAB_MAX_SIZE       256
+#define SLAB_CLASS_NUM      (SLAB_MAX_SIZE / SLAB_GRANULARITY)
+#define SLAB_PAGE_SIZE      (1024 * 64) // 页按其大小对齐，由对象地址可直接找到所在页
+#define SLAB_NO_CLASS       0xff // 对象不由 slab 分配
+
+#ifdef USE_MARK_BITMAP
+    #define SLAB_MAX_SLOTS      (SLAB_PAGE_SIZE / SLAB_GRANULARITY)
+    #define SLAB_BITMAP_WORDS   (SLAB_MAX_SLOTS / 64)
+#endif
+
+typedef struct slabFreeNode {
+    struct slabFreeNode* next;
+} SlabFreeNode;
+
+// 页首的元信息，其后为 slot_count 个大小为 slot_size 的槽
+typedef struct slabPage {
+    struct slabPage* next; // 同一大小类的下一页
+    u32 slot_size;
+    u32 slot_count;
+#ifdef USE_MARK_BITMAP
+    bool need_sweep; // 标记结束后尚未清除
+    u64 live_bits[SLAB_BITMAP_WORDS]; // 已分配的槽
+    u64 mark_bits[SLAB_BITMAP_WORDS]; // 标记位图，代替对象头中的 is_dark
+#endif
+} SlabPage;
+
+#define SLAB_PAGE_HEADER_SIZE \
+    ((sizeof(SlabPage) + SLAB_GRANULARITY - 1) / SLAB_GRANULARITY * SLAB_GRANULARITY)
+
+typedef struct {
+    u64 page_bytes; // 向系统申请的页的总字节数
+    u32 page_count;
+    u64 alloc_count; // slab 分配次数
+    u64 reuse_count; // 其中从空闲链表复用的次数
+    u64 free_count; // 归还到空闲链表的次数
+    u32 live_count[SLAB_CLASS_NUM]; // 各大小类中存活的对象数
+} SlabStats;
+
+typedef struct {
+    SlabFreeNode* free_list[SLAB_CLASS_NUM];
+    SlabPage* pages[SLAB_CLASS_NUM]; // 各大小类的页链表，新页在表头
+    char* bump[SLAB_CLASS_NUM]; // 各大小类最新一页中未使用部分的起止
+    char* bump_end[SLAB_CLASS_NUM];
+#ifdef USE_MARK_BITMAP
+    SlabPage* sweep_cursor[SLAB_CLASS_NUM]; // 各大小类中下一个待清除的页
+#endif
+    SlabStats stats;
+} SlabAllocator;
+
+// 返回 size 对应的大小类，过大时返回 SLAB_NO_CLASS
+static inline u8 slab_size_class(u32 size) {
+    if (size == 0 || size > SLAB_MAX_SIZE) {
+        return SLAB_NO_CLASS;
+    }
+    return (size - 1) / SLAB_GRANULARITY;
+}
+
+void slab_init(SlabAllocator* slab);
+void slab_destroy(SlabAllocator* slab);
+void* slab_alloc(SlabAllocator* slab, u8 size_class);
+void slab_free(SlabAllocator* slab, void* ptr, u8 size_class);
+
+#ifdef USE_MARK_BITMAP
+static inline SlabPage* slab_page_of(void* ptr) {
+    return (SlabPage*)((uintptr_t)ptr & ~(uintptr_t)(SLAB_PAGE_SIZE - 1));
+}
+
+static inline u32 slab_slot_index(SlabPage* page, void* ptr) {
+    return (u32)((char*)ptr - (char*)page - SLAB_PAGE_HEADER_SIZE) / page->slot_size;
+}
+
+static inline void* slab_slot(SlabPage* page, u32 index) {
+    return (char*)page + SLAB_PAGE_HEADER_SIZE + index * page->slot_size;
+}
+
+static inline bool slab_is_marked(void* ptr) {
+    SlabPage* page = slab_page_of(ptr);
+    u32 index = slab_slot_index(page, ptr);
+    return (page->mark_bits[index / 64] >> (index % 64)) & 1;
+}
+
+// 标记对象，返回其此前是否已被标记
+static inline bool slab_test_and_mark(void* ptr) {
+    SlabPage* page = slab_page_of(ptr);
+    u32 index = slab_slot_index(page, ptr);
+    u64 bit = (u64)1 << (index % 64);
+#ifdef USE_PARALLEL_MARK
+    return (__atomic_fetch_or(&page->mark_bits[index / 64], bit, __ATOMIC_RELAXED) & bit) != 0;
+#else
+    u64 old = page->mark_bits[index / 64];
+    page->mark_bits[index / 64] = old | bit;
+    return (old & bit) != 0;
+#endif
+}
+
+// 标记结束后将所有页置为待清除，清除工作推迟到之后的分配中
+void slab_begin_sweep(SlabAllocator* slab);
+// 对所有已分配的对象调用 visit
+void slab_for_each_live(SlabAllocator* slab, void (*visit)(void* obj, void* arg), void* arg);
+#endif
+
+#endif
@@ -6,18 +6,76 @@
 #include <stdarg.h>
 #include "gc.h"
 
-void* mem_manager(VM* vm, void* ptr, u32 old_size, u32 new_size) {
+// 分配内存前检查：超过 next_gc 时回收；超过硬上限时先进行完整回收，
+// 仍超过则记录内存不足，由解释器在安全点以线程错误抛出
+static void check_heap(VM* vm) {
+    if (vm->allocated_bytes > vm->config.next_gc) {
+        start_gc(vm);
+    }
+
+    if (vm->config.max_heap_size != 0 && !vm->out_of_memory && vm->allocated_bytes > vm->config.max_heap_size) {
+        start_full_gc(vm);
+        if (vm->allocated_bytes > vm->config.max_heap_size) {
+            vm->out_of_memory = true;
+        }
+    }
+}
+
+void* mem_manager(VM* vm, void* ptr, u64 old_size, u64 new_size) {
     vm->allocated_bytes += new_size - old_size;
     if (new_size == 0) {
         free(ptr);
         return NULL;
     }
 
-    if (new_size > 0 && vm->allocated_bytes > vm->config.next_gc) {
-        start_gc(vm);
+    check_heap(vm);
+
+    void* res = realloc(ptr, new_size);
+    if (res == NULL) {
+        // 系统内存不足，完整回收后重试一次
+        start_full_gc(vm);
+        res = realloc(ptr, new_size);
+        if (res == NULL) {
+            MEM_ERROR("allocate %llu bytes failed.", (unsigned long long)new_size);
+        }
     }
+    return res;
+}
 
-    return realloc(ptr, new_size);
+// 启用 USE_SLAB_ALLOCATOR 时，小对象按大小类从 vm->slab 分配，大小类记录在对象头中
+void* obj_allocate(VM* vm, u32 size) {
+#ifdef USE_SLAB_ALLOCATOR
+    u8 size_class = slab_size_class(size);
+    if (size_class == SLAB_NO_CLASS) {
+        ObjHeader* header = (ObjHeader*)mem_manager(vm, NULL, 0, size);
+        header->slab_class = SLAB_NO_CLASS;
+        return header;
+    }
+
+    vm->allocated_bytes += size;
+    check_heap(vm);
+
+#ifdef USE_MARK_BITMAP
+    gc_lazy_sweep(vm, size_class);
+#endif
+    ObjHeader* header = (ObjHeader*)slab_alloc(&vm->slab, size_class);
+    header->slab_class = size_class;
+    return header;
+#else
+    return mem_manager(vm, NULL, 0, size);
+#endif
+}
+
+// 释放对象，内存计数不变
+void obj_deallocate(VM* vm, void* obj) {
+#ifdef USE_SLAB_ALLOCATOR
+    ObjHeader* header = (ObjHeader*)obj;
+    if (header->slab_class != SLAB_NO_CLASS) {
+        slab_free(&vm->slab, header, header->slab_class);
+        return;
+    }
+#endif
+    DEALLOCATE(vm, obj);
 }
 
 u32 ceil_to_power_of_2(u32 v) {
@@ -37,12 +95,29 @@ DEFINE_BUFFER_METHOD(Int)
 DEFINE_BUFFER_METHOD(Char)
 DEFINE_BUFFER_METHOD(Byte)
 
+void symbol_table_init(SymbolTable* table) {
+    table->datas = NULL;
+    table->capacity = 0;
+    table->count = 0;
+    table->slots = NULL;
+    table->slot_capacity = 0;
+}
+
 void symbol_table_clear(VM* vm, SymbolTable* buffer) {
     u32 idx = 0;
     while (idx < buffer->count) {
         mem_manager(vm, buffer->datas[idx++].str, 0, 0);
     }
-    StringBufferClear(vm, buffer);
+    mem_manager(vm, buffer->datas, sizeof(String) * buffer->capacity, 0);
+    mem_manager(vm, buffer->slots, sizeof(SymbolSlot) * buffer->slot_capacity, 0);
+    symbol_table_init(buffer);
+}
+
+// gc 回收模块时使用，内存已由 gc 统计，不再计入 allocated_bytes
+void gc_symbol_table_clear(VM* vm, SymbolTable* table) {
+    mem_manager(vm, table->datas, 0, 0);
+    mem_manager(vm, table->slots, 0, 0);
+    symbol_table_init(table);
 }
 
 void error_report_proto(char* file, int line, char* func, void* parser, ErrorType error_type, const char* fmt, ...) {
@@ -5,7 +5,9 @@
 
 #define DEFAULT_BUFFER_SIZE (512)
 
-void* mem_manager(VM* vm, void* ptr, u32 old_size, u32 new_size);
+void* mem_manager(VM* vm, void* ptr, u64 old_size, u64 new_size);
+void* obj_allocate(VM* vm, u32 size);
+void obj_deallocate(VM* vm, void* obj);
 
 // 创建带有扩展数组的结构，内存计数增加
 #define ALLOCATE(vm_ptr, type) \
@@ -15,6 +17,14 @@ void* mem_manager(VM* vm, void* ptr, u32 old_size, u32 new_size);
 #define ALLOCATE_EXTRA(vm_ptr, main_type, extra_size) \
     (main_type*)mem_manager(vm_ptr, NULL, 0, sizeof(main_type) + extra_size)
 
+// 创建对象，内存计数增加。对象须由 free_obj 通过 obj_deallocate 释放
+#define ALLOCATE_OBJ(vm_ptr, type) \
+    (type*)obj_allocate(vm_ptr, sizeof(type))
+
+// 创建带有扩展数组的对象，内存计数增加
+#define ALLOCATE_OBJ_EXTRA(vm_ptr, main_type, extra_size) \
+    (main_type*)obj_allocate(vm_ptr, sizeof(main_type) + extra_size)
+
 // 创建数组，内存计数增加
 #define ALLOCATE_ARRAY(vm_ptr, type, count) \
     (type*)mem_manager(vm_ptr, NULL, 0, sizeof(type) * count)
@@ -95,7 +105,24 @@ typedef char Char;
 typedef int Int;
 
 DECLARE_BUFFER_TYPE(String)
-typedef BufferType(String) SymbolTable;
+
+// 符号数达到该值时为符号表建立 hash 索引，更小的表直接线性查找
+#define SYMBOL_TABLE_INDEX_THRESHOLD 8
+
+typedef struct {
+    u32 hash;
+    u32 index; // 符号在 datas 中的下标 + 1，0 为空槽
+} SymbolSlot;
+
+// 符号按加入顺序保存在 datas 中，下标即符号的索引且始终不变；
+// slots 为开放寻址的 hash 索引，负载不超过 1/2，与 datas 同步更新
+typedef struct {
+    String* datas;
+    u32 capacity;
+    u32 count;
+    SymbolSlot* slots;
+    u32 slot_capacity; // 0（未建立索引）或 2 的幂
+} SymbolTable;
 DECLARE_BUFFER_TYPE(Int)
 DECLARE_BUFFER_TYPE(Char)
 DECLARE_BUFFER_TYPE(Byte)
@@ -106,7 +133,9 @@ typedef enum {
     ERROR_RUNTIME,
 } ErrorType;
 
+void symbol_table_init(SymbolTable* table);
 void symbol_table_clear(VM* vm, SymbolTable* buffer);
+void gc_symbol_table_clear(VM* vm, SymbolTable* table);
 void error_report_proto(char* file, int line, char* func, void* parser, ErrorType error_type, const char* fmt, ...);
 #define error_report(parser, error_type, ...) error_report_proto(__FILE__, __LINE__, (char*)__func__, parser, error_type, __VA_ARGS__)
 
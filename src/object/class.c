@@ -11,79 +11,86 @@
 #include "utils.h"
 #include "vm.h"
 
-DEFINE_BUFFER_METHOD(Method)
 
 bool value_is_equal(Value a, Value b) {
-    if (a.type != b.type) {
+    if (VALUE_TYPE(a) != VALUE_TYPE(b)) {
         return false;
     }
 
-    if (a.type == VT_NULL || a.type == VT_FALSE || a.type == VT_TRUE) {
+    if (VALUE_IS_NULL(a) || VALUE_IS_FALSE(a) || VALUE_IS_TRUE(a)) {
         return true;
     }
 
-    if (a.type == VT_I32) {
-        return a.i32val == b.i32val;
+    if (VALUE_IS_I32(a)) {
+        return VALUE_TO_I32(a) == VALUE_TO_I32(b);
     }
 
-    if (a.type == VT_F64) {
-        return a.f64val == b.f64val;
+    if (VALUE_IS_F64(a)) {
+        return VALUE_TO_F64(a) == VALUE_TO_F64(b);
     }
 
-    if (a.type == VT_U32) {
-        return a.u32val == b.u32val;
+    if (VALUE_IS_U32(a)) {
+        return VALUE_TO_U32(a) == VALUE_TO_U32(b);
     }
 
-    if (a.type == VT_U8) {
-        return a.u8val == b.u8val;
+    if (VALUE_IS_U8(a)) {
+        return VALUE_TO_U8(a) == VALUE_TO_U8(b);
     }
 
-    if (a.header == b.header) {
+    if (VALUE_TO_OBJ(a) == VALUE_TO_OBJ(b)) {
         return true;
     }
 
-    if (a.header->type != b.header->type) {
+    if (VALUE_TO_OBJ(a)->type != VALUE_TO_OBJ(b)->type) {
         return false;
     }
 
-    if (a.header->type == OT_STRING) {
+    if (VALUE_TO_OBJ(a)->type == OT_STRING) {
+#ifdef USE_STRING_INTERN
+        return false; // 字符串均已驻留，内容相同即为同一对象
+#else
         ObjString* str_a = VALUE_TO_STRING(a);
         ObjString* str_b = VALUE_TO_STRING(b);
         return (str_a->val.len == str_b->val.len)
             && (str_a->hash_code == str_b->hash_code)
             && (memcmp(str_a->val.start, str_b->val.start, str_a->val.len) == 0);
+#endif
     }
 
-    if (a.header->type == OT_RANGE) {
+    if (VALUE_TO_OBJ(a)->type == OT_RANGE) {
         ObjRange* ra = VALUE_TO_RANGE(a);
         ObjRange* rb = VALUE_TO_RANGE(b);
         return (ra->from == rb->from) && (ra->to == rb->to) && (ra->step == rb->step);
     }
 
-    if (a.header->type == OT_NATIVE_POINTER) {
-        return native_pointer_is_eq((ObjNativePointer*)a.header, (ObjNativePointer*)b.header);
+    if (VALUE_TO_OBJ(a)->type == OT_NATIVE_POINTER) {
+        return native_pointer_is_eq((ObjNativePointer*)VALUE_TO_OBJ(a), (ObjNativePointer*)VALUE_TO_OBJ(b));
     }
 
     return false;
 }
 
 Class* class_new_raw(VM* vm, const char* name, u32 field_num) {
-    Class* class = ALLOCATE(vm, Class);
+    Class* class = ALLOCATE_OBJ(vm, Class);
     objheader_init(vm, &class->header, OT_CLASS, class);
 
-    push_tmp_root(vm, (ObjHeader*)class);
-
-    class->name = objstring_new(vm, name, strlen(name));
+    class->name = NULL;
     class->field_number = field_num;
     class->super_class = NULL;
-    BufferInit(Method, &class->methods);
+    class->method_capacity = 0;
+    class->method_count = 0;
+    class->method_keys = NULL;
+    class->method_slots = NULL;
+
+    push_tmp_root(vm, (ObjHeader*)class);
+    class->name = objstring_new(vm, name, strlen(name));
 
     pop_tmp_root(vm);
     return class;
 }
 
 inline Class* get_class_of_object(VM* vm, Value object) {
-    switch (object.type) {
+    switch (VALUE_TYPE(object)) {
         case VT_U8:
             return vm->u8_class;
         case VT_U32:
@@ -135,3 +142,47 @@ Class* class_new(VM* vm, ObjString* class_name, u32 field_num, Class* super_clas
 
     return class;
 }
+
+static void method_table_insert(u32* keys, Method* slots, u32 capacity, u32 index, Method method) {
+    u32 slot = METHOD_SLOT_OF(index, capacity);
+    while (keys[slot] != 0) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    keys[slot] = index + 1;
+    slots[slot] = method;
+}
+
+static void method_table_resize(VM* vm, Class* class, u32 new_capacity) {
+    // 键与方法依次存放在同一块内存中，capacity 为偶数，method_slots 保持 8 字节对齐
+    u32* keys = (u32*)mem_manager(vm, NULL, 0, METHOD_TABLE_BYTES(new_capacity));
+    Method* slots = (Method*)(keys + new_capacity);
+    memset(keys, 0, sizeof(u32) * new_capacity);
+
+    for (u32 i = 0; i < class->method_capacity; i++) {
+        if (class->method_keys[i] != 0) {
+            method_table_insert(keys, slots, new_capacity, class->method_keys[i] - 1, class->method_slots[i]);
+        }
+    }
+    if (class->method_keys != NULL) {
+        mem_manager(vm, class->method_keys, METHOD_TABLE_BYTES(class->method_capacity), 0);
+    }
+
+    class->method_keys = keys;
+    class->method_slots = slots;
+    class->method_capacity = new_capacity;
+}
+
+void class_set_method(VM* vm, Class* class, u32 index, Method method) {
+    Method* exist = class_find_method(class, index);
+    if (exist != NULL) {
+        *exist = method;
+        return;
+    }
+
+    if ((class->method_count + 1) * 4 > class->method_capacity * 3) {
+        u32 new_capacity = class->method_capacity == 0 ? METHOD_TABLE_MIN_CAPACITY : class->method_capacity * 2;
+        method_table_resize(vm, class, new_capacity);
+    }
+    method_table_insert(class->method_keys, class->method_slots, class->method_capacity, index, method);
+    class->method_count++;
+}
@@ -7,19 +7,6 @@
 #include "obj_string.h"
 #include "obj_fn.h"
 
-#define VT_TO_VALUE(vt)         ((Value){vt, {0}})
-#define BOOL_TO_VALUE(b)        (b ? VT_TO_VALUE(VT_TRUE) : VT_TO_VALUE(VT_FALSE))
-#define I32_TO_VALUE(i)         ((Value){.type = VT_I32, .i32val = (i)})
-#define U32_TO_VALUE(i)         ((Value){.type = VT_U32, .u32val = (i)})
-#define U8_TO_VALUE(i)         ((Value){.type = VT_U8,  .u8val = (i)})
-#define F64_TO_VALUE(f)         ((Value){.type = VT_F64, .f64val = (f)})
-#define OBJ_TO_VALUE(obj)       ((Value){.type = VT_OBJ, .header = (ObjHeader*)(obj)})
-
-#define VALUE_TO_BOOL(v)        ((v).type == VT_TRUE ? true : false)
-#define VALUE_TO_I32(v)         ((v).i32val)
-#define VALUE_TO_U32(v)         ((v).u32val)
-#define VALUE_TO_F64(v)         ((v).f64val)
-#define VALUE_TO_OBJ(v)         (v.header)
 #define VALUE_TO_OBJSTR(v)      ((ObjString*)VALUE_TO_OBJ(v))
 #define VALUE_TO_OBJFN(v)       ((ObjFn*)VALUE_TO_OBJ(v))
 #define VALUE_TO_OBJCLOSURE(v)  ((ObjClosure*)VALUE_TO_OBJ(v))
@@ -33,23 +20,13 @@
 #define VALUE_TO_OBJMAP(v)      ((ObjMap*)VALUE_TO_OBJ(v))
 #define VALUE_TO_NATIVE_POINTER(v) ((ObjNativePointer*)VALUE_TO_OBJ(v))
 
-#define VALUE_IS_UNDEFINED(v)   (v.type == VT_UNDEFINED)
-#define VALUE_IS_FALSE(v)       (v.type == VT_FALSE)
-#define VALUE_IS_TRUE(v)        (v.type == VT_TRUE)
-#define VALUE_IS_BOOL(v)        (VALUE_IS_TRUE(v) || VALUE_IS_FALSE(v))
-#define VALUE_IS_I32(v)         (v.type == VT_I32)
-#define VALUE_IS_U32(v)         (v.type == VT_U32)
-#define VALUE_IS_U8(v)          (v.type == VT_U8)
-#define VALUE_IS_F64(v)         (v.type == VT_F64)
-#define VALUE_IS_NULL(v)        (v.type == VT_NULL)
-#define VALUE_IS_NUM(v)         (VALUE_IS_I32(v) || VALUE_IS_F64(v) || VALUE_IS_U32(v))
-#define VALUE_IS_OBJ(v)         (v.type == VT_OBJ)
-#define VALUE_IS_CLASS(v)       (v.type == VT_OBJ && VALUE_TO_OBJ(v)->type == OT_CLASS)
-#define VALUE_IS_INSTANCE(v)    (v.type == VT_OBJ && VALUE_TO_OBJ(v)->type == OT_INSTANCE)
-#define VALUE_IS_STRING(v)      (v.type == VT_OBJ && VALUE_TO_OBJ(v)->type == OT_STRING)
-#define VALUE_IS_CLOSURE(v)     (v.type == VT_OBJ && VALUE_TO_OBJ(v)->type == OT_CLOSURE)
-#define VALUE_IS_RANGE(v)       (v.type == VT_OBJ && VALUE_TO_OBJ(v)->type == OT_RANGE)
-#define VALUE_IS_NATIVE_POINTER(v) (v.type == VT_OBJ && VALUE_TO_OBJ(v)->type == OT_NATIVE_POINTER)
+#define VALUE_IS_OBJ_OF(v, ot)  (VALUE_IS_OBJ(v) && VALUE_TO_OBJ(v)->type == ot)
+#define VALUE_IS_CLASS(v)       VALUE_IS_OBJ_OF(v, OT_CLASS)
+#define VALUE_IS_INSTANCE(v)    VALUE_IS_OBJ_OF(v, OT_INSTANCE)
+#define VALUE_IS_STRING(v)      VALUE_IS_OBJ_OF(v, OT_STRING)
+#define VALUE_IS_CLOSURE(v)     VALUE_IS_OBJ_OF(v, OT_CLOSURE)
+#define VALUE_IS_RANGE(v)       VALUE_IS_OBJ_OF(v, OT_RANGE)
+#define VALUE_IS_NATIVE_POINTER(v) VALUE_IS_OBJ_OF(v, OT_NATIVE_POINTER)
 
 #define CLASS_IS_BUILTIN(vm, c) (c == vm->string_class || c == vm->fn_class || c == vm->list_class || c == vm->range_class || c == vm->map_class || c == vm->null_class || c == vm->bool_class || c == vm->i32_class || c == vm->f64_class || c == vm->thread_class || c == vm->native_pointer_class)
 
@@ -68,16 +45,57 @@ typedef struct {
     };
 } Method;
 
-DECLARE_BUFFER_TYPE(Method)
+// 调用点内联缓存：记录调用点上出现过的接收者class及其解析出的方法，最多 INLINE_CACHE_WAYS 项。
+// epoch 与 vm->method_cache_epoch 不一致时整个缓存失效，bind_method 与 gc 会递增后者。
+#define INLINE_CACHE_WAYS 4
 
+typedef struct {
+    Class* class;
+    Method method;
+} InlineCacheEntry;
+
+struct _InlineCache {
+    u32 epoch;
+    u32 entry_count;
+    u32 hits;
+    u32 misses;
+    InlineCacheEntry entries[INLINE_CACHE_WAYS];
+};
+
+// 每个类的方法表只保存自身定义及绑定父类时继承的方法，以全局方法索引（vm->all_method_names 的下标）为键开放寻址，
+// 负载不超过 3/4。method_keys 中为索引 + 1，0 为空槽；method_slots 与 method_keys 在同一块内存中
 struct _Class {
     ObjHeader header;
     Class* super_class; // 对象的父类
     u32 field_number;
-    BufferType(Method) methods;
+    u32 method_capacity; // 0 或 2 的幂
+    u32 method_count;
+    u32* method_keys;
+    Method* method_slots;
     ObjString* name;
 };
 
+#define METHOD_TABLE_MIN_CAPACITY 8
+#define METHOD_TABLE_BYTES(capacity) ((usize)(capacity) * (sizeof(u32) + sizeof(Method)))
+
+// 乘以奇数在低位上是双射，连续的方法索引不会互相冲突
+#define METHOD_SLOT_OF(index, capacity) (((index) * 0x9E3779B1u) & ((capacity) - 1))
+
+// 查找类中全局索引为 index 的方法，不存在时返回 NULL
+static inline Method* class_find_method(Class* class, u32 index) {
+    u32 capacity = class->method_capacity;
+    if (capacity == 0) {
+        return NULL;
+    }
+    u32 key = index + 1;
+    for (u32 slot = METHOD_SLOT_OF(index, capacity); class->method_keys[slot] != 0; slot = (slot + 1) & (capacity - 1)) {
+        if (class->method_keys[slot] == key) {
+            return &class->method_slots[slot];
+        }
+    }
+    return NULL;
+}
+
 typedef union {
     u64 bits64;
     u32 bits32[2];
@@ -91,5 +109,6 @@ bool value_is_equal(Value a, Value b);
 Class* class_new_raw(VM* vm, const char* name, u32 field_num);
 Class* get_class_of_object(VM* vm, Value object);
 Class* class_new(VM* vm, ObjString* class_name, u32 field_num, Class* super_class);
+void class_set_method(VM* vm, Class* class, u32 index, Method method);
 
 #endif
\ No newline at end of file
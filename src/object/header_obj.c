@@ -6,9 +6,22 @@ DEFINE_BUFFER_METHOD(Value)
 
 void objheader_init(VM* vm, ObjHeader* header, ObjType type, Class* class) {
     header->type = type;
+#ifdef USE_INCREMENTAL_GC
+    header->is_dark = vm->gc_marking; // 标记期间新分配的对象直接视为已标记，本轮不回收
+#else
     header->is_dark = false;
+#endif
+    header->is_old = false;
+    header->is_remembered = false;
     header->class = class;
     
+#ifdef USE_MARK_BITMAP
+    // slab 中的对象由页的位图记录，all_objs 只保存大对象
+    if (header->slab_class != SLAB_NO_CLASS) {
+        header->next = NULL;
+        return;
+    }
+#endif
     header->next = vm->all_objs;
     vm->all_objs = header;
 }
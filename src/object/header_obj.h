@@ -22,6 +22,11 @@ typedef enum {
 typedef struct objHeader {
     ObjType type;
     bool is_dark;
+    bool is_old; // 是否已晋升到老年代，仅 USE_GENERATIONAL_GC 时使用
+    bool is_remembered; // 是否已在记忆集中
+#ifdef USE_SLAB_ALLOCATOR
+    u8 slab_class; // 所属的 slab 大小类，SLAB_NO_CLASS 表示由 realloc 分配
+#endif
     Class* class; // 对象的元信息类(meta-class)，提示对象类型。
     struct objHeader* next;
 } ObjHeader;
@@ -6,7 +6,7 @@
 #include "vm.h"
 
 ObjModule* objmodule_new(VM* vm, const char* mod_name) {
-    ObjModule* obj = ALLOCATE(vm, ObjModule);
+    ObjModule* obj = ALLOCATE_OBJ(vm, ObjModule);
     if (obj == NULL) {
         MEM_ERROR("allocate ObjModule failed.");
     }
@@ -14,7 +14,7 @@ ObjModule* objmodule_new(VM* vm, const char* mod_name) {
     objheader_init(vm, &obj->header, OT_MODULE, NULL);
     push_tmp_root(vm, (ObjHeader*)obj);
     
-    BufferInit(String, &obj->module_var_name);
+    symbol_table_init(&obj->module_var_name);
     BufferInit(Value, &obj->module_var_value);
 
     obj->name = mod_name == NULL ? NULL : objstring_new(vm, mod_name, strlen(mod_name));
@@ -24,7 +24,7 @@ ObjModule* objmodule_new(VM* vm, const char* mod_name) {
 }
 
 ObjInstance* objinstance_new(VM* vm, Class* class) {
-    ObjInstance* obj = ALLOCATE_EXTRA(vm, ObjInstance, sizeof(Value) * class->field_number);
+    ObjInstance* obj = ALLOCATE_OBJ_EXTRA(vm, ObjInstance, sizeof(Value) * class->field_number);
     if (obj == NULL) {
         MEM_ERROR("allocate ObjInstance failed.");
     }
@@ -5,7 +5,7 @@
 #include "vm.h"
 
 ObjUpvalue* objupvalue_new(VM* vm, Value* local_var_ptr) {
-    ObjUpvalue* obj = ALLOCATE(vm, ObjUpvalue);
+    ObjUpvalue* obj = ALLOCATE_OBJ(vm, ObjUpvalue);
     objheader_init(vm, &obj->header, OT_UPVALUE, NULL);
     obj->local_var_ptr = local_var_ptr;
     obj->closed_upvalue = VT_TO_VALUE(VT_NULL);
@@ -14,7 +14,7 @@ ObjUpvalue* objupvalue_new(VM* vm, Value* local_var_ptr) {
 }
 
 ObjClosure* objclosure_new(VM* vm, ObjFn* objfn) {
-    ObjClosure* obj = ALLOCATE_EXTRA(vm, ObjClosure, sizeof(ObjUpvalue*) * objfn->upvalue_number);
+    ObjClosure* obj = ALLOCATE_OBJ_EXTRA(vm, ObjClosure, sizeof(ObjUpvalue*) * objfn->upvalue_number);
 
     objheader_init(vm, &obj->header, OT_CLOSURE, vm->fn_class);
     
@@ -28,7 +28,7 @@ ObjClosure* objclosure_new(VM* vm, ObjFn* objfn) {
 }
 
 ObjFn* objfn_new(VM* vm, ObjModule* module, u32 max_stack_slot_used) {
-    ObjFn* obj = ALLOCATE(vm, ObjFn);
+    ObjFn* obj = ALLOCATE_OBJ(vm, ObjFn);
     if (obj == NULL) {
         MEM_ERROR("allocate ObjFn failed.");
     }
@@ -43,6 +43,17 @@ ObjFn* objfn_new(VM* vm, ObjModule* module, u32 max_stack_slot_used) {
     
     obj->upvalue_number = 0;
     obj->argc = 0;
+    obj->inline_caches = NULL;
+    obj->inline_cache_number = 0;
+    obj->call_count = 0;
+    obj->loop_counters = NULL;
+    obj->loop_counter_number = 0;
+    obj->loop_counter_index = NULL;
+    obj->is_hot = false;
+#ifdef USE_TEMPLATE_JIT
+    obj->jit_failed = false;
+    obj->jit = NULL;
+#endif
 
 #ifdef DEBUG
     obj->debug = ALLOCATE(vm, FnDebug);
@@ -10,6 +10,21 @@ typedef struct {
     BufferType(Int) line;
 } FnDebug;
 
+typedef struct _InlineCache InlineCache; // 调用点内联缓存，定义于 class.h
+#ifdef USE_TEMPLATE_JIT
+typedef struct _JitCode JitCode; // 编译得到的机器码，定义于 jit.h
+#endif
+
+// 调用次数或某个 LOOP 的回跳次数达到阈值时函数成为热点，记录到 vm->hot_fns 并分层编译
+#define HOT_CALL_THRESHOLD  100
+#define HOT_LOOP_THRESHOLD  1000
+
+// LOOP 指令的回跳计数
+typedef struct {
+    u32 offset; // LOOP 在指令流中的位置
+    u64 count;
+} LoopCounter;
+
 typedef struct {
     ObjHeader header;
     BufferType(Byte) instr_stream; // 指令流
@@ -17,7 +32,18 @@ typedef struct {
     ObjModule* module;
     u32 max_stack_slot_used;
     u32 upvalue_number;
-    u8 argc;
+    u8 argc; // 形参数，不含 self
+    InlineCache* inline_caches; // 由 CALLx/SUPERx 的 cache_index 操作数索引
+    u32 inline_cache_number;
+    u64 call_count;
+    LoopCounter* loop_counters; // 每条 LOOP 一个，按 offset 递增排列
+    u32 loop_counter_number;
+    u16* loop_counter_index; // 以 LOOP 在指令流中的位置为下标，得到其计数器在 loop_counters 中的下标
+    bool is_hot; // 已记录到 vm->hot_fns，记录的闭包被回收时清除
+#ifdef USE_TEMPLATE_JIT
+    bool jit_failed; // 编译失败后不再尝试
+    JitCode* jit;
+#endif
 #ifdef DEBUG
     FnDebug* debug;
 #endif
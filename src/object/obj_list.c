@@ -1,12 +1,13 @@
 #include "obj_list.h"
 #include "class.h"
+#include "gc.h"
 #include "header_obj.h"
 #include "utils.h"
 #include "vm.h"
 
 ObjList* objlist_new(VM* vm, u32 element_count) {
     Value* element_array = element_count <= 0 ? NULL : ALLOCATE_ARRAY(vm, Value, element_count);
-    ObjList* obj = ALLOCATE(vm, ObjList);
+    ObjList* obj = ALLOCATE_OBJ(vm, ObjList);
     obj->elements = (BufferType(Value)) {
         .datas = element_array,
         .capacity = element_count,
@@ -22,7 +23,7 @@ void objlist_insert_element(VM* vm, ObjList* list, u32 index, Value value) {
     }
 
     if (VALUE_IS_OBJ(value)) {
-        push_tmp_root(vm, value.header);
+        push_tmp_root(vm, VALUE_TO_OBJ(value));
     }
 
     BufferAdd(Value, &list->elements, vm, value);
@@ -36,11 +37,12 @@ void objlist_insert_element(VM* vm, ObjList* list, u32 index, Value value) {
     }
 
     list->elements.datas[index] = value;
+    GC_WRITE_BARRIER(vm, list, value);
 }
 
 static void shrink_list(VM* vm, ObjList* list, u32 new_capacity) {
-    u32 old_size = list->elements.capacity * sizeof(Value);
-    u32 new_size = new_capacity * sizeof(Value);
+    u64 old_size = (u64)list->elements.capacity * sizeof(Value);
+    u64 new_size = (u64)new_capacity * sizeof(Value);
     mem_manager(vm, list->elements.datas, old_size, new_size);
     list->elements.capacity = new_capacity;
 }
@@ -48,7 +50,7 @@ static void shrink_list(VM* vm, ObjList* list, u32 new_capacity) {
 Value objlist_remove_element(VM* vm, ObjList* list, u32 index) {
     Value value_removed = list->elements.datas[index];
     if (VALUE_IS_OBJ(value_removed)) {
-        push_tmp_root(vm, value_removed.header);
+        push_tmp_root(vm, VALUE_TO_OBJ(value_removed));
     }
 
     for (int i = index; i < list->elements.count - 1; i++) {
@@ -1,18 +1,28 @@
 #include "obj_map.h"
 #include "class.h"
 #include "common.h"
+#include "gc.h"
 #include "header_obj.h"
 #include "sparrow.h"
 #include "utils.h"
 #include "vm.h"
 #include "obj_string.h"
 #include "obj_range.h"
+#include <string.h>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
 
 ObjMap* objmap_new(VM* vm) {
-    ObjMap* map = ALLOCATE(vm, ObjMap);
+    ObjMap* map = ALLOCATE_OBJ(vm, ObjMap);
     objheader_init(vm, &map->header, OT_MAP, vm->map_class);
     map->capacity = 0;
     map->len = 0;
+    map->growth_left = 0;
+    map->entry_count = 0;
+    map->ctrls = NULL;
+    map->indices = NULL;
     map->entries = NULL;
     return map;
 }
@@ -42,16 +52,9 @@ static u32 hash_obj(ObjHeader* header) {
     return 0;
 }
 
+// 数字以外的 hash，数字由 hash_key 处理
 static u32 hash_value(Value val) {
-    switch (val.type) {
-        case VT_F64:
-            return hash_num(val.f64val);
-        case VT_I32:
-            return hash_num(val.i32val);
-        case VT_U32:
-            return hash_num(val.u32val);
-        case VT_U8:
-            return hash_num(val.u8val);
+    switch (VALUE_TYPE(val)) {
         case VT_FALSE:
             return 0;
         case VT_TRUE:
@@ -59,121 +62,317 @@ static u32 hash_value(Value val) {
         case VT_NULL:
             return 2;
         case VT_OBJ:
-            return hash_obj(val.header);
+            return hash_obj(VALUE_TO_OBJ(val));
         default:
-            RUNTIME_ERROR("unhashable value. type: %d", val.type);
+            RUNTIME_ERROR("unhashable value. type: %d", VALUE_TYPE(val));
     }
     return 0;
 }
 
-static bool add_entry(Entry* entries, u32 capacity, Value key, Value val) {
-    u32 index = hash_value(key) % capacity;
-    while (true) {
-        if (entries[index].key.type == VT_UNDEFINED) {
-            entries[index].key = key;
-            entries[index].val = val;
-            return true;
-        } else if (value_is_equal(entries[index].key, key)) {
-            entries[index].val = val;
-            return false;
+// hash_num 等得到的 hash 低位往往相同（如整数的 double 表示低 32 位全为 0），先混合再使用
+inline static u32 mix_hash(u32 hash) {
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+// 低 7 位存入控制字节，其余位决定探测的起始组
+#define H1(hash) ((hash) >> 7)
+#define H2(hash) ((u8)((hash) & 0x7F))
+
+// 整数 key 以 4096 个相邻整数为一段，段号经 mix_hash 打散后作为段的起始组，段内相邻的整数依次落在相邻的组中。
+// 按顺序访问稠密的整数 key 时顺序访问索引表；各段起点随机，每组的负载与完全打散时相同，步长较大的整数 key 分属不同的段
+inline static u32 hash_int(i64 num) {
+    u64 bits = (u64)num;
+    u32 run = mix_hash((u32)(bits >> 12) ^ (u32)(bits >> 44));
+    u32 offset = (u32)(bits & 0xFFF);
+    return ((run + offset) << 7) | (((offset >> 5) ^ offset ^ (run >> 25)) & 0x7F);
+}
+
+// map 中使用的 hash：值为整数的数字（含值为整数的 f64）使用 hash_int，其余经 mix_hash 混合
+static u32 hash_key(Value key) {
+    switch (VALUE_TYPE(key)) {
+        case VT_I32:
+            return hash_int(VALUE_TO_I32(key));
+        case VT_U32:
+            return hash_int(VALUE_TO_U32(key));
+        case VT_U8:
+            return hash_int(VALUE_TO_U8(key));
+        case VT_F64: {
+            // 范围检查保证转换为 i64 有定义，NaN 不满足比较而走通用路径
+            double num = VALUE_TO_F64(key);
+            if (num >= -9.2e18 && num <= 9.2e18 && num == (double)(i64)num) {
+                return hash_int((i64)num);
+            }
+            return mix_hash(hash_num(num));
         }
-        index = (index + 1) % capacity;
+        default:
+            return mix_hash(hash_value(key));
     }
 }
 
-static void resize_map(VM* vm, ObjMap* map, u32 new_capacity) {
-    Entry* new_entries = ALLOCATE_ARRAY(vm, Entry, new_capacity);
+// 组内匹配结果为位掩码，第 i 位对应组内第 i 个槽
+typedef u32 GroupMask;
+
+#ifdef __SSE2__
+inline static GroupMask group_match(const u8* group, u8 h2) {
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+    return (GroupMask)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)h2)));
+}
 
-    for (int i = 0; i < new_capacity; i++) {
-        new_entries[i].key = VT_TO_VALUE(VT_UNDEFINED);
-        new_entries[i].val = VT_TO_VALUE(VT_FALSE);
+inline static GroupMask group_match_empty(const u8* group) {
+    return group_match(group, MAP_CTRL_EMPTY);
+}
+
+// 空槽与已删除的槽最高位都为 1
+inline static GroupMask group_match_empty_or_deleted(const u8* group) {
+    return (GroupMask)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+}
+#else
+inline static GroupMask group_match(const u8* group, u8 h2) {
+    GroupMask mask = 0;
+    for (int i = 0; i < MAP_GROUP_SIZE; i++) {
+        mask |= (GroupMask)(group[i] == h2) << i;
     }
+    return mask;
+}
+
+inline static GroupMask group_match_empty(const u8* group) {
+    return group_match(group, MAP_CTRL_EMPTY);
+}
 
-    if (new_capacity > 0) {
-        for (int i = 0; i < map->capacity; i++) {
-            if (map->entries[i].key.type == VT_UNDEFINED) {
-                continue;
+inline static GroupMask group_match_empty_or_deleted(const u8* group) {
+    GroupMask mask = 0;
+    for (int i = 0; i < MAP_GROUP_SIZE; i++) {
+        mask |= (GroupMask)(group[i] >> 7) << i;
+    }
+    return mask;
+}
+#endif
+
+// 取出并清除掩码中最低的置位，返回其位置
+inline static u32 mask_next(GroupMask* mask) {
+#if defined(__GNUC__)
+    u32 index = __builtin_ctz(*mask);
+#else
+    u32 index = 0;
+    while (!((*mask >> index) & 1)) {
+        index++;
+    }
+#endif
+    *mask &= *mask - 1;
+    return index;
+}
+
+// 按组进行三角数探测，组数为 2 的幂时可遍历所有组
+#define PROBE_START(map, hash) (H1(hash) & ((map)->capacity / MAP_GROUP_SIZE - 1))
+#define PROBE_NEXT(map, group, step) (((group) + (step)) & ((map)->capacity / MAP_GROUP_SIZE - 1))
+
+// 返回 key 所在的槽，不存在时返回 UINT32_MAX
+static u32 find_slot(ObjMap* map, Value key, u32 hash) {
+    if (map->capacity == 0) {
+        return UINT32_MAX;
+    }
+
+    u8 h2 = H2(hash);
+    u32 group = PROBE_START(map, hash);
+    for (u32 step = 1; ; step++) {
+        const u8* ctrls = &map->ctrls[group * MAP_GROUP_SIZE];
+
+        GroupMask match = group_match(ctrls, h2);
+        while (match != 0) {
+            u32 slot = group * MAP_GROUP_SIZE + mask_next(&match);
+            Entry* entry = &map->entries[map->indices[slot]];
+            if (entry->hash == hash && value_is_equal(key, entry->key)) {
+                return slot;
             }
+        }
 
-            add_entry(new_entries, new_capacity, map->entries[i].key, map->entries[i].val);
+        // 组内有空槽说明插入时探测不会越过此组
+        if (group_match_empty(ctrls) != 0) {
+            return UINT32_MAX;
         }
+        group = PROBE_NEXT(map, group, step);
     }
+}
+
+// 返回探测序列中第一个空槽或已删除的槽
+static u32 find_first_non_full(ObjMap* map, u32 hash) {
+    u32 group = PROBE_START(map, hash);
+    for (u32 step = 1; ; step++) {
+        GroupMask mask = group_match_empty_or_deleted(&map->ctrls[group * MAP_GROUP_SIZE]);
+        if (mask != 0) {
+            return group * MAP_GROUP_SIZE + mask_next(&mask);
+        }
+        group = PROBE_NEXT(map, group, step);
+    }
+}
+
+// 控制字节、下标与 entries 依次存放在同一块内存中，capacity 为 MAP_GROUP_SIZE 的倍数，各部分保持对齐
+inline static u64 table_bytes(u32 capacity) {
+    return (u64)capacity * (sizeof(u8) + sizeof(u32)) + (u64)MAP_MAX_LOAD(capacity) * sizeof(Entry);
+}
+
+// 根据稠密且无空位的 entries 重建索引表
+static void rebuild_index(ObjMap* map) {
+    ASSERT(map->entry_count == map->len, "entries must be compacted before rebuilding index.");
+
+    memset(map->ctrls, MAP_CTRL_EMPTY, map->capacity);
+    for (u32 i = 0; i < map->entry_count; i++) {
+        u32 hash = map->entries[i].hash;
+        u32 slot = find_first_non_full(map, hash);
+        map->ctrls[slot] = H2(hash);
+        map->indices[slot] = i;
+    }
+    map->growth_left = MAP_MAX_LOAD(map->capacity) - map->len;
+}
+
+// 将有效的 entry 按原顺序复制到 dest，返回复制的数量。dest 可以与 map->entries 相同
+static u32 compact_entries(ObjMap* map, Entry* dest) {
+    u32 count = 0;
+    for (u32 i = 0; i < map->entry_count; i++) {
+        if (MAP_ENTRY_IS_VALID(&map->entries[i])) {
+            dest[count++] = map->entries[i];
+        }
+    }
+    return count;
+}
+
+static void resize_map(VM* vm, ObjMap* map, u32 new_capacity) {
+    ASSERT(MAP_MAX_LOAD(new_capacity) >= map->len, "map capacity too small.");
 
-    DEALLOCATE_ARRAY(vm, map->entries, map->capacity);
+    u8* new_ctrls = (u8*)mem_manager(vm, NULL, 0, table_bytes(new_capacity));
+    u32* new_indices = (u32*)(new_ctrls + new_capacity);
+    Entry* new_entries = (Entry*)(new_indices + new_capacity);
+
+    u32 count = map->ctrls == NULL ? 0 : compact_entries(map, new_entries);
+    if (map->ctrls != NULL) {
+        mem_manager(vm, map->ctrls, table_bytes(map->capacity), 0);
+    }
+
+    map->ctrls = new_ctrls;
+    map->indices = new_indices;
     map->entries = new_entries;
     map->capacity = new_capacity;
+    map->entry_count = count;
+    rebuild_index(map);
 }
 
-static Entry* find_entry(ObjMap* map, Value key) {
+// 没有可用的空槽或 entries 已满时调用：删除留下的空位较多时原地压缩 entries 并重建索引，否则扩容
+static void reserve_entry(VM* vm, ObjMap* map) {
     if (map->capacity == 0) {
-        return NULL;
+        resize_map(vm, map, MAP_GROUP_SIZE);
+    } else if (map->len <= MAP_MAX_LOAD(map->capacity) / 2) {
+        map->entry_count = compact_entries(map, map->entries);
+        rebuild_index(map);
+    } else {
+        resize_map(vm, map, map->capacity * 2);
     }
+}
 
-    u32 index = hash_value(key) % map->capacity;
-    Entry* entry = NULL;
-    while (true) {
-        entry = &map->entries[index];
-        
-        if (value_is_equal(key, entry->key)) {
-            return entry;
-        }
+bool objmap_key_is_hashable(Value key) {
+    return VALUE_IS_TRUE(key)
+        || VALUE_IS_FALSE(key)
+        || VALUE_IS_NULL(key)
+        || VALUE_IS_NUM(key)
+        || VALUE_IS_STRING(key)
+        || VALUE_IS_RANGE(key)
+        || VALUE_IS_CLASS(key)
+        || VALUE_IS_U32(key)
+        || VALUE_IS_U8(key);
+}
 
-        if (VALUE_IS_UNDEFINED(entry->key) && VALUE_IS_FALSE(entry->val)) {
-            return NULL;
-        }
+// 预先分配至少容纳 count 个 entry 的空间，之后插入 count 个 entry 不会再扩容
+void objmap_reserve(VM* vm, ObjMap* map, u32 count) {
+    if (count <= MAP_MAX_LOAD(map->capacity)) {
+        return;
+    }
 
-        index = (index + 1) % map->capacity;
+    u32 capacity = ceil_to_power_of_2(count + count / 7 + 1);
+    while (MAP_MAX_LOAD(capacity) < count) {
+        capacity *= 2;
     }
-    return NULL;
+    resize_map(vm, map, capacity < MAP_GROUP_SIZE ? MAP_GROUP_SIZE : capacity);
 }
 
 void objmap_set(VM* vm, ObjMap* map, Value key, Value val) {
-    if (map->len + 1 > map->capacity * MAP_LOAD_PRECENT) {
-        u32 new_capacity = map->capacity * CAPACITY_GROW_FACTOR;
-        new_capacity = new_capacity < MIN_CAPACITY ? MIN_CAPACITY : new_capacity;
-        resize_map(vm, map, new_capacity);
-    }
+    u32 hash = hash_key(key);
+    u32 slot = find_slot(map, key, hash);
 
-    // 返回true，表示创建了新entry
-    if (add_entry(map->entries, map->capacity, key, val)) {
+    if (slot != UINT32_MAX) {
+        map->entries[map->indices[slot]].val = val;
+    } else {
+        if (map->growth_left == 0 || map->entry_count == MAP_MAX_LOAD(map->capacity)) {
+            reserve_entry(vm, map);
+        }
+
+        slot = find_first_non_full(map, hash);
+        if (map->ctrls[slot] == MAP_CTRL_EMPTY) {
+            map->growth_left--;
+        }
+        map->ctrls[slot] = H2(hash);
+        map->indices[slot] = map->entry_count;
+        map->entries[map->entry_count++] = (Entry) {.key = key, .val = val, .hash = hash};
         map->len++;
     }
+    GC_WRITE_BARRIER(vm, map, key);
+    GC_WRITE_BARRIER(vm, map, val);
 }
 
 Value objmap_get(ObjMap* map, Value key) {
-    Entry* entry = find_entry(map, key);
-    return entry == NULL ? VT_TO_VALUE(VT_UNDEFINED) : entry->val;
+    u32 slot = find_slot(map, key, hash_key(key));
+    return slot == UINT32_MAX ? VT_TO_VALUE(VT_UNDEFINED) : map->entries[map->indices[slot]].val;
 }
 
 void objmap_clear(VM* vm, ObjMap* map) {
-    DEALLOCATE_ARRAY(vm, map->entries, map->capacity);
+    if (map->ctrls != NULL) {
+        mem_manager(vm, map->ctrls, table_bytes(map->capacity), 0);
+    }
+    map->ctrls = NULL;
+    map->indices = NULL;
     map->entries = NULL;
     map->capacity = 0;
     map->len = 0;
+    map->growth_left = 0;
+    map->entry_count = 0;
 }
 
 Value objmap_remove(VM* vm, ObjMap* map, Value key) {
-    Entry* entry = find_entry(map, key);
-    if (entry == NULL) {
+    u32 slot = find_slot(map, key, hash_key(key));
+    if (slot == UINT32_MAX) {
         return VT_TO_VALUE(VT_NULL);
     }
 
-    Value val = entry->val;
+    u32 index = map->indices[slot];
+    Value val = map->entries[index].val;
     if (VALUE_IS_OBJ(val)) {
-        push_tmp_root(vm, val.header);
+        push_tmp_root(vm, VALUE_TO_OBJ(val));
     }
-    
-    entry->key = VT_TO_VALUE(VT_UNDEFINED);
-    entry->val = VT_TO_VALUE(VT_TRUE);
 
+    // 所在组中仍有空槽时，没有探测序列越过此组，可直接标为空槽
+    if (group_match_empty(&map->ctrls[slot / MAP_GROUP_SIZE * MAP_GROUP_SIZE]) != 0) {
+        map->ctrls[slot] = MAP_CTRL_EMPTY;
+        map->growth_left++;
+    } else {
+        map->ctrls[slot] = MAP_CTRL_DELETED;
+    }
+
+    map->entries[index].key = VT_TO_VALUE(VT_UNDEFINED);
+    map->entries[index].val = VT_TO_VALUE(VT_NULL);
     map->len--;
 
+    // 删除的是最后插入的 entry 时直接回收其位置
+    while (map->entry_count > 0 && !MAP_ENTRY_IS_VALID(&map->entries[map->entry_count - 1])) {
+        map->entry_count--;
+    }
+
     if (map->len == 0) {
         objmap_clear(vm, map);
-    } else if (map->len < ((f64)map->capacity / CAPACITY_GROW_FACTOR * MAP_LOAD_PRECENT) && map->len > MIN_CAPACITY) {
-        u32 new_capacity = map->capacity / CAPACITY_GROW_FACTOR;
-        new_capacity = new_capacity < MIN_CAPACITY ? MIN_CAPACITY : new_capacity;
-        resize_map(vm, map, new_capacity);
+    } else if (map->len < MAP_MAX_LOAD(map->capacity) / 4 && map->capacity > MAP_GROUP_SIZE) {
+        resize_map(vm, map, map->capacity / 2);
     }
 
     if (VALUE_IS_OBJ(val)) {
@@ -3,24 +3,43 @@
 
 #include "header_obj.h"
 
-#define MAP_LOAD_PRECENT 0.8
+// 紧凑布局的有序 map：
+// entries 为按插入顺序排列的稠密数组，删除时只将 key 置为 undefined 留下空位；
+// 查找使用 SwissTable 式的开放寻址索引表，每个槽对应一个控制字节及一个指向 entries 的下标。
+// 控制字节为 MAP_CTRL_EMPTY（空槽）、MAP_CTRL_DELETED（已删除）或 hash 的低 7 位（有 entry），
+// 按 MAP_GROUP_SIZE 个一组对齐，查找时一次比较一组（支持 SSE2 时使用一条向量比较），只有低 7 位相同的槽才需要比较 key。
+#define MAP_GROUP_SIZE 16
+#define MAP_CTRL_EMPTY ((u8)0x80)
+#define MAP_CTRL_DELETED ((u8)0xFE)
+
+// 索引表的负载上限为 7/8，也是 entries 的容量
+#define MAP_MAX_LOAD(capacity) ((capacity) - (capacity) / 8)
 
 typedef struct {
-    Value key;
+    Value key; // 已删除的 entry 为 undefined
     Value val;
+    u32 hash; // 缓存的 hash，重建索引时无需重新计算
 } Entry;
 
 typedef struct {
     ObjHeader header;
-    u32 capacity;
+    u32 capacity; // 索引表的槽数，为 0 或不小于 MAP_GROUP_SIZE 的 2 的幂
     u32 len;
-    Entry* entries;
+    u32 growth_left; // 不超过负载上限时索引表中还可占用的空槽数，已删除的槽不计入
+    u32 entry_count; // entries 已使用的长度，含删除留下的空位
+    u8* ctrls; // capacity 个控制字节，与 indices、entries 在同一块内存中
+    u32* indices; // 槽中 entry 在 entries 中的下标
+    Entry* entries; // 容量为索引表的负载上限
 } ObjMap;
 
+#define MAP_ENTRY_IS_VALID(entry) (!VALUE_IS_UNDEFINED((entry)->key))
+
 ObjMap* objmap_new(VM* vm);
+bool objmap_key_is_hashable(Value key);
+void objmap_reserve(VM* vm, ObjMap* map, u32 count);
 void objmap_set(VM* vm, ObjMap* map, Value key, Value val);
 Value objmap_get(ObjMap* map, Value key);
 void objmap_clear(VM* vm, ObjMap* map);
 Value objmap_remove(VM* vm, ObjMap* map, Value key);
 
-#endif
\ No newline at end of file
+#endif
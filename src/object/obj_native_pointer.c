@@ -11,7 +11,7 @@ bool native_pointer_check_classifier(ObjNativePointer* np, ObjString* expect) {
 }
 
 ObjNativePointer* native_pointer_new(VM* vm, void* ptr, ObjString* classifier, Destroy destroy) {
-    ObjNativePointer* self = ALLOCATE(vm, ObjNativePointer);
+    ObjNativePointer* self = ALLOCATE_OBJ(vm, ObjNativePointer);
     
     objheader_init(vm, &self->header, OT_NATIVE_POINTER, vm->native_pointer_class);
     
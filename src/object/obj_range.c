@@ -4,7 +4,7 @@
 #include "vm.h"
 
 ObjRange* objrange_new(VM* vm, int from, int to, int step) {
-    ObjRange* obj = ALLOCATE(vm, ObjRange);
+    ObjRange* obj = ALLOCATE_OBJ(vm, ObjRange);
     objheader_init(vm, &obj->header, OT_RANGE, vm->range_class);
     obj->from = from;
     obj->step = step;
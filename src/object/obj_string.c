@@ -4,6 +4,7 @@
 #include "utils.h"
 #include <string.h>
 #include "vm.h"
+#include "gc.h"
 
 // fnv-1a
 u32 hash_string(char* str, u32 len) {
@@ -19,10 +20,133 @@ inline void objstring_hash(ObjString* str) {
     str->hash_code = hash_string(str->val.start, str->val.len);
 }
 
+#ifdef USE_STRING_INTERN
+#define STRING_TABLE_TOMBSTONE ((ObjString*)1)
+#define STRING_TABLE_MIN_CAPACITY 64
+
+void string_table_init(StringTable* table) {
+    table->entries = NULL;
+    table->capacity = 0;
+    table->count = 0;
+    table->used = 0;
+}
+
+void string_table_free(VM* vm, StringTable* table) {
+    mem_manager(vm, table->entries, table->capacity * sizeof(ObjString*), 0);
+    string_table_init(table);
+}
+
+static ObjString* string_table_find(StringTable* table, const char* str, u32 len, u32 hash) {
+    if (table->count == 0) {
+        return NULL;
+    }
+
+    u32 mask = table->capacity - 1;
+    u32 index = hash & mask;
+    while (true) {
+        ObjString* entry = table->entries[index];
+        if (entry == NULL) {
+            return NULL;
+        }
+
+        if (entry != STRING_TABLE_TOMBSTONE && entry->hash_code == hash
+            && entry->val.len == len && (len == 0 || memcmp(entry->val.start, str, len) == 0)) {
+            return entry;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+// 插入前已确认表中没有相同内容的字符串，可复用遇到的第一个已删除的槽
+static void string_table_insert(StringTable* table, ObjString* str) {
+    u32 mask = table->capacity - 1;
+    u32 index = str->hash_code & mask;
+    while (table->entries[index] != NULL && table->entries[index] != STRING_TABLE_TOMBSTONE) {
+        index = (index + 1) & mask;
+    }
+
+    if (table->entries[index] == NULL) {
+        table->used++;
+    }
+    table->entries[index] = str;
+    table->count++;
+}
+
+static void string_table_add(VM* vm, ObjString* str) {
+    StringTable* table = &vm->strings;
+    if ((table->used + 1) * 4 > table->capacity * 3) {
+        u32 new_capacity = ceil_to_power_of_2((table->count + 1) * 2);
+        if (new_capacity < STRING_TABLE_MIN_CAPACITY) {
+            new_capacity = STRING_TABLE_MIN_CAPACITY;
+        }
+
+        // 分配新表可能触发 gc，其间旧表会被清理，str 尚未入表须暂时作为根
+        push_tmp_root(vm, &str->header);
+        ObjString** entries = (ObjString**)mem_manager(vm, NULL, 0, new_capacity * sizeof(ObjString*));
+        pop_tmp_root(vm);
+        memset(entries, 0, new_capacity * sizeof(ObjString*));
+
+        ObjString** old_entries = table->entries;
+        u32 old_capacity = table->capacity;
+        table->entries = entries;
+        table->capacity = new_capacity;
+        table->count = 0;
+        table->used = 0;
+        for (u32 i = 0; i < old_capacity; i++) {
+            if (old_entries[i] != NULL && old_entries[i] != STRING_TABLE_TOMBSTONE) {
+                string_table_insert(table, old_entries[i]);
+            }
+        }
+        mem_manager(vm, old_entries, old_capacity * sizeof(ObjString*), 0);
+    }
+
+    string_table_insert(table, str);
+}
+
+void string_table_remove_unmarked(StringTable* table, bool (*is_marked)(ObjHeader* obj)) {
+    for (u32 i = 0; i < table->capacity; i++) {
+        ObjString* entry = table->entries[i];
+        if (entry != NULL && entry != STRING_TABLE_TOMBSTONE && !is_marked(&entry->header)) {
+            table->entries[i] = STRING_TABLE_TOMBSTONE;
+            table->count--;
+        }
+    }
+}
+
+// 命中驻留表的字符串将重新被用户持有
+inline static ObjString* string_table_hit(VM* vm, ObjString* str) {
+#ifdef USE_INCREMENTAL_GC
+    // 增量标记期间表中的字符串可能尚未被标记，直接置灰，避免其经由未设写屏障的路径被持有后在本轮被回收
+    if (vm->gc_marking) {
+        gray_obj(vm, &str->header);
+    }
+#endif
+    return str;
+}
+
+ObjString* objstring_intern(VM* vm, ObjString* str) {
+    ObjString* interned = string_table_find(&vm->strings, str->val.start, str->val.len, str->hash_code);
+    if (interned != NULL) {
+        return string_table_hit(vm, interned); // str 不再被引用，由之后的 gc 回收
+    }
+
+    string_table_add(vm, str);
+    return str;
+}
+#endif
+
 ObjString* objstring_new(VM* vm, const char* str, u32 len) {
     ASSERT(len == 0 || str != NULL, "str len don't match str.");
 
-    ObjString* obj = ALLOCATE_EXTRA(vm, ObjString, len + 1);
+#ifdef USE_STRING_INTERN
+    u32 hash = hash_string((char*)str, len);
+    ObjString* interned = string_table_find(&vm->strings, str, len, hash);
+    if (interned != NULL) {
+        return string_table_hit(vm, interned);
+    }
+#endif
+
+    ObjString* obj = ALLOCATE_OBJ_EXTRA(vm, ObjString, len + 1);
 
     if (obj == NULL) {
         MEM_ERROR("Allocating ObjString failed.");
@@ -36,7 +160,12 @@ ObjString* objstring_new(VM* vm, const char* str, u32 len) {
         memcpy(obj->val.start, str, len);
     }
     obj->val.start[len] = '\0';
+#ifdef USE_STRING_INTERN
+    obj->hash_code = hash;
+    string_table_add(vm, obj);
+#else
     objstring_hash(obj);
+#endif
 
     return obj;
 }
@@ -9,8 +9,28 @@ struct _ObjString{
     CharValue val;
 };
 
+#ifdef USE_STRING_INTERN
+// 字符串驻留表，开放寻址。表对字符串是弱引用，gc 标记结束后移除未被标记的字符串
+typedef struct {
+    ObjString** entries; // NULL 为空槽，STRING_TABLE_TOMBSTONE 为已删除
+    u32 capacity; // 为 0 或 2 的幂
+    u32 count; // 表中的字符串数
+    u32 used; // 非空槽数，含已删除的槽
+} StringTable;
+#endif
+
 u32 hash_string(char* str, u32 len);
 void objstring_hash(ObjString* str);
 ObjString* objstring_new(VM* vm, const char* str, u32 len);
 
+#ifdef USE_STRING_INTERN
+void string_table_init(StringTable* table);
+void string_table_free(VM* vm, StringTable* table);
+void string_table_remove_unmarked(StringTable* table, bool (*is_marked)(ObjHeader* obj));
+// 原地构造完成（已计算 hash）的字符串在返回给用户前须经此驻留，返回表中内容相同的字符串
+ObjString* objstring_intern(VM* vm, ObjString* str);
+#else
+    #define objstring_intern(vm, str) (str)
+#endif
+
 #endif
\ No newline at end of file
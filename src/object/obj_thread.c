@@ -23,7 +23,7 @@ ObjThread* objthread_new(VM* vm, ObjClosure* closure) {
     u32 stack_capacity = ceil_to_power_of_2(closure->fn->max_stack_slot_used + 1);
     Value* new_stack = ALLOCATE_ARRAY(vm, Value, stack_capacity);
 
-    ObjThread* thread = ALLOCATE(vm, ObjThread);
+    ObjThread* thread = ALLOCATE_OBJ(vm, ObjThread);
     objheader_init(vm, &thread->header, OT_THREAD, vm->thread_class);
     thread->frames = frames;
     thread->frame_capacity = INITIAL_FRAME_NUM;
@@ -29,6 +29,7 @@
 #include "ast.h"
 
 #include "compiler.h"
+#include "bytecode_cache.h"
 
 #if defined(USE_AST_COMPILER)
     #include "ast_compiler.h"
@@ -111,37 +112,40 @@ char* read_file(const char* path) {
 
 static ObjModule* get_module(VM* vm, Value module_name) {
     Value val = objmap_get(vm->all_module, module_name);
-    return val.type == VT_UNDEFINED ? NULL : VALUE_TO_OBJMODULE(val);
+    return VALUE_IS_UNDEFINED(val) ? NULL : VALUE_TO_OBJMODULE(val);
 }
 
-static ObjThread* load_module(VM* vm, Value module_name, const char* module_code) {
-    ObjModule* module = get_module(vm, module_name);
+static ObjModule* new_module(VM* vm, Value module_name) {
+    ObjString* name = VALUE_TO_OBJSTR(module_name);
+    ASSERT(name->val.start[name->val.len] == '\0', "string is not terminated.");
     
-    if (module == NULL) {
-        ObjString* name = VALUE_TO_OBJSTR(module_name);
-        ASSERT(name->val.start[name->val.len] == '\0', "string is not terminated.");
-        
-        module = objmodule_new(vm, name->val.start);
-        push_tmp_root(vm, (ObjHeader*)module);
-        objmap_set(vm, vm->all_module, module_name, OBJ_TO_VALUE(module));
-        pop_tmp_root(vm);
+    ObjModule* module = objmodule_new(vm, name->val.start);
+    push_tmp_root(vm, (ObjHeader*)module);
+    objmap_set(vm, vm->all_module, module_name, OBJ_TO_VALUE(module));
+    pop_tmp_root(vm);
 
-        // 继承核心模块的模块变量
-        ObjModule* core = get_module(vm, CORE_MODULE);
-        for (int i = 0; i < core->module_var_name.count; i++) {
-            String name = core->module_var_name.datas[i];
-            Value val = core->module_var_value.datas[i];
-            define_module_var(vm, module, name.str, name.len, val);
-        }
+    // 继承核心模块的模块变量
+    ObjModule* core = get_module(vm, CORE_MODULE);
+    for (int i = 0; i < core->module_var_name.count; i++) {
+        String name = core->module_var_name.datas[i];
+        Value val = core->module_var_value.datas[i];
+        define_module_var(vm, module, name.str, name.len, val);
     }
+    return module;
+}
 
+static ObjFn* compile_module_code(VM* vm, ObjModule* module, const char* module_code) {
 #if defined(USE_AST_COMPILER)
-    ObjFn* fn = compile_module(vm, module, module_code, ast_compile_program);
+    return compile_module(vm, module, module_code, ast_compile_program);
 #elif defined (USE_ONE_PASS_COMPILER)
-    ObjFn* fn = compile_module(vm, module, module_code, one_pass_compile_program);
+    return compile_module(vm, module, module_code, one_pass_compile_program);
 #else
-    ObjFn* fn = compile_module(vm, module, module_code, one_pass_compile_program);
+    return compile_module(vm, module, module_code, one_pass_compile_program);
 #endif
+}
+
+// module_name 与 module 仅在定义 DIS_ASM_CHUNK 时使用
+static ObjThread* create_module_thread(VM* vm, UNUSED Value module_name, UNUSED ObjModule* module, ObjFn* fn) {
     push_tmp_root(vm, (ObjHeader*)fn);
 
 #ifdef DIS_ASM_CHUNK
@@ -160,6 +164,39 @@ static ObjThread* load_module(VM* vm, Value module_name, const char* module_code
     return thread;
 }
 
+static ObjThread* load_module(VM* vm, Value module_name, const char* module_code) {
+    ObjModule* module = get_module(vm, module_name);
+    if (module == NULL) {
+        module = new_module(vm, module_name);
+    }
+
+    ObjFn* fn = compile_module_code(vm, module, module_code);
+    return create_module_thread(vm, module_name, module, fn);
+}
+
+#ifdef USE_BYTECODE_CACHE
+// 优先使用源文件旁比源文件新的 .spc 缓存，没有可用缓存时编译源文件并写入缓存
+static ObjThread* load_module_with_cache(VM* vm, Value module_name, const char* path) {
+    ObjModule* module = new_module(vm, module_name);
+    char* cache_path = bytecode_cache_path(path);
+
+    ObjFn* fn = bytecode_cache_load(vm, module, path, cache_path);
+    if (fn == NULL) {
+        char* module_code = read_file(path);
+        fn = compile_module_code(vm, module, module_code);
+        free(module_code);
+
+        push_tmp_root(vm, (ObjHeader*)fn);
+        u32 inherited_var_num = get_module(vm, CORE_MODULE)->module_var_name.count;
+        bytecode_cache_save(vm, module, inherited_var_num, fn, path, cache_path); // 写入失败（如目录只读）时忽略
+        pop_tmp_root(vm);
+    }
+
+    free(cache_path);
+    return create_module_thread(vm, module_name, module, fn);
+}
+#endif
+
 VMResult execute_module(VM* vm, Value module_name, const char* module_code) {
     ObjThread* obj_thread = load_module(vm, module_name, module_code);
     return execute_instruction(vm, obj_thread);
@@ -168,15 +205,64 @@ VMResult execute_module(VM* vm, Value module_name, const char* module_code) {
 int get_index_from_symbol_table(SymbolTable* table, const char* symbol, u32 len) {
     ASSERT(len != 0, "length of symbole is 0.");
 
-    for (int i = 0; i < table->count; i++) {
-        if (len == table->datas[i].len && memcmp(symbol, table->datas[i].str, len) == 0) {
-            return i;
+    if (table->slot_capacity == 0) {
+        for (int i = 0; i < table->count; i++) {
+            if (len == table->datas[i].len && memcmp(symbol, table->datas[i].str, len) == 0) {
+                return i;
+            }
         }
+        return -1;
     }
 
+    u32 hash = hash_string((char*)symbol, len);
+    u32 mask = table->slot_capacity - 1;
+    for (u32 slot = hash & mask; table->slots[slot].index != 0; slot = (slot + 1) & mask) {
+        SymbolSlot* s = &table->slots[slot];
+        String* str = &table->datas[s->index - 1];
+        if (s->hash == hash && str->len == len && memcmp(symbol, str->str, len) == 0) {
+            return s->index - 1;
+        }
+    }
     return -1;
 }
 
+static void symbol_index_insert(SymbolSlot* slots, u32 slot_capacity, u32 hash, u32 index) {
+    u32 mask = slot_capacity - 1;
+    u32 slot = hash & mask;
+    while (slots[slot].index != 0) {
+        slot = (slot + 1) & mask;
+    }
+    slots[slot].hash = hash;
+    slots[slot].index = index + 1;
+}
+
+// 扩容 hash 索引，新建索引时计算已有符号的 hash，扩容时复用槽中记录的 hash。
+// 刚加入 datas 的最后一个符号由调用者插入
+static void symbol_index_grow(VM* vm, SymbolTable* table) {
+    u32 new_capacity = table->slot_capacity == 0 ? ceil_to_power_of_2(table->count * 4) : table->slot_capacity * 2;
+    SymbolSlot* slots = ALLOCATE_ARRAY(vm, SymbolSlot, new_capacity);
+    if (slots == NULL) {
+        MEM_ERROR("allocate symbol table index failed.");
+    }
+    memset(slots, 0, sizeof(SymbolSlot) * new_capacity);
+
+    if (table->slot_capacity == 0) {
+        for (u32 i = 0; i + 1 < table->count; i++) {
+            symbol_index_insert(slots, new_capacity, hash_string(table->datas[i].str, table->datas[i].len), i);
+        }
+    } else {
+        for (u32 i = 0; i < table->slot_capacity; i++) {
+            if (table->slots[i].index != 0) {
+                symbol_index_insert(slots, new_capacity, table->slots[i].hash, table->slots[i].index - 1);
+            }
+        }
+        DEALLOCATE_ARRAY(vm, table->slots, table->slot_capacity);
+    }
+
+    table->slots = slots;
+    table->slot_capacity = new_capacity;
+}
+
 int add_symbol(VM* vm, SymbolTable* table, const char* symbol, u32 len) {
     ASSERT(len != 0, "length of symbole is 0.");
 
@@ -187,9 +273,22 @@ int add_symbol(VM* vm, SymbolTable* table, const char* symbol, u32 len) {
     memcpy(str.str, symbol, len);
     str.str[len] = '\0';
 
-    BufferAdd(String, table, vm, str);
+    if (table->count == table->capacity) {
+        u32 new_capacity = ceil_to_power_of_2(table->count + 1);
+        table->datas = (String*)mem_manager(vm, table->datas, sizeof(String) * table->capacity, sizeof(String) * new_capacity);
+        table->capacity = new_capacity;
+    }
+    u32 index = table->count++;
+    table->datas[index] = str;
+
+    if (table->slot_capacity != 0 || table->count >= SYMBOL_TABLE_INDEX_THRESHOLD) {
+        if (table->count * 2 > table->slot_capacity) {
+            symbol_index_grow(vm, table);
+        }
+        symbol_index_insert(table->slots, table->slot_capacity, hash_string(str.str, len), index);
+    }
     
-    return table->count - 1;
+    return index;
 }
 
 static Class* define_class(VM* vm, ObjModule* module, const char* name) {
@@ -200,18 +299,22 @@ static Class* define_class(VM* vm, ObjModule* module, const char* name) {
 }
 
 void bind_method(VM* vm, Class* class, u32 index, Method method) {
-    if (index >= class->methods.count) {
-        Method empty_pad = {.type = MT_NONE, .prim = NULL};
-        BufferFill(Method, &class->methods, vm, empty_pad, (index - class->methods.count + 1));
+    class_set_method(vm, class, index, method);
+    if (method.type == MT_SCRIPT) {
+        GC_WRITE_BARRIER(vm, class, OBJ_TO_VALUE(method.obj));
     }
-    class->methods.datas[index] = method;
+    vm->method_cache_epoch++; // 方法表已改变，所有内联缓存失效
 }
 
 void bind_super_class(VM* vm, Class* sub_class, Class* super_calss) {
     sub_class->super_class = super_calss;
+    GC_WRITE_BARRIER(vm, sub_class, OBJ_TO_VALUE(super_calss));
     sub_class->field_number += super_calss->field_number;
-    for (int i = 0; i < super_calss->methods.count; i++) {
-        bind_method(vm, sub_class, i, super_calss->methods.datas[i]);
+    // 继承时复制父类当前的方法，之后父类新绑定的方法不影响子类
+    for (u32 i = 0; i < super_calss->method_capacity; i++) {
+        if (super_calss->method_keys[i] != 0) {
+            bind_method(vm, sub_class, super_calss->method_keys[i] - 1, super_calss->method_slots[i]);
+        }
     }
 }
 
@@ -261,7 +364,7 @@ def_prim(Object_to_string) {
     // "<instance of %(self.class.name) at %(self)>"
     int max_len = 13 + class_name->val.len + 4 + 18 + 1;
     char* buf = ALLOCATE_ARRAY(vm, char, max_len);
-    sprintf(buf, "<instance of %s at %p>", class_name->val.start, args[0].header);
+    sprintf(buf, "<instance of %s at %p>", class_name->val.start, VALUE_TO_OBJ(args[0]));
     ObjString* str = objstring_new(vm, buf, strlen(buf));
     DEALLOCATE_ARRAY(vm, buf, max_len);
     ROBJ(str);
@@ -272,7 +375,7 @@ def_prim(Object_debug_str) {
     // "<instance of %(self.class.name) at %(self)>"
     int max_len = 13 + class_name->val.len + 4 + 18 + 1;
     char* buf = ALLOCATE_ARRAY(vm, char, max_len);
-    sprintf(buf, "<instance of %s at %p>", class_name->val.start, args[1].header);
+    sprintf(buf, "<instance of %s at %p>", class_name->val.start, VALUE_TO_OBJ(args[1]));
     ObjString* str = objstring_new(vm, buf, strlen(buf));
     DEALLOCATE_ARRAY(vm, buf, max_len);
     ROBJ(str);
@@ -319,16 +422,12 @@ def_prim(Class_get_static_method) {
     }
     
     int index = get_index_from_symbol_table(&vm->all_method_names, VALUE_TO_OBJSTR(args[1])->val.start, VALUE_TO_OBJSTR(args[1])->val.len);
-    if (index == -1 || index >= VALUE_TO_CLASS(args[0])->header.class->methods.count) {
-        RNULL();
-    }
-
-    Method m = VALUE_TO_CLASS(args[0])->header.class->methods.datas[index];
-    if (m.type != MT_SCRIPT) {
+    Method* m = index == -1 ? NULL : class_find_method(VALUE_TO_CLASS(args[0])->header.class, index);
+    if (m == NULL || m->type != MT_SCRIPT) {
         RNULL();
     }
 
-    ROBJ(m.obj);
+    ROBJ(m->obj);
 }
 
 // Object::same(o1: Object, o2: Object) -> bool;
@@ -475,6 +574,11 @@ def_prim(Thread_is_done) {
     RBOOL(thread->used_frame_num == 0 || !VALUE_IS_NULL(thread->error_obj));
 }
 
+// Thread.error，线程因错误结束时为错误信息，否则为 null
+def_prim(Thread_error) {
+    RVAL(VALUE_TO_THREAD(args[0])->error_obj);
+}
+
 // Fn::new(func: Fn) -> Fn;
 def_prim(Fn_new) {
     if (!validate_fn(vm, args[1])) {
@@ -489,6 +593,30 @@ def_prim(Fn_disasm) {
     RNULL();
 }
 
+// Fn.opcodes，按顺序返回函数的指令名，用于检查特化和快化的结果
+def_prim(Fn_opcodes) {
+    ObjFn* fn = VALUE_TO_OBJCLOSURE(args[0])->fn;
+    ObjList* res = objlist_new(vm, 0);
+    push_tmp_root(vm, (ObjHeader*)res);
+
+    u32 ip = 0;
+    while (ip < fn->instr_stream.count) {
+        OpCode op = fn->instr_stream.datas[ip];
+        const char* name = opcode_name(op);
+        ObjString* str = objstring_new(vm, name, strlen(name));
+        push_tmp_root(vm, (ObjHeader*)str);
+        BufferAdd(Value, &res->elements, vm, OBJ_TO_VALUE(str));
+        pop_tmp_root(vm);
+        if (op == OPCODE_END) {
+            break;
+        }
+        ip += 1 + get_byte_of_operands(fn->instr_stream.datas, fn->constants.datas, ip);
+    }
+
+    pop_tmp_root(vm);
+    ROBJ(res);
+}
+
 static void bind_fn_overload_call(VM* vm, const char* sign) {
     u32 index = ensure_symbol_exist(vm, &vm->all_method_names, sign, strlen(sign));
     Method method = {
@@ -538,7 +666,7 @@ inline static ObjString* u32_2str(VM* vm, int num) {
 }
 
 inline static int validate_num(VM* vm, Value arg) {
-    switch (arg.type) {
+    switch (VALUE_TYPE(arg)) {
         case VT_I32:
             return 1;
         case VT_F64:
@@ -634,11 +762,11 @@ def_prim(i32_from_string) {
 def_prim(u32_add) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RU32(args[0].u32val + (u32)args[1].i32val);
+            RU32(VALUE_TO_U32(args[0]) + (u32)VALUE_TO_I32(args[1]));
         case 2:
-            RF64((double)(args[0].u32val) + args[1].f64val);
+            RF64((double)(VALUE_TO_U32(args[0])) + VALUE_TO_F64(args[1]));
         case 3:
-            RU32(args[0].u32val + args[1].u32val);
+            RU32(VALUE_TO_U32(args[0]) + VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -647,11 +775,11 @@ def_prim(u32_add) {
 def_prim(u32_sub) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RU32(args[0].u32val - (u32)args[1].i32val);
+            RU32(VALUE_TO_U32(args[0]) - (u32)VALUE_TO_I32(args[1]));
         case 2:
-            RF64((double)(args[0].u32val) - args[1].f64val);
+            RF64((double)(VALUE_TO_U32(args[0])) - VALUE_TO_F64(args[1]));
         case 3:
-            RU32(args[0].u32val - args[1].u32val);
+            RU32(VALUE_TO_U32(args[0]) - VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -660,11 +788,11 @@ def_prim(u32_sub) {
 def_prim(u32_mul) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RU32(args[0].u32val * (u32)args[1].i32val);
+            RU32(VALUE_TO_U32(args[0]) * (u32)VALUE_TO_I32(args[1]));
         case 2:
-            RF64((double)(args[0].u32val) * args[1].f64val);
+            RF64((double)(VALUE_TO_U32(args[0])) * VALUE_TO_F64(args[1]));
         case 3:
-            RU32(args[0].u32val * args[1].u32val);
+            RU32(VALUE_TO_U32(args[0]) * VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -673,11 +801,11 @@ def_prim(u32_mul) {
 def_prim(u32_div) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RU32(args[0].u32val / (u32)args[1].i32val);
+            RU32(VALUE_TO_U32(args[0]) / (u32)VALUE_TO_I32(args[1]));
         case 2:
-            RF64((double)(args[0].u32val) / args[1].f64val);
+            RF64((double)(VALUE_TO_U32(args[0])) / VALUE_TO_F64(args[1]));
         case 3:
-            RU32(args[0].u32val / args[1].u32val);
+            RU32(VALUE_TO_U32(args[0]) / VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -686,11 +814,11 @@ def_prim(u32_div) {
 def_prim(u32_mod) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RU32(args[0].u32val % (u32)args[1].i32val);
+            RU32(VALUE_TO_U32(args[0]) % (u32)VALUE_TO_I32(args[1]));
         case 2:
-            RF64(fmod((double)(args[0].u32val), args[1].f64val));
+            RF64(fmod((double)(VALUE_TO_U32(args[0])), VALUE_TO_F64(args[1])));
         case 3:
-            RU32(args[0].u32val % args[1].u32val);
+            RU32(VALUE_TO_U32(args[0]) % VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -699,11 +827,11 @@ def_prim(u32_mod) {
 def_prim(i32_add) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RI32(args[0].i32val + args[1].i32val);
+            RI32(VALUE_TO_I32(args[0]) + VALUE_TO_I32(args[1]));
         case 2:
-            RF64((double)(args[0].i32val) + args[1].f64val);
+            RF64((double)(VALUE_TO_I32(args[0])) + VALUE_TO_F64(args[1]));
         case 3:
-            RI32(args[0].i32val + (i32)args[1].u32val);
+            RI32(VALUE_TO_I32(args[0]) + (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -712,11 +840,11 @@ def_prim(i32_add) {
 def_prim(i32_sub) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RI32(args[0].i32val - args[1].i32val);
+            RI32(VALUE_TO_I32(args[0]) - VALUE_TO_I32(args[1]));
         case 2:
-            RF64((double)(args[0].i32val) - args[1].f64val);
+            RF64((double)(VALUE_TO_I32(args[0])) - VALUE_TO_F64(args[1]));
         case 3:
-            RI32(args[0].i32val - (i32)args[1].u32val);
+            RI32(VALUE_TO_I32(args[0]) - (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -725,11 +853,11 @@ def_prim(i32_sub) {
 def_prim(i32_mul) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RI32(args[0].i32val * args[1].i32val);
+            RI32(VALUE_TO_I32(args[0]) * VALUE_TO_I32(args[1]));
         case 2:
-            RF64((double)(args[0].i32val) * args[1].f64val);
+            RF64((double)(VALUE_TO_I32(args[0])) * VALUE_TO_F64(args[1]));
         case 3:
-            RI32(args[0].i32val * (i32)args[1].u32val);
+            RI32(VALUE_TO_I32(args[0]) * (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -738,11 +866,11 @@ def_prim(i32_mul) {
 def_prim(i32_div) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RI32(args[0].i32val / args[1].i32val);
+            RI32(VALUE_TO_I32(args[0]) / VALUE_TO_I32(args[1]));
         case 2:
-            RF64((double)(args[0].i32val) / args[1].f64val);
+            RF64((double)(VALUE_TO_I32(args[0])) / VALUE_TO_F64(args[1]));
         case 3:
-            RI32(args[0].i32val / (i32)args[1].u32val);
+            RI32(VALUE_TO_I32(args[0]) / (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -751,11 +879,11 @@ def_prim(i32_div) {
 def_prim(i32_mod) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RI32(args[0].i32val % args[1].i32val);
+            RI32(VALUE_TO_I32(args[0]) % VALUE_TO_I32(args[1]));
         case 2:
-            RF64(fmod((double)(args[0].i32val), args[1].f64val));
+            RF64(fmod((double)(VALUE_TO_I32(args[0])), VALUE_TO_F64(args[1])));
         case 3:
-            RI32(args[0].i32val % (i32)args[1].u32val);
+            RI32(VALUE_TO_I32(args[0]) % (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -764,11 +892,11 @@ def_prim(i32_mod) {
 def_prim(u32_gt) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].u32val > args[1].i32val);
+            RBOOL(VALUE_TO_U32(args[0]) > VALUE_TO_I32(args[1]));
         case 2:
-            RBOOL((double)(args[0].u32val) > args[1].f64val);
+            RBOOL((double)(VALUE_TO_U32(args[0])) > VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].u32val > (i32)args[1].u32val);
+            RBOOL(VALUE_TO_U32(args[0]) > (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -777,11 +905,11 @@ def_prim(u32_gt) {
 def_prim(u32_ge) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].u32val >= args[1].i32val);
+            RBOOL(VALUE_TO_U32(args[0]) >= VALUE_TO_I32(args[1]));
         case 2:
-            RBOOL((double)(args[0].u32val) >= args[1].f64val);
+            RBOOL((double)(VALUE_TO_U32(args[0])) >= VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].u32val >= (i32)args[1].u32val);
+            RBOOL(VALUE_TO_U32(args[0]) >= (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -790,11 +918,11 @@ def_prim(u32_ge) {
 def_prim(u32_lt) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].u32val < args[1].i32val);
+            RBOOL(VALUE_TO_U32(args[0]) < VALUE_TO_I32(args[1]));
         case 2:
-            RBOOL((double)(args[0].u32val) < args[1].f64val);
+            RBOOL((double)(VALUE_TO_U32(args[0])) < VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].u32val < (i32)args[1].u32val);
+            RBOOL(VALUE_TO_U32(args[0]) < (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -803,11 +931,11 @@ def_prim(u32_lt) {
 def_prim(u32_le) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].u32val <= args[1].i32val);
+            RBOOL(VALUE_TO_U32(args[0]) <= VALUE_TO_I32(args[1]));
         case 2:
-            RBOOL((double)(args[0].u32val) <= args[1].f64val);
+            RBOOL((double)(VALUE_TO_U32(args[0])) <= VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].u32val <= (i32)args[1].u32val);
+            RBOOL(VALUE_TO_U32(args[0]) <= (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -816,11 +944,11 @@ def_prim(u32_le) {
 def_prim(i32_gt) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].i32val > args[1].i32val);
+            RBOOL(VALUE_TO_I32(args[0]) > VALUE_TO_I32(args[1]));
         case 2:
-            RBOOL((double)(args[0].i32val) > args[1].f64val);
+            RBOOL((double)(VALUE_TO_I32(args[0])) > VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].i32val > (i32)args[1].u32val);
+            RBOOL(VALUE_TO_I32(args[0]) > (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -829,11 +957,11 @@ def_prim(i32_gt) {
 def_prim(i32_ge) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].i32val >= args[1].i32val);
+            RBOOL(VALUE_TO_I32(args[0]) >= VALUE_TO_I32(args[1]));
         case 2:
-            RBOOL((double)(args[0].i32val) >= args[1].f64val);
+            RBOOL((double)(VALUE_TO_I32(args[0])) >= VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].i32val >= (i32)args[1].u32val);
+            RBOOL(VALUE_TO_I32(args[0]) >= (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -842,11 +970,11 @@ def_prim(i32_ge) {
 def_prim(i32_lt) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].i32val < args[1].i32val);
+            RBOOL(VALUE_TO_I32(args[0]) < VALUE_TO_I32(args[1]));
         case 2:
-            RBOOL((double)(args[0].i32val) < args[1].f64val);
+            RBOOL((double)(VALUE_TO_I32(args[0])) < VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].i32val < (i32)args[1].u32val);
+            RBOOL(VALUE_TO_I32(args[0]) < (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -855,11 +983,11 @@ def_prim(i32_lt) {
 def_prim(i32_le) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].i32val <= args[1].i32val);
+            RBOOL(VALUE_TO_I32(args[0]) <= VALUE_TO_I32(args[1]));
         case 2:
-            RBOOL((double)(args[0].i32val) <= args[1].f64val);
+            RBOOL((double)(VALUE_TO_I32(args[0])) <= VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].i32val <= (i32)args[1].u32val);
+            RBOOL(VALUE_TO_I32(args[0]) <= (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -868,11 +996,11 @@ def_prim(i32_le) {
 def_prim(u32_bit_and) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RU32(args[0].u32val & (u32)args[1].i32val);
+            RU32(VALUE_TO_U32(args[0]) & (u32)VALUE_TO_I32(args[1]));
         case 2:
-            RU32(args[0].u32val & (u32)(args[1].f64val));
+            RU32(VALUE_TO_U32(args[0]) & (u32)(VALUE_TO_F64(args[1])));
         case 3:
-            RU32(args[0].u32val & args[1].u32val);
+            RU32(VALUE_TO_U32(args[0]) & VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -881,11 +1009,11 @@ def_prim(u32_bit_and) {
 def_prim(u32_bit_or) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RU32(args[0].u32val | (u32)args[1].i32val);
+            RU32(VALUE_TO_U32(args[0]) | (u32)VALUE_TO_I32(args[1]));
         case 2:
-            RU32(args[0].u32val | (u32)(args[1].f64val));
+            RU32(VALUE_TO_U32(args[0]) | (u32)(VALUE_TO_F64(args[1])));
         case 3:
-            RU32(args[0].u32val | args[1].u32val);
+            RU32(VALUE_TO_U32(args[0]) | VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -894,11 +1022,11 @@ def_prim(u32_bit_or) {
 def_prim(u32_bit_xor) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RU32(args[0].u32val ^ (u32)args[1].i32val);
+            RU32(VALUE_TO_U32(args[0]) ^ (u32)VALUE_TO_I32(args[1]));
         case 2:
-            RU32(args[0].u32val ^ (u32)(args[1].f64val));
+            RU32(VALUE_TO_U32(args[0]) ^ (u32)(VALUE_TO_F64(args[1])));
         case 3:
-            RU32(args[0].u32val ^ args[1].u32val);
+            RU32(VALUE_TO_U32(args[0]) ^ VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -907,11 +1035,11 @@ def_prim(u32_bit_xor) {
 def_prim(i32_bit_and) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RI32(args[0].i32val & args[1].i32val);
+            RI32(VALUE_TO_I32(args[0]) & VALUE_TO_I32(args[1]));
         case 2:
-            RI32(args[0].i32val & (int)(args[1].f64val));
+            RI32(VALUE_TO_I32(args[0]) & (int)(VALUE_TO_F64(args[1])));
         case 3:
-            RI32(args[0].i32val & (i32)args[1].u32val);
+            RI32(VALUE_TO_I32(args[0]) & (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -920,11 +1048,11 @@ def_prim(i32_bit_and) {
 def_prim(u32_bit_ls) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RU32(args[0].u32val << (u32)args[1].i32val);
+            RU32(VALUE_TO_U32(args[0]) << (u32)VALUE_TO_I32(args[1]));
         case 2:
-            RU32(args[0].u32val << (u32)(args[1].f64val));
+            RU32(VALUE_TO_U32(args[0]) << (u32)(VALUE_TO_F64(args[1])));
         case 3:
-            RU32(args[0].u32val << args[1].u32val);
+            RU32(VALUE_TO_U32(args[0]) << VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -933,11 +1061,11 @@ def_prim(u32_bit_ls) {
 def_prim(u32_bit_rs) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RU32(args[0].u32val >> (u32)args[1].i32val);
+            RU32(VALUE_TO_U32(args[0]) >> (u32)VALUE_TO_I32(args[1]));
         case 2:
-            RU32(args[0].u32val >> (u32)(args[1].f64val));
+            RU32(VALUE_TO_U32(args[0]) >> (u32)(VALUE_TO_F64(args[1])));
         case 3:
-            RU32(args[0].u32val >> args[1].u32val);
+            RU32(VALUE_TO_U32(args[0]) >> VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -946,11 +1074,11 @@ def_prim(u32_bit_rs) {
 def_prim(i32_bit_or) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RI32(args[0].i32val | args[1].i32val);
+            RI32(VALUE_TO_I32(args[0]) | VALUE_TO_I32(args[1]));
         case 2:
-            RI32(args[0].i32val | (int)(args[1].f64val));
+            RI32(VALUE_TO_I32(args[0]) | (int)(VALUE_TO_F64(args[1])));
         case 3:
-            RI32(args[0].i32val | (i32)args[1].u32val);
+            RI32(VALUE_TO_I32(args[0]) | (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -959,11 +1087,11 @@ def_prim(i32_bit_or) {
 def_prim(i32_bit_ls) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RI32(args[0].i32val << args[1].i32val);
+            RI32(VALUE_TO_I32(args[0]) << VALUE_TO_I32(args[1]));
         case 2:
-            RI32(args[0].i32val << (u32)(args[1].f64val));
+            RI32(VALUE_TO_I32(args[0]) << (u32)(VALUE_TO_F64(args[1])));
         case 3:
-            RI32(args[0].i32val << (i32)args[1].u32val);
+            RI32(VALUE_TO_I32(args[0]) << (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -972,11 +1100,11 @@ def_prim(i32_bit_ls) {
 def_prim(i32_bit_rs) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RI32(args[0].i32val >> args[1].i32val);
+            RI32(VALUE_TO_I32(args[0]) >> VALUE_TO_I32(args[1]));
         case 2:
-            RI32(args[0].i32val >> (u32)(args[1].f64val));
+            RI32(VALUE_TO_I32(args[0]) >> (u32)(VALUE_TO_F64(args[1])));
         case 3:
-            RI32(args[0].i32val >> (i32)args[1].u32val);
+            RI32(VALUE_TO_I32(args[0]) >> (i32)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -985,11 +1113,11 @@ def_prim(i32_bit_rs) {
 def_prim(f64_add) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RF64(args[0].f64val + (double)(args[1].i32val));
+            RF64(VALUE_TO_F64(args[0]) + (double)(VALUE_TO_I32(args[1])));
         case 2:
-            RF64(args[0].f64val + args[1].f64val);
+            RF64(VALUE_TO_F64(args[0]) + VALUE_TO_F64(args[1]));
         case 3:
-            RF64(args[0].f64val + (f64)args[1].u32val);
+            RF64(VALUE_TO_F64(args[0]) + (f64)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -998,11 +1126,11 @@ def_prim(f64_add) {
 def_prim(f64_sub) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RF64(args[0].f64val - (double)(args[1].i32val));
+            RF64(VALUE_TO_F64(args[0]) - (double)(VALUE_TO_I32(args[1])));
         case 2:
-            RF64(args[0].f64val - args[1].f64val);
+            RF64(VALUE_TO_F64(args[0]) - VALUE_TO_F64(args[1]));
         case 3:
-            RF64(args[0].f64val - (f64)args[1].u32val);
+            RF64(VALUE_TO_F64(args[0]) - (f64)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -1011,11 +1139,11 @@ def_prim(f64_sub) {
 def_prim(f64_mul) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RF64(args[0].f64val * (double)(args[1].i32val));
+            RF64(VALUE_TO_F64(args[0]) * (double)(VALUE_TO_I32(args[1])));
         case 2:
-            RF64(args[0].f64val * args[1].f64val);
+            RF64(VALUE_TO_F64(args[0]) * VALUE_TO_F64(args[1]));
         case 3:
-            RF64(args[0].f64val * (f64)args[1].u32val);
+            RF64(VALUE_TO_F64(args[0]) * (f64)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -1024,11 +1152,11 @@ def_prim(f64_mul) {
 def_prim(f64_div) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RF64(args[0].f64val / (double)(args[1].i32val));
+            RF64(VALUE_TO_F64(args[0]) / (double)(VALUE_TO_I32(args[1])));
         case 2:
-            RF64(args[0].f64val / args[1].f64val);
+            RF64(VALUE_TO_F64(args[0]) / VALUE_TO_F64(args[1]));
         case 3:
-            RF64(args[0].f64val / (f64)args[1].u32val);
+            RF64(VALUE_TO_F64(args[0]) / (f64)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -1037,11 +1165,11 @@ def_prim(f64_div) {
 def_prim(f64_mod) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RF64(fmod(args[0].f64val, (double)(args[1].i32val)));
+            RF64(fmod(VALUE_TO_F64(args[0]), (double)(VALUE_TO_I32(args[1]))));
         case 2:
-            RF64(fmod(args[0].f64val, args[1].f64val));
+            RF64(fmod(VALUE_TO_F64(args[0]), VALUE_TO_F64(args[1])));
         case 3:
-            RF64(fmod(args[0].f64val, (f64)args[1].u32val));
+            RF64(fmod(VALUE_TO_F64(args[0]), (f64)VALUE_TO_U32(args[1])));
         default:
             return false; // 报错
     }
@@ -1050,11 +1178,11 @@ def_prim(f64_mod) {
 def_prim(f64_gt) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].f64val > (double)(args[1].i32val));
+            RBOOL(VALUE_TO_F64(args[0]) > (double)(VALUE_TO_I32(args[1])));
         case 2:
-            RBOOL(args[0].f64val > args[1].f64val);
+            RBOOL(VALUE_TO_F64(args[0]) > VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].f64val > (f64)args[1].u32val);
+            RBOOL(VALUE_TO_F64(args[0]) > (f64)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -1063,11 +1191,11 @@ def_prim(f64_gt) {
 def_prim(f64_ge) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].f64val >= (double)(args[1].i32val));
+            RBOOL(VALUE_TO_F64(args[0]) >= (double)(VALUE_TO_I32(args[1])));
         case 2:
-            RBOOL(args[0].f64val >= args[1].f64val);
+            RBOOL(VALUE_TO_F64(args[0]) >= VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].f64val >= (f64)args[1].u32val);
+            RBOOL(VALUE_TO_F64(args[0]) >= (f64)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -1076,11 +1204,11 @@ def_prim(f64_ge) {
 def_prim(f64_lt) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].f64val < (double)(args[1].i32val));
+            RBOOL(VALUE_TO_F64(args[0]) < (double)(VALUE_TO_I32(args[1])));
         case 2:
-            RBOOL(args[0].f64val < args[1].f64val);
+            RBOOL(VALUE_TO_F64(args[0]) < VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].f64val < (f64)args[1].u32val);
+            RBOOL(VALUE_TO_F64(args[0]) < (f64)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
@@ -1089,66 +1217,67 @@ def_prim(f64_lt) {
 def_prim(f64_le) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].f64val <= (double)(args[1].i32val));
+            RBOOL(VALUE_TO_F64(args[0]) <= (double)(VALUE_TO_I32(args[1])));
         case 2:
-            RBOOL(args[0].f64val <= args[1].f64val);
+            RBOOL(VALUE_TO_F64(args[0]) <= VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].f64val <= (f64)args[1].u32val);
+            RBOOL(VALUE_TO_F64(args[0]) <= (f64)VALUE_TO_U32(args[1]));
         default:
             return false; // 报错
     }
 }
 
+// 经由 u32 取反，-(-2147483648) 按补码回绕，与常量折叠的结果一致
 def_prim(i32_neg) {
-    RI32(-args[0].i32val);
+    RI32((i32)(0u - (u32)VALUE_TO_I32(args[0])));
 }
 
 def_prim(u32_neg) {
-    RI32(-args[0].u32val);
+    RI32((i32)(0u - VALUE_TO_U32(args[0])));
 }
 
 def_prim(f64_neg) {
-    RF64(-args[0].f64val);
+    RF64(-VALUE_TO_F64(args[0]));
 }
 
 def_prim(i32_bit_not) {
-    RU32(~(u32)args[0].i32val);
+    RU32(~(u32)VALUE_TO_I32(args[0]));
 }
 
 def_prim(u32_bit_not) {
-    RU32(~args[0].u32val);
+    RU32(~VALUE_TO_U32(args[0]));
 }
 
 def_prim(i32_range) {
     if (!VALUE_IS_I32(args[1])) {
         SET_ERROR_FALSE(vm, "expect i32 value for i32.range(to: i32) -> Range;");
     }
-    int from = args[0].i32val;
-    int to = args[1].i32val;
+    int from = VALUE_TO_I32(args[0]);
+    int to = VALUE_TO_I32(args[1]);
     int step = from <= to ? 1 : -1;
     ROBJ(objrange_new(vm, from, to, step));
 }
 
 def_prim(i32_to_string) {
-    ROBJ(i32_2str(vm, args[0].i32val));
+    ROBJ(i32_2str(vm, VALUE_TO_I32(args[0])));
 }
 
 def_prim(u32_to_string) {
-    ROBJ(u32_2str(vm, args[0].u32val));
+    ROBJ(u32_2str(vm, VALUE_TO_U32(args[0])));
 }
 
 def_prim(f64_to_string) {
-    ROBJ(f64_2str(vm, args[0].f64val));
+    ROBJ(f64_2str(vm, VALUE_TO_F64(args[0])));
 }
 
 def_prim(i32_eq) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].i32val == args[1].i32val);
+            RBOOL(VALUE_TO_I32(args[0]) == VALUE_TO_I32(args[1]));
         case 2:
-            RBOOL(args[0].i32val == args[1].f64val);
+            RBOOL(VALUE_TO_I32(args[0]) == VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].i32val == args[1].u32val);
+            RBOOL(VALUE_TO_I32(args[0]) == VALUE_TO_U32(args[1]));
         default:
             RFALSE();
     }
@@ -1157,11 +1286,11 @@ def_prim(i32_eq) {
 def_prim(u32_eq) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].u32val == args[1].i32val);
+            RBOOL(VALUE_TO_U32(args[0]) == VALUE_TO_I32(args[1]));
         case 2:
-            RBOOL(args[0].u32val == args[1].f64val);
+            RBOOL(VALUE_TO_U32(args[0]) == VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].u32val == args[1].u32val);
+            RBOOL(VALUE_TO_U32(args[0]) == VALUE_TO_U32(args[1]));
         default:
             RFALSE();
     }
@@ -1170,11 +1299,11 @@ def_prim(u32_eq) {
 def_prim(i32_ne) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].i32val != args[1].i32val);
+            RBOOL(VALUE_TO_I32(args[0]) != VALUE_TO_I32(args[1]));
         case 2:
-            RBOOL(args[0].i32val != args[1].f64val);
+            RBOOL(VALUE_TO_I32(args[0]) != VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].i32val != args[1].u32val);
+            RBOOL(VALUE_TO_I32(args[0]) != VALUE_TO_U32(args[1]));
         default:
             RTRUE();
     }
@@ -1183,11 +1312,11 @@ def_prim(i32_ne) {
 def_prim(u32_ne) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].u32val != args[1].i32val);
+            RBOOL(VALUE_TO_U32(args[0]) != VALUE_TO_I32(args[1]));
         case 2:
-            RBOOL(args[0].u32val != args[1].f64val);
+            RBOOL(VALUE_TO_U32(args[0]) != VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].u32val != args[1].u32val);
+            RBOOL(VALUE_TO_U32(args[0]) != VALUE_TO_U32(args[1]));
         default:
             RTRUE();
     }
@@ -1196,11 +1325,11 @@ def_prim(u32_ne) {
 def_prim(f64_eq) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].f64val == args[1].i32val);
+            RBOOL(VALUE_TO_F64(args[0]) == VALUE_TO_I32(args[1]));
         case 2:
-            RBOOL(args[0].f64val == args[1].f64val);
+            RBOOL(VALUE_TO_F64(args[0]) == VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].f64val == args[1].u32val);
+            RBOOL(VALUE_TO_F64(args[0]) == VALUE_TO_U32(args[1]));
         default:
             RFALSE();
     }
@@ -1209,11 +1338,11 @@ def_prim(f64_eq) {
 def_prim(f64_ne) {
     switch (validate_num(vm, args[1])) {
         case 1:
-            RBOOL(args[0].f64val != args[1].i32val);
+            RBOOL(VALUE_TO_F64(args[0]) != VALUE_TO_I32(args[1]));
         case 2:
-            RBOOL(args[0].f64val != args[1].f64val);
+            RBOOL(VALUE_TO_F64(args[0]) != VALUE_TO_F64(args[1]));
         case 3:
-            RBOOL(args[0].f64val != args[1].u32val);
+            RBOOL(VALUE_TO_F64(args[0]) != VALUE_TO_U32(args[1]));
         default:
             RTRUE();
     }
@@ -1239,14 +1368,14 @@ inline static u32 validate_index(VM* vm, Value index, u32 len) {
         vm->cur_thread = NULL;
         return UINT32_MAX;
     }
-    return validate_index_value(vm, index.i32val, len);
+    return validate_index_value(vm, VALUE_TO_I32(index), len);
 }
 
 static Value make_string_from_code_point(VM* vm, int value) {
     u32 byte = get_byte_of_decode_utf8(value);
     ASSERT(byte != 0, "utf8 encode bytes should be between 1 and 4.");
 
-    ObjString* str = ALLOCATE_EXTRA(vm, ObjString, byte + 1);
+    ObjString* str = ALLOCATE_OBJ_EXTRA(vm, ObjString, byte + 1);
     if (str == NULL) {
         MEM_ERROR("allocate memory failed in runtime.");
     }
@@ -1258,7 +1387,7 @@ static Value make_string_from_code_point(VM* vm, int value) {
     str->val.start[byte] = '\0';
     objstring_hash(str);
     
-    return OBJ_TO_VALUE(str);
+    return OBJ_TO_VALUE(objstring_intern(vm, str));
 }
 
 inline static Value string_code_point_at(VM* vm, ObjString* str, u32 index) {
@@ -1296,7 +1425,7 @@ static ObjString* objstring_from_sub(VM* vm, ObjString* src_str, int start, u32
         total_len += get_byte_of_decode_utf8_from_start(src[start + i * step]);
     }
 
-    ObjString* res = ALLOCATE_EXTRA(vm, ObjString, total_len + 1);
+    ObjString* res = ALLOCATE_OBJ_EXTRA(vm, ObjString, total_len + 1);
     if (res == NULL) {
         MEM_ERROR("allocate memory failed in runtime.");
     }
@@ -1318,7 +1447,7 @@ static ObjString* objstring_from_sub(VM* vm, ObjString* src_str, int start, u32
     }
 
     objstring_hash(res);
-    return res;
+    return objstring_intern(vm, res);
 }
 
 static int find_string(ObjString* haystack, ObjString* needle) {
@@ -1362,7 +1491,7 @@ def_prim(String_from_code_point) {
         SET_ERROR_FALSE(vm, "String.from_code_point(index: i32) -> String; index must be i32 value.");
     }
 
-    int code_point = args[1].i32val;
+    int code_point = VALUE_TO_I32(args[1]);
     if (code_point < 0) {
         SET_ERROR_FALSE(vm, "code point can't be negetive.");
     }
@@ -1392,7 +1521,7 @@ def_prim(String_add) {
 
     u32 total_len = l->val.len + r->val.len;
     
-    ObjString* res = ALLOCATE_EXTRA(vm, ObjString, total_len + 1);
+    ObjString* res = ALLOCATE_OBJ_EXTRA(vm, ObjString, total_len + 1);
     if (res == NULL) {
         MEM_ERROR("allocate memory failed in runtime.");
     }
@@ -1404,13 +1533,13 @@ def_prim(String_add) {
     res->val.start[res->val.len] = '\0';
     objstring_hash(res);
 
-    ROBJ(res);
+    ROBJ(objstring_intern(vm, res));
 }
 
 def_prim(String_subscript) {
     ObjString* str = VALUE_TO_OBJSTR(args[0]);
     if (VALUE_IS_I32(args[1])) {
-        u32 index = validate_index_value(vm, args[1].i32val, str->val.len);
+        u32 index = validate_index_value(vm, VALUE_TO_I32(args[1]), str->val.len);
         if (index == UINT32_MAX) {
             return false; // 报错
         }
@@ -1522,7 +1651,7 @@ def_prim(String_iterate) {
         SET_ERROR_FALSE(vm, "iter-var must be a i32 value.");
     }
 
-    int iter_var = args[1].i32val; // iter_var保存的是上一个迭代的值
+    int iter_var = VALUE_TO_I32(args[1]); // iter_var保存的是上一个迭代的值
     if (iter_var < 0) {
         RFALSE();
     }
@@ -1551,7 +1680,7 @@ def_prim(String_iterate_byte) {
         SET_ERROR_FALSE(vm, "iter-var must be a i32 value.");
     }
 
-    int iter_var = args[1].i32val; // iter_var保存的是上一个迭代的值
+    int iter_var = VALUE_TO_I32(args[1]); // iter_var保存的是上一个迭代的值
     if (iter_var < 0) {
         RFALSE();
     }
@@ -1601,7 +1730,7 @@ def_prim(List_subscript) {
     ObjList* self = VALUE_TO_LIST(args[0]);
 
     if (VALUE_IS_I32(args[1])) {
-        u32 index = validate_index_value(vm, args[1].i32val, self->elements.count);
+        u32 index = validate_index_value(vm, VALUE_TO_I32(args[1]), self->elements.count);
         if (index == UINT32_MAX) {
             return false; // error
         }
@@ -1629,21 +1758,24 @@ def_prim(List_subscript_set) {
     }
     
     ObjList* self = VALUE_TO_LIST(args[0]);
-    u32 index = validate_index_value(vm, args[1].i32val, self->elements.count);
+    u32 index = validate_index_value(vm, VALUE_TO_I32(args[1]), self->elements.count);
 
     self->elements.datas[index] = args[2];
+    GC_WRITE_BARRIER(vm, self, args[2]);
     RVAL(args[2]);
 }
 
 def_prim(List_append) {
     ObjList* self = VALUE_TO_LIST(args[0]);
     BufferAdd(Value, &self->elements, vm, args[1]);
+    GC_WRITE_BARRIER(vm, self, args[1]);
     RVAL(args[1]);
 }
 
 def_prim(List_core_append) {
     ObjList* self = VALUE_TO_LIST(args[0]);
     BufferAdd(Value, &self->elements, vm, args[1]);
+    GC_WRITE_BARRIER(vm, self, args[1]);
     RVAL(args[0]);
 }
 
@@ -1713,16 +1845,7 @@ def_prim(List_len) {
 }
 
 static bool validate_key(VM* vm, Value arg) {
-    if (VALUE_IS_TRUE(arg)
-        || VALUE_IS_FALSE(arg)
-        || VALUE_IS_NULL(arg)
-        || VALUE_IS_NUM(arg)
-        || VALUE_IS_STRING(arg)
-        || VALUE_IS_RANGE(arg)
-        || VALUE_IS_CLASS(arg)
-        || VALUE_IS_U32(arg)
-        || VALUE_IS_U8(arg)
-    ) {
+    if (objmap_key_is_hashable(arg)) {
         return true;
     }
     SET_ERROR_FALSE(vm, "key must be hashable value.");
@@ -1732,6 +1855,18 @@ def_prim(Map_new) {
     ROBJ(objmap_new(vm));
 }
 
+def_prim(Map_with_capacity) {
+    if (!VALUE_IS_I32(args[1]) || VALUE_TO_I32(args[1]) < 0) {
+        SET_ERROR_FALSE(vm, "Map.with_capacity(capacity: i32) -> Map; capacity must be a non-negative i32 value.");
+    }
+
+    ObjMap* map = objmap_new(vm);
+    push_tmp_root(vm, (ObjHeader*)map);
+    objmap_reserve(vm, map, VALUE_TO_I32(args[1]));
+    pop_tmp_root(vm);
+    ROBJ(map);
+}
+
 def_prim(Map_subscript) {
     if (!validate_key(vm, args[1])) {
         return false; // error
@@ -1806,22 +1941,22 @@ def_prim(Map_iterate) {
             SET_ERROR_FALSE(vm, "iter-var must be a i32 value.");
         }
 
-        if (args[1].i32val < 0) {
+        if (VALUE_TO_I32(args[1]) < 0) {
             RFALSE();
         }
 
-        index = args[1].i32val;
+        index = VALUE_TO_I32(args[1]);
 
-        if (index >= self->capacity) {
+        if (index >= self->entry_count) {
             RFALSE();
         }
 
         index++;
     }
 
-    // 迭代到下一个有效的entry
-    while (index < self->capacity) {
-        if (!VALUE_IS_UNDEFINED(self->entries[index].key)) {
+    // 按插入顺序迭代到下一个有效的entry
+    while (index < self->entry_count) {
+        if (MAP_ENTRY_IS_VALID(&self->entries[index])) {
             RI32(index);
         }
         index++;
@@ -1833,13 +1968,13 @@ def_prim(Map_iterate) {
 
 def_prim(Map_val_iterator_value) {
     ObjMap* self = VALUE_TO_OBJMAP(args[0]);
-    u32 index = validate_index(vm, args[1], self->capacity);
+    u32 index = validate_index(vm, args[1], self->entry_count);
     if (index == UINT32_MAX) {
         return false; // error
     }
 
     Entry* entry = &self->entries[index];
-    if (VALUE_IS_UNDEFINED(entry->key)) {
+    if (!MAP_ENTRY_IS_VALID(entry)) {
         SET_ERROR_FALSE(vm, "invalid iter.");
     }
 
@@ -1848,13 +1983,13 @@ def_prim(Map_val_iterator_value) {
 
 def_prim(Map_key_iterator_value) {
     ObjMap* self = VALUE_TO_OBJMAP(args[0]);
-    u32 index = validate_index(vm, args[1], self->capacity);
+    u32 index = validate_index(vm, args[1], self->entry_count);
     if (index == UINT32_MAX) {
         return false; // error
     }
 
     Entry* entry = &self->entries[index];
-    if (VALUE_IS_UNDEFINED(entry->key)) {
+    if (!MAP_ENTRY_IS_VALID(entry)) {
         SET_ERROR_FALSE(vm, "invalid iter.");
     }
 
@@ -1888,7 +2023,7 @@ def_prim(Range_iterate) {
         SET_ERROR_FALSE(vm, "iter-var must be a i32 value.");
     }
 
-    int iter = args[1].i32val + self->step;
+    int iter = VALUE_TO_I32(args[1]) + self->step;
 
     if (self->from < self->to && self->to <= iter || self->from > self->to && self->to >= iter) {
         RFALSE();
@@ -1903,7 +2038,7 @@ def_prim(Range_iterator_value) {
     }
     
     ObjRange* self = VALUE_TO_RANGE(args[0]);
-    int iter = args[1].i32val;
+    int iter = VALUE_TO_I32(args[1]);
 
     if (self->from < self->to && self->to <= iter || self->from > self->to && self->to >= iter) {
         RFALSE();
@@ -1925,7 +2060,7 @@ def_prim(Range_new_arg3) {
         SET_ERROR_FALSE(vm, "Range.step must be a i32 value.");
     }
 
-    ROBJ(objrange_new(vm, args[1].i32val, args[2].i32val, args[3].i32val));
+    ROBJ(objrange_new(vm, VALUE_TO_I32(args[1]), VALUE_TO_I32(args[2]), VALUE_TO_I32(args[3])));
 }
 
 def_prim(Range_new_arg2) {
@@ -1937,9 +2072,9 @@ def_prim(Range_new_arg2) {
         SET_ERROR_FALSE(vm, "Range.to must be a i32 value.");
     }
 
-    int step = args[1].i32val <= args[2].i32val ? 1 : -1;
+    int step = VALUE_TO_I32(args[1]) <= VALUE_TO_I32(args[2]) ? 1 : -1;
 
-    ROBJ(objrange_new(vm, args[1].i32val, args[2].i32val, step));
+    ROBJ(objrange_new(vm, VALUE_TO_I32(args[1]), VALUE_TO_I32(args[2]), step));
 }
 
 def_prim(Range_new_arg1) {
@@ -1949,9 +2084,9 @@ def_prim(Range_new_arg1) {
         SET_ERROR_FALSE(vm, "Range.from must be a i32 value.");
     }
 
-    int step = args[1].i32val <= args[2].i32val ? 1 : -1;
+    int step = VALUE_TO_I32(args[1]) <= VALUE_TO_I32(args[2]) ? 1 : -1;
 
-    ROBJ(objrange_new(vm, from, args[1].i32val, step));
+    ROBJ(objrange_new(vm, from, VALUE_TO_I32(args[1]), step));
 }
 
 inline static char* get_file_path(const char* module_name, enum ImportRootType mode) {
@@ -2015,9 +2150,14 @@ static Value import_module(VM* vm, Value module_name, enum ImportRootType mode)
     }
 
     ObjString* str = VALUE_TO_STRING(module_name);
+#ifdef USE_BYTECODE_CACHE
+    char* path = get_file_path(str->val.start, mode);
+    ObjThread* module_thread = load_module_with_cache(vm, module_name, path);
+    free(path);
+#else
     const char* src = read_module(str->val.start, mode);
-
     ObjThread* module_thread = load_module(vm, module_name, src);
+#endif
     return OBJ_TO_VALUE(module_thread);
 }
 
@@ -2133,18 +2273,266 @@ def_prim(System_write_string) {
 }
 
 def_prim(VM_gc) {
-    start_gc(vm);
+    start_full_gc(vm);
     RNULL();
 }
 
 def_prim(VM_allocated_bytes) {
-    RI32((int)vm->allocated_bytes);
+    RF64((double)vm->allocated_bytes);
+}
+
+// 将数值参数转换为字节数，负数视为0
+inline static bool value_to_bytes(VM* vm, Value arg, u64* bytes) {
+    switch (validate_num(vm, arg)) {
+        case 1:
+            *bytes = VALUE_TO_I32(arg) < 0 ? 0 : (u64)VALUE_TO_I32(arg);
+            return true;
+        case 2:
+            *bytes = VALUE_TO_F64(arg) < 0 ? 0 : (u64)VALUE_TO_F64(arg);
+            return true;
+        case 3:
+            *bytes = VALUE_TO_U32(arg);
+            return true;
+        case 4:
+            *bytes = VALUE_TO_U8(arg);
+            return true;
+        default:
+            return false; // error
+    }
+}
+
+def_prim(VM_max_heap_size) {
+    RF64((double)vm->config.max_heap_size);
+}
+
+// VM.max_heap_size = bytes; 0 表示不限制
+def_prim(VM_set_max_heap_size) {
+    if (!value_to_bytes(vm, args[1], &vm->config.max_heap_size)) {
+        return false; // error
+    }
+    RVAL(args[1]);
+}
+
+def_prim(VM_soft_heap_size) {
+    RF64((double)vm->config.soft_heap_size);
+}
+
+// VM.soft_heap_size = bytes; 0 表示不限制。立即生效，当前回收阈值超过软上限时下一次分配即回收
+def_prim(VM_set_soft_heap_size) {
+    u64 soft = 0;
+    if (!value_to_bytes(vm, args[1], &soft)) {
+        return false; // error
+    }
+    vm->config.soft_heap_size = soft;
+    if (soft != 0 && vm->config.next_gc > soft) {
+        vm->config.next_gc = soft;
+    }
+    RVAL(args[1]);
+}
+
+// 增量标记的步长配置，未定义 USE_INCREMENTAL_GC 时读取为 0，设置不起作用
+def_prim(VM_gc_step_budget) {
+#ifdef USE_INCREMENTAL_GC
+    RF64((double)vm->config.gc_step_budget);
+#else
+    (void)vm;
+    RF64(0);
+#endif
+}
+
+// VM.gc_step_budget = bytes; 增量标记每步最多处理的字节数，至少为 1
+def_prim(VM_set_gc_step_budget) {
+    u64 budget = 0;
+    if (!value_to_bytes(vm, args[1], &budget)) {
+        return false; // error
+    }
+#ifdef USE_INCREMENTAL_GC
+    vm->config.gc_step_budget = budget == 0 ? 1 : budget;
+#endif
+    RVAL(args[1]);
+}
+
+def_prim(VM_gc_step_interval) {
+#ifdef USE_INCREMENTAL_GC
+    RF64((double)vm->config.gc_step_interval);
+#else
+    (void)vm;
+    RF64(0);
+#endif
+}
+
+// VM.gc_step_interval = bytes; 标记期间每新分配该字节数推进一步，下一步起生效
+def_prim(VM_set_gc_step_interval) {
+    u64 interval = 0;
+    if (!value_to_bytes(vm, args[1], &interval)) {
+        return false; // error
+    }
+#ifdef USE_INCREMENTAL_GC
+    vm->config.gc_step_interval = interval;
+#endif
+    RVAL(args[1]);
+}
+
+// 并行标记的线程配置，未定义 USE_PARALLEL_MARK 时读取为 0，设置不起作用
+def_prim(VM_mark_threads) {
+#ifdef USE_PARALLEL_MARK
+    RF64((double)vm->config.mark_threads);
+#else
+    (void)vm;
+    RF64(0);
+#endif
+}
+
+// VM.mark_threads = n; 完整回收时参与标记的线程数（含当前线程），限制在 1 到 MAX_MARK_THREADS 之间
+def_prim(VM_set_mark_threads) {
+    u64 threads = 0;
+    if (!value_to_bytes(vm, args[1], &threads)) {
+        return false; // error
+    }
+#ifdef USE_PARALLEL_MARK
+    vm->config.mark_threads = threads == 0 ? 1 : (threads > MAX_MARK_THREADS ? MAX_MARK_THREADS : (u32)threads);
+#endif
+    RVAL(args[1]);
+}
+
+def_prim(VM_parallel_mark_min_heap) {
+#ifdef USE_PARALLEL_MARK
+    RF64((double)vm->config.parallel_mark_min_heap);
+#else
+    (void)vm;
+    RF64(0);
+#endif
+}
+
+// VM.parallel_mark_min_heap = bytes; 设为 0 时任意大小的堆都并行标记
+def_prim(VM_set_parallel_mark_min_heap) {
+    u64 min_heap = 0;
+    if (!value_to_bytes(vm, args[1], &min_heap)) {
+        return false; // error
+    }
+#ifdef USE_PARALLEL_MARK
+    vm->config.parallel_mark_min_heap = min_heap;
+#endif
+    RVAL(args[1]);
+}
+
+// 以多个线程完成标记的完整回收次数
+def_prim(VM_parallel_mark_count) {
+#ifdef USE_PARALLEL_MARK
+    RF64((double)vm->parallel_mark_count);
+#else
+    (void)vm;
+    RF64(0);
+#endif
+}
+
+#ifdef USE_SLAB_ALLOCATOR
+inline static void slab_stats_set(VM* vm, ObjMap* map, const char* key, double val) {
+    Value key_val = OBJ_TO_VALUE(objstring_new(vm, key, strlen(key)));
+    push_tmp_root(vm, VALUE_TO_OBJ(key_val));
+    objmap_set(vm, map, key_val, F64_TO_VALUE(val));
+    pop_tmp_root(vm);
+}
+#endif
+
+// 返回 slab 分配器的统计信息，未启用 USE_SLAB_ALLOCATOR 时返回 null
+def_prim(VM_slab_stats) {
+#ifdef USE_SLAB_ALLOCATOR
+    SlabStats* stats = &vm->slab.stats;
+    u64 live = 0;
+    for (int i = 0; i < SLAB_CLASS_NUM; i++) {
+        live += stats->live_count[i];
+    }
+
+    ObjMap* map = objmap_new(vm);
+    push_tmp_root(vm, (ObjHeader*)map);
+    slab_stats_set(vm, map, "page_count", stats->page_count);
+    slab_stats_set(vm, map, "page_bytes", stats->page_bytes);
+    slab_stats_set(vm, map, "alloc_count", stats->alloc_count);
+    slab_stats_set(vm, map, "reuse_count", stats->reuse_count);
+    slab_stats_set(vm, map, "free_count", stats->free_count);
+    slab_stats_set(vm, map, "live_count", live);
+    pop_tmp_root(vm);
+    ROBJ(map);
+#else
+    (void)vm;
+    RNULL();
+#endif
 }
 
 def_prim(VM_is_main) {
     RBOOL(vm->cur_thread->caller == NULL);
 }
 
+// 调用次数与所有 LOOP 回跳次数之和，用于热点函数排序
+static u64 fn_heat(ObjFn* fn) {
+    u64 heat = fn->call_count;
+    for (u32 i = 0; i < fn->loop_counter_number; i++) {
+        heat += fn->loop_counters[i].count;
+    }
+    return heat;
+}
+
+static int compare_hot_fn(const void* a, const void* b) {
+    u64 heat_a = fn_heat(VALUE_TO_OBJCLOSURE(*(const Value*)a)->fn);
+    u64 heat_b = fn_heat(VALUE_TO_OBJCLOSURE(*(const Value*)b)->fn);
+    return heat_a < heat_b ? 1 : heat_a > heat_b ? -1 : 0;
+}
+
+// val 为对象时须已可达
+inline static void hot_fn_set(VM* vm, ObjMap* map, const char* key, Value val) {
+    Value key_val = OBJ_TO_VALUE(objstring_new(vm, key, strlen(key)));
+    push_tmp_root(vm, VALUE_TO_OBJ(key_val));
+    objmap_set(vm, map, key_val, val);
+    pop_tmp_root(vm);
+}
+
+// VM.hot_functions() -> List<Map>
+// 成为热点的函数，按调用与循环回跳次数之和降序排列。每项为
+// {"fn": 闭包, "calls": 调用次数, "loops": 每条 LOOP 的回跳次数, "jit": 是否已编译为机器码}
+def_prim(VM_hot_functions) {
+    // vm->hot_fns 是弱引用，先将闭包复制到结果列表中使其可达，再逐项替换为信息表
+    ObjList* res = objlist_new(vm, vm->hot_fns.count);
+    u32 count = vm->hot_fns.count; // 创建列表时的回收可能删除了部分闭包
+    res->elements.count = count;
+    if (count > 0) {
+        memcpy(res->elements.datas, vm->hot_fns.datas, sizeof(Value) * count);
+        qsort(res->elements.datas, count, sizeof(Value), compare_hot_fn);
+    }
+    push_tmp_root(vm, (ObjHeader*)res);
+
+    for (u32 i = 0; i < count; i++) {
+        Value closure = res->elements.datas[i];
+        ObjFn* fn = VALUE_TO_OBJCLOSURE(closure)->fn;
+        ObjMap* info = objmap_new(vm);
+        push_tmp_root(vm, (ObjHeader*)info);
+        // 闭包在写入信息表之前仍由结果列表持有
+        hot_fn_set(vm, info, "fn", closure);
+        res->elements.datas[i] = OBJ_TO_VALUE(info);
+        GC_WRITE_BARRIER(vm, res, res->elements.datas[i]);
+        pop_tmp_root(vm);
+
+        hot_fn_set(vm, info, "calls", F64_TO_VALUE((double)fn->call_count));
+
+        ObjList* loops = objlist_new(vm, fn->loop_counter_number);
+        for (u32 j = 0; j < fn->loop_counter_number; j++) {
+            loops->elements.datas[j] = F64_TO_VALUE((double)fn->loop_counters[j].count);
+        }
+        push_tmp_root(vm, (ObjHeader*)loops);
+        hot_fn_set(vm, info, "loops", OBJ_TO_VALUE(loops));
+        pop_tmp_root(vm);
+
+    #ifdef USE_TEMPLATE_JIT
+        hot_fn_set(vm, info, "jit", BOOL_TO_VALUE(fn->jit != NULL));
+    #else
+        hot_fn_set(vm, info, "jit", VT_TO_VALUE(VT_FALSE));
+    #endif
+    }
+
+    pop_tmp_root(vm);
+    ROBJ(res);
+}
+
 def_prim(NativePointer_check_classifier) {
     if (!validate_str(vm, args[1])) {
         return false; // error
@@ -2157,7 +2545,7 @@ def_prim(NativePointer_is_null) {
 }
 
 def_prim(NativePointer_classifiers) {
-    ObjNativePointer* np = (ObjNativePointer*)args[0].header;
+    ObjNativePointer* np = (ObjNativePointer*)VALUE_TO_OBJ(args[0]);
     if (np->classifier == NULL) {
         RNULL();
     }
@@ -2166,7 +2554,7 @@ def_prim(NativePointer_classifiers) {
 
 def_prim(u8_to_string) {
     char buf[10] = {'\0'};
-    u32 len = snprintf(buf, 10, "%u", args[0].u8val);
+    u32 len = snprintf(buf, 10, "%u", VALUE_TO_U8(args[0]));
     ROBJ(objstring_new(vm, buf, len));
 }
 
@@ -2174,14 +2562,14 @@ def_prim(u8_to_char) {
     char buf[5] = {'\0'};
     u32 len = 0;
 
-    if (args[0].u8val == '\n') {
+    if (VALUE_TO_U8(args[0]) == '\n') {
         len = snprintf(buf, 5, "'\\n'");
-    } else if (args[0].u8val == '\b') {
+    } else if (VALUE_TO_U8(args[0]) == '\b') {
         len = snprintf(buf, 5, "'\\b'");
-    } else if (args[0].u8val == '\t') {
+    } else if (VALUE_TO_U8(args[0]) == '\t') {
         len = snprintf(buf, 5, "'\\t'");
     } else {
-        len = snprintf(buf, 5, "'%c'", args[0].u8val);
+        len = snprintf(buf, 5, "'%c'", VALUE_TO_U8(args[0]));
     }
     
     ROBJ(objstring_new(vm, buf, len));
@@ -2189,56 +2577,56 @@ def_prim(u8_to_char) {
 
 def_prim(u8_to_printable) {
     char buf[5] = {'\0'};
-    u32 len = snprintf(buf, 5, "%c", args[0].u8val);
+    u32 len = snprintf(buf, 5, "%c", VALUE_TO_U8(args[0]));
     ROBJ(objstring_new(vm, buf, len));
 }
 
 def_prim(u8_eq) {
-    if (args[1].type != VT_U8) {
+    if (!VALUE_IS_U8(args[1])) {
         SET_ERROR_FALSE(vm, "u8.==(val: u8) -> bool;\n");
     }
 
-    RBOOL(args[0].u8val == args[1].u8val);
+    RBOOL(VALUE_TO_U8(args[0]) == VALUE_TO_U8(args[1]));
 }
 
 def_prim(u8_ne) {
-    if (args[1].type != VT_U8) {
+    if (!VALUE_IS_U8(args[1])) {
         SET_ERROR_FALSE(vm, "u8.!=(val: u8) -> bool;\n");
     }
 
-    RBOOL(args[0].u8val != args[1].u8val);
+    RBOOL(VALUE_TO_U8(args[0]) != VALUE_TO_U8(args[1]));
 }
 
 def_prim(u8_gt) {
-    if (args[1].type != VT_U8) {
+    if (!VALUE_IS_U8(args[1])) {
         SET_ERROR_FALSE(vm, "u8.>(val: u8) -> bool;\n");
     }
 
-    RBOOL(args[0].u8val > args[1].u8val);
+    RBOOL(VALUE_TO_U8(args[0]) > VALUE_TO_U8(args[1]));
 }
 
 def_prim(u8_ge) {
-    if (args[1].type != VT_U8) {
+    if (!VALUE_IS_U8(args[1])) {
         SET_ERROR_FALSE(vm, "u8.>=(val: u8) -> bool;\n");
     }
 
-    RBOOL(args[0].u8val >= args[1].u8val);
+    RBOOL(VALUE_TO_U8(args[0]) >= VALUE_TO_U8(args[1]));
 }
 
 def_prim(u8_lt) {
-    if (args[1].type != VT_U8) {
+    if (!VALUE_IS_U8(args[1])) {
         SET_ERROR_FALSE(vm, "u8.<(val: u8) -> bool;\n");
     }
 
-    RBOOL(args[0].u8val < args[1].u8val);
+    RBOOL(VALUE_TO_U8(args[0]) < VALUE_TO_U8(args[1]));
 }
 
 def_prim(u8_le) {
-    if (args[1].type != VT_U8) {
+    if (!VALUE_IS_U8(args[1])) {
         SET_ERROR_FALSE(vm, "u8.<=(val: u8) -> bool;\n");
     }
 
-    RBOOL(args[0].u8val <= args[1].u8val);
+    RBOOL(VALUE_TO_U8(args[0]) <= VALUE_TO_U8(args[1]));
 }
 
 static ObjMap* DyLib_all_opened_lib = NULL;
@@ -2296,10 +2684,10 @@ static void SprApi_release_tmp_obj(SprApi* api) {
 }
 
 static void SprApi_push_tmp_obj(SprApi* api, Value* val) {
-    if (val == NULL || val->type != VT_OBJ) {
+    if (val == NULL || !VALUE_IS_OBJ(*val)) {
         return;
     }
-    push_tmp_root(api->vm, val->header);
+    push_tmp_root(api->vm, VALUE_TO_OBJ(*val));
     api->tmp_obj_count++;
 }
 
@@ -2358,6 +2746,12 @@ def_prim(DyLib_bind) {
         RFALSE();
     }
 
+    // Value 的内存布局随 USE_NAN_BOXING 改变，布局不一致的 dylib 不能绑定
+    const u32* api_version = dlsym(handle->ptr, "pub_spr_dylib_api_version");
+    if ((api_version == NULL ? SPR_API_VERSION_STRUCT_VALUE : *api_version) != SPR_API_VERSION) {
+        SET_ERROR_FALSE(vm, "incompatible SprApi version, rebuild the dylib with the same Value layout.");
+    }
+
     SprApi api = (SprApi) {
         .vm = vm,
         .class = class,
@@ -2391,7 +2785,57 @@ def_prim(DyLib_bind) {
     RTRUE();
 }
 
-void build_core(VM* vm) {
+#ifdef USE_MARK_BITMAP
+static void patch_string_class(void* obj, void* vm) {
+    ObjHeader* header = (ObjHeader*)obj;
+    if (header->type == OT_STRING) {
+        header->class = ((VM*)vm)->string_class;
+    }
+}
+#endif
+
+static ObjThread* load_core_module(VM* vm, ObjModule* core_module, CoreSnapshot* snapshot) {
+    ObjFn* fn = NULL;
+    if (snapshot != NULL && snapshot->data != NULL) {
+        fn = bytecode_cache_load_snapshot(vm, core_module, core_module_code, snapshot->data, snapshot->size);
+        snapshot->ok = fn != NULL;
+    }
+
+    if (fn == NULL) {
+        u32 inherited_var_num = core_module->module_var_name.count;
+        fn = compile_module_code(vm, core_module, core_module_code);
+        if (snapshot != NULL && snapshot->out != NULL) {
+            push_tmp_root(vm, (ObjHeader*)fn);
+            snapshot->ok = bytecode_cache_save_snapshot(vm, core_module, inherited_var_num, fn, core_module_code, snapshot->out);
+            pop_tmp_root(vm);
+        }
+    }
+
+    return create_module_thread(vm, CORE_MODULE, core_module, fn);
+}
+
+// 调用点快化：CALLX 调用的是 builtin 类上可由解释器直接执行的 primitive 时返回对应的快化指令，否则返回 OPCODE_END。
+// 快化指令只守卫接收者的 class 与此处的 builtin 类完全相同，子类和其他定义了同名方法的类都不满足而退回 CALLX。
+// 因此无需再检查方法本身：builtin 类的方法表在 build_core 之后不会再改变
+OpCode quickened_opcode(VM* vm, Class* class, Method* method) {
+    if (method->type != MT_PRIMITIVE) {
+        return OPCODE_END;
+    }
+
+    if (class == vm->list_class) {
+        if (method->prim == prim_name(List_subscript)) {
+            return OPCODE_LIST_SUBSCRIPT;
+        }
+        if (method->prim == prim_name(List_len)) {
+            return OPCODE_LIST_LEN;
+        }
+    } else if (class == vm->map_class && method->prim == prim_name(Map_subscript)) {
+        return OPCODE_MAP_SUBSCRIPT;
+    }
+    return OPCODE_END;
+}
+
+void build_core(VM* vm, CoreSnapshot* snapshot) {
     ObjModule* core_module = objmodule_new(vm, NULL);
     push_tmp_root(vm, (ObjHeader*)core_module);
     objmap_set(vm, vm->all_module, CORE_MODULE, OBJ_TO_VALUE(core_module));
@@ -2422,7 +2866,7 @@ void build_core(VM* vm) {
     object_meta_class->header.class = vm->class_of_class;
     vm->class_of_class->header.class = vm->class_of_class;
 
-    execute_module(vm, CORE_MODULE, core_module_code);
+    execute_instruction(vm, load_core_module(vm, core_module, snapshot));
 
     // bool
     vm->bool_class = VALUE_TO_CLASS(get_core_class_value(core_module, "bool"));
@@ -2441,12 +2885,14 @@ void build_core(VM* vm) {
     BIND_PRIM_METHOD(vm->thread_class, "call()", prim_name(Thread_call));
     BIND_PRIM_METHOD(vm->thread_class, "call(_)", prim_name(Thread_call_arg1));
     BIND_PRIM_METHOD(vm->thread_class, "is_done", prim_name(Thread_is_done));
+    BIND_PRIM_METHOD(vm->thread_class, "error", prim_name(Thread_error));
 
     vm->fn_class = VALUE_TO_CLASS(get_core_class_value(core_module, "Fn"));
     // static
     BIND_PRIM_METHOD(vm->fn_class->header.class, "new(_)", prim_name(Fn_new));
     // field
     BIND_PRIM_METHOD(vm->fn_class, "disasm()", prim_name(Fn_disasm));
+    BIND_PRIM_METHOD(vm->fn_class, "opcodes", prim_name(Fn_opcodes));
     bind_fn_overload_call(vm, "call()");
     bind_fn_overload_call(vm, "call(_)");
     bind_fn_overload_call(vm, "call(_,_)");
@@ -2576,6 +3022,7 @@ void build_core(VM* vm) {
     vm->map_class = VALUE_TO_CLASS(get_core_class_value(core_module, "Map"));
     // static
     BIND_PRIM_METHOD(vm->map_class->header.class, "new()", prim_name(Map_new));
+    BIND_PRIM_METHOD(vm->map_class->header.class, "with_capacity(_)", prim_name(Map_with_capacity));
     // field
     BIND_PRIM_METHOD(vm->map_class, "[_]", prim_name(Map_subscript));
     BIND_PRIM_METHOD(vm->map_class, "[_]=(_)", prim_name(Map_subscript_set));
@@ -2613,7 +3060,22 @@ void build_core(VM* vm) {
     Class* vm_class = VALUE_TO_CLASS(get_core_class_value(core_module, "VM"));
     BIND_PRIM_METHOD(vm_class->header.class, "gc()", prim_name(VM_gc));
     BIND_PRIM_METHOD(vm_class->header.class, "allocated_bytes", prim_name(VM_allocated_bytes));
+    BIND_PRIM_METHOD(vm_class->header.class, "max_heap_size", prim_name(VM_max_heap_size));
+    BIND_PRIM_METHOD(vm_class->header.class, "max_heap_size=(_)", prim_name(VM_set_max_heap_size));
+    BIND_PRIM_METHOD(vm_class->header.class, "soft_heap_size", prim_name(VM_soft_heap_size));
+    BIND_PRIM_METHOD(vm_class->header.class, "soft_heap_size=(_)", prim_name(VM_set_soft_heap_size));
+    BIND_PRIM_METHOD(vm_class->header.class, "gc_step_budget", prim_name(VM_gc_step_budget));
+    BIND_PRIM_METHOD(vm_class->header.class, "gc_step_budget=(_)", prim_name(VM_set_gc_step_budget));
+    BIND_PRIM_METHOD(vm_class->header.class, "gc_step_interval", prim_name(VM_gc_step_interval));
+    BIND_PRIM_METHOD(vm_class->header.class, "gc_step_interval=(_)", prim_name(VM_set_gc_step_interval));
+    BIND_PRIM_METHOD(vm_class->header.class, "mark_threads", prim_name(VM_mark_threads));
+    BIND_PRIM_METHOD(vm_class->header.class, "mark_threads=(_)", prim_name(VM_set_mark_threads));
+    BIND_PRIM_METHOD(vm_class->header.class, "parallel_mark_min_heap", prim_name(VM_parallel_mark_min_heap));
+    BIND_PRIM_METHOD(vm_class->header.class, "parallel_mark_min_heap=(_)", prim_name(VM_set_parallel_mark_min_heap));
+    BIND_PRIM_METHOD(vm_class->header.class, "parallel_mark_count", prim_name(VM_parallel_mark_count));
     BIND_PRIM_METHOD(vm_class->header.class, "is_main", prim_name(VM_is_main));
+    BIND_PRIM_METHOD(vm_class->header.class, "hot_functions()", prim_name(VM_hot_functions));
+    BIND_PRIM_METHOD(vm_class->header.class, "slab_stats", prim_name(VM_slab_stats));
 
     vm->native_pointer_class = VALUE_TO_CLASS(get_core_class_value(core_module, "NativePointer"));
     BIND_PRIM_METHOD(vm->native_pointer_class, "check_classifier(_)", prim_name(NativePointer_check_classifier));
@@ -2633,6 +3095,9 @@ void build_core(VM* vm) {
     BIND_PRIM_METHOD(dylib_class->header.class, "SPR_DYLIB_PATH", prim_name(DyLib_spr_dylib_path));
 
     // 编译core.sp时字符串对象初始化时vm->string->class为NULL，现重新填充
+#ifdef USE_MARK_BITMAP
+    slab_for_each_live(&vm->slab, patch_string_class, vm);
+#endif
     ObjHeader* header = vm->all_objs;
     while (header != NULL) {
         if (header->type == OT_STRING) {
@@ -2640,4 +3105,14 @@ void build_core(VM* vm) {
         }
         header = header->next;
     }
+#ifdef USE_GENERATIONAL_GC
+    // 编译core.sp期间可能发生minor gc，已晋升到老年代的字符串同样需要填充
+    header = vm->old_objs;
+    while (header != NULL) {
+        if (header->type == OT_STRING) {
+            header->class = vm->string_class;
+        }
+        header = header->next;
+    }
+#endif
 }
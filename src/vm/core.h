@@ -8,12 +8,21 @@
 
 extern char* root_dir;
 
+// 核心模块快照：core.script.inc 的编译结果，格式与 .spc 缓存相同
+typedef struct {
+    const void* data; // 加载的快照，为 NULL 或无效（如由其它版本生成）时编译 core.script.inc
+    usize size;
+    FILE* out; // 不为 NULL 时把核心模块的编译结果写入其中
+    bool ok; // 快照是否加载或写入成功
+} CoreSnapshot;
+
 char* read_file(const char* path);
 VMResult execute_module(VM* vm, Value module_name, const char* module_code);
-void build_core(VM* vm);
+void build_core(VM* vm, CoreSnapshot* snapshot);
 int add_symbol(VM* vm, SymbolTable* table, const char* symbol, u32 len);
 int get_index_from_symbol_table(SymbolTable* table, const char* symbol, u32 len);
 void bind_super_class(VM* vm, Class* sub_class, Class* super_calss);
 void bind_method(VM* vm, Class* class, u32 index, Method method);
+OpCode quickened_opcode(VM* vm, Class* class, Method* method);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,1099 @@
+#include "jit.h"
+
+#ifdef USE_TEMPLATE_JIT
+
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "class.h"
+#include "compiler.h"
+#include "gc.h"
+#include "meta_obj.h"
+#include "obj_list.h"
+#include "obj_map.h"
+#include "opcode.h"
+#include "vm.h"
+
+// 模板 jit：按指令流的顺序为每条指令生成一段固定的 x86-64 机器码，不做跨指令的优化。
+// 机器码与解释器共用线程栈，寄存器约定如下，均为 callee-saved，调用 C 函数后仍然有效：
+//   rbx = esp，r12 = JitState*，r13 = stack_start，r14 = 当前线程，r15 = 常量表
+// 调用 C 函数前把 rbx 写回 thread->esp，gc 由此扫描到完整的栈，返回后重新读取。
+// 方法调用只在内联缓存命中 primitive 时由 jit_call 完成，其余调用、不支持的指令和类型守卫失败时
+// 在退出桩中记录字节码偏移后返回解释器，由解释器从该指令开始继续执行。
+
+typedef struct {
+    VM* vm;
+    ObjThread* thread;
+    Frame* frame;
+    u32 exit_offset; // 解释器继续执行的字节码偏移
+    u32 exit_status; // JitExit
+} JitState;
+
+// 机器码起始处的入口函数：保存寄存器后跳转到 target
+typedef JitExit (*JitEntry)(JitState* state, u8* target);
+
+enum {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+};
+enum { XMM0, XMM1 };
+
+#define REG_ESP     RBX
+#define REG_STATE   R12
+#define REG_STACK   R13
+#define REG_THREAD  R14
+#define REG_CONST   R15
+
+typedef enum {
+    CC_B  = 0x2,
+    CC_AE = 0x3,
+    CC_E  = 0x4,
+    CC_NE = 0x5,
+    CC_BE = 0x6,
+    CC_A  = 0x7,
+    CC_P  = 0xa,
+    CC_NP = 0xb,
+    CC_L  = 0xc,
+    CC_GE = 0xd,
+    CC_LE = 0xe,
+    CC_G  = 0xf,
+} Cond;
+
+#define VS ((i32)sizeof(Value))
+#define TOP(k) (-(k) * VS) // 栈顶第 k 个值相对 rbx 的偏移
+
+#ifdef USE_NAN_BOXING
+    #define PAYLOAD_OFFSET  0
+    #define TAG_HIGH(vt)    ((u32)(SPR_TAGGED(vt, 0) >> 32)) // 非 f64、非对象的值的高 32 位
+#else
+    #define TYPE_OFFSET     ((i32)offsetof(Value, type))
+    #define PAYLOAD_OFFSET  ((i32)offsetof(Value, i32val))
+#endif
+
+// 机器码中需回填的 rel32，target 为字节码偏移
+typedef struct {
+    u32 pos;
+    u32 target;
+} Patch;
+
+typedef struct {
+    u8* code;
+    u32 count;
+    u32 capacity;
+    Patch* branches; // 跳转到字节码偏移处的机器码
+    u32 branch_count;
+    u32 branch_capacity;
+    Patch* exits; // 跳转到字节码偏移处的退出桩
+    u32 exit_count;
+    u32 exit_capacity;
+    u32 epilogue; // 恢复寄存器并返回的代码所在位置
+    bool failed;
+} Assembler;
+
+static bool ensure_capacity(void** datas, u32* capacity, u32 count, usize elem_size) {
+    if (count < *capacity) {
+        return true;
+    }
+    u32 new_capacity = *capacity == 0 ? 64 : *capacity * 2;
+    void* new_datas = realloc(*datas, new_capacity * elem_size);
+    if (new_datas == NULL) {
+        return false;
+    }
+    *datas = new_datas;
+    *capacity = new_capacity;
+    return true;
+}
+
+static void emit_byte(Assembler* as, u8 byte) {
+    if (!ensure_capacity((void**)&as->code, &as->capacity, as->count, 1)) {
+        as->failed = true;
+        return;
+    }
+    as->code[as->count++] = byte;
+}
+
+static void emit_u32(Assembler* as, u32 val) {
+    for (int i = 0; i < 4; i++) {
+        emit_byte(as, (val >> (i * 8)) & 0xff);
+    }
+}
+
+static void emit_u64(Assembler* as, u64 val) {
+    emit_u32(as, (u32)val);
+    emit_u32(as, (u32)(val >> 32));
+}
+
+static void add_patch(Assembler* as, Patch** patches, u32* count, u32* capacity, u32 pos, u32 target) {
+    if (!ensure_capacity((void**)patches, capacity, *count, sizeof(Patch))) {
+        as->failed = true;
+        return;
+    }
+    (*patches)[(*count)++] = (Patch) {.pos = pos, .target = target};
+}
+
+static void patch_rel32(Assembler* as, u32 pos, u32 target) {
+    if (as->failed) {
+        return;
+    }
+    i32 rel = (i32)target - (i32)(pos + 4);
+    memcpy(as->code + pos, &rel, 4);
+}
+
+// ---------------- 指令编码 ----------------
+
+static void emit_opcode_bytes(Assembler* as, u32 op, u8 len) {
+    for (int i = len - 1; i >= 0; i--) {
+        emit_byte(as, (op >> (i * 8)) & 0xff);
+    }
+}
+
+// REX 前缀，reg 为 modrm.reg 字段，rm 为 modrm.rm 字段
+static void emit_rex(Assembler* as, bool w, u8 reg, u8 rm) {
+    u8 rex = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+    if (rex != 0x40) {
+        emit_byte(as, rex);
+    }
+}
+
+// [prefix] [REX] op modrm [sib] disp32，内存操作数为 [base + disp]
+static void emit_mem(Assembler* as, u8 prefix, bool w, u32 op, u8 op_len, u8 reg, u8 base, i32 disp) {
+    if (prefix != 0) {
+        emit_byte(as, prefix);
+    }
+    emit_rex(as, w, reg, base);
+    emit_opcode_bytes(as, op, op_len);
+    emit_byte(as, 0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP) {
+        emit_byte(as, 0x24);
+    }
+    emit_u32(as, (u32)disp);
+}
+
+// [prefix] [REX] op modrm，两个操作数均为寄存器
+static void emit_reg(Assembler* as, u8 prefix, bool w, u32 op, u8 op_len, u8 reg, u8 rm) {
+    if (prefix != 0) {
+        emit_byte(as, prefix);
+    }
+    emit_rex(as, w, reg, rm);
+    emit_opcode_bytes(as, op, op_len);
+    emit_byte(as, 0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+#define LOAD64(as, dst, base, disp)         emit_mem(as, 0, true, 0x8b, 1, dst, base, disp)
+#define STORE64(as, base, disp, src)        emit_mem(as, 0, true, 0x89, 1, src, base, disp)
+#define LOAD32(as, dst, base, disp)         emit_mem(as, 0, false, 0x8b, 1, dst, base, disp)
+#define STORE32(as, base, disp, src)        emit_mem(as, 0, false, 0x89, 1, src, base, disp)
+#define LEA(as, dst, base, disp)            emit_mem(as, 0, true, 0x8d, 1, dst, base, disp)
+#define MOV64(as, dst, src)                 emit_reg(as, 0, true, 0x89, 1, src, dst)
+#define MOVSD_LOAD(as, xmm, base, disp)     emit_mem(as, 0xf2, false, 0x0f10, 2, xmm, base, disp)
+#define MOVSD_STORE(as, base, disp, xmm)    emit_mem(as, 0xf2, false, 0x0f11, 2, xmm, base, disp)
+#define CVTSI2SD(as, xmm, base, disp)       emit_mem(as, 0xf2, false, 0x0f2a, 2, xmm, base, disp)
+#define UCOMISD(as, a, b)                   emit_reg(as, 0x66, false, 0x0f2e, 2, a, b)
+#define SSE_ARITH(as, op, dst, src)         emit_reg(as, 0xf2, false, op, 2, dst, src)
+#define ALU32_MEM(as, op, op_len, dst, base, disp) emit_mem(as, 0, false, op, op_len, dst, base, disp)
+
+#define SSE_ADD 0x0f58
+#define SSE_MUL 0x0f59
+#define SSE_SUB 0x0f5c
+#define SSE_DIV 0x0f5e
+
+static void store_imm32(Assembler* as, u8 base, i32 disp, u32 imm) {
+    emit_mem(as, 0, false, 0xc7, 1, 0, base, disp);
+    emit_u32(as, imm);
+}
+
+#ifndef USE_NAN_BOXING
+// 64 位写入，立即数符号扩展
+static void store_imm64(Assembler* as, u8 base, i32 disp, i32 imm) {
+    emit_mem(as, 0, true, 0xc7, 1, 0, base, disp);
+    emit_u32(as, (u32)imm);
+}
+#endif
+
+static void cmp_mem_imm32(Assembler* as, u8 base, i32 disp, u32 imm) {
+    emit_mem(as, 0, false, 0x81, 1, 7, base, disp);
+    emit_u32(as, imm);
+}
+
+static void mov_imm64(Assembler* as, u8 dst, u64 imm) {
+    emit_rex(as, true, 0, dst);
+    emit_byte(as, 0xb8 + (dst & 7));
+    emit_u64(as, imm);
+}
+
+static void mov_imm32(Assembler* as, u8 dst, u32 imm) {
+    emit_rex(as, false, 0, dst);
+    emit_byte(as, 0xb8 + (dst & 7));
+    emit_u32(as, imm);
+}
+
+// add/sub/cmp r64, imm32，ext 为 modrm.reg 中的操作码扩展
+static void alu64_imm(Assembler* as, u8 ext, u8 dst, i32 imm) {
+    emit_reg(as, 0, true, 0x81, 1, ext, dst);
+    emit_u32(as, (u32)imm);
+}
+#define ADD_IMM(as, dst, imm) alu64_imm(as, 0, dst, imm)
+#define SUB_IMM(as, dst, imm) alu64_imm(as, 5, dst, imm)
+
+static void push_reg(Assembler* as, u8 reg) {
+    if (reg & 8) {
+        emit_byte(as, 0x41);
+    }
+    emit_byte(as, 0x50 + (reg & 7));
+}
+
+static void pop_reg(Assembler* as, u8 reg) {
+    if (reg & 8) {
+        emit_byte(as, 0x41);
+    }
+    emit_byte(as, 0x58 + (reg & 7));
+}
+
+// setcc r8，只用于 al、cl
+static void setcc(Assembler* as, Cond cc, u8 reg) {
+    emit_byte(as, 0x0f);
+    emit_byte(as, 0x90 | cc);
+    emit_byte(as, 0xc0 | reg);
+}
+
+// 返回 rel32 的位置，由 patch_here 或 add_patch 回填
+static u32 emit_jcc(Assembler* as, Cond cc) {
+    emit_byte(as, 0x0f);
+    emit_byte(as, 0x80 | cc);
+    u32 pos = as->count;
+    emit_u32(as, 0);
+    return pos;
+}
+
+static u32 emit_jmp(Assembler* as) {
+    emit_byte(as, 0xe9);
+    u32 pos = as->count;
+    emit_u32(as, 0);
+    return pos;
+}
+
+static void patch_here(Assembler* as, u32 pos) {
+    patch_rel32(as, pos, as->count);
+}
+
+static void jcc_to_bytecode(Assembler* as, Cond cc, u32 target) {
+    u32 pos = emit_jcc(as, cc);
+    add_patch(as, &as->branches, &as->branch_count, &as->branch_capacity, pos, target);
+}
+
+static void jmp_to_bytecode(Assembler* as, u32 target) {
+    u32 pos = emit_jmp(as);
+    add_patch(as, &as->branches, &as->branch_count, &as->branch_capacity, pos, target);
+}
+
+// 已发出的跳转在退出时从字节码偏移 offset 处继续解释执行
+static void exit_at(Assembler* as, u32 pos, u32 offset) {
+    add_patch(as, &as->exits, &as->exit_count, &as->exit_capacity, pos, offset);
+}
+
+static void jcc_exit(Assembler* as, Cond cc, u32 offset) {
+    exit_at(as, emit_jcc(as, cc), offset);
+}
+
+static void jmp_exit(Assembler* as, u32 offset) {
+    exit_at(as, emit_jmp(as), offset);
+}
+
+// ---------------- Value 的读写 ----------------
+
+// [dst] = [src]，使用 rax 或 xmm0
+static void copy_value(Assembler* as, u8 dst_base, i32 dst_disp, u8 src_base, i32 src_disp) {
+#ifdef USE_NAN_BOXING
+    LOAD64(as, RAX, src_base, src_disp);
+    STORE64(as, dst_base, dst_disp, RAX);
+#else
+    emit_mem(as, 0, false, 0x0f10, 2, XMM0, src_base, src_disp); // movups
+    emit_mem(as, 0, false, 0x0f11, 2, XMM0, dst_base, dst_disp);
+#endif
+}
+
+static void push_value(Assembler* as, u8 base, i32 disp) {
+    copy_value(as, REG_ESP, 0, base, disp);
+    ADD_IMM(as, REG_ESP, VS);
+}
+
+static void push_vt(Assembler* as, ValueType vt) {
+#ifdef USE_NAN_BOXING
+    store_imm32(as, REG_ESP, 0, 0);
+    store_imm32(as, REG_ESP, 4, TAG_HIGH(vt));
+#else
+    store_imm32(as, REG_ESP, TYPE_OFFSET, vt);
+    store_imm64(as, REG_ESP, PAYLOAD_OFFSET, 0);
+#endif
+    ADD_IMM(as, REG_ESP, VS);
+}
+
+// 比较 [base + disp] 的类型，返回类型不是 vt 时的跳转，vt 不能为 VT_F64 或 VT_OBJ
+static u32 check_type(Assembler* as, u8 base, i32 disp, ValueType vt) {
+#ifdef USE_NAN_BOXING
+    // 比较整个高 32 位比 VALUE_IS_xxx 更严格，不满足时只是退回解释器
+    cmp_mem_imm32(as, base, disp + 4, TAG_HIGH(vt));
+#else
+    cmp_mem_imm32(as, base, disp + TYPE_OFFSET, vt);
+#endif
+    return emit_jcc(as, CC_NE);
+}
+
+static void load_i32(Assembler* as, u8 dst, u8 base, i32 disp) {
+    LOAD32(as, dst, base, disp + PAYLOAD_OFFSET);
+}
+
+// 写入 eax 中的 i32
+static void store_i32(Assembler* as, u8 base, i32 disp) {
+#ifdef USE_NAN_BOXING
+    STORE32(as, base, disp, RAX);
+    store_imm32(as, base, disp + 4, TAG_HIGH(VT_I32));
+#else
+    store_imm32(as, base, disp + TYPE_OFFSET, VT_I32);
+    STORE64(as, base, disp + PAYLOAD_OFFSET, RAX); // 32 位运算已清零 rax 的高位
+#endif
+}
+
+static void store_f64(Assembler* as, u8 base, i32 disp, u8 xmm) {
+#ifndef USE_NAN_BOXING
+    store_imm32(as, base, disp + TYPE_OFFSET, VT_F64);
+#endif
+    MOVSD_STORE(as, base, disp + PAYLOAD_OFFSET, xmm);
+}
+
+// 把 i32 或 f64 读为 f64，其它类型从 offset 处退出，使用 eax
+static void load_as_f64(Assembler* as, u8 xmm, u8 base, i32 disp, u32 offset) {
+#ifdef USE_NAN_BOXING
+    LOAD32(as, RAX, base, disp + 4);
+    emit_byte(as, 0x25); // and eax, imm32
+    emit_u32(as, TAG_HIGH(0));
+    emit_byte(as, 0x3d); // cmp eax, imm32
+    emit_u32(as, TAG_HIGH(0));
+    u32 not_f64 = emit_jcc(as, CC_E);
+#else
+    cmp_mem_imm32(as, base, disp + TYPE_OFFSET, VT_F64);
+    u32 not_f64 = emit_jcc(as, CC_NE);
+#endif
+    MOVSD_LOAD(as, xmm, base, disp + PAYLOAD_OFFSET);
+    u32 done = emit_jmp(as);
+
+    patch_here(as, not_f64);
+    exit_at(as, check_type(as, base, disp, VT_I32), offset);
+    CVTSI2SD(as, xmm, base, disp + PAYLOAD_OFFSET);
+    patch_here(as, done);
+}
+
+// 把 al 中的 0 或 1 写为 false 或 true
+static void store_bool(Assembler* as, u8 base, i32 disp) {
+    // VT_TRUE 紧跟在 VT_FALSE 之后
+    emit_byte(as, 0x0f); // movzx eax, al
+    emit_byte(as, 0xb6);
+    emit_byte(as, 0xc0);
+    emit_byte(as, 0x05); // add eax, imm32
+#ifdef USE_NAN_BOXING
+    emit_u32(as, TAG_HIGH(VT_FALSE));
+    STORE32(as, base, disp + 4, RAX);
+    store_imm32(as, base, disp, 0);
+#else
+    emit_u32(as, VT_FALSE);
+    STORE32(as, base, disp + TYPE_OFFSET, RAX);
+    store_imm64(as, base, disp + PAYLOAD_OFFSET, 0);
+#endif
+}
+
+// 设置标志位，随后 jbe 在值为 null 或 false 时跳转，ja 在其余情况跳转，使用 rax、rcx
+static void test_falsy(Assembler* as, u8 base, i32 disp) {
+#ifdef USE_NAN_BOXING
+    // null 与 false 只在高 32 位的类型中相差 1，减去 null 后循环右移 32 位得到 0 或 1
+    LOAD64(as, RAX, base, disp);
+    mov_imm64(as, RCX, VT_TO_VALUE(VT_NULL));
+    emit_reg(as, 0, true, 0x29, 1, RCX, RAX); // sub rax, rcx
+    emit_reg(as, 0, true, 0xc1, 1, 1, RAX);   // ror rax, 32
+    emit_byte(as, 32);
+    emit_reg(as, 0, true, 0x83, 1, 7, RAX);   // cmp rax, 1
+    emit_byte(as, 1);
+#else
+    // VT_NULL 与 VT_FALSE 相邻
+    LOAD32(as, RAX, base, disp + TYPE_OFFSET);
+    emit_reg(as, 0, false, 0x83, 1, 5, RAX);  // sub eax, VT_NULL
+    emit_byte(as, VT_NULL);
+    emit_reg(as, 0, false, 0x83, 1, 7, RAX);  // cmp eax, 1
+    emit_byte(as, 1);
+#endif
+}
+
+// 把对象读入 rcx，使用 rdx
+static void load_obj(Assembler* as, u8 base, i32 disp) {
+#ifdef USE_NAN_BOXING
+    LOAD64(as, RCX, base, disp);
+    mov_imm64(as, RDX, ~(SPR_SIGN_BIT | SPR_QNAN));
+    emit_reg(as, 0, true, 0x21, 1, RDX, RCX); // and rcx, rdx
+#else
+    LOAD64(as, RCX, base, disp + PAYLOAD_OFFSET);
+#endif
+}
+
+// ---------------- 对 C 函数的调用 ----------------
+
+static void call_c(Assembler* as, void* fn) {
+    STORE64(as, REG_THREAD, offsetof(ObjThread, esp), REG_ESP);
+    mov_imm64(as, RAX, (u64)(uintptr_t)fn);
+    emit_reg(as, 0, false, 0xff, 1, 2, RAX); // call rax
+    LOAD64(as, REG_ESP, REG_THREAD, offsetof(ObjThread, esp));
+}
+
+#if defined(USE_GENERATIONAL_GC) || defined(USE_INCREMENTAL_GC)
+static void jit_write_barrier(VM* vm, ObjHeader* holder, Value* val) {
+    GC_WRITE_BARRIER(vm, holder, *val);
+}
+
+// 写入 rcx 中对象后的写屏障，写入的值在 [base + disp]
+static void write_barrier(Assembler* as, u8 base, i32 disp) {
+    LEA(as, RDX, base, disp);
+    MOV64(as, RSI, RCX);
+    LOAD64(as, RDI, REG_STATE, offsetof(JitState, vm));
+    call_c(as, jit_write_barrier);
+}
+#else
+static void write_barrier(UNUSED Assembler* as, UNUSED u8 base, UNUSED i32 disp) {}
+#endif
+
+// CALLx：内联缓存命中 primitive 时直接调用，返回 true 时机器码继续执行。
+// 其它方法不在此查找，由解释器重新执行该调用并维护内联缓存
+static bool jit_call(JitState* state, u32 argc, u32 cache_index, u32 call_offset, u32 next_offset) {
+    VM* vm = state->vm;
+    ObjThread* thread = state->thread;
+    Value* args = thread->esp - argc;
+    InlineCache* cache = &state->frame->closure->fn->inline_caches[cache_index];
+
+    Method* method = NULL;
+    if (cache->epoch == vm->method_cache_epoch) {
+        Class* class = get_class_of_object(vm, args[0]);
+        for (u32 i = 0; i < cache->entry_count; i++) {
+            if (cache->entries[i].class == class) {
+                method = &cache->entries[i].method;
+                break;
+            }
+        }
+    }
+
+    if (method == NULL || method->type != MT_PRIMITIVE) {
+        state->exit_offset = call_offset;
+        state->exit_status = JIT_EXIT_INTERPRET;
+        return false;
+    }
+
+    cache->hits++;
+    if (!method->prim(vm, args)) {
+        state->exit_offset = next_offset;
+        state->exit_status = JIT_EXIT_PRIMITIVE_FAILED;
+        return false;
+    }
+
+    thread->esp -= argc - 1;
+    if (vm->out_of_memory) {
+        // 由解释器在退出后抛出错误
+        state->exit_offset = next_offset;
+        state->exit_status = JIT_EXIT_INTERPRET;
+        return false;
+    }
+    return true;
+}
+
+// 快速路径与解释器一样计入该调用点内联缓存的命中次数
+static void quickened_hit(JitState* state, u32 call_offset) {
+    ObjFn* fn = state->frame->closure->fn;
+    u8* code = fn->instr_stream.datas + call_offset;
+    fn->inline_caches[(u16)(code[3] << 8) | code[4]].hits++;
+}
+
+// 快化指令：只处理解释器中的快速路径，其余情况（含接收者 class 不符）从 call_offset 退出，
+// 由解释器重新执行该指令
+static bool jit_quickened(JitState* state, u32 op, u32 call_offset) {
+    VM* vm = state->vm;
+    Value* esp = state->thread->esp;
+
+    switch (op) {
+        case OPCODE_LIST_SUBSCRIPT:
+            if (VALUE_IS_OBJ(esp[-2]) && VALUE_TO_OBJ(esp[-2])->class == vm->list_class && VALUE_IS_I32(esp[-1])) {
+                ObjList* list = VALUE_TO_LIST(esp[-2]);
+                int i = VALUE_TO_I32(esp[-1]);
+                if (i < 0) {
+                    i += (int)list->elements.count;
+                }
+                if (i >= 0 && i < (int)list->elements.count) {
+                    quickened_hit(state, call_offset);
+                    esp[-2] = list->elements.datas[i];
+                    state->thread->esp--;
+                    return true;
+                }
+            }
+            break;
+
+        case OPCODE_LIST_LEN:
+            if (VALUE_IS_OBJ(esp[-1]) && VALUE_TO_OBJ(esp[-1])->class == vm->list_class) {
+                quickened_hit(state, call_offset);
+                esp[-1] = I32_TO_VALUE(VALUE_TO_LIST(esp[-1])->elements.count);
+                return true;
+            }
+            break;
+
+        case OPCODE_MAP_SUBSCRIPT:
+            if (VALUE_IS_OBJ(esp[-2]) && VALUE_TO_OBJ(esp[-2])->class == vm->map_class && objmap_key_is_hashable(esp[-1])) {
+                quickened_hit(state, call_offset);
+                Value val = objmap_get(VALUE_TO_OBJMAP(esp[-2]), esp[-1]);
+                esp[-2] = VALUE_IS_UNDEFINED(val) ? VT_TO_VALUE(VT_NULL) : val;
+                state->thread->esp--;
+                return true;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    state->exit_offset = call_offset;
+    state->exit_status = JIT_EXIT_INTERPRET;
+    return false;
+}
+
+// ---------------- 指令模板 ----------------
+
+static void emit_prologue(Assembler* as, ObjFn* fn) {
+    push_reg(as, RBP);
+    push_reg(as, RBX);
+    push_reg(as, R12);
+    push_reg(as, R13);
+    push_reg(as, R14);
+    push_reg(as, R15);
+    SUB_IMM(as, RSP, 8); // 调用 C 函数时栈按 16 字节对齐
+
+    MOV64(as, REG_STATE, RDI);
+    LOAD64(as, REG_THREAD, REG_STATE, offsetof(JitState, thread));
+    LOAD64(as, REG_ESP, REG_THREAD, offsetof(ObjThread, esp));
+    LOAD64(as, RAX, REG_STATE, offsetof(JitState, frame));
+    LOAD64(as, REG_STACK, RAX, offsetof(Frame, stack_start));
+    mov_imm64(as, RAX, (u64)(uintptr_t)fn);
+    LOAD64(as, REG_CONST, RAX, offsetof(ObjFn, constants) + offsetof(ValueBuffer, datas));
+
+    emit_byte(as, 0xff); // jmp rsi
+    emit_byte(as, 0xe6);
+}
+
+static void emit_epilogue(Assembler* as) {
+    as->epilogue = as->count;
+    STORE64(as, REG_THREAD, offsetof(ObjThread, esp), REG_ESP);
+    LOAD32(as, RAX, REG_STATE, offsetof(JitState, exit_status));
+    ADD_IMM(as, RSP, 8);
+    pop_reg(as, R15);
+    pop_reg(as, R14);
+    pop_reg(as, R13);
+    pop_reg(as, R12);
+    pop_reg(as, RBX);
+    pop_reg(as, RBP);
+    emit_byte(as, 0xc3); // ret
+}
+
+static void emit_exit_stub(Assembler* as, u32 offset) {
+    store_imm32(as, REG_STATE, offsetof(JitState, exit_offset), offset);
+    store_imm32(as, REG_STATE, offsetof(JitState, exit_status), JIT_EXIT_INTERPRET);
+    patch_rel32(as, emit_jmp(as), as->epilogue);
+}
+
+// 特化指令的守卫失败时，与解释器一样把 site 处的指令改写为通用指令 op，使用 rcx
+static void emit_deoptimize(Assembler* as, u8* site, OpCode op) {
+    mov_imm64(as, RCX, (u64)(uintptr_t)site);
+    emit_byte(as, 0xc6); // mov byte [rcx], op
+    emit_byte(as, 0x01);
+    emit_byte(as, (u8)op);
+}
+
+// ADD、SUB、MUL、DIV、MOD 及其特化指令：与解释器相同，两侧均为 i32 时按 i32 计算，
+// 其中一侧为 f64 且另一侧为 i32 或 f64 时按 f64 计算，其余情况从 cur 处退出。
+// site 为特化指令 spec 所在的位置，其守卫不成立的路径上先改写为通用指令
+static void emit_arith(Assembler* as, OpCode op, OpCode spec, u8* site, u32 cur) {
+    bool spec_i32 = spec == OPCODE_ADD_I32 || spec == OPCODE_SUB_I32 || spec == OPCODE_MUL_I32;
+    bool spec_f64 = spec == OPCODE_ADD_F64 || spec == OPCODE_SUB_F64 || spec == OPCODE_MUL_F64 || spec == OPCODE_DIV_F64;
+    u32 l_not_i32 = check_type(as, REG_ESP, TOP(2), VT_I32);
+    u32 r_not_i32 = check_type(as, REG_ESP, TOP(1), VT_I32);
+
+    if (spec_f64) {
+        emit_deoptimize(as, site, op);
+    }
+    load_i32(as, RAX, REG_ESP, TOP(2));
+    switch (op) {
+        case OPCODE_ADD:
+            ALU32_MEM(as, 0x03, 1, RAX, REG_ESP, TOP(1) + PAYLOAD_OFFSET);
+            break;
+        case OPCODE_SUB:
+            ALU32_MEM(as, 0x2b, 1, RAX, REG_ESP, TOP(1) + PAYLOAD_OFFSET);
+            break;
+        case OPCODE_MUL:
+            ALU32_MEM(as, 0x0faf, 2, RAX, REG_ESP, TOP(1) + PAYLOAD_OFFSET); // imul
+            break;
+        case OPCODE_DIV:
+        case OPCODE_MOD:
+            // 除数为 0 时交由 primitive 报错，为 -1 时可能溢出，都交给解释器
+            load_i32(as, RCX, REG_ESP, TOP(1));
+            emit_reg(as, 0, false, 0x85, 1, RCX, RCX); // test ecx, ecx
+            jcc_exit(as, CC_E, cur);
+            emit_reg(as, 0, false, 0x83, 1, 7, RCX);   // cmp ecx, -1
+            emit_byte(as, 0xff);
+            jcc_exit(as, CC_E, cur);
+            emit_byte(as, 0x99);                       // cdq
+            emit_reg(as, 0, false, 0xf7, 1, 7, RCX);   // idiv ecx
+            if (op == OPCODE_MOD) {
+                emit_reg(as, 0, false, 0x89, 1, RDX, RAX); // mov eax, edx
+            }
+            break;
+        default:
+            UNREACHABLE();
+    }
+    SUB_IMM(as, REG_ESP, VS);
+    store_i32(as, REG_ESP, TOP(1));
+    u32 done = emit_jmp(as);
+
+    patch_here(as, l_not_i32);
+    patch_here(as, r_not_i32);
+    if (spec_i32) {
+        emit_deoptimize(as, site, op);
+    }
+    if (op == OPCODE_MOD) {
+        jmp_exit(as, cur);
+    } else {
+        load_as_f64(as, XMM0, REG_ESP, TOP(2), cur);
+        load_as_f64(as, XMM1, REG_ESP, TOP(1), cur);
+        u32 sse_op = op == OPCODE_ADD ? SSE_ADD : op == OPCODE_SUB ? SSE_SUB : op == OPCODE_MUL ? SSE_MUL : SSE_DIV;
+        SSE_ARITH(as, sse_op, XMM0, XMM1);
+        SUB_IMM(as, REG_ESP, VS);
+        store_f64(as, REG_ESP, TOP(1), XMM0);
+    }
+    patch_here(as, done);
+}
+
+// 比较栈顶两个值，结果 0 或 1 留在 al 中，不弹栈。非数字从 cur 处退出
+static void emit_compare(Assembler* as, OpCode op, u32 cur) {
+    static const Cond i32_cond[] = {CC_L, CC_LE, CC_G, CC_GE, CC_E, CC_NE};
+    u32 l_not_i32 = check_type(as, REG_ESP, TOP(2), VT_I32);
+    u32 r_not_i32 = check_type(as, REG_ESP, TOP(1), VT_I32);
+
+    load_i32(as, RAX, REG_ESP, TOP(2));
+    ALU32_MEM(as, 0x3b, 1, RAX, REG_ESP, TOP(1) + PAYLOAD_OFFSET); // cmp eax, r
+    setcc(as, i32_cond[op - OPCODE_LT], RAX);
+    u32 done = emit_jmp(as);
+
+    // 无序（含 NaN）时 ucomisd 置 ZF、PF、CF，除 != 外结果均为 false
+    patch_here(as, l_not_i32);
+    patch_here(as, r_not_i32);
+    load_as_f64(as, XMM0, REG_ESP, TOP(2), cur);
+    load_as_f64(as, XMM1, REG_ESP, TOP(1), cur);
+    switch (op) {
+        case OPCODE_LT:
+            UCOMISD(as, XMM1, XMM0);
+            setcc(as, CC_A, RAX);
+            break;
+        case OPCODE_LE:
+            UCOMISD(as, XMM1, XMM0);
+            setcc(as, CC_AE, RAX);
+            break;
+        case OPCODE_GT:
+            UCOMISD(as, XMM0, XMM1);
+            setcc(as, CC_A, RAX);
+            break;
+        case OPCODE_GE:
+            UCOMISD(as, XMM0, XMM1);
+            setcc(as, CC_AE, RAX);
+            break;
+        case OPCODE_EQ:
+            UCOMISD(as, XMM0, XMM1);
+            setcc(as, CC_E, RAX);
+            setcc(as, CC_NP, RCX);
+            emit_reg(as, 0, false, 0x20, 1, RCX, RAX); // and al, cl
+            break;
+        case OPCODE_NE:
+            UCOMISD(as, XMM0, XMM1);
+            setcc(as, CC_NE, RAX);
+            setcc(as, CC_P, RCX);
+            emit_reg(as, 0, false, 0x08, 1, RCX, RAX); // or al, cl
+            break;
+        default:
+            UNREACHABLE();
+    }
+    patch_here(as, done);
+}
+
+// BIT_AND、BIT_OR：只处理 i32
+static void emit_bit(Assembler* as, OpCode op, u32 cur) {
+    exit_at(as, check_type(as, REG_ESP, TOP(2), VT_I32), cur);
+    exit_at(as, check_type(as, REG_ESP, TOP(1), VT_I32), cur);
+    load_i32(as, RAX, REG_ESP, TOP(2));
+    ALU32_MEM(as, op == OPCODE_BIT_AND ? 0x23 : 0x0b, 1, RAX, REG_ESP, TOP(1) + PAYLOAD_OFFSET);
+    SUB_IMM(as, REG_ESP, VS);
+    store_i32(as, REG_ESP, TOP(1));
+}
+
+static u32 read_2b(u8* code, u32 pos) {
+    return (code[pos] << 8) | code[pos + 1];
+}
+
+// 为 cur 处的指令生成机器码，next 为下一条指令的偏移
+static void emit_instruction(Assembler* as, VM* vm, ObjFn* fn, u32 cur, u32 next) {
+    u8* code = fn->instr_stream.datas;
+    OpCode op = (OpCode)code[cur];
+
+    switch (op) {
+        // 超级指令只替换了第一条指令的操作码，其后的指令保持原样，按第一条指令生成即可
+        case OPCODE_LOAD_LOCAL_VAR:
+        case OPCODE_LOAD_LOCAL_VAR_LOAD_LOCAL_VAR:
+        case OPCODE_LOAD_LOCAL_VAR_LOAD_CONSTANT:
+        case OPCODE_LOAD_LOCAL_VAR_LOAD_CONSTANT_CALL1:
+            push_value(as, REG_STACK, code[cur + 1] * VS);
+            break;
+
+        case OPCODE_LOAD_CONSTANT:
+            push_value(as, REG_CONST, read_2b(code, cur + 1) * VS);
+            break;
+
+        case OPCODE_PUSH_NULL:
+            push_vt(as, VT_NULL);
+            break;
+        case OPCODE_PUSH_TRUE:
+            push_vt(as, VT_TRUE);
+            break;
+        case OPCODE_PUSH_FALSE:
+            push_vt(as, VT_FALSE);
+            break;
+
+        case OPCODE_POP:
+            SUB_IMM(as, REG_ESP, VS);
+            break;
+
+        case OPCODE_STORE_LOCAL_VAR:
+        case OPCODE_STORE_LOCAL_VAR_POP:
+            copy_value(as, REG_STACK, code[cur + 1] * VS, REG_ESP, TOP(1));
+            if (op == OPCODE_STORE_LOCAL_VAR_POP) {
+                SUB_IMM(as, REG_ESP, VS);
+            }
+            break;
+
+        case OPCODE_LOAD_MODULE_VAR:
+            // 模块变量表可能扩容，每次经由 module 读取
+            mov_imm64(as, RCX, (u64)(uintptr_t)&fn->module->module_var_value.datas);
+            LOAD64(as, RCX, RCX, 0);
+            push_value(as, RCX, read_2b(code, cur + 1) * VS);
+            break;
+
+        case OPCODE_STORE_MODULE_VAR:
+        case OPCODE_STORE_MODULE_VAR_POP:
+            mov_imm64(as, RCX, (u64)(uintptr_t)&fn->module->module_var_value.datas);
+            LOAD64(as, RCX, RCX, 0);
+            copy_value(as, RCX, read_2b(code, cur + 1) * VS, REG_ESP, TOP(1));
+            mov_imm64(as, RCX, (u64)(uintptr_t)fn->module);
+            write_barrier(as, REG_ESP, TOP(1));
+            if (op == OPCODE_STORE_MODULE_VAR_POP) {
+                SUB_IMM(as, REG_ESP, VS);
+            }
+            break;
+
+        case OPCODE_LOAD_UPVALUE:
+        case OPCODE_STORE_UPVALUE:
+            LOAD64(as, RAX, REG_STATE, offsetof(JitState, frame));
+            LOAD64(as, RAX, RAX, offsetof(Frame, closure));
+            LOAD64(as, RCX, RAX, offsetof(ObjClosure, upvalue) + code[cur + 1] * sizeof(ObjUpvalue*));
+            LOAD64(as, RDX, RCX, offsetof(ObjUpvalue, local_var_ptr));
+            if (op == OPCODE_LOAD_UPVALUE) {
+                push_value(as, RDX, 0);
+            } else {
+                // 开放的 upvalue 可能指向其它线程的栈，与解释器一样总是对 upvalue 施加写屏障
+                copy_value(as, RDX, 0, REG_ESP, TOP(1));
+                write_barrier(as, REG_ESP, TOP(1));
+            }
+            break;
+
+        case OPCODE_LOAD_SELF_FIELD:
+        case OPCODE_LOAD_SELF_FIELD_CALL0:
+            load_obj(as, REG_STACK, 0);
+            push_value(as, RCX, offsetof(ObjInstance, fields) + code[cur + 1] * VS);
+            break;
+
+        case OPCODE_STORE_SELF_FIELD:
+            load_obj(as, REG_STACK, 0);
+            copy_value(as, RCX, offsetof(ObjInstance, fields) + code[cur + 1] * VS, REG_ESP, TOP(1));
+            write_barrier(as, REG_ESP, TOP(1));
+            break;
+
+        case OPCODE_LOAD_FIELD:
+            load_obj(as, REG_ESP, TOP(1));
+            copy_value(as, REG_ESP, TOP(1), RCX, offsetof(ObjInstance, fields) + code[cur + 1] * VS);
+            break;
+
+        case OPCODE_STORE_FIELD:
+            load_obj(as, REG_ESP, TOP(1));
+            SUB_IMM(as, REG_ESP, VS);
+            copy_value(as, RCX, offsetof(ObjInstance, fields) + code[cur + 1] * VS, REG_ESP, TOP(1));
+            write_barrier(as, REG_ESP, TOP(1));
+            break;
+
+        case OPCODE_JMP:
+            jmp_to_bytecode(as, next + (i16)read_2b(code, cur + 1));
+            break;
+
+        case OPCODE_LOOP: {
+            // 与解释器共用回跳计数器，函数已是热点，计数只用于 VM.hot_functions()
+            LoopCounter* counter = &fn->loop_counters[fn->loop_counter_index[cur]];
+            mov_imm64(as, RAX, (u64)(uintptr_t)&counter->count);
+            emit_mem(as, 0, true, 0xff, 1, 0, RAX, 0); // inc qword [rax]
+
+            // 内存超限时从循环头退出，由解释器抛出错误
+            u32 target = next - (i16)read_2b(code, cur + 1);
+            mov_imm64(as, RAX, (u64)(uintptr_t)&vm->out_of_memory);
+            emit_mem(as, 0, false, 0x80, 1, 7, RAX, 0); // cmp byte [rax], 0
+            emit_byte(as, 0);
+            jcc_exit(as, CC_NE, target);
+            jmp_to_bytecode(as, target);
+            break;
+        }
+
+        case OPCODE_JMP_IF_FALSE:
+            test_falsy(as, REG_ESP, TOP(1));
+            LEA(as, REG_ESP, REG_ESP, TOP(1)); // 弹栈，lea 不影响标志位
+            jcc_to_bytecode(as, CC_BE, next + (i16)read_2b(code, cur + 1));
+            break;
+
+        case OPCODE_AND:
+            // 第一个条件为假时保留在栈顶作为结果，否则弹出
+            test_falsy(as, REG_ESP, TOP(1));
+            jcc_to_bytecode(as, CC_BE, next + (i16)read_2b(code, cur + 1));
+            SUB_IMM(as, REG_ESP, VS);
+            break;
+
+        case OPCODE_OR:
+            test_falsy(as, REG_ESP, TOP(1));
+            jcc_to_bytecode(as, CC_A, next + (i16)read_2b(code, cur + 1));
+            SUB_IMM(as, REG_ESP, VS);
+            break;
+
+        case OPCODE_CALL0 ... OPCODE_CALL16:
+            // jit_call(state, argc, cache_index, cur, next)
+            MOV64(as, RDI, REG_STATE);
+            mov_imm32(as, RSI, op - OPCODE_CALL0 + 1);
+            mov_imm32(as, RDX, read_2b(code, cur + 3));
+            mov_imm32(as, RCX, cur);
+            mov_imm32(as, R8, next);
+            call_c(as, jit_call);
+            emit_byte(as, 0x84); // test al, al
+            emit_byte(as, 0xc0);
+            patch_rel32(as, emit_jcc(as, CC_E), as->epilogue);
+            break;
+
+        case OPCODE_LIST_SUBSCRIPT:
+        case OPCODE_LIST_LEN:
+        case OPCODE_MAP_SUBSCRIPT:
+            // jit_quickened(state, op, cur)
+            MOV64(as, RDI, REG_STATE);
+            mov_imm32(as, RSI, op);
+            mov_imm32(as, RDX, cur);
+            call_c(as, jit_quickened);
+            emit_byte(as, 0x84); // test al, al
+            emit_byte(as, 0xc0);
+            patch_rel32(as, emit_jcc(as, CC_E), as->epilogue);
+            break;
+
+        case OPCODE_ADD:
+        case OPCODE_ADD_I32:
+        case OPCODE_ADD_F64:
+            emit_arith(as, OPCODE_ADD, op, code + cur, cur);
+            break;
+        case OPCODE_SUB:
+        case OPCODE_SUB_I32:
+        case OPCODE_SUB_F64:
+            emit_arith(as, OPCODE_SUB, op, code + cur, cur);
+            break;
+        case OPCODE_MUL:
+        case OPCODE_MUL_I32:
+        case OPCODE_MUL_F64:
+            emit_arith(as, OPCODE_MUL, op, code + cur, cur);
+            break;
+        case OPCODE_DIV:
+        case OPCODE_DIV_F64:
+            emit_arith(as, OPCODE_DIV, op, code + cur, cur);
+            break;
+        case OPCODE_MOD:
+            emit_arith(as, OPCODE_MOD, op, code + cur, cur);
+            break;
+
+        case OPCODE_LT:
+        case OPCODE_LE:
+        case OPCODE_GT:
+        case OPCODE_GE:
+        case OPCODE_EQ:
+        case OPCODE_NE:
+            emit_compare(as, op, cur);
+            SUB_IMM(as, REG_ESP, VS);
+            store_bool(as, REG_ESP, TOP(1));
+            break;
+
+        case OPCODE_LT_JMP_IF_FALSE:
+        case OPCODE_LE_JMP_IF_FALSE:
+        case OPCODE_GT_JMP_IF_FALSE:
+        case OPCODE_GE_JMP_IF_FALSE:
+        case OPCODE_EQ_JMP_IF_FALSE:
+        case OPCODE_NE_JMP_IF_FALSE: {
+            // <COMPARE>_JMP_IF_FALSE [2b method_index] JMP_IF_FALSE [2b offset]
+            // 其后的 JMP_IF_FALSE 仍单独生成，只在从它开始执行时用到
+            u32 after = next + 3;
+            emit_compare(as, OPCODE_LT + (op - OPCODE_LT_JMP_IF_FALSE), cur);
+            SUB_IMM(as, REG_ESP, VS * 2);
+            emit_byte(as, 0x84); // test al, al
+            emit_byte(as, 0xc0);
+            jcc_to_bytecode(as, CC_E, after + (i16)read_2b(code, next + 1));
+            jmp_to_bytecode(as, after);
+            break;
+        }
+
+        case OPCODE_BIT_AND:
+        case OPCODE_BIT_OR:
+            emit_bit(as, op, cur);
+            break;
+
+        default:
+            // 其余指令（RETURN、SUPERx、创建对象等）交给解释器
+            jmp_exit(as, cur);
+            break;
+    }
+}
+
+void jit_compile(VM* vm, ObjFn* fn) {
+    if (fn->jit != NULL || fn->jit_failed) {
+        return;
+    }
+    fn->jit_failed = true; // 编译成功后清除
+
+    u32 len = fn->instr_stream.count;
+    if (len == 0 || len > JIT_MAX_INSTR_BYTES) {
+        return;
+    }
+
+    u32* entries = (u32*)malloc(len * sizeof(u32));
+    if (entries == NULL) {
+        return;
+    }
+    for (u32 i = 0; i < len; i++) {
+        entries[i] = JIT_NO_ENTRY;
+    }
+
+    Assembler as;
+    memset(&as, 0, sizeof(Assembler));
+    emit_prologue(&as, fn);
+    emit_epilogue(&as);
+
+    u8* code = fn->instr_stream.datas;
+    u32 ip = 0;
+    while (ip < len && !as.failed) {
+        entries[ip] = as.count;
+        u32 next = ip + 1 + get_byte_of_operands(code, fn->constants.datas, ip);
+        emit_instruction(&as, vm, fn, ip, next);
+        if (code[ip] == OPCODE_END) {
+            break;
+        }
+        ip = next;
+    }
+
+    // 退出桩：同一指令的多个退出共用一个
+    u32* stubs = (u32*)malloc(len * sizeof(u32));
+    if (stubs == NULL) {
+        as.failed = true;
+    }
+    for (u32 i = 0; !as.failed && i < len; i++) {
+        stubs[i] = JIT_NO_ENTRY;
+    }
+    for (u32 i = 0; !as.failed && i < as.exit_count; i++) {
+        Patch* exit = &as.exits[i];
+        if (exit->target >= len) {
+            as.failed = true;
+            break;
+        }
+        if (stubs[exit->target] == JIT_NO_ENTRY) {
+            stubs[exit->target] = as.count;
+            emit_exit_stub(&as, exit->target);
+        }
+        patch_rel32(&as, exit->pos, stubs[exit->target]);
+    }
+    free(stubs);
+
+    for (u32 i = 0; !as.failed && i < as.branch_count; i++) {
+        Patch* branch = &as.branches[i];
+        if (branch->target >= len || entries[branch->target] == JIT_NO_ENTRY) {
+            as.failed = true;
+            break;
+        }
+        patch_rel32(&as, branch->pos, entries[branch->target]);
+    }
+
+    JitCode* jit = NULL;
+    u8* mem = MAP_FAILED;
+    usize page_size = (usize)sysconf(_SC_PAGESIZE);
+    usize size = (as.count + page_size - 1) / page_size * page_size;
+    if (!as.failed) {
+        mem = (u8*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (mem != MAP_FAILED) {
+        memcpy(mem, as.code, as.count);
+        jit = (JitCode*)malloc(sizeof(JitCode));
+        if (jit == NULL || mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+            free(jit);
+            jit = NULL;
+            munmap(mem, size);
+        }
+    }
+
+    free(as.code);
+    free(as.branches);
+    free(as.exits);
+
+    if (jit == NULL) {
+        free(entries);
+        return;
+    }
+
+    jit->code = mem;
+    jit->size = size;
+    jit->entries = entries;
+    jit->entry_count = len;
+    fn->jit = jit;
+    fn->jit_failed = false;
+}
+
+JitExit jit_execute(VM* vm, ObjThread* thread, Frame* frame, u8* ip) {
+    ObjFn* fn = frame->closure->fn;
+    JitCode* jit = fn->jit;
+    frame->ip = ip;
+    u32 offset = (u32)(ip - fn->instr_stream.datas);
+    if (offset >= jit->entry_count || jit->entries[offset] == JIT_NO_ENTRY) {
+        return JIT_EXIT_INTERPRET;
+    }
+
+    JitState state = {
+        .vm = vm,
+        .thread = thread,
+        .frame = frame,
+        .exit_offset = offset,
+        .exit_status = JIT_EXIT_INTERPRET,
+    };
+    JitExit res = ((JitEntry)jit->code)(&state, jit->code + jit->entries[offset]);
+    frame->ip = fn->instr_stream.datas + state.exit_offset;
+    return res;
+}
+
+void jit_free(ObjFn* fn) {
+    if (fn->jit == NULL) {
+        return;
+    }
+    munmap(fn->jit->code, fn->jit->size);
+    free(fn->jit->entries);
+    free(fn->jit);
+    fn->jit = NULL;
+}
+
+#endif
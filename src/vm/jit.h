@@ -0,0 +1,40 @@
+#ifndef __VM_JIT_H__
+#define __VM_JIT_H__
+
+#include "common.h"
+#include "obj_fn.h"
+#include "obj_thread.h"
+
+#ifdef USE_TEMPLATE_JIT
+
+#if !defined(__x86_64__) || !defined(__linux__)
+    #error "USE_TEMPLATE_JIT requires x86-64 Linux."
+#endif
+
+// 指令流超过该长度的函数不编译
+#define JIT_MAX_INSTR_BYTES (1024 * 32)
+
+typedef enum {
+    JIT_EXIT_INTERPRET,         // 遇到机器码不处理的情况，解释器从 ip 处继续执行
+    JIT_EXIT_PRIMITIVE_FAILED,  // primitive 返回 false，ip 为调用之后的指令，由解释器处理错误或线程切换
+} JitExit;
+
+// 字节码偏移处不是指令的起始位置
+#define JIT_NO_ENTRY UINT32_MAX
+
+struct _JitCode {
+    u8* code;       // mmap 得到的可执行内存，起始处为入口函数
+    usize size;     // 映射的字节数
+    u32* entries;   // 字节码偏移 -> 机器码偏移，每条指令的起始处都可以进入
+    u32 entry_count;
+};
+
+// 编译 fn，由 vm.c 中的 tier_up 在函数成为热点时调用。失败时 fn->jit 仍为 NULL 且不再尝试
+void jit_compile(VM* vm, ObjFn* fn);
+// 从 ip 处执行 frame 所在函数的机器码，返回时 frame->ip 为解释器继续执行的位置，thread->esp 已同步
+JitExit jit_execute(VM* vm, ObjThread* thread, Frame* frame, u8* ip);
+void jit_free(ObjFn* fn);
+
+#endif
+
+#endif
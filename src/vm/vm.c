@@ -1,19 +1,28 @@
 #include "vm.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include "class.h"
 #include "common.h"
 #include "compiler.h"
 #include "core.h"
 #include "gc.h"
 #include "header_obj.h"
+#include "jit.h"
 #include "meta_obj.h"
 #include "obj_fn.h"
+#include "obj_list.h"
 #include "obj_map.h"
+#include "obj_string.h"
 #include "obj_thread.h"
 #include "utils.h"
+#include <string.h>
 
-#ifdef DIS_ASM_CHUNK_WHEN_CALL
+#ifdef USE_PARALLEL_MARK
+    #include <unistd.h>
+#endif
+
+#if defined(DIS_ASM_CHUNK_WHEN_CALL) || defined(PROFILE_OPCODE_BIGRAM)
     #include "disassemble.h"
 #endif
 
@@ -30,24 +39,77 @@ inline void pop_tmp_root(VM* vm) {
 
 void vm_init(VM* vm) {
     vm->allocated_bytes = 0;
+#ifdef USE_SLAB_ALLOCATOR
+    slab_init(&vm->slab);
+#endif
     vm->cur_parser = NULL;
+    vm->cur_cu = NULL;
+    vm->cur_thread = NULL;
     vm->all_objs = NULL;
-    BufferInit(String, &vm->all_method_names);
-    vm->all_module = objmap_new(vm);
+    vm->tmp_roots_num = 0;
+    vm->method_cache_epoch = 1;
+    vm->out_of_memory = false;
+#ifdef PROFILE_OPCODE_BIGRAM
+    memset(vm->opcode_bigrams, 0, sizeof(vm->opcode_bigrams));
+#endif
+    symbol_table_init(&vm->all_method_names);
+#ifdef USE_STRING_INTERN
+    string_table_init(&vm->strings);
+#endif
 
     BufferInit(Value, &vm->allways_keep_roots);
     BufferInit(Value, &vm->ast_obj_root);
+    BufferInit(Value, &vm->hot_fns);
     vm->config = (Configuration) {
         .heap_growth_factor = 1.5,
         .min_heap_size      = 1024 * 1024,      // 最小堆大小为1mb
         .initial_heap_size  = 1024 * 1024 * 10, // 初始化为10mb
         .next_gc            = 1024 * 1024 * 10, // 下一次回收大小
+        .max_heap_size      = 0,
+        .soft_heap_size     = 0,
     };
     vm->grays = (Gray) {
         .gray_objs = (ObjHeader**)(malloc(32 * sizeof(ObjHeader*))),
         .count = 0,
         .capacity = 32,
     };
+
+#ifdef USE_GENERATIONAL_GC
+    vm->config.nursery_size = 1024 * 1024 * 2; // 新生代为2mb
+    vm->config.next_full_gc = vm->config.initial_heap_size;
+    vm->config.next_gc = vm->config.nursery_size;
+    vm->old_objs = NULL;
+    vm->old_bytes = 0;
+    vm->remembered_set = (Gray) {
+        .gray_objs = (ObjHeader**)(malloc(32 * sizeof(ObjHeader*))),
+        .count = 0,
+        .capacity = 32,
+    };
+    vm->in_minor_gc = false;
+#endif
+
+#ifdef USE_PARALLEL_MARK
+    long cpu_num = sysconf(_SC_NPROCESSORS_ONLN);
+    vm->config.mark_threads = cpu_num < 1 ? 1 : (cpu_num > 8 ? 8 : (u32)cpu_num); // 默认不超过8个线程
+    vm->config.parallel_mark_min_heap = 1024 * 1024 * 16; // 堆达到16mb时才并行标记
+    vm->parallel_mark_count = 0;
+#endif
+
+#ifdef USE_INCREMENTAL_GC
+    vm->config.gc_step_budget = 1024 * 64; // 每次最多标记64kb
+    vm->config.gc_step_interval = 1024 * 16; // 标记期间每分配16kb推进一次
+    vm->gc_marking = false;
+    vm->marked_bytes = 0;
+    vm->cycle_start_bytes = 0;
+    vm->remembered_set = (Gray) {
+        .gray_objs = (ObjHeader**)(malloc(32 * sizeof(ObjHeader*))),
+        .count = 0,
+        .capacity = 32,
+    };
+#endif
+
+    // 分配对象可能触发 gc，须在 config 与 gray 初始化之后
+    vm->all_module = objmap_new(vm);
 }
 
 VM* vm_new() {
@@ -57,14 +119,65 @@ VM* vm_new() {
     }
     
     vm_init(vm);
-    build_core(vm);
+    build_core(vm, NULL);
     
     return vm;
 }
 
+// 从 vm_dump_core_snapshot 生成的快照创建 vm，跳过核心模块的词法分析和编译。
+// 快照只被读取，可以 mmap 后供多个 vm 共用；快照无效时退回到编译 core.script.inc，此时 loaded 置为 false
+VM* vm_new_from_snapshot(const void* snapshot, usize size, bool* loaded) {
+    VM* vm = (VM*)malloc(sizeof(VM));
+    if (vm == NULL) {
+        MEM_ERROR("allocate VM failed!\n");
+    }
+
+    vm_init(vm);
+    CoreSnapshot core_snapshot = {.data = snapshot, .size = size, .out = NULL, .ok = false};
+    build_core(vm, &core_snapshot);
+    if (loaded != NULL) {
+        *loaded = core_snapshot.ok;
+    }
+
+    return vm;
+}
+
+bool vm_dump_core_snapshot(const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    VM* vm = (VM*)malloc(sizeof(VM));
+    if (vm == NULL) {
+        MEM_ERROR("allocate VM failed!\n");
+    }
+
+    vm_init(vm);
+    CoreSnapshot core_snapshot = {.data = NULL, .size = 0, .out = file, .ok = false};
+    build_core(vm, &core_snapshot);
+    vm_free(vm);
+
+    bool ok = fclose(file) == 0 && core_snapshot.ok;
+    if (!ok) {
+        remove(path);
+    }
+    return ok;
+}
+
+#ifdef USE_MARK_BITMAP
+static void free_slab_obj(void* obj, void* vm) {
+    free_obj((VM*)vm, (ObjHeader*)obj);
+}
+#endif
+
 void vm_free(VM* vm) {
     ASSERT(vm->all_method_names.count > 0, "vm have already been freed.");
 
+#ifdef PROFILE_OPCODE_BIGRAM
+    dump_opcode_bigrams(vm, 30);
+#endif
+
     ObjHeader* header = vm->all_objs;
     while (header != NULL) {
         ObjHeader* next = header->next;
@@ -72,10 +185,35 @@ void vm_free(VM* vm) {
         header = next;
     }
 
+#ifdef USE_MARK_BITMAP
+    slab_for_each_live(&vm->slab, free_slab_obj, vm);
+#endif
+
+#ifdef USE_GENERATIONAL_GC
+    header = vm->old_objs;
+    while (header != NULL) {
+        ObjHeader* next = header->next;
+        free_obj(vm, header);
+        header = next;
+    }
+    vm->remembered_set.gray_objs = DEALLOCATE(vm, vm->remembered_set.gray_objs);
+#endif
+
+#ifdef USE_INCREMENTAL_GC
+    vm->remembered_set.gray_objs = DEALLOCATE(vm, vm->remembered_set.gray_objs);
+#endif
+
     vm->grays.gray_objs = DEALLOCATE(vm, vm->grays.gray_objs);
-    BufferClear(String, &vm->all_method_names, vm);
+#ifdef USE_STRING_INTERN
+    string_table_free(vm, &vm->strings);
+#endif
+    symbol_table_clear(vm, &vm->all_method_names);
     BufferClear(Value, &vm->allways_keep_roots, vm);
     BufferClear(Value, &vm->ast_obj_root, vm);
+    BufferClear(Value, &vm->hot_fns, vm);
+#ifdef USE_SLAB_ALLOCATOR
+    slab_destroy(&vm->slab);
+#endif
     DEALLOCATE(vm, vm);
 }
 
@@ -136,10 +274,11 @@ inline static void create_frame(VM* vm, ObjThread* thread, ObjClosure* closure,
     prepare_frame(thread, closure, thread->esp - argc);
 }
 
-static void closed_upvalue(ObjThread* thread, Value* last_slot) {
+static void closed_upvalue(UNUSED VM* vm, ObjThread* thread, Value* last_slot) {
     ObjUpvalue* upvalue = thread->open_upvalue;
     while (upvalue != NULL && upvalue->local_var_ptr >= last_slot) {
         upvalue->closed_upvalue = *(upvalue->local_var_ptr);
+        GC_WRITE_BARRIER(vm, upvalue, upvalue->closed_upvalue);
         upvalue->local_var_ptr = &(upvalue->closed_upvalue);
         upvalue = upvalue->next;
     }
@@ -191,7 +330,7 @@ static void validate_super_class(VM* vm, Value class_name, u32 field_num, Value
     }
 }
 
-static void patch_operand(Class* class, ObjFn* fn) {
+static void patch_operand(VM* vm, Class* class, ObjFn* fn) {
     int ip = 0;
     while (true) {
         OpCode opcode = (OpCode)fn->instr_stream.datas[ip++];
@@ -200,8 +339,13 @@ static void patch_operand(Class* class, ObjFn* fn) {
             case OPCODE_STORE_FIELD: 
             case OPCODE_LOAD_SELF_FIELD: 
             case OPCODE_STORE_SELF_FIELD: 
+            case OPCODE_LOAD_SELF_FIELD_CALL0: 
                 //修正子类的field数目 <opcode> [1b field_number]
-                fn->instr_stream.datas[ip++] += class->super_class->field_number;
+                fn->instr_stream.datas[ip] += class->super_class->field_number;
+                // 编译器生成的下标总在范围内，从字节码缓存加载的方法只能在此时检查
+                if (fn->instr_stream.datas[ip++] >= class->field_number) {
+                    RUNTIME_ERROR("field index of method out of bounds.");
+                }
                 break;
 
             case OPCODE_SUPER0:
@@ -227,8 +371,10 @@ static void patch_operand(Class* class, ObjFn* fn) {
 
                 // 回填在函数emitCallBySignature中的占位VT_TO_VALUE(VT_NULL)
                 fn->constants.datas[superClassIdx] = OBJ_TO_VALUE(class->super_class);
+                GC_WRITE_BARRIER(vm, fn, fn->constants.datas[superClassIdx]);
 
                 ip += 2; // 跳过2字节的基类索引
+                ip += 2; // 跳过2字节的内联缓存索引
                 break;
             }
 
@@ -239,7 +385,7 @@ static void patch_operand(Class* class, ObjFn* fn) {
                 uint32_t fnIdx = (fn->instr_stream.datas[ip] << 8) | fn->instr_stream.datas[ip + 1]; 
 
                 // 递归进入该函数的指令流,继续为其中的super和field修正操作数
-                patch_operand(class, VALUE_TO_OBJFN(fn->constants.datas[fnIdx]));	    
+                patch_operand(vm, class, VALUE_TO_OBJFN(fn->constants.datas[fnIdx]));	    
             
                 // ip-1是操作码OPCODE_CREATE_CLOSURE,
                 // 闭包中的参数涉及到upvalue,调用getBytesOfOperands获得参数字节数
@@ -269,18 +415,32 @@ static void bind_method_and_patch(VM* vm, OpCode opcode, u32 method_index, Class
         .obj = VALUE_TO_OBJCLOSURE(method),
     };
 
-    patch_operand(class, m.obj->fn);
+    patch_operand(vm, class, m.obj->fn);
 
     bind_method(vm, class, method_index, m);
 }
 
+// 分层编译的入口：closure 所在函数的调用次数或某个 LOOP 的回跳次数达到阈值，且函数尚未记录到 vm->hot_fns。
+// vm->hot_fns 弱引用闭包，闭包被回收时函数的记录随之删除，之后由该函数的其他闭包重新记录。
+// 启用 USE_TEMPLATE_JIT 时同时编译为机器码，解释器在调用、返回及循环头处切换到机器码
+static void tier_up(VM* vm, ObjClosure* closure) {
+    ObjFn* fn = closure->fn;
+    fn->is_hot = true;
+    BufferAdd(Value, &vm->hot_fns, vm, OBJ_TO_VALUE(closure));
+
+#ifdef USE_TEMPLATE_JIT
+    jit_compile(vm, fn);
+#endif
+}
+
 VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
     vm->cur_thread = cur_thread;
+    GC_REMEMBER(vm, cur_thread); // 线程栈的写入没有写屏障，运行中的线程始终在记忆集中
     register Frame* cur_frame = NULL;
     register Value* stack_start = NULL;
     register u8* ip = 0;
     register ObjFn* fn = NULL;
-    OpCode opcode;
+    OpCode opcode = OPCODE_END; // 统计指令对时，线程的第一条指令记为 END 之后
 
     #define PUSH(value) (*cur_thread->esp++ = value)
     #define POP()       (*(--cur_thread->esp))
@@ -293,18 +453,96 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
     #define READ_2B()   (ip += 2, (u16)(ip[-2] << 8) | ip[-1])
     
     #define STORE_CUR_FRAME()   cur_frame->ip = ip;
+
+    // 以线程错误终止当前线程，vm 本身仍可继续使用。
+    // 线程由其他线程唤起时回到调用者，Thread.call 返回 null，错误信息由 Thread.error 读取；否则结束执行
+    #define THREAD_ERROR(msg) \
+        do {\
+            STORE_CUR_FRAME();\
+            const char* err_msg = msg;\
+            cur_thread->error_obj = OBJ_TO_VALUE(objstring_new(vm, err_msg, strlen(err_msg)));\
+            fprintf(stderr, "thread error: %s", err_msg);\
+            ObjThread* caller = cur_thread->caller;\
+            if (caller == NULL) {\
+                vm->cur_thread = NULL;\
+                return VM_RES_ERROR;\
+            }\
+            /* 线程不再运行，释放其栈上的对象；创建错误信息时再次记录的内存不足属于该线程 */\
+            closed_upvalue(vm, cur_thread, cur_thread->stack);\
+            cur_thread->esp = cur_thread->stack;\
+            cur_thread->used_frame_num = 0;\
+            vm->out_of_memory = false;\
+            cur_thread->caller = NULL;\
+            cur_thread = caller;\
+            vm->cur_thread = caller;\
+            GC_REMEMBER(vm, cur_thread);\
+            cur_thread->esp[-1] = VT_TO_VALUE(VT_NULL);\
+            LOAD_CUR_FRAME();\
+            LOOP();\
+        } while (0)
+
+    // 分配内存时超过了 max_heap_size：在安全点抛出线程错误
+    #define CHECK_OUT_OF_MEMORY() \
+        if (vm->out_of_memory) {\
+            vm->out_of_memory = false;\
+            THREAD_ERROR("out of memory: heap exceeds max_heap_size.");\
+        }
     #define LOAD_CUR_FRAME()    \
         cur_frame = &cur_thread->frames[cur_thread->used_frame_num - 1];\
         stack_start = cur_frame->stack_start;\
         ip = cur_frame->ip;\
         fn = cur_frame->closure->fn;
 
-    #define DECODE \
-        loop_start:\
-            opcode = READ_1B();\
-            switch (opcode)
-    #define CASE(code)  case OPCODE_##code
-    #define LOOP()      goto loop_start
+    // 新的 frame 开始执行时计数
+    #define COUNT_CALL() \
+        if (++fn->call_count >= HOT_CALL_THRESHOLD && !fn->is_hot) {\
+            tier_up(vm, cur_frame->closure);\
+        }
+
+    #ifdef USE_TEMPLATE_JIT
+        // 当前函数已编译时从 ip 处执行机器码，返回后由解释器继续执行。
+        // 在循环头处进入即为栈上替换：正在运行的 frame 无需重新调用即切换到机器码
+        #define ENTER_JIT() \
+            if (fn->jit != NULL) {\
+                JitExit jit_res = jit_execute(vm, cur_thread, cur_frame, ip);\
+                ip = cur_frame->ip;\
+                if (jit_res == JIT_EXIT_PRIMITIVE_FAILED) {\
+                    goto primitive_failed;\
+                }\
+                CHECK_OUT_OF_MEMORY();\
+            }
+    #else
+        #define ENTER_JIT()
+    #endif
+
+    #ifdef PROFILE_OPCODE_BIGRAM
+        // 以前一条指令 opcode 为行计数，返回下一条指令
+        #define NEXT_OPCODE()   (next_opcode = READ_1B(), vm->opcode_bigrams[opcode][next_opcode]++, next_opcode)
+        u8 next_opcode;
+    #else
+        #define NEXT_OPCODE()   READ_1B()
+    #endif
+
+    #ifdef USE_COMPUTED_GOTO
+        // 由 opcode.inc 生成的分派表，下标即为操作码。
+        // 每条指令执行完毕后直接跳转到下一条指令的处理代码，分派跳转分散在各指令末尾，便于分支预测。
+        static void* dispatch_table[] = {
+            #define OPCODE_SLOTS(opcode, effect) &&opcode_##opcode,
+                #include "opcode.inc"
+            #undef OPCODE_SLOTS
+        };
+
+        #define DECODE      LOOP();
+        #define CASE(code)  opcode_##code
+        #define LOOP()      goto *dispatch_table[opcode = NEXT_OPCODE()]
+    #else
+        #define DECODE \
+            loop_start:\
+                opcode = NEXT_OPCODE();\
+                switch (opcode)
+        #define CASE(code)  case OPCODE_##code
+        #define LOOP()      goto loop_start
+    #endif
 
     LOAD_CUR_FRAME();
 
@@ -316,6 +554,22 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
             LOOP();
         }
 
+        CASE(LOAD_LOCAL_VAR_LOAD_LOCAL_VAR): {
+            // LOAD_LOCAL_VAR_LOAD_LOCAL_VAR [1b local_var_index] LOAD_LOCAL_VAR [1b local_var_index]
+            PUSH(stack_start[ip[0]]);
+            PUSH(stack_start[ip[2]]);
+            ip += 3;
+            LOOP();
+        }
+
+        CASE(LOAD_LOCAL_VAR_LOAD_CONSTANT): {
+            // LOAD_LOCAL_VAR_LOAD_CONSTANT [1b local_var_index] LOAD_CONSTANT [2b constant_index]
+            PUSH(stack_start[ip[0]]);
+            PUSH(fn->constants.datas[(ip[2] << 8) | ip[3]]);
+            ip += 4;
+            LOOP();
+        }
+
         CASE(POP): {
             // POP
             DROP();
@@ -347,6 +601,13 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
             LOOP();
         }
 
+        CASE(STORE_LOCAL_VAR_POP): {
+            // STORE_LOCAL_VAR_POP [1b local_var_index]
+            // 与 STORE_LOCAL_VAR 相同，但消耗栈顶
+            stack_start[READ_1B()] = POP();
+            LOOP();
+        }
+
         CASE(LOAD_CONSTANT): {
             // LOAD_CONSTANT [2b constant_index]
             // 从当前frame的常量表中读取index位置的常数入栈
@@ -360,6 +621,7 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
             Value* args = NULL;
             Class* class = NULL;
             Method* method = NULL;
+            InlineCache* cache = NULL;
 
             CASE(CALL0):
             CASE(CALL1):
@@ -378,14 +640,126 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
             CASE(CALL14):
             CASE(CALL15):
             CASE(CALL16):
-                // CALLX [2b method_index]
+                // CALLX [2b method_index] [2b cache_index]
+        call_method:
                 argc = opcode - OPCODE_CALL0 + 1; // 计算argc，所有函数都至少有一个args[0]参数为self
                 index = READ_2B(); // 方法索引
                 args = cur_thread->esp - argc;
 
                 class = get_class_of_object(vm, args[0]); // 方法所在的class
+                cache = &fn->inline_caches[READ_2B()];
                 
-                goto invoke_method; // enter method
+                goto invoke_cached_method; // enter method
+
+            CASE(LOAD_LOCAL_VAR_LOAD_CONSTANT_CALL1):
+                // LOAD_LOCAL_VAR_LOAD_CONSTANT_CALL1 [1b local_var_index] LOAD_CONSTANT [2b constant_index]
+                // CALL1 [2b method_index] [2b cache_index]
+                PUSH(stack_start[ip[0]]);
+                PUSH(fn->constants.datas[(ip[2] << 8) | ip[3]]);
+                ip += 5; // 停在 CALL1 的操作数处
+                if (ip[-1] != OPCODE_CALL1) {
+                    ip--; // CALL1 已被快化
+                    LOOP();
+                }
+                opcode = OPCODE_CALL1;
+                goto call_method;
+
+            CASE(LOAD_SELF_FIELD_CALL0): {
+                // LOAD_SELF_FIELD_CALL0 [1b field_index] CALL0 [2b method_index] [2b cache_index]
+                ASSERT(VALUE_IS_INSTANCE(stack_start[0]), "method receiver should be instance.");
+                ObjInstance* self = VALUE_TO_INSTANCE(stack_start[0]);
+                ASSERT(ip[0] < self->header.class->field_number, "(decoder)[LOAD_SELF_FIELD_CALL0] field index out of bounds.");
+
+                PUSH(self->fields[ip[0]]);
+                ip += 2; // 停在 CALL0 的操作数处
+                if (ip[-1] != OPCODE_CALL0) {
+                    ip--; // CALL0 已被快化
+                    LOOP();
+                }
+                opcode = OPCODE_CALL0;
+                goto call_method;
+            }
+
+            // LIST_SUBSCRIPT / LIST_LEN / MAP_SUBSCRIPT [2b method_index] [2b cache_index]
+            // 接收者的 class 不符时将指令永久改写回 CALLX 并重新执行，
+            // 下标不是 i32、越界或键不可哈希时按 CALLX 调用 primitive（含报错）
+            #define RECEIVER_IS(v, builtin) (VALUE_IS_OBJ(v) && VALUE_TO_OBJ(v)->class == vm->builtin)
+            #define DEQUICKEN(generic) \
+                do {\
+                    ip[-1] = OPCODE_##generic;\
+                    ip--;\
+                    LOOP();\
+                } while (0)
+            #define QUICKENED_FALLBACK(generic) \
+                do {\
+                    opcode = OPCODE_##generic;\
+                    goto call_method;\
+                } while (0)
+            // 快速路径与 CALLX 的内联缓存命中一样计数，jit 中同样如此
+            #define QUICKENED_HIT() \
+                fn->inline_caches[(u16)(ip[2] << 8) | ip[3]].hits++
+
+            CASE(LIST_SUBSCRIPT): {
+                if (!RECEIVER_IS(PEEK2(), list_class)) {
+                    DEQUICKEN(CALL1);
+                }
+                ObjList* list = VALUE_TO_LIST(PEEK2());
+                if (VALUE_IS_I32(PEEK())) {
+                    int i = VALUE_TO_I32(PEEK());
+                    if (i < 0) {
+                        i += (int)list->elements.count;
+                    }
+                    if (i >= 0 && i < (int)list->elements.count) {
+                        QUICKENED_HIT();
+                        DROP();
+                        PEEK() = list->elements.datas[i];
+                        ip += 4;
+                        LOOP();
+                    }
+                }
+                QUICKENED_FALLBACK(CALL1);
+            }
+
+            CASE(LIST_LEN):
+                if (!RECEIVER_IS(PEEK(), list_class)) {
+                    DEQUICKEN(CALL0);
+                }
+                QUICKENED_HIT();
+                PEEK() = I32_TO_VALUE(VALUE_TO_LIST(PEEK())->elements.count);
+                ip += 4;
+                LOOP();
+
+            CASE(MAP_SUBSCRIPT): {
+                if (!RECEIVER_IS(PEEK2(), map_class)) {
+                    DEQUICKEN(CALL1);
+                }
+                if (!objmap_key_is_hashable(PEEK())) {
+                    QUICKENED_FALLBACK(CALL1);
+                }
+                QUICKENED_HIT();
+                Value val = objmap_get(VALUE_TO_OBJMAP(PEEK2()), PEEK());
+                DROP();
+                PEEK() = VALUE_IS_UNDEFINED(val) ? VT_TO_VALUE(VT_NULL) : val;
+                ip += 4;
+                LOOP();
+            }
+
+            #undef QUICKENED_HIT
+            #undef QUICKENED_FALLBACK
+            #undef DEQUICKEN
+            #undef RECEIVER_IS
+
+        binary_operator_fallback:
+                // <BINARY_OPERATOR> [2b method_index]
+                // 操作数不满足快速路径时，等同于以 CALL1 调用运算符方法
+                argc = 2;
+                index = READ_2B();
+                args = cur_thread->esp - argc;
+
+                class = get_class_of_object(vm, args[0]);
+                cache = NULL; // 运算符方法不经过内联缓存
+
+                goto invoke_method;
 
             CASE(SUPER0):
             CASE(SUPER1):
@@ -404,26 +778,72 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
             CASE(SUPER14):
             CASE(SUPER15):
             CASE(SUPER16):
-                // SUPERX [2b method_index] [2b super_class_index]
-                argc = opcode - OPCODE_CALL0 + 1; // 计算argc，所有函数都至少有一个args[0]参数为self
+                // SUPERX [2b method_index] [2b super_class_index] [2b cache_index]
+                argc = opcode - OPCODE_SUPER0 + 1; // 计算argc，所有函数都至少有一个args[0]参数为self
                 index = READ_2B(); // 方法索引
                 args = cur_thread->esp - argc;
 
                 class = VALUE_TO_CLASS(fn->constants.datas[READ_2B()]);
+                cache = &fn->inline_caches[READ_2B()];
+
+        invoke_cached_method:
+            // 调用点的方法索引固定，缓存只需按class查找
+            if (cache->epoch == vm->method_cache_epoch) {
+                for (u32 i = 0; i < cache->entry_count; i++) {
+                    if (cache->entries[i].class == class) {
+                        cache->hits++;
+                        method = &cache->entries[i].method;
+                        goto dispatch_method;
+                    }
+                }
+            } else {
+                cache->epoch = vm->method_cache_epoch;
+                cache->entry_count = 0;
+            }
+            cache->misses++;
+
+            if ((method = class_find_method(class, index)) == NULL || method->type == MT_NONE) {
+                RUNTIME_ERROR(
+                    "method '%s.%s' not found.",
+                    class->name->val.start, vm->all_method_names.datas[index].str
+                );
+            }
+
+            // 缓存已满的调用点（超多态）不再记录新的class
+            if (cache->entry_count < INLINE_CACHE_WAYS) {
+                cache->entries[cache->entry_count++] = (InlineCacheEntry) {
+                    .class = class,
+                    .method = *method,
+                };
+            }
+            goto dispatch_method;
 
         invoke_method:
-            if ((u32)index > class->methods.count || (method = &class->methods.datas[index])->type == MT_NONE) {
+            if ((method = class_find_method(class, index)) == NULL || method->type == MT_NONE) {
                 RUNTIME_ERROR(
                     "method '%s.%s' not found.",
                     class->name->val.start, vm->all_method_names.datas[index].str
                 );
             }
 
+        dispatch_method:
             switch (method->type) {
                 case MT_PRIMITIVE:
                     if (method->prim(vm, args)) {
                         cur_thread->esp -= argc - 1;
+                        // 单态的 CALL0 / CALL1 调用点首次调用 builtin 类的 primitive 后就地快化
+                        if ((opcode == OPCODE_CALL0 || opcode == OPCODE_CALL1)
+                            && cache->epoch == vm->method_cache_epoch && cache->entry_count == 1) {
+                            OpCode quickened = quickened_opcode(vm, class, method);
+                            if (quickened != OPCODE_END) {
+                                ip[-5] = quickened; // CALLX [2b method_index] [2b cache_index]
+                            }
+                        }
+                        CHECK_OUT_OF_MEMORY();
                     } else {
+                    #ifdef USE_TEMPLATE_JIT
+                    primitive_failed:
+                    #endif
                         // primitive返回false：
                         // 1. 出现错误，此时cur_thread->error_obj != NULL
                         // 2. 切换线程，此时vm->cur_thread变更为新线程
@@ -442,6 +862,7 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
                         }
 
                         cur_thread = vm->cur_thread;
+                        GC_REMEMBER(vm, cur_thread);
                         LOAD_CUR_FRAME();
                     }
                     break;
@@ -462,6 +883,8 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
                     STORE_CUR_FRAME();
                     create_frame(vm, cur_thread, VALUE_TO_OBJCLOSURE(args[0]), argc);
                     LOAD_CUR_FRAME();
+                    COUNT_CALL();
+                    ENTER_JIT();
                     break;
 
                 case MT_SCRIPT:
@@ -474,6 +897,9 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
                     STORE_CUR_FRAME();
                     create_frame(vm, cur_thread, method->obj, argc);
                     LOAD_CUR_FRAME();
+                    CHECK_OUT_OF_MEMORY();
+                    COUNT_CALL();
+                    ENTER_JIT();
                     break;
 
                 default:
@@ -483,6 +909,159 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
             LOOP();
         }
 
+        // 二元运算指令 <BINARY_OPERATOR> [2b method_index]
+        // 两侧操作数均为数字时直接计算，结果与 core.c 中对应的 primitive 一致；
+        // 其余情况回退为对运算符方法的调用，用户类重载的运算符因此仍然有效。
+        #define BINARY_OPERANDS()   Value l = PEEK2(); Value r = PEEK();
+        #define BINARY_RESULT(res) \
+            do {\
+                DROP();\
+                PEEK() = (res);\
+                ip += 2; /* 跳过回退时使用的方法索引 */\
+                LOOP();\
+            } while (0)
+        #define BOTH_IS(type)       (VALUE_IS_##type(l) && VALUE_IS_##type(r))
+        #define BOTH_IS_I32_OR_F64  ((VALUE_IS_I32(l) || VALUE_IS_F64(l)) && (VALUE_IS_I32(r) || VALUE_IS_F64(r)))
+        #define AS_F64(v)           (VALUE_IS_F64(v) ? VALUE_TO_F64(v) : (f64)VALUE_TO_I32(v))
+        // i32 溢出时经由 u32 按补码回绕，与常量折叠及 jit 的结果一致
+        #define WRAP_I32(l, op, r)  ((i32)((u32)VALUE_TO_I32(l) op (u32)VALUE_TO_I32(r)))
+
+        // i32 与 f64 混合运算时结果为 f64
+        #define ARITH_OPERATOR(op) \
+            BINARY_OPERANDS();\
+            if (BOTH_IS(I32)) BINARY_RESULT(I32_TO_VALUE(WRAP_I32(l, op, r)));\
+            if (BOTH_IS(U32)) BINARY_RESULT(U32_TO_VALUE(VALUE_TO_U32(l) op VALUE_TO_U32(r)));\
+            if (BOTH_IS_I32_OR_F64) BINARY_RESULT(F64_TO_VALUE(AS_F64(l) op AS_F64(r)));\
+            goto binary_operator_fallback;
+
+        #define COMPARE_OPERATOR(op) \
+            BINARY_OPERANDS();\
+            if (BOTH_IS(I32)) BINARY_RESULT(BOOL_TO_VALUE(VALUE_TO_I32(l) op VALUE_TO_I32(r)));\
+            if (BOTH_IS(U32)) BINARY_RESULT(BOOL_TO_VALUE(VALUE_TO_U32(l) op VALUE_TO_U32(r)));\
+            if (BOTH_IS(U8)) BINARY_RESULT(BOOL_TO_VALUE(VALUE_TO_U8(l) op VALUE_TO_U8(r)));\
+            if (BOTH_IS_I32_OR_F64) BINARY_RESULT(BOOL_TO_VALUE(AS_F64(l) op AS_F64(r)));\
+            goto binary_operator_fallback;
+
+        // <COMPARE>_JMP_IF_FALSE [2b method_index] JMP_IF_FALSE [2b offset]
+        // 快速路径直接弹出两个操作数并完成跳转；回退时与 <COMPARE> 相同，结果留在栈顶由随后的 JMP_IF_FALSE 处理
+        #define COMPARE_JMP_RESULT(res) \
+            do {\
+                cur_thread->esp -= 2;\
+                i16 offset = (i16)((ip[3] << 8) | ip[4]);\
+                ip += 5;\
+                if (!(res)) {\
+                    ip += offset;\
+                }\
+                LOOP();\
+            } while (0)
+        #define COMPARE_JMP_IF_FALSE(op) \
+            BINARY_OPERANDS();\
+            if (BOTH_IS(I32)) COMPARE_JMP_RESULT(VALUE_TO_I32(l) op VALUE_TO_I32(r));\
+            if (BOTH_IS(U32)) COMPARE_JMP_RESULT(VALUE_TO_U32(l) op VALUE_TO_U32(r));\
+            if (BOTH_IS(U8)) COMPARE_JMP_RESULT(VALUE_TO_U8(l) op VALUE_TO_U8(r));\
+            if (BOTH_IS_I32_OR_F64) COMPARE_JMP_RESULT(AS_F64(l) op AS_F64(r));\
+            goto binary_operator_fallback;
+
+        // 整数位运算，f64 参与时回退到方法调用
+        #define BIT_OPERATOR(op) \
+            BINARY_OPERANDS();\
+            if (BOTH_IS(I32)) BINARY_RESULT(I32_TO_VALUE(WRAP_I32(l, op, r)));\
+            if (BOTH_IS(U32)) BINARY_RESULT(U32_TO_VALUE(VALUE_TO_U32(l) op VALUE_TO_U32(r)));\
+            goto binary_operator_fallback;
+
+        CASE(ADD):      { ARITH_OPERATOR(+) }
+        CASE(SUB):      { ARITH_OPERATOR(-) }
+        CASE(MUL):      { ARITH_OPERATOR(*) }
+        CASE(LT):       { COMPARE_OPERATOR(<) }
+        CASE(LE):       { COMPARE_OPERATOR(<=) }
+        CASE(GT):       { COMPARE_OPERATOR(>) }
+        CASE(GE):       { COMPARE_OPERATOR(>=) }
+        CASE(EQ):       { COMPARE_OPERATOR(==) }
+        CASE(NE):       { COMPARE_OPERATOR(!=) }
+        CASE(LT_JMP_IF_FALSE):  { COMPARE_JMP_IF_FALSE(<) }
+        CASE(LE_JMP_IF_FALSE):  { COMPARE_JMP_IF_FALSE(<=) }
+        CASE(GT_JMP_IF_FALSE):  { COMPARE_JMP_IF_FALSE(>) }
+        CASE(GE_JMP_IF_FALSE):  { COMPARE_JMP_IF_FALSE(>=) }
+        CASE(EQ_JMP_IF_FALSE):  { COMPARE_JMP_IF_FALSE(==) }
+        CASE(NE_JMP_IF_FALSE):  { COMPARE_JMP_IF_FALSE(!=) }
+
+        // <OP>_I32 / <OP>_F64 [2b method_index]
+        // 类型注释不做检查，守卫失败时将指令永久改写为通用的 <OP> 并重新执行
+        #define DEOPTIMIZE(generic) \
+            do {\
+                ip[-1] = OPCODE_##generic;\
+                ip--;\
+                LOOP();\
+            } while (0)
+        #define I32_OPERATOR(op, generic) \
+            BINARY_OPERANDS();\
+            if (BOTH_IS(I32)) BINARY_RESULT(I32_TO_VALUE(WRAP_I32(l, op, r)));\
+            DEOPTIMIZE(generic);
+        // 至少一侧为 f64 时结果与通用指令相同
+        #define F64_OPERATOR(op, generic) \
+            BINARY_OPERANDS();\
+            if ((VALUE_IS_F64(l) || VALUE_IS_F64(r)) && BOTH_IS_I32_OR_F64) BINARY_RESULT(F64_TO_VALUE(AS_F64(l) op AS_F64(r)));\
+            DEOPTIMIZE(generic);
+
+        CASE(ADD_I32):  { I32_OPERATOR(+, ADD) }
+        CASE(SUB_I32):  { I32_OPERATOR(-, SUB) }
+        CASE(MUL_I32):  { I32_OPERATOR(*, MUL) }
+        CASE(ADD_F64):  { F64_OPERATOR(+, ADD) }
+        CASE(SUB_F64):  { F64_OPERATOR(-, SUB) }
+        CASE(MUL_F64):  { F64_OPERATOR(*, MUL) }
+        CASE(DIV_F64):  { F64_OPERATOR(/, DIV) }
+
+        #undef F64_OPERATOR
+        #undef I32_OPERATOR
+        #undef DEOPTIMIZE
+
+        CASE(BIT_AND):  { BIT_OPERATOR(&) }
+        CASE(BIT_OR):   { BIT_OPERATOR(|) }
+        CASE(BIT_SL):   { BIT_OPERATOR(<<) }
+        CASE(BIT_SR): {
+            // i32 为算术右移，不经由 u32 计算
+            BINARY_OPERANDS();
+            if (BOTH_IS(I32)) BINARY_RESULT(I32_TO_VALUE(VALUE_TO_I32(l) >> VALUE_TO_I32(r)));
+            if (BOTH_IS(U32)) BINARY_RESULT(U32_TO_VALUE(VALUE_TO_U32(l) >> VALUE_TO_U32(r)));
+            goto binary_operator_fallback;
+        }
+
+        CASE(BIT_XOR): {
+            // i32 没有 ^ 运算符
+            BINARY_OPERANDS();
+            if (BOTH_IS(U32)) BINARY_RESULT(U32_TO_VALUE(VALUE_TO_U32(l) ^ VALUE_TO_U32(r)));
+            goto binary_operator_fallback;
+        }
+
+        CASE(DIV): {
+            // 整数除零交由 primitive 处理
+            BINARY_OPERANDS();
+            if (BOTH_IS(I32) && VALUE_TO_I32(r) != 0) BINARY_RESULT(I32_TO_VALUE(VALUE_TO_I32(l) / VALUE_TO_I32(r)));
+            if (BOTH_IS(U32) && VALUE_TO_U32(r) != 0) BINARY_RESULT(U32_TO_VALUE(VALUE_TO_U32(l) / VALUE_TO_U32(r)));
+            if (BOTH_IS_I32_OR_F64 && !BOTH_IS(I32)) BINARY_RESULT(F64_TO_VALUE(AS_F64(l) / AS_F64(r)));
+            goto binary_operator_fallback;
+        }
+
+        CASE(MOD): {
+            BINARY_OPERANDS();
+            if (BOTH_IS(I32) && VALUE_TO_I32(r) != 0) BINARY_RESULT(I32_TO_VALUE(VALUE_TO_I32(l) % VALUE_TO_I32(r)));
+            if (BOTH_IS(U32) && VALUE_TO_U32(r) != 0) BINARY_RESULT(U32_TO_VALUE(VALUE_TO_U32(l) % VALUE_TO_U32(r)));
+            if (BOTH_IS_I32_OR_F64 && !BOTH_IS(I32)) BINARY_RESULT(F64_TO_VALUE(fmod(AS_F64(l), AS_F64(r))));
+            goto binary_operator_fallback;
+        }
+
+        #undef BIT_OPERATOR
+        #undef COMPARE_JMP_IF_FALSE
+        #undef COMPARE_JMP_RESULT
+        #undef COMPARE_OPERATOR
+        #undef ARITH_OPERATOR
+        #undef WRAP_I32
+        #undef AS_F64
+        #undef BOTH_IS_I32_OR_F64
+        #undef BOTH_IS
+        #undef BINARY_RESULT
+        #undef BINARY_OPERANDS
+
         CASE(LOAD_UPVALUE): {
             // LOAD_UPVALUE [1b upvalue_index]
             PUSH(*((cur_frame->closure->upvalue[READ_1B()])->local_var_ptr));
@@ -491,7 +1070,10 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
 
         CASE(STORE_UPVALUE): {
             // STORE_UPVALUE [1b upvalue_index]
-            *(cur_frame->closure->upvalue[READ_1B()])->local_var_ptr = PEEK();
+            // 开放的upvalue可能指向其它线程的栈，因此总是对upvalue本身施加写屏障
+            ObjUpvalue* upvalue = cur_frame->closure->upvalue[READ_1B()];
+            *upvalue->local_var_ptr = PEEK();
+            GC_WRITE_BARRIER(vm, upvalue, PEEK());
             LOOP();
         }
 
@@ -504,6 +1086,16 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
         CASE(STORE_MODULE_VAR): {
             // STORE_MODULE_VAR [2b module_var_index]
             fn->module->module_var_value.datas[READ_2B()] = PEEK();
+            GC_WRITE_BARRIER(vm, fn->module, PEEK());
+            LOOP();
+        }
+
+        CASE(STORE_MODULE_VAR_POP): {
+            // STORE_MODULE_VAR_POP [2b module_var_index]
+            // 与 STORE_MODULE_VAR 相同，但消耗栈顶
+            fn->module->module_var_value.datas[READ_2B()] = PEEK();
+            GC_WRITE_BARRIER(vm, fn->module, PEEK());
+            DROP();
             LOOP();
         }
 
@@ -530,6 +1122,7 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
             ASSERT(field_index < self->header.class->field_number, "(decoder)[STORE_SELF_FIELD] field index out of bounds.");
 
             self->fields[field_index] = PEEK();
+            GC_WRITE_BARRIER(vm, self, PEEK());
             LOOP();
         }
 
@@ -557,13 +1150,21 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
             ASSERT(field_index < instance->header.class->field_number, "[STORE_FIELD] field index out of bounds.");
 
             instance->fields[field_index] = PEEK();
+            GC_WRITE_BARRIER(vm, instance, PEEK());
             LOOP();
         }
 
         CASE(LOOP): {
             // LOOP [2b offset]
+            LoopCounter* counter = &fn->loop_counters[fn->loop_counter_index[ip - 1 - fn->instr_stream.datas]];
             i16 offset = READ_2B();
             ip -= offset;
+            CHECK_OUT_OF_MEMORY();
+            if (++counter->count >= HOT_LOOP_THRESHOLD && !fn->is_hot) {
+                tier_up(vm, cur_frame->closure);
+            }
+            // 从循环头进入机器码，包括机器码在不支持的指令处退出之后，以及从未被重新调用的模块顶层循环
+            ENTER_JIT();
             LOOP();
         }
 
@@ -617,7 +1218,7 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
 
         CASE(CLOSE_UPVALUE): {
             // CLOSE_UPVALUE
-            closed_upvalue(cur_thread, cur_thread->esp - 1);
+            closed_upvalue(vm, cur_thread, cur_thread->esp - 1);
             DROP();
             LOOP();
         }
@@ -630,7 +1231,7 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
             cur_thread->used_frame_num--;
             
             // 局部变量被复写前保留upvalue
-            closed_upvalue(cur_thread, cur_thread->esp - 1);
+            closed_upvalue(vm, cur_thread, cur_thread->esp - 1);
 
             if (cur_thread->used_frame_num == 0) {
                 // 当前线程已无等待运行的frame
@@ -646,9 +1247,11 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
                 cur_thread->caller = NULL;
                 cur_thread = caller;
                 vm->cur_thread = caller;
+                GC_REMEMBER(vm, cur_thread);
                 cur_thread->esp[-1] = res; // 把当前线程运行的结果保存到caller的栈顶
 
                 LOAD_CUR_FRAME();
+                ENTER_JIT();
                 LOOP();
             }
 
@@ -657,6 +1260,7 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
             cur_thread->esp = stack_start + 1;
 
             LOAD_CUR_FRAME();
+            ENTER_JIT();
             LOOP();
         }
 
@@ -682,6 +1286,8 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
                 } else {
                     closure->upvalue[i] = cur_frame->closure->upvalue[index];
                 }
+                GC_WRITE_BARRIER(vm, closure, OBJ_TO_VALUE(closure->upvalue[i])); // 创建upvalue时可能发生gc
+
             }
 
             LOOP();
@@ -703,25 +1309,74 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
             LOOP();
         }
 
+        CASE(MAKE_LIST): {
+            // MAKE_LIST [2b count]
+            // 栈顶 count 个值依次作为元素，一次分配容量恰好的 List。分配时元素仍在栈上，不会被回收
+            u32 count = READ_2B();
+            ObjList* list = objlist_new(vm, count);
+            Value* items = cur_thread->esp - count;
+            for (u32 i = 0; i < count; i++) {
+                list->elements.datas[i] = items[i];
+                GC_WRITE_BARRIER(vm, list, items[i]);
+            }
+            cur_thread->esp = items;
+            PUSH(OBJ_TO_VALUE(list));
+            CHECK_OUT_OF_MEMORY();
+            LOOP();
+        }
+
+        CASE(MAKE_MAP): {
+            // MAKE_MAP [2b count]
+            // 栈顶 count 对 key、value 依次作为 entry，预先分配容量后插入，插入期间不再扩容
+            u32 count = READ_2B();
+            Value* items = cur_thread->esp - count * 2;
+            for (u32 i = 0; i < count; i++) {
+                if (!objmap_key_is_hashable(items[i * 2])) {
+                    THREAD_ERROR("key must be hashable value.");
+                }
+            }
+
+            ObjMap* map = objmap_new(vm);
+            push_tmp_root(vm, (ObjHeader*)map);
+            objmap_reserve(vm, map, count);
+            for (u32 i = 0; i < count; i++) {
+                objmap_set(vm, map, items[i * 2], items[i * 2 + 1]);
+            }
+            pop_tmp_root(vm);
+
+            cur_thread->esp = items;
+            PUSH(OBJ_TO_VALUE(map));
+            CHECK_OUT_OF_MEMORY();
+            LOOP();
+        }
+
         CASE(STATIC_METHOD):
         CASE(INSTANCE_METHOD): {
             // <OPCODE> [2b method_index]
             i16 method_index = READ_2B();
-            Value class = POP();
-            Value method = POP();
+            Value class = PEEK();
+            Value method = PEEK2();
 
+            // 绑定时可能触发gc，绑定完成前class与method保留在栈上
             bind_method_and_patch(vm, opcode, method_index, VALUE_TO_CLASS(class), method);
+            DROP();
+            DROP();
 
             LOOP();
         }
 
+    #ifdef USE_COMPUTED_GOTO
+        CASE(END):
+    #else
         default:
+    #endif
             printf(">>> %-5ld? %d\n", ip - cur_frame->closure->fn->instr_stream.datas - 1, *(ip - 1));
             UNREACHABLE();
     }
 
     #undef CASE
     #undef LOOP
+    #undef NEXT_OPCODE
     #undef POP
     #undef PUSH
     #undef PEEK_K
@@ -730,6 +1385,10 @@ VMResult execute_instruction(VM* vm, register ObjThread* cur_thread) {
     #undef DECODE
     #undef LOAD_CUR_FRAME
     #undef STORE_CUR_FRAME
+    #undef THREAD_ERROR
+    #undef CHECK_OUT_OF_MEMORY
+    #undef COUNT_CALL
+    #undef ENTER_JIT
     #undef READ_1B
     #undef READ_2B
 
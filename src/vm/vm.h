@@ -7,8 +7,23 @@
 #include "obj_map.h"
 #include "utils.h"
 #include "obj_thread.h"
+#include "slab.h"
+#include "obj_string.h"
 
 #define MAX_TEMP_ROOTS_NUM 8
+#define OPCODE_NUM (OPCODE_END + 1)
+
+#if defined(USE_GENERATIONAL_GC) && defined(USE_INCREMENTAL_GC)
+    #error "USE_GENERATIONAL_GC and USE_INCREMENTAL_GC cannot be defined at the same time."
+#endif
+
+#if defined(USE_MARK_BITMAP) && (defined(USE_GENERATIONAL_GC) || defined(USE_INCREMENTAL_GC))
+    #error "USE_MARK_BITMAP cannot be used with USE_GENERATIONAL_GC or USE_INCREMENTAL_GC."
+#endif
+
+#ifdef USE_PARALLEL_MARK
+    #define MAX_MARK_THREADS 64
+#endif
 
 typedef enum {
     VM_RES_SUCCESS,
@@ -23,13 +38,27 @@ typedef struct {
 
 typedef struct {
     double heap_growth_factor;
-    u32 initial_heap_size;
-    u32 min_heap_size;
-    u32 next_gc;
+    u64 initial_heap_size;
+    u64 min_heap_size;
+    u64 next_gc;
+    u64 max_heap_size; // 硬上限，回收后仍超过时当前线程以内存不足错误终止，为0时不限制
+    u64 soft_heap_size; // 软上限，下一次回收的阈值不超过该值，为0时不限制
+#ifdef USE_GENERATIONAL_GC
+    u64 nursery_size; // 新生代大小，新分配的内存超过该值时进行一次新生代回收
+    u64 next_full_gc; // 老年代超过该值时进行完整回收
+#endif
+#ifdef USE_PARALLEL_MARK
+    u32 mark_threads; // 完整回收时参与标记的线程数（含当前线程），为1时不并行，不超过 MAX_MARK_THREADS
+    u64 parallel_mark_min_heap; // 堆小于该值时不启动标记线程
+#endif
+#ifdef USE_INCREMENTAL_GC
+    u64 gc_step_budget; // 暂停预算，每次增量标记最多处理的存活字节数
+    u64 gc_step_interval; // 标记期间每新分配该字节数进行一次增量标记
+#endif
 } Configuration;
 
 struct _VM {
-    u32 allocated_bytes;
+    u64 allocated_bytes;
     ObjHeader* all_objs;
     SymbolTable all_method_names;
     ObjMap* all_module;
@@ -39,11 +68,44 @@ struct _VM {
 
     BufferType(Value) allways_keep_roots; // 长久持有的对象根，从添加开始直到vm_free才自动释放
     BufferType(Value) ast_obj_root; // ast中持有的对象
+    BufferType(Value) hot_fns; // 成为热点的函数，每个 ObjFn 记录一个使其成为热点的闭包。弱引用，回收时删除被回收的闭包
     ObjHeader* tmp_roots[MAX_TEMP_ROOTS_NUM];
     u32 tmp_roots_num;
+    u32 method_cache_epoch; // 内联缓存的有效期，方法表变化或 gc 后递增
+    bool out_of_memory; // 超过 max_heap_size，等待解释器在安全点抛出错误
     Gray grays;
     Configuration config;
 
+#ifdef PROFILE_OPCODE_BIGRAM
+    u64 opcode_bigrams[OPCODE_NUM][OPCODE_NUM]; // 相邻执行的指令对计数，下标为 [前一条][后一条]
+#endif
+
+#ifdef USE_SLAB_ALLOCATOR
+    SlabAllocator slab; // 小对象的分配器
+#endif
+
+#ifdef USE_STRING_INTERN
+    StringTable strings; // 所有字符串的驻留表，内容相同的字符串只有一个对象
+#endif
+
+#ifdef USE_GENERATIONAL_GC
+    ObjHeader* old_objs; // 老年代对象链表，all_objs 只保存新生代对象
+    u64 old_bytes; // 老年代占用的内存
+    Gray remembered_set; // 可能引用了新生代对象的老年代对象
+    bool in_minor_gc;
+#endif
+
+#ifdef USE_PARALLEL_MARK
+    u64 parallel_mark_count; // 以多个线程完成标记的完整回收次数
+#endif
+
+#ifdef USE_INCREMENTAL_GC
+    bool gc_marking; // 是否处于增量标记阶段
+    u64 marked_bytes; // 本轮已标记的存活对象字节数
+    u64 cycle_start_bytes; // 本轮标记开始时的 allocated_bytes
+    Gray remembered_set; // 标记期间在无写屏障的情况下被修改的对象，标记结束前需重新扫描
+#endif
+
     Class* string_class;
     Class* fn_class;
     Class* list_class;
@@ -63,6 +125,8 @@ struct _VM {
 
 void vm_init(VM* vm);
 VM* vm_new();
+VM* vm_new_from_snapshot(const void* snapshot, usize size, bool* loaded);
+bool vm_dump_core_snapshot(const char* path);
 void vm_free(VM* vm);
 VMResult execute_instruction(VM* vm, register ObjThread* cur_thread);
 void push_tmp_root(VM* vm, ObjHeader* obj);
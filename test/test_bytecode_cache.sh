@@ -0,0 +1,69 @@
+#!/bin/bash
+
+# 模块的字节码缓存：有效的缓存直接加载，损坏的缓存退回到编译并重新写入，脚本结果不受影响
+# 需以 USE_BYTECODE_CACHE 构建，否则跳过
+# 用法: test_bytecode_cache.sh [spr 路径] [临时目录]
+
+spr=${1:-~/sparrow/build/spr}
+work=${2:-$(mktemp -d)}
+test_dir="$(cd "$(dirname "$0")" && pwd)"
+mkdir -p "$work"
+cp "$test_dir/test_bytecode_cache.sp" "$test_dir/bytecode_cache_module.sp" "$work/"
+rm -f "$work/bytecode_cache_module.spc"
+cache="$work/bytecode_cache_module.spc"
+
+failed=0
+
+run_script() {
+    local name=$1 out
+    out=$("$spr" "$work/test_bytecode_cache.sp" 2>&1)
+    local rc=$?
+    if [ $rc -ne 0 ] || [ -n "$out" ]; then
+        echo "❌ $name: rc=$rc, output '$out'"
+        failed=1
+        return 1
+    fi
+    return 0
+}
+
+# 把 $2 处的字节按位取反
+flip_byte() {
+    local byte
+    byte=$(od -An -tu1 -j "$2" -N1 "$1" | tr -d ' ')
+    printf "\\x$(printf '%02x' $((byte ^ 0xff)))" | dd of="$1" bs=1 seek="$2" conv=notrunc status=none
+}
+
+run_script "first run" || exit 1
+if [ ! -s "$cache" ]; then
+    echo "⏭ bytecode cache is disabled, skipped"
+    exit 0
+fi
+cp "$cache" "$work/valid.spc"
+
+if run_script "valid cache"; then
+    if [ "$cache" -nt "$work/valid.spc" ]; then
+        echo "❌ valid cache: cache was rebuilt"
+        failed=1
+    else
+        echo "✅ valid cache"
+    fi
+fi
+
+# 头部之后的内容由校验和覆盖，任何一个字节损坏都应退回到编译，并重新写入相同的缓存。
+# 字符串常量中的字节不影响指令的合法性，只有校验和能发现
+size=$(wc -c < "$cache")
+title=$(grep -obUa "bytecode cache" "$cache" | head -1 | cut -d: -f1)
+for pos in 44 $((title + 2)) $((size / 2)) $((size - 1)); do
+    cp "$work/valid.spc" "$cache"
+    flip_byte "$cache" $pos
+    if run_script "cache corrupted at byte $pos"; then
+        if cmp -s "$cache" "$work/valid.spc"; then
+            echo "✅ cache corrupted at byte $pos"
+        else
+            echo "❌ cache corrupted at byte $pos: cache was not rebuilt"
+            failed=1
+        fi
+    fi
+done
+
+exit $failed
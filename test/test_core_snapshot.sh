@@ -0,0 +1,88 @@
+#!/bin/bash
+
+# 核心模块快照：有效的快照直接加载，过期或损坏的快照退回到编译核心模块，脚本结果不受影响
+# 用法: test_core_snapshot.sh [spr 路径] [临时目录]
+
+spr=${1:-~/sparrow/build/spr}
+work=${2:-$(mktemp -d)}
+script="$(cd "$(dirname "$0")" && pwd)/core_snapshot_script.sp"
+mkdir -p "$work"
+
+failed=0
+
+# 运行 core_snapshot_script.sp，$2 为是否应提示快照无法使用
+run_with_snapshot() {
+    local name=$1 expect_warning=$2 snapshot=$3
+    local out err
+    err=$(SPR_CORE_SNAPSHOT="$snapshot" "$spr" "$script" 2>&1 >"$work/out")
+    local rc=$?
+    out=$(cat "$work/out")
+    if [ $rc -ne 0 ] || [ "$out" != "ok" ]; then
+        echo "❌ $name: rc=$rc, output '$out', stderr '$err'"
+        failed=1
+    elif [ "$expect_warning" = yes ] && [[ "$err" != *"warning: "* ]]; then
+        echo "❌ $name: fallback was not reported"
+        failed=1
+    elif [ "$expect_warning" = no ] && [ -n "$err" ]; then
+        echo "❌ $name: unexpected stderr '$err'"
+        failed=1
+    else
+        echo "✅ $name"
+    fi
+}
+
+# 在 $2 处写入一个字节
+patch_byte() {
+    printf '\xff' | dd of="$1" bs=1 seek="$2" conv=notrunc status=none
+}
+
+# 把 $2 处的字节按位取反
+flip_byte() {
+    local byte
+    byte=$(od -An -tu1 -j "$2" -N1 "$1" | tr -d ' ')
+    printf "\\x$(printf '%02x' $((byte ^ 0xff)))" | dd of="$1" bs=1 seek="$2" conv=notrunc status=none
+}
+
+if ! "$spr" --dump-core-snapshot "$work/core.snapshot" || [ ! -s "$work/core.snapshot" ]; then
+    echo "❌ failed to dump core snapshot"
+    exit 1
+fi
+size=$(wc -c < "$work/core.snapshot")
+
+run_with_snapshot "valid snapshot" no "$work/core.snapshot"
+
+# 快照头依次为 magic(4) 版本(4) 指令签名(4) 核心模块源码的长度(8)
+cp "$work/core.snapshot" "$work/bad_version.snapshot"
+patch_byte "$work/bad_version.snapshot" 4
+run_with_snapshot "snapshot of another version" yes "$work/bad_version.snapshot"
+
+cp "$work/core.snapshot" "$work/stale.snapshot"
+patch_byte "$work/stale.snapshot" 12
+run_with_snapshot "snapshot of stale core module" yes "$work/stale.snapshot"
+
+cp "$work/core.snapshot" "$work/bad_magic.snapshot"
+patch_byte "$work/bad_magic.snapshot" 0
+run_with_snapshot "snapshot with bad magic" yes "$work/bad_magic.snapshot"
+
+# 快照头之后为 [u32 校验和]（偏移 40）及其覆盖的内容，其中任何一个字节损坏都应退回到编译。
+# 核心模块报错信息中的字节不影响指令的合法性，也不影响脚本结果，只有校验和能发现
+cp "$work/core.snapshot" "$work/bad_checksum.snapshot"
+flip_byte "$work/bad_checksum.snapshot" 40
+run_with_snapshot "snapshot with bad checksum" yes "$work/bad_checksum.snapshot"
+
+message=$(grep -obUa "non-negative integer" "$work/core.snapshot" | head -1 | cut -d: -f1)
+for pos in 44 $((message + 2)) $((size / 2)) $((size - 1)); do
+    cp "$work/core.snapshot" "$work/corrupted.snapshot"
+    flip_byte "$work/corrupted.snapshot" $pos
+    run_with_snapshot "snapshot corrupted at byte $pos" yes "$work/corrupted.snapshot"
+done
+
+head -c $((size / 2)) "$work/core.snapshot" > "$work/truncated.snapshot"
+run_with_snapshot "truncated snapshot" yes "$work/truncated.snapshot"
+
+: > "$work/empty.snapshot"
+run_with_snapshot "empty snapshot" yes "$work/empty.snapshot"
+
+run_with_snapshot "missing snapshot" yes "$work/missing.snapshot"
+
+exit $failed